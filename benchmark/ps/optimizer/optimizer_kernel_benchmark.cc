@@ -0,0 +1,201 @@
+#include <benchmark/benchmark.h>
+
+#include "core/ps/optimizer/optimizer_kernel.h"
+#include "core/ps/optimizer/adam_kernel.h"
+#include "core/ps/optimizer/ada_grad_kernel.h"
+#include "core/ps/optimizer/ftrl_kernel.h"
+#include "benchmark/zipf.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace tensornet;
+
+namespace {
+
+static constexpr size_t BATCH_SIGNS = 4096;
+static constexpr uint64_t KEY_NUM = 1 << 20;
+
+template <typename OptType>
+OptType* GetOpt();
+
+template <>
+Adam* GetOpt<Adam>() {
+    static Adam opt(0.001, 0.9, 0.999, 1e-8, 0.1);
+    return &opt;
+}
+
+template <>
+AdaGrad* GetOpt<AdaGrad>() {
+    static AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+    return &opt;
+}
+
+template <>
+Ftrl* GetOpt<Ftrl>() {
+    static Ftrl opt(0.05, 0.1, 1.0, 0.1, 1.0, 0.98);
+    return &opt;
+}
+
+// kernel of dim shared by all threads of a benchmark, keys of KEY_NUM are created
+// before measuring
+template <typename OptType>
+SparseOptimizerKernelBase* SharedSparseKernel(int dim) {
+    static std::mutex mu;
+    static std::map<int, SparseOptKernelSharedPtr> kernels;
+
+    const std::lock_guard<std::mutex> lock(mu);
+    auto& kernel = kernels[dim];
+    if (!kernel) {
+        kernel = GetOpt<OptType>()->CreateSparseOptKernel(dim, SparseKernelOption());
+
+        std::vector<uint64_t> signs(KEY_NUM);
+        for (uint64_t i = 0; i < KEY_NUM; ++i) {
+            signs[i] = ZipfSign(i);
+        }
+
+        std::vector<float> weights(signs.size() * dim);
+        kernel->GetWeights(signs.data(), signs.size(), weights.data());
+    }
+
+    return kernel.get();
+}
+
+struct SparseGrads {
+    SparseGrads(size_t n, int dim)
+        : grads(n * dim, 0.01)
+        , grad_infos(n) {
+        for (size_t i = 0; i < n; ++i) {
+            grad_infos[i].grad = grads.data() + i * dim;
+            grad_infos[i].batch_show = 1;
+        }
+    }
+
+    std::vector<float> grads;
+    std::vector<SparseGradInfo> grad_infos;
+};
+
+} // namespace
+
+static void BM_SparseGetWeight(benchmark::State& state) {
+    int dim = state.range(0);
+    auto* kernel = SharedSparseKernel<AdaGrad>(dim);
+    auto signs = ZipfSigns(BATCH_SIGNS, KEY_NUM, state.thread_index());
+
+    std::vector<float> w(dim);
+    size_t i = 0;
+    for (auto _ : state) {
+        kernel->GetWeight(signs[i++ % signs.size()], w.data());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SparseGetWeight)->Arg(8)->Arg(64)->ThreadRange(1, 16)->UseRealTime();
+
+static void BM_SparseApply(benchmark::State& state) {
+    int dim = state.range(0);
+    auto* kernel = SharedSparseKernel<AdaGrad>(dim);
+    auto signs = ZipfSigns(BATCH_SIGNS, KEY_NUM, state.thread_index());
+    SparseGrads grads(1, dim);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        kernel->Apply(signs[i++ % signs.size()], grads.grad_infos[0]);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SparseApply)->Arg(8)->Arg(64)->ThreadRange(1, 16)->UseRealTime();
+
+// batch pull and push of every optimizer across dims, including a dim with no
+// value type specialized for
+template <typename OptType>
+static void BM_SparseGetWeights(benchmark::State& state) {
+    int dim = state.range(0);
+    auto* kernel = SharedSparseKernel<OptType>(dim);
+    auto signs = ZipfSigns(BATCH_SIGNS, KEY_NUM, state.thread_index());
+
+    std::vector<float> weights(signs.size() * dim);
+    for (auto _ : state) {
+        kernel->GetWeights(signs.data(), signs.size(), weights.data());
+        benchmark::DoNotOptimize(weights.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * signs.size());
+}
+BENCHMARK_TEMPLATE(BM_SparseGetWeights, Adam)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(10)
+    ->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_SparseGetWeights, AdaGrad)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(10)
+    ->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_SparseGetWeights, Ftrl)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(10)
+    ->ThreadRange(1, 8)->UseRealTime();
+
+template <typename OptType>
+static void BM_SparseApplyBatch(benchmark::State& state) {
+    int dim = state.range(0);
+    auto* kernel = SharedSparseKernel<OptType>(dim);
+    auto signs = ZipfSigns(BATCH_SIGNS, KEY_NUM, state.thread_index());
+    SparseGrads grads(signs.size(), dim);
+
+    for (auto _ : state) {
+        kernel->ApplyBatch(signs.data(), grads.grad_infos.data(), signs.size());
+    }
+
+    state.SetItemsProcessed(state.iterations() * signs.size());
+}
+BENCHMARK_TEMPLATE(BM_SparseApplyBatch, Adam)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(10)
+    ->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_SparseApplyBatch, AdaGrad)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(10)
+    ->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_SparseApplyBatch, Ftrl)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(10)
+    ->ThreadRange(1, 8)->UseRealTime();
+
+template <typename OptType>
+static void BM_DenseApply(benchmark::State& state) {
+    int len = state.range(0);
+    auto kernel = GetOpt<OptType>()->CreateDenseOptKernel(0, len);
+
+    std::vector<float> w(len, 0.01);
+    butil::IOBuf w_buf;
+    w_buf.append(w.data(), len * sizeof(float));
+    kernel->SetWeight(w_buf);
+
+    std::vector<float> g(len, 0.001);
+
+    for (auto _ : state) {
+        butil::IOBuf grad;
+        grad.append(g.data(), len * sizeof(float));
+        kernel->Apply(grad);
+    }
+
+    state.SetBytesProcessed(state.iterations() * len * sizeof(float));
+}
+BENCHMARK_TEMPLATE(BM_DenseApply, Adam)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_DenseApply, AdaGrad)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_DenseApply, Ftrl)->Range(1 << 10, 1 << 22);
+
+static void BM_SparseSaveLoad(benchmark::State& state) {
+    int dim = 8;
+    auto* kernel = SharedSparseKernel<Adam>(dim);
+    std::string filepath = "/tmp/tensornet_optimizer_kernel_benchmark";
+    bool load = state.range(0);
+
+    kernel->Serialized(filepath, SFF_BINARY, false);
+
+    for (auto _ : state) {
+        if (load) {
+            auto load_kernel = GetOpt<Adam>()->CreateSparseOptKernel(dim, SparseKernelOption());
+            load_kernel->DeSerialized(filepath);
+        } else {
+            kernel->Serialized(filepath, SFF_BINARY, false);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * kernel->KeyCount());
+}
+BENCHMARK(BM_SparseSaveLoad)->ArgName("load")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,127 @@
+#include <benchmark/benchmark.h>
+
+#include "core/ps/ps_cluster.h"
+#include "core/ps/optimizer/optimizer.h"
+#include "core/ps/table/sparse_table.h"
+#include "core/ps_interface/sparse_codec.h"
+#include "benchmark/zipf.h"
+
+#include <brpc/controller.h>
+#include <bthread/countdown_event.h>
+#include <butil/logging.h>
+
+#include <vector>
+
+using namespace tensornet;
+
+// end to end pull and push through the ps service. run it with two ranks on one
+// host, e.g. `mpirun -np 2 ps_loopback_benchmark`, rank 0 drives the benchmarks
+// against the in process server of its own and the remote server of rank 1 over
+// loopback network, rank 1 only serves.
+
+namespace {
+
+static constexpr int DIM = 8;
+static constexpr uint64_t KEY_NUM = 1 << 20;
+
+uint32_t g_table_handle = 0;
+
+const PsServerInterface* GetServer(bool remote) {
+    PsCluster* cluster = PsCluster::Instance();
+    if (remote) {
+        return cluster->GetServer(1);
+    }
+
+    return &cluster->local_server;
+}
+
+void FillPullRequest(const std::vector<uint64_t>& signs, SparsePullRequest* req) {
+    req->set_table_handle(g_table_handle);
+    req->set_dim(DIM);
+    req->mutable_signs()->Add(signs.begin(), signs.end());
+}
+
+void Pull(const PsServerInterface* server, const SparsePullRequest& req) {
+    brpc::Controller cntl;
+    SparsePullResponse resp;
+    bthread::CountdownEvent event(1);
+
+    server->SparsePullAsync(&cntl, &req, &resp, [&event]() { event.signal(); });
+    event.wait();
+}
+
+} // namespace
+
+static void BM_SparsePull(benchmark::State& state) {
+    const PsServerInterface* server = GetServer(state.range(0));
+    auto signs = ZipfSigns(state.range(1), KEY_NUM, state.thread_index());
+
+    SparsePullRequest req;
+    FillPullRequest(signs, &req);
+
+    for (auto _ : state) {
+        Pull(server, req);
+    }
+
+    state.SetItemsProcessed(state.iterations() * signs.size());
+}
+BENCHMARK(BM_SparsePull)->ArgNames({"remote", "signs"})
+    ->ArgsProduct({{0, 1}, {1 << 10, 1 << 14}})->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_SparsePush(benchmark::State& state) {
+    const PsServerInterface* server = GetServer(state.range(0));
+    auto signs = ZipfSigns(state.range(1), KEY_NUM, state.thread_index());
+
+    // gradient of a sign is only applied after it is pulled
+    SparsePullRequest pull_req;
+    FillPullRequest(signs, &pull_req);
+    Pull(server, pull_req);
+
+    SparsePushRequest req;
+    req.set_table_handle(g_table_handle);
+    req.set_dim(DIM);
+    req.mutable_signs()->Add(signs.begin(), signs.end());
+    for (size_t i = 0; i < signs.size(); ++i) {
+        req.add_batch_shows(1);
+    }
+
+    std::vector<float> grads(signs.size() * DIM, 0.001);
+
+    for (auto _ : state) {
+        brpc::Controller cntl;
+        SparsePushResponse resp;
+        bthread::CountdownEvent event(1);
+
+        EncodeSparseValues(grads.data(), grads.size(), SVE_FLOAT, &cntl.request_attachment());
+
+        server->SparsePushAsync(&cntl, &req, &resp, [&event]() { event.signal(); });
+        event.wait();
+    }
+
+    state.SetItemsProcessed(state.iterations() * signs.size());
+}
+BENCHMARK(BM_SparsePush)->ArgNames({"remote", "signs"})
+    ->ArgsProduct({{0, 1}, {1 << 10, 1 << 14}})->ThreadRange(1, 8)->UseRealTime();
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    PsCluster* cluster = PsCluster::Instance();
+    CHECK_EQ(0, cluster->Init());
+    CHECK_GE(cluster->RankNum(), 2) << "run with at least 2 ranks, e.g. mpirun -np 2";
+
+    // every rank create the table so that it has the same handle everywhere
+    static AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+    SparseTable* table = CreateSparseTable(&opt, DIM, cluster->RankNum(), cluster->Rank());
+    g_table_handle = table->GetHandle();
+
+    cluster->Barrier();
+
+    if (cluster->Rank() == 0) {
+        benchmark::RunSpecifiedBenchmarks();
+    }
+
+    cluster->Barrier();
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <benchmark/benchmark.h>
+
+#include "core/ps_interface/sparse_codec.h"
+#include "benchmark/zipf.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace tensornet;
+
+// sign dedup of a feature column batch, as done by sparse pull before sending
+static void BM_DedupSigns(benchmark::State& state) {
+    auto signs = ZipfSigns(state.range(0), 1 << 20);
+    std::vector<int64_t> ids(signs.size());
+
+    for (auto _ : state) {
+        std::vector<uint64_t> unique;
+        DedupSigns(signs.data(), signs.size(), &unique, ids.data());
+        benchmark::DoNotOptimize(unique.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * signs.size());
+}
+BENCHMARK(BM_DedupSigns)->Range(1 << 10, 1 << 20);
+
+static void BM_EncodeDeltaSigns(benchmark::State& state) {
+    auto signs = ZipfSigns(state.range(0), 1 << 20);
+    std::sort(signs.begin(), signs.end());
+
+    for (auto _ : state) {
+        google::protobuf::RepeatedField<google::protobuf::uint64> out;
+        EncodeDeltaSigns(signs.data(), signs.size(), &out);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * signs.size());
+}
+BENCHMARK(BM_EncodeDeltaSigns)->Range(1 << 10, 1 << 20);
+
+static void BM_SparseValues(benchmark::State& state) {
+    auto encoding = static_cast<SparseValueEncoding>(state.range(0));
+    size_t n = state.range(1);
+    std::vector<float> values(n, 0.01);
+    std::vector<float> decoded(n);
+
+    for (auto _ : state) {
+        butil::IOBuf buf;
+        EncodeSparseValues(values.data(), n, encoding, &buf);
+        DecodeSparseValues(&buf, n, encoding, decoded.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * n * sizeof(float));
+}
+BENCHMARK(BM_SparseValues)->ArgNames({"encoding", "n"})
+    ->ArgsProduct({{SVE_FLOAT, SVE_FP16, SVE_BF16}, {1 << 12, 1 << 18}});
+
+BENCHMARK_MAIN();
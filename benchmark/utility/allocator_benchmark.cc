@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+
+#include "core/utility/allocator.h"
+
+#include <vector>
+
+using namespace tensornet;
+
+namespace {
+
+struct Value {
+    explicit Value(int dim) {
+        data[0] = dim;
+    }
+
+    float data[16];
+};
+
+} // namespace
+
+// allocate a batch and free it, the slab is reused
+static void BM_AllocatorReuse(benchmark::State& state) {
+    size_t n = state.range(0);
+    Allocator<Value> alloc(sizeof(Value));
+    std::vector<Value*> values(n);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = alloc.allocate(16);
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            alloc.deallocate(values[i]);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_AllocatorReuse)->Range(1 << 10, 1 << 20);
+
+// allocate only, new slabs are mapped and touched
+static void BM_AllocatorGrow(benchmark::State& state) {
+    size_t n = state.range(0);
+
+    for (auto _ : state) {
+        Allocator<Value> alloc(sizeof(Value));
+        for (size_t i = 0; i < n; ++i) {
+            benchmark::DoNotOptimize(alloc.allocate(16));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_AllocatorGrow)->Range(1 << 16, 1 << 22)->Unit(benchmark::kMillisecond);
+
+// baseline of the same pattern with global new and delete
+static void BM_NewDelete(benchmark::State& state) {
+    size_t n = state.range(0);
+    std::vector<Value*> values(n);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = new Value(16);
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            delete values[i];
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_NewDelete)->Range(1 << 10, 1 << 20);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,95 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_BENCHMARK_ZIPF_H_
+#define TENSORNET_BENCHMARK_ZIPF_H_
+
+#include <stdint.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace tensornet {
+
+// zipfian rank in [0, n) with skew theta in (0, 1), rank 0 is the hottest. see
+// "Quickly Generating Billion-Record Synthetic Databases", Gray et al.
+class ZipfGenerator {
+public:
+    explicit ZipfGenerator(uint64_t n, double theta = 0.99)
+        : n_(n)
+        , theta_(theta) {
+        double zeta2 = Zeta_(2, theta);
+        zetan_ = Zeta_(n, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+    }
+
+    template <typename Engine>
+    uint64_t operator()(Engine& engine) {
+        double u = uniform_(engine);
+        double uz = u * zetan_;
+
+        if (uz < 1.0) {
+            return 0;
+        }
+
+        if (uz < 1.0 + std::pow(0.5, theta_)) {
+            return 1;
+        }
+
+        uint64_t rank = n_ * std::pow(eta_ * u - eta_ + 1, alpha_);
+        return rank < n_ ? rank : n_ - 1;
+    }
+
+private:
+    static double Zeta_(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) {
+            sum += 1.0 / std::pow((double)i, theta);
+        }
+
+        return sum;
+    }
+
+private:
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+    std::uniform_real_distribution<double> uniform_;
+};
+
+// rank is scattered into a sign, so hot signs are spread over shards and blocks
+inline uint64_t ZipfSign(uint64_t rank) {
+    return (rank + 1) * 0x9E3779B97F4A7C15ULL;
+}
+
+// batch of n signs drawn from a zipfian of key_num keys
+inline std::vector<uint64_t> ZipfSigns(size_t n, uint64_t key_num, uint32_t seed = 0) {
+    std::mt19937_64 engine(seed);
+    ZipfGenerator zipf(key_num);
+
+    std::vector<uint64_t> signs(n);
+    for (auto& sign : signs) {
+        sign = ZipfSign(zipf(engine));
+    }
+
+    return signs;
+}
+
+} // namespace tensornet
+
+#endif // TENSORNET_BENCHMARK_ZIPF_H_
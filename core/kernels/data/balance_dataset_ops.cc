@@ -15,14 +15,22 @@
 #include "core/kernels/data/balance_dataset_ops.h"
 
 #include "core/public/version.h"
-#include "core/utility/semaphore.h"
+#include "core/utility/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <tuple>
 
 #include <brpc/server.h>
+#include <brpc/policy/gzip_compress.h>
+#include <brpc/policy/snappy_compress.h>
 #include <butil/rand_util.h>
+#include <bvar/bvar.h>
 
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/variant_tensor_data.h"
 #include "tensorflow/core/kernels/data/name_utils.h"
 #include "tensorflow/core/lib/core/blocking_counter.h"
@@ -41,24 +49,183 @@ namespace tensorflow {
 /* static */ constexpr const char* const BalanceDatasetOp::kInputDataset;
 /* static */ constexpr const char* const BalanceDatasetOp::kOutputTypes;
 /* static */ constexpr const char* const BalanceDatasetOp::kOutputShapes;
+/* static */ constexpr const char* const BalanceDatasetOp::kBufferSize;
+/* static */ constexpr const char* const BalanceDatasetOp::kCompress;
 
 constexpr char kInputImplEmpty[] = "input_impl_empty";
 constexpr char kBalanceDataset[] = "BalanceDataset";
 
+namespace {
+
+// element is encoded as tensor number followed by tensors, every tensor is
+// dtype, dims, shape, byte size and data. tensors of memcpy-able types put their
+// buffer directly, others (e.g. string) put a serialized TensorProto.
+void EncodeElement(const std::vector<Tensor>& tensors, butil::IOBuf* buf) {
+    uint32_t tensor_num = tensors.size();
+    buf->append(&tensor_num, sizeof(tensor_num));
+
+    for (const auto& tensor : tensors) {
+        int32_t dtype = tensor.dtype();
+        int32_t dims = tensor.dims();
+        buf->append(&dtype, sizeof(dtype));
+        buf->append(&dims, sizeof(dims));
+
+        for (int d = 0; d < dims; ++d) {
+            int64_t dim_size = tensor.dim_size(d);
+            buf->append(&dim_size, sizeof(dim_size));
+        }
+
+        if (DataTypeCanUseMemcpy(tensor.dtype())) {
+            auto data = tensor.tensor_data();
+            uint64_t bytes = data.size();
+            buf->append(&bytes, sizeof(bytes));
+            buf->append(data.data(), bytes);
+        } else {
+            TensorProto proto;
+            tensor.AsProtoTensorContent(&proto);
+            std::string content = proto.SerializeAsString();
+            uint64_t bytes = content.size();
+            buf->append(&bytes, sizeof(bytes));
+            buf->append(content);
+        }
+    }
+}
+
+template <typename T>
+bool CutPod(butil::IOBuf* buf, T* value) {
+    return buf->cutn(value, sizeof(T)) == sizeof(T);
+}
+
+bool DecodeElement(butil::IOBuf* buf, std::vector<Tensor>* tensors) {
+    uint32_t tensor_num = 0;
+    if (!CutPod(buf, &tensor_num)) {
+        return false;
+    }
+
+    tensors->clear();
+    tensors->reserve(tensor_num);
+
+    for (uint32_t i = 0; i < tensor_num; ++i) {
+        int32_t dtype = 0;
+        int32_t dims = 0;
+        if (!CutPod(buf, &dtype) || !CutPod(buf, &dims)) {
+            return false;
+        }
+
+        TensorShape shape;
+        for (int d = 0; d < dims; ++d) {
+            int64_t dim_size = 0;
+            if (!CutPod(buf, &dim_size)) {
+                return false;
+            }
+            shape.AddDim(dim_size);
+        }
+
+        uint64_t bytes = 0;
+        if (!CutPod(buf, &bytes) || buf->size() < bytes) {
+            return false;
+        }
+
+        if (DataTypeCanUseMemcpy(static_cast<DataType>(dtype))) {
+            Tensor tensor(static_cast<DataType>(dtype), shape);
+            auto data = tensor.tensor_data();
+            if (data.size() != bytes) {
+                return false;
+            }
+            buf->cutn(const_cast<char*>(data.data()), bytes);
+            tensors->emplace_back(std::move(tensor));
+        } else {
+            std::string content;
+            buf->cutn(&content, bytes);
+
+            TensorProto proto;
+            Tensor tensor;
+            if (!proto.ParseFromString(content) || !tensor.FromProto(proto)) {
+                return false;
+            }
+            tensors->emplace_back(std::move(tensor));
+        }
+    }
+
+    return true;
+}
+
+bool CompressAttachment(uint32_t compress_type, const butil::IOBuf& in, butil::IOBuf* out) {
+    switch (compress_type) {
+    case brpc::COMPRESS_TYPE_NONE:
+        out->append(in);
+        return true;
+    case brpc::COMPRESS_TYPE_SNAPPY:
+        return brpc::policy::SnappyCompress(in, out);
+    case brpc::COMPRESS_TYPE_GZIP:
+        return brpc::policy::GzipCompress(in, out, nullptr);
+    }
+
+    return false;
+}
+
+bool DecompressAttachment(uint32_t compress_type, const butil::IOBuf& in, butil::IOBuf* out) {
+    switch (compress_type) {
+    case brpc::COMPRESS_TYPE_NONE:
+        out->append(in);
+        return true;
+    case brpc::COMPRESS_TYPE_SNAPPY:
+        return brpc::policy::SnappyDecompress(in, out);
+    case brpc::COMPRESS_TYPE_GZIP:
+        return brpc::policy::GzipDecompress(in, out);
+    }
+
+    return false;
+}
+
+}  // namespace
+
+int BalanceInputDataInfo::ParseCompressType(const std::string& name) {
+    if (name == "none") {
+        return brpc::COMPRESS_TYPE_NONE;
+    } else if (name == "snappy") {
+        return brpc::COMPRESS_TYPE_SNAPPY;
+    } else if (name == "gzip") {
+        return brpc::COMPRESS_TYPE_GZIP;
+    }
+
+    return -1;
+}
+
 class BalanceDataCall {
 public:
-    BalanceDataCall(uint32_t shard_id, uint32_t balance_handle)
+    BalanceDataCall(uint32_t shard_id, uint32_t balance_handle,
+                    uint32_t max_elements, uint32_t compress_type)
         : shard_id_(shard_id) {
         req.set_req_shard_id(PsCluster::Instance()->Rank());
         req.set_balance_handle(balance_handle);
+        req.set_max_elements(max_elements);
+        req.set_compress_type(compress_type);
     }
 
     ~BalanceDataCall() {}
 
     void Start(const tensornet::Callback& done) {
+        Tracer* tracer = Tracer::Instance();
+        if (!tracer->Enabled()) {
+            const PsServerInterface* si =
+                PsCluster::Instance()->GetServer(shard_id_);
+            si->DatasetPullAsync(&cntl, &req, &resp, done);
+            return;
+        }
+
+        uint64_t step = tracer->Step();
+        req.set_trace_step(step);
+        req.set_trace_rank(PsCluster::Instance()->Rank());
+
         const PsServerInterface* si =
             PsCluster::Instance()->GetServer(shard_id_);
-        si->DatasetPullAsync(&cntl, &req, &resp, done);
+        int64_t begin = Tracer::NowUs();
+        si->DatasetPullAsync(&cntl, &req, &resp, [this, begin, step, done]() {
+            Tracer::Instance()->Record("dataset_pull_rpc", "rpc", begin, Tracer::NowUs(),
+                                       step, shard_id_, true);
+            done();
+        });
     }
 
 public:
@@ -70,12 +237,14 @@ private:
     uint32_t shard_id_ = -1;
 };
 
-void BalanceInputDataInfo::ProcessBrpcDatasetPullReq(const DatasetPullRequest* req, DatasetPullResponse* resp) {
+void BalanceInputDataInfo::ProcessBrpcDatasetPullReq(const DatasetPullRequest* req,
+                                                     DatasetPullResponse* resp,
+                                                     butil::IOBuf* attachment) {
     resp->set_resp_shard_id(PsCluster::Instance()->Rank());
 
     ChangeShardStatus(req->req_shard_id());
 
-    if (GetFinished()) {
+    if (op_elements_.empty()) {
         resp->set_end_of_sequence(true);
         return;
     }
@@ -84,76 +253,214 @@ void BalanceInputDataInfo::ProcessBrpcDatasetPullReq(const DatasetPullRequest* r
 
     CHECK(op_elements_.count(balance_handle)) << "balance_handle " << balance_handle << " not registered.";
     auto* elements = op_elements_[balance_handle];
+
+    uint32_t max_elements = std::max(req->max_elements(), 1u);
+    uint32_t element_num = 0;
+
+    butil::IOBuf data;
     std::vector<Tensor> tensors;
-    if (elements->get(&tensors)) {
-        VariantTensorData variant_tensor;
-        {
-            for (auto& element : tensors) {
-                *(variant_tensor.add_tensors()) = element;
-            }
-        }
-        resp->set_end_of_sequence(false);
-        resp->set_dataset_info(variant_tensor.SerializeAsString());
-    } else {
+    while (element_num < max_elements && elements->get(&tensors)) {
+        EncodeElement(tensors, &data);
+        ++element_num;
+    }
+
+    if (element_num == 0) {
+        resp->set_element_num(0);
         resp->set_end_of_sequence(GetFinished());
+        resp->set_backlog(0);
+        resp->set_input_finished(GetFinished());
+        return;
+    }
+
+    // small payloads are not worth compressing
+    uint32_t compress_type = req->compress_type();
+    if (data.size() < 1024) {
+        compress_type = brpc::COMPRESS_TYPE_NONE;
     }
+
+    CHECK(CompressAttachment(compress_type, data, attachment))
+        << "compress dataset pull response failed, compress_type:" << compress_type;
+
+    resp->set_element_num(element_num);
+    resp->set_compress_type(compress_type);
+    resp->set_end_of_sequence(false);
+    resp->set_backlog(elements->size());
+    resp->set_input_finished(GetFinished());
 }
 
-void BalanceInputDataInfo::SendBrpcDatasetPullReq(uint32_t balance_handle, bool* no_shard_remaining) {
-    std::vector<BalanceDataCall*> calls;
+std::vector<std::pair<uint32_t, uint32_t>> BalanceInputDataInfo::ChooseDonors_(size_t room) {
+    // shard and its weight, donors still reading input come first, then the ones
+    // with more buffered elements
+    std::vector<std::tuple<bool, uint32_t, uint32_t>> candidates;
     {
         const std::lock_guard<std::mutex> lock(RemainingShardsMutex());
         for (auto shard : *RemainingShards()) {
-            calls.emplace_back(new BalanceDataCall(shard, balance_handle));
+            auto it = shard_backlogs_.find(shard);
+            if (it == shard_backlogs_.end()) {
+                candidates.emplace_back(false, room, shard);
+            } else {
+                candidates.emplace_back(it->second.input_finished, it->second.backlog, shard);
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::tuple<bool, uint32_t, uint32_t>& a, const std::tuple<bool, uint32_t, uint32_t>& b) {
+                  if (std::get<0>(a) != std::get<0>(b)) {
+                      return !std::get<0>(a);
+                  }
+                  return std::get<1>(a) > std::get<1>(b);
+              });
+
+    if (candidates.size() > room) {
+        candidates.resize(room);
+    }
+
+    // every donor is asked one element at least, the rest of room is split by
+    // weight of backlog
+    std::vector<std::pair<uint32_t, uint32_t>> donors;
+    size_t left = room - candidates.size();
+    uint64_t total_weight = 0;
+    for (const auto& candidate : candidates) {
+        total_weight += std::get<1>(candidate) + 1;
+    }
+
+    for (const auto& candidate : candidates) {
+        uint32_t extra = total_weight > 0 ? left * (std::get<1>(candidate) + 1) / total_weight : 0;
+        donors.emplace_back(std::get<2>(candidate), 1 + extra);
+    }
+
+    return donors;
+}
+
+void BalanceInputDataInfo::StartDatasetPull(uint32_t balance_handle, uint32_t compress_type) {
+    BufferQueue* q = op_elements_[balance_handle];
+    PullState* state = pull_states_[balance_handle].get();
+
+    {
+        std::unique_lock<std::mutex> lock(state->mu);
+        if (state->in_flight) {
+            return;
+        }
+
+        // ask remote shards which are dry again and again is only burning cpu
+        if (state->last_round_empty) {
+            state->cv.wait_for(lock, std::chrono::milliseconds(1));
+            if (state->in_flight) {
+                return;
+            }
         }
+
+        state->in_flight = true;
     }
 
-    if (calls.empty()) {
-        *no_shard_remaining = true;
-    } else {
-        *no_shard_remaining = false;
+    // ask no more elements from all shards than the room of buffer so that no
+    // response is dropped
+    size_t room = q->capacity() - std::min(q->size(), q->capacity());
+
+    std::vector<std::pair<uint32_t, uint32_t>> donors = ChooseDonors_(room);
+
+    if (donors.empty()) {
+        const std::lock_guard<std::mutex> lock(state->mu);
+        state->in_flight = false;
+        state->cv.notify_all();
+        return;
     }
 
-    Semaphore semaphore(calls.size());
-    for (auto& call : calls) {
-        call->Start([this, call, &semaphore, balance_handle]() {
-            this->CopyDataToBuffer(&(call->resp), balance_handle);
-            semaphore.Notify();
+    auto pending = std::make_shared<std::atomic<int>>(donors.size());
+    auto element_num = std::make_shared<std::atomic<uint32_t>>(0);
+
+    for (const auto& donor : donors) {
+        auto* call = new BalanceDataCall(donor.first, balance_handle, donor.second, compress_type);
+        call->Start([this, call, state, pending, element_num, balance_handle]() {
+            this->CopyDataToBuffer(&(call->resp), call->cntl.response_attachment(), balance_handle);
+            element_num->fetch_add(call->resp.element_num());
             delete call;
+
+            if (pending->fetch_sub(1) == 1) {
+                const std::lock_guard<std::mutex> lock(state->mu);
+                state->in_flight = false;
+                state->last_round_empty = element_num->load() == 0;
+                state->cv.notify_all();
+            }
         });
     }
+}
+
+bool BalanceInputDataInfo::WaitDatasetPull(uint32_t balance_handle) {
+    PullState* state = pull_states_[balance_handle].get();
 
-    semaphore.WaitForSemaphore();
+    {
+        std::unique_lock<std::mutex> lock(state->mu);
+        if (state->in_flight) {
+            state->cv.wait(lock, [state]() { return !state->in_flight; });
+            return true;
+        }
+    }
+
+    const std::lock_guard<std::mutex> lock(RemainingShardsMutex());
+    return !RemainingShards()->empty();
 }
 
-void BalanceInputDataInfo::CopyDataToBuffer(const DatasetPullResponse* resp, uint32_t balance_handle) {
-    if (resp->dataset_info().length() == 0) {
-        if (resp->end_of_sequence()) {
-            ChangeShardStatus(resp->resp_shard_id());
+void BalanceInputDataInfo::CopyDataToBuffer(const DatasetPullResponse* resp, const butil::IOBuf& attachment,
+                                            uint32_t balance_handle) {
+    if (resp->element_num() == 0 && resp->end_of_sequence()) {
+        ChangeShardStatus(resp->resp_shard_id());
+        return;
+    }
+
+    {
+        const std::lock_guard<std::mutex> lock(RemainingShardsMutex());
+        if (remaining_shards_.count(resp->resp_shard_id())) {
+            auto& backlog = shard_backlogs_[resp->resp_shard_id()];
+            backlog.backlog = resp->backlog();
+            backlog.input_finished = resp->input_finished();
         }
+    }
+
+    if (resp->element_num() == 0) {
         return;
     }
-    VariantTensorData variant_tensor;
-    variant_tensor.ParseFromString(resp->dataset_info());
-    BufferQueueWithLock* q = op_elements_[balance_handle];
-    std::vector<Tensor> brpc_data;
-    for (const Tensor& tensor : variant_tensor.tensors()) {
-        brpc_data.emplace_back(std::move(tensor));
+
+    butil::IOBuf data;
+    CHECK(DecompressAttachment(resp->compress_type(), attachment, &data))
+        << "decompress dataset pull response failed, shard:" << resp->resp_shard_id();
+
+    BufferQueue* q = op_elements_[balance_handle];
+    for (uint32_t i = 0; i < resp->element_num(); ++i) {
+        std::vector<Tensor> tensors;
+        CHECK(DecodeElement(&data, &tensors)) << "bad dataset pull response, shard:" << resp->resp_shard_id();
+        CHECK(q->try_put(std::move(tensors))) << "balance buffer overflow, handle:" << balance_handle;
     }
-    q->put(std::move(brpc_data));
 }
 
 class BalanceDatasetOp::Dataset : public DatasetBase {
 public:
-    Dataset(OpKernelContext* ctx, const DatasetBase* input)
+    Dataset(OpKernelContext* ctx, const DatasetBase* input, int64 buffer_size,
+            const std::string& compress)
         : DatasetBase(DatasetContext(ctx))
-        , input_(input) {
+        , input_(input)
+        , buffer_size_(buffer_size)
+        , compress_(compress)
+        , compress_type_(BalanceInputDataInfo::ParseCompressType(compress))
+        , brpc_element_(buffer_size) {
         input_->Ref();
         auto* data_info = BalanceInputDataInfo::Instance();
         balance_handle_ = data_info->Register(&brpc_element_);
+
+        queue_depth_var_.reset(new bvar::PassiveStatus<int64_t>(
+            "tensornet_balance_dataset_" + std::to_string(balance_handle_) + "_queue_depth",
+            [](void* arg) -> int64_t {
+                return static_cast<BufferQueue*>(arg)->size();
+            }, &brpc_element_));
     }
 
-    ~Dataset() override { input_->Unref(); }
+    ~Dataset() override {
+        // pull in flight writes into brpc_element_
+        BalanceInputDataInfo::Instance()->WaitDatasetPull(balance_handle_);
+        queue_depth_var_.reset();
+        input_->Unref();
+    }
 
     std::unique_ptr<IteratorBase> MakeIteratorInternal(const string& prefix) const override {
         return absl::make_unique<Iterator>(Iterator::Params{
@@ -182,8 +489,13 @@ protected:
                               Node** output) const override {
         Node* input_graph_node = nullptr;
         TF_RETURN_IF_ERROR(b->AddInputDataset(ctx, input_, &input_graph_node));
+        AttrValue buffer_size;
+        b->BuildAttrValue(buffer_size_, &buffer_size);
+        AttrValue compress;
+        b->BuildAttrValue(compress_, &compress);
         TF_RETURN_IF_ERROR(
-            b->AddDataset(this, {input_graph_node}, output));
+            b->AddDataset(this, {input_graph_node},
+                          {{kBufferSize, buffer_size}, {kCompress, compress}}, output));
         return Status::OK();
     }
 
@@ -221,17 +533,14 @@ private:
                 return Status::OK();
             }
 
-            BufferQueueWithLock* q = data_info->op_elements_[dataset()->balance_handle_];
-            if (q->empty() && *end_of_sequence) {
+            if (*end_of_sequence) {
                 GetDataFromBrpcInternal(end_of_sequence, out_tensors);
                 return Status::OK();
             }
 
-            if (!q->empty() || !*end_of_sequence) {
-                q->get(out_tensors);
-                *end_of_sequence = false;
-            }
-
+            BufferQueue* q = data_info->op_elements_[dataset()->balance_handle_];
+            q->get(out_tensors);
+            *end_of_sequence = false;
 
             return Status::OK();
         }
@@ -291,30 +600,43 @@ private:
             *has_data = true;
 
             auto* data_info = BalanceInputDataInfo::Instance();
-            BufferQueueWithLock* q = data_info->op_elements_[dataset()->balance_handle_];
+            BufferQueue* q = data_info->op_elements_[dataset()->balance_handle_];
+            // the iterator is the only producer while input is not end, buffer
+            // checked not full always has room
             while (!q->buffer_full() && !*end_of_sequence) {
                 std::vector<Tensor> input_vec;
                 TF_RETURN_IF_ERROR(
                     input_impl_->GetNext(ctx, &input_vec, end_of_sequence));
                 if (!*end_of_sequence) {
-                    q->put(std::move(input_vec));
+                    CHECK(q->try_put(std::move(input_vec)));
                 }
             }
 
             return Status::OK();
         }
 
+        // local input is end, consume buffered elements while stealing from other
+        // ranks in background, so that the buffer is refilled before it runs dry
         void GetDataFromBrpcInternal(bool* end_of_sequence, std::vector<Tensor>* out_tensors) {
             auto* data_info = BalanceInputDataInfo::Instance();
-            BufferQueueWithLock* q = data_info->op_elements_[dataset()->balance_handle_];
-            bool no_shard = false;
-            while (!no_shard) {
-                data_info->SendBrpcDatasetPullReq(dataset()->balance_handle_, &no_shard);
+            uint32_t handle = dataset()->balance_handle_;
+            BufferQueue* q = data_info->op_elements_[handle];
+
+            for (;;) {
+                if (q->size() <= q->capacity() / 2) {
+                    data_info->StartDatasetPull(handle, dataset()->compress_type_);
+                }
+
                 if (q->get(out_tensors)) {
                     *end_of_sequence = false;
                     return;
                 }
+
+                if (!data_info->WaitDatasetPull(handle) && q->empty()) {
+                    break;
+                }
             }
+
             *end_of_sequence = true;
         }
 
@@ -327,17 +649,27 @@ private:
     const DatasetBase* const input_;
     std::vector<PartialTensorShape> output_shapes_;
 
+    const int64 buffer_size_;
+    const std::string compress_;
+    const uint32_t compress_type_;
     uint32_t balance_handle_;
-    BufferQueueWithLock brpc_element_;
+    BufferQueue brpc_element_;
+    std::unique_ptr<bvar::PassiveStatus<int64_t>> queue_depth_var_;
 };
 
 BalanceDatasetOp::BalanceDatasetOp(OpKernelConstruction* ctx)
     : UnaryDatasetOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kBufferSize, &buffer_size_));
+    OP_REQUIRES(ctx, buffer_size_ > 0,
+                errors::InvalidArgument("balance dataset buffer_size must be positive"));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kCompress, &compress_));
+    OP_REQUIRES(ctx, BalanceInputDataInfo::ParseCompressType(compress_) >= 0,
+                errors::InvalidArgument("balance dataset compress must be one of none, snappy, gzip"));
 }
 
 void BalanceDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
                                   DatasetBase** output) {
-    *output = new Dataset(ctx, input);
+    *output = new Dataset(ctx, input, buffer_size_, compress_);
 }
 
 namespace {
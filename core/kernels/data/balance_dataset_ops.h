@@ -17,13 +17,17 @@
 
 #include "tensorflow/core/framework/dataset.h"
 
+#include <map>
 #include <set>
+#include <string>
 #include <vector>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <condition_variable>
 
 #include "core/ps/ps_server_interface.h"
 #include "core/ps/ps_cluster.h"
+#include "core/utility/mpmc_queue.h"
 
 namespace tensorflow {
 
@@ -33,6 +37,8 @@ public:
     static constexpr const char* const kInputDataset = "input_dataset";
     static constexpr const char* const kOutputTypes = "output_types";
     static constexpr const char* const kOutputShapes = "output_shapes";
+    static constexpr const char* const kBufferSize = "buffer_size";
+    static constexpr const char* const kCompress = "compress";
 
     explicit BalanceDatasetOp(OpKernelConstruction* ctx);
 
@@ -42,56 +48,48 @@ protected:
 
 private:
     class Dataset;
+
+    int64 buffer_size_ = 0;
+    std::string compress_;
 };
 
-class BufferQueueWithLock {
+// bounded buffer of input elements, filled by the local iterator or DatasetPull
+// responses and drained by the local iterator and DatasetPull handlers of other
+// ranks concurrently.
+class BufferQueue {
 public:
-    void put(std::vector<Tensor>&& element) {
-        const std::lock_guard<std::mutex> lock(mu_);
-        elements_.emplace(element);
+    explicit BufferQueue(size_t capacity)
+        : elements_(capacity) {
     }
 
-    bool empty() {
-        const std::lock_guard<std::mutex> lock(mu_);
-        return elements_.empty();
+    // return false if buffer is full, producers must check full() before reading
+    // an element from input so that no element is dropped
+    bool try_put(std::vector<Tensor>&& element) {
+        return elements_.try_push(std::move(element));
     }
 
-    bool buffer_full() {
-        const std::lock_guard<std::mutex> lock(mu_);
-        return elements_.size() > buffer_size_;
+    bool empty() const {
+        return elements_.empty();
     }
 
-    bool get(std::vector<Tensor>* tensors) {
-        const std::lock_guard<std::mutex> lock(mu_);
-
-        if (empty_unlock()) {
-            return false;
-        }
-        
-        *tensors = std::move(elements_.front());
-        elements_.pop();
-        return true;
+    bool buffer_full() const {
+        return elements_.full();
     }
 
-    void pop() {
-        const std::lock_guard<std::mutex> lock(mu_);
-        elements_.pop();
+    bool get(std::vector<Tensor>* tensors) {
+        return elements_.try_pop(tensors);
     }
 
-    size_t size() {
-        const std::lock_guard<std::mutex> lock(mu_);
+    size_t size() const {
         return elements_.size();
     }
 
-private:
-    bool empty_unlock() {
-        return elements_.empty();
+    size_t capacity() const {
+        return elements_.capacity();
     }
 
 private:
-    size_t buffer_size_ = 100;
-    std::mutex mu_;
-    std::queue<std::vector<Tensor> > elements_;
+    tensornet::MpmcQueue<std::vector<Tensor>> elements_;
 };
 
 class BalanceInputDataInfo {
@@ -101,11 +99,12 @@ public:
         return &instance;
     }
 
-    uint32_t Register(BufferQueueWithLock* elements) {
+    uint32_t Register(BufferQueue* elements) {
         const std::lock_guard<std::mutex> lock(mu_);
         uint32_t handle = op_elements_.size();
         // LOG(INFO) << "Register:" << handle << " pid:" << std::this_thread::get_id();
         op_elements_[handle] = elements;
+        pull_states_[handle].reset(new PullState());
         return handle;
     }
 
@@ -115,6 +114,7 @@ public:
             remaining_shards_.insert(i);
         }
         remaining_shards_.erase(self_shard);
+        shard_backlogs_.clear();
 
         finished_ = false;
 
@@ -132,25 +132,59 @@ public:
     void ChangeShardStatus(uint32_t shard_id) {
         const std::lock_guard<std::mutex> lock(remaining_mu_);
         remaining_shards_.erase(shard_id);
+        shard_backlogs_.erase(shard_id);
     }
 
     bool GetFinished() { return finished_; }
 
     void SetFinished(bool finished) { finished_ = finished; }
 
-    void ProcessBrpcDatasetPullReq(const tensornet::DatasetPullRequest* req, tensornet::DatasetPullResponse* resp);
+    // brpc::CompressType of none, snappy or gzip, -1 if unknown
+    static int ParseCompressType(const std::string& name);
+
+    // pop at most req->max_elements() elements into attachment
+    void ProcessBrpcDatasetPullReq(const tensornet::DatasetPullRequest* req,
+                                   tensornet::DatasetPullResponse* resp,
+                                   butil::IOBuf* attachment);
+
+    // pull elements from remaining shards asynchronously if no pull is in flight,
+    // donors with more backlog are asked more elements
+    void StartDatasetPull(uint32_t balance_handle, uint32_t compress_type);
 
-    void SendBrpcDatasetPullReq(uint32_t balance_handle, bool* no_shard_remaining);
+    // wait the in flight pull finish, return false if there is nothing to wait,
+    // i.e. no pull in flight and no shard remaining
+    bool WaitDatasetPull(uint32_t balance_handle);
 
-    void CopyDataToBuffer(const tensornet::DatasetPullResponse* resp, uint32_t balance_handle);
+    void CopyDataToBuffer(const tensornet::DatasetPullResponse* resp,
+                          const butil::IOBuf& attachment, uint32_t balance_handle);
+
+private:
+    struct PullState {
+        std::mutex mu;
+        std::condition_variable cv;
+        bool in_flight = false;
+        // last round brought no element, wait a while before next round
+        bool last_round_empty = false;
+    };
+
+    struct ShardBacklog {
+        uint32_t backlog = 0;
+        bool input_finished = false;
+    };
+
+    // split room among donors, shards never responded are taken as busy ones
+    std::vector<std::pair<uint32_t, uint32_t>> ChooseDonors_(size_t room);
 
 public:
     std::mutex remaining_mu_;
     std::set<uint32_t> remaining_shards_;
+    // last advertised backlog of remaining shards, guarded by remaining_mu_
+    std::map<uint32_t, ShardBacklog> shard_backlogs_;
 
     std::mutex mu_;
     bool finished_ = false;
-    std::map<uint32_t, BufferQueueWithLock*> op_elements_;
+    std::map<uint32_t, BufferQueue*> op_elements_;
+    std::map<uint32_t, std::unique_ptr<PullState>> pull_states_;
 };
 
 }  // namespace tensorflow
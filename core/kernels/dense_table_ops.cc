@@ -14,17 +14,26 @@
 
 #include "core/utility/semaphore.h"
 #include "core/ps/table/dense_table.h"
+#include "core/ps/host_aggregator.h"
 #include "core/ps/ps_cluster.h"
+#include "core/utility/metrics.h"
+#include "core/utility/mpi_manager.h"
+#include "core/utility/trace.h"
 
 #include "tensorflow/core/framework/attr_value.pb.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/refcount.h"
 
+#include "core/kernels/gpu_copy.h"
 #include "core/kernels/resource_var_wrapper.h"
 #include "core/ps/optimizer/optimizer_kernel.h"
 
 #include <brpc/controller.h>
+#include <butil/object_pool.h>
+
+#include <algorithm>
+#include <vector>
 
 using namespace tensornet;
 
@@ -38,15 +47,31 @@ Status LookupResource(OpKernelContext* ctx, const ResourceHandle& p,
 
 const ResourceHandle& HandleFromInput(OpKernelContext* ctx, int input);
 
+// calls are taken from the object pool of butil and returned to it, so that
+// controller and protobufs of a reused call keep their buffers.
 class DensePushPullCall {
 public:
-    DensePushPullCall(int table_handle, int shard_id)
-        : shard_id_(shard_id) {
-        req.set_table_handle(table_handle);
-    }
+    DensePushPullCall() {}
 
     ~DensePushPullCall() {}
 
+    static DensePushPullCall* New(int table_handle, int shard_id) {
+        DensePushPullCall* call = butil::get_object<DensePushPullCall>();
+        CHECK(nullptr != call);
+
+        call->cntl.Reset();
+        call->req.Clear();
+        call->resp.Clear();
+        call->shard_id_ = shard_id;
+        call->req.set_table_handle(table_handle);
+
+        return call;
+    }
+
+    static void Free(DensePushPullCall* call) {
+        butil::return_object(call);
+    }
+
     void AddRequestData(butil::IOBuf& k_buf) {
         butil::IOBuf &buf = cntl.request_attachment();
         buf.append(k_buf);
@@ -55,9 +80,23 @@ public:
     void Start(const tensornet::Callback& done) {
         cntl.http_request().set_method(brpc::HTTP_METHOD_POST);
 
+        Tracer* tracer = Tracer::Instance();
+        uint64_t step = tracer->Step();
+        if (tracer->Enabled()) {
+            req.set_trace_step(step);
+            req.set_trace_rank(PsCluster::Instance()->Rank());
+        }
+
         const PsServerInterface* si =
             PsCluster::Instance()->GetServer(shard_id_);
-        si->DensePushPullAsync(&cntl, &req, &resp, done);
+        int64_t begin = butil::gettimeofday_us();
+        si->DensePushPullAsync(&cntl, &req, &resp, [this, begin, step, done]() {
+            int64_t end = butil::gettimeofday_us();
+            Metrics::Instance()->client_dense_push_pull.Record(end - begin,
+                cntl.request_attachment().size(), cntl.response_attachment().size());
+            Tracer::Instance()->Record("dense_push_pull_rpc", "rpc", begin, end, step, shard_id_, true);
+            done();
+        });
     }
 
 public:
@@ -122,6 +161,175 @@ private:
 REGISTER_KERNEL_BUILDER(Name("DenseTableInit").Device(DEVICE_CPU),
                         DenseTableInitKernel);
 
+static void CopyToVariables(const float* data, const std::vector<Tensor*>& var_tensors) {
+    for (size_t i = 0, offset = 0; i < var_tensors.size(); ++i) {
+        Tensor *var_tensor = var_tensors[i];
+        std::copy_n(data + offset, var_tensor->NumElements(), var_tensor->flat<float>().data());
+        offset += var_tensor->NumElements();
+    }
+}
+
+// tensors of variables of the op, in the same order as their grads
+static Status GetDenseVarTensors(OpKernelContext* c, int N, int table_handle,
+                                 std::vector<Tensor*>* var_tensors) {
+    OpInputList grads;
+    TF_RETURN_IF_ERROR(c->input_list("grads", &grads));
+
+    if (c->num_inputs() != N * 2) {
+        return errors::InvalidArgument("DenseTable pushpull num_inputs:", c->num_inputs(),
+                                       " not equal:", N * 2);
+    }
+
+    int total_elements = 0;
+
+    for (int i = 0; i < N; i++) {
+        const ResourceHandle &handle = HandleFromInput(c, i);
+        const Tensor& grad_tensor = grads[i];
+
+        Var *variable = nullptr;
+        TF_RETURN_IF_ERROR(LookupResource<Var, false>(c, handle, &variable));
+        CHECK(variable);
+        Tensor *var_tensor = variable->tensor();
+
+        if (var_tensor->NumElements() != grad_tensor.NumElements()) {
+            return errors::InvalidArgument("DenseTable var tensor length:",
+                                           var_tensor->NumElements(),
+                                           " not equal grad tensor length:",
+                                           grad_tensor.NumElements());
+        }
+
+        total_elements += grad_tensor.NumElements();
+        var_tensors->push_back(var_tensor);
+    }
+
+    DenseTable* table = DenseTableRegistry::Instance()->Get(table_handle);
+
+    if (nullptr == table) {
+        return errors::InvalidArgument("DenseTable not found:", table_handle);
+    }
+
+    CHECK_EQ(total_elements, table->TotalElements());
+
+    return Status::OK();
+}
+
+// push grads and pull updated weights into var_tensors, all of them are host tensors.
+// it returns after all rpc are done.
+static void PushPullDense(int table_handle, const std::vector<Tensor*>& var_tensors,
+                          const std::vector<const Tensor*>& grads) {
+    DenseTable* table = DenseTableRegistry::Instance()->Get(table_handle);
+    int total_elements = table->TotalElements();
+
+    butil::IOBuf buf;
+
+    // gradients of all ranks of the host are summed and push pulled by the host
+    // leader, which sends updated weights back to the others
+    HostAggregator* aggregator = HostAggregator::Instance();
+    bool host_aggregate = aggregator->Enabled();
+    std::vector<float> host_data;
+
+    if (host_aggregate) {
+        host_data.resize(total_elements);
+        for (size_t i = 0, offset = 0; i < grads.size(); ++i) {
+            std::copy_n(grads[i]->flat<float>().data(), grads[i]->NumElements(),
+                        host_data.data() + offset);
+            offset += grads[i]->NumElements();
+        }
+
+        if (!aggregator->ReduceDense(table_handle, host_data.data(), total_elements)) {
+            aggregator->BroadcastDense(table_handle, host_data.data(), total_elements);
+            CopyToVariables(host_data.data(), var_tensors);
+            return;
+        }
+
+        buf.append_user_data(host_data.data(), total_elements * sizeof(float), NoOpDeleter);
+    } else {
+        for (size_t i = 0; i < grads.size(); ++i) {
+            const float* grad_data = grads[i]->flat<float>().data();
+            buf.append_user_data(const_cast<float *>(grad_data),
+                                 grads[i]->NumElements() * sizeof(float),
+                                 NoOpDeleter);
+        }
+    }
+
+    int shard_num = PsCluster::Instance()->RankNum();
+    Semaphore semaphore(shard_num);
+
+    for (int shard_id = 0; shard_id < shard_num; shard_id++) {
+        const auto* opt_kernel = table->GetOptKernels(shard_id).get();
+
+        if (nullptr == opt_kernel) {
+            semaphore.Notify();
+            continue;
+        }
+
+        auto* call = DensePushPullCall::New(table_handle, shard_id);
+
+        butil::IOBuf k_buf;
+        int k_len = opt_kernel->Length() * sizeof(float);
+        CHECK_EQ(k_len, buf.cutn(&k_buf, k_len));
+        call->AddRequestData(k_buf);
+
+        // var_tensors is alive till all calls done, it is not copied into every call
+        call->Start([call, &var_tensors, opt_kernel, k_len, &semaphore]() {
+            const butil::IOBuf& output = call->cntl.response_attachment();
+
+            CHECK_EQ(output.size(), k_len);
+
+            // weights are copied from the response blocks into variables directly
+            size_t pos = 0;
+
+            for (int i = 0, offset = 0; i < (int)var_tensors.size(); ++i) {
+                Tensor *var_tensor = var_tensors[i];
+                float* var_data = var_tensor->flat<float>().data();
+
+                int num_elements = var_tensor->NumElements();
+
+                // find the first variable to populate
+                if (offset + num_elements <= opt_kernel->OffsetBegin()) {
+                    offset += num_elements;
+                    continue;
+                }
+
+                int var_offset = 0;
+
+                // fist populate variable may be not start with 0
+                if (opt_kernel->OffsetBegin() > offset) {
+                    var_offset = opt_kernel->OffsetBegin() - offset;
+                }
+
+                CHECK_LT(var_offset, num_elements);
+
+                size_t copy_len = std::min(output.size() - pos, (num_elements - var_offset) * sizeof(float));
+
+                CHECK_EQ(copy_len, output.copy_to(var_data + var_offset, copy_len, pos));
+                pos += copy_len;
+
+                if (pos < output.size()) {
+                    offset += num_elements;
+                } else {
+                    break;
+                }
+            }
+
+            DensePushPullCall::Free(call);
+            semaphore.Notify();
+        });
+    }
+
+    semaphore.WaitForSemaphore();
+
+    if (host_aggregate) {
+        for (size_t i = 0, offset = 0; i < var_tensors.size(); ++i) {
+            std::copy_n(var_tensors[i]->flat<float>().data(), var_tensors[i]->NumElements(),
+                        host_data.data() + offset);
+            offset += var_tensors[i]->NumElements();
+        }
+
+        aggregator->BroadcastDense(table_handle, host_data.data(), total_elements);
+    }
+}
+
 class DenseTablePushPullKernel : public AsyncOpKernel {
 public:
     explicit DenseTablePushPullKernel(OpKernelConstruction* c)
@@ -131,16 +339,124 @@ public:
     }
 
     void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        std::vector<Tensor*> var_tensors;
+        OP_REQUIRES_OK_ASYNC(c, GetDenseVarTensors(c, N_, table_handle_, &var_tensors), done);
+
+        std::vector<const Tensor*> grads;
+        for (int i = 0; i < N_; i++) {
+            grads.push_back(&c->input(N_ + i));
+        }
+
+        PushPullDense(table_handle_, var_tensors, grads);
+
+        done();
+    }
+
+private:
+    int table_handle_;
+    int N_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("DenseTablePushPull").Device(DEVICE_CPU),
+                        DenseTablePushPullKernel);
+
+#if GOOGLE_CUDA
+// variables and gradients are on gpu. gradients are copied into pinned host tensors,
+// push pull in a cpu worker lands the weights in pinned host tensors, which are
+// copied back into the variables, no op thread is blocked by the copies or rpc.
+class DenseTablePushPullGpuKernel : public AsyncOpKernel {
+public:
+    explicit DenseTablePushPullGpuKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        std::vector<Tensor*> var_tensors;
+        OP_REQUIRES_OK_ASYNC(c, GetDenseVarTensors(c, N_, table_handle_, &var_tensors), done);
+
+        std::vector<Tensor> host_grads(N_);
+        std::vector<Tensor> host_vars(N_);
+
+        for (int i = 0; i < N_; i++) {
+            OP_REQUIRES_OK_ASYNC(c, AllocatePinnedTemp(c, c->input(N_ + i).shape(), &host_grads[i]),
+                                 done);
+            OP_REQUIRES_OK_ASYNC(c, AllocatePinnedTemp(c, var_tensors[i]->shape(), &host_vars[i]),
+                                 done);
+        }
+
+        int table_handle = table_handle_;
+
+        auto push_pull = [c, table_handle, var_tensors, host_grads, host_vars, done]() mutable {
+            std::vector<Tensor*> host_var_ptrs;
+            std::vector<const Tensor*> host_grad_ptrs;
+
+            for (size_t i = 0; i < host_vars.size(); i++) {
+                host_var_ptrs.push_back(&host_vars[i]);
+                host_grad_ptrs.push_back(&host_grads[i]);
+            }
+
+            PushPullDense(table_handle, host_var_ptrs, host_grad_ptrs);
+
+            auto* to_vars = new GpuCopyGroup(c, "dense_pull_h2d", [c, done](const Status& status) {
+                OP_REQUIRES_OK_ASYNC(c, status, done);
+                done();
+            });
+
+            for (size_t i = 0; i < var_tensors.size(); i++) {
+                to_vars->ToDevice(host_vars[i], *var_tensors[i]);
+            }
+
+            to_vars->Start();
+        };
+
+        auto* to_host = new GpuCopyGroup(c, "dense_push_d2h", [c, push_pull, done](const Status& status) {
+            OP_REQUIRES_OK_ASYNC(c, status, done);
+            ScheduleOnCpuWorker(c, push_pull);
+        });
+
+        for (int i = 0; i < N_; i++) {
+            to_host->ToHost(c->input(N_ + i), host_grads[i]);
+        }
+
+        to_host->Start();
+    }
+
+private:
+    int table_handle_;
+    int N_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("DenseTablePushPull")
+                            .Device(DEVICE_GPU)
+                            .HostMemory("vars"),
+                        DenseTablePushPullGpuKernel);
+#endif // GOOGLE_CUDA
+
+// synchronous alternative to DenseTablePushPull. gradients are reduce scattered so
+// that every rank gets the sum of its own slice, which is averaged and applied by
+// the local optimizer kernel, then updated weights are allgathered to all ranks.
+// traffic per rank is about 2x of the dense size no matter how many ranks there are.
+// the slices and optimizer states are the same of push pull, so save and load of
+// dense table do not care which one is used.
+class DenseTableAllReduceKernel : public OpKernel {
+public:
+    explicit DenseTableAllReduceKernel(OpKernelConstruction* c)
+        : OpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+    }
+
+    void Compute(OpKernelContext* c) override {
         OpInputList grads;
-        OP_REQUIRES_OK_ASYNC(c, c->input_list("grads", &grads), done);
+        OP_REQUIRES_OK(c, c->input_list("grads", &grads));
 
-        OP_REQUIRES_ASYNC(c, c->num_inputs() == N_ * 2,
-                          errors::InvalidArgument("DenseTable pushpull num_inputs:",
-                                                  c->num_inputs(),
-                                                  " not equal:", N_ * 2),
-                          done);
+        OP_REQUIRES(c, c->num_inputs() == N_ * 2,
+                    errors::InvalidArgument("DenseTable allreduce num_inputs:",
+                                            c->num_inputs(), " not equal:", N_ * 2));
 
-        std::vector<Var*> variables;
+        std::vector<Tensor*> var_tensors;
 
         int total_elements = 0;
 
@@ -151,111 +467,79 @@ public:
             Var *variable = nullptr;
             const auto status = LookupResource<Var, false>(c, handle, &variable);
 
-            OP_REQUIRES_OK_ASYNC(c, status, done);
+            OP_REQUIRES_OK(c, status);
             CHECK(variable);
             Tensor *var_tensor = variable->tensor();
 
-            OP_REQUIRES_ASYNC(c, var_tensor->NumElements() == grad_tensor.NumElements(),
-                              errors::InvalidArgument("DenseTable var tensor length:",
-                                                      var_tensor->NumElements(),
-                                                      " not equal grad tensor length:",
-                                                      grad_tensor.NumElements()),
-                              done);
+            OP_REQUIRES(c, var_tensor->NumElements() == grad_tensor.NumElements(),
+                        errors::InvalidArgument("DenseTable var tensor length:",
+                                                var_tensor->NumElements(),
+                                                " not equal grad tensor length:",
+                                                grad_tensor.NumElements()));
 
             total_elements += grad_tensor.NumElements();
-            variables.push_back(variable);
-        }
-
-        butil::IOBuf buf;
-
-        for (int i = 0; i < N_; ++i) {
-            const Tensor& grad_tensor = grads[i];
-            const float* grad_data = grad_tensor.flat<float>().data();
-            buf.append_user_data(const_cast<float *>(grad_data),
-                                 grad_tensor.NumElements() * sizeof(float),
-                                  NoOpDeleter);
+            var_tensors.push_back(var_tensor);
         }
 
         DenseTable* table = DenseTableRegistry::Instance()->Get(table_handle_);
 
-        OP_REQUIRES_ASYNC(c, nullptr != table,
-                          errors::InvalidArgument("DenseTable not found:",
-                                                  table_handle_),
-                          done);
+        OP_REQUIRES(c, nullptr != table,
+                    errors::InvalidArgument("DenseTable not found:", table_handle_));
 
         CHECK_EQ(total_elements, table->TotalElements());
 
+        std::vector<float> grad(total_elements);
+
+        for (int i = 0, offset = 0; i < N_; ++i) {
+            const Tensor& grad_tensor = grads[i];
+            std::copy_n(grad_tensor.flat<float>().data(), grad_tensor.NumElements(),
+                        grad.data() + offset);
+            offset += grad_tensor.NumElements();
+        }
+
         int shard_num = PsCluster::Instance()->RankNum();
-        Semaphore semaphore(shard_num);
+        std::vector<int> counts(shard_num, 0);
 
         for (int shard_id = 0; shard_id < shard_num; shard_id++) {
-            const auto* opt_kernel = table->GetOptKernels(shard_id).get();
+            const auto opt_kernel = table->GetOptKernels(shard_id);
 
-            if (nullptr == opt_kernel) {
-                semaphore.Notify();
-                continue;
+            if (nullptr != opt_kernel) {
+                counts[shard_id] = opt_kernel->Length();
             }
+        }
 
-            auto* call = new DensePushPullCall(table_handle_, shard_id);
-
-            butil::IOBuf k_buf;
-            int k_len = opt_kernel->Length() * sizeof(float);
-            CHECK_EQ(k_len, buf.cutn(&k_buf, k_len));
-            call->AddRequestData(k_buf);
-
-            call->Start([call, variables, opt_kernel, k_len, &semaphore]() {
-                std::unique_ptr<DensePushPullCall> call_free_guard(call);
-
-                butil::IOBuf& output = call->cntl.response_attachment();
-
-                CHECK_EQ(output.size(), k_len);
-
-                for (int i = 0, offset = 0; i < (int)variables.size(); ++i) {
-                    Var* variable = variables[i];
-
-                    Tensor *var_tensor = variable->tensor();
-                    float* var_data = var_tensor->flat<float>().data();
-
-                    int num_elements = var_tensor->NumElements();
-
-                    // find the first variable to populate
-                    if (offset + num_elements <= opt_kernel->OffsetBegin()) {
-                        offset += num_elements;
-                        continue;
-                    }
-
-                    int var_offset = 0;
+        const auto opt_kernel = table->GetOptKernels(PsCluster::Instance()->Rank());
 
-                    // fist populate variable may be not start with 0
-                    if (opt_kernel->OffsetBegin() > offset) {
-                        var_offset = opt_kernel->OffsetBegin() - offset;
-                    }
+        // reduced gradient of self slice is received in place of its weight
+        std::vector<float> weight(total_elements);
+        float* self_data = weight.data() + (opt_kernel ? opt_kernel->OffsetBegin() : 0);
 
-                    CHECK_LT(var_offset, num_elements);
+        MpiManager* mpi_manager = MpiManager::Instance();
 
-                    int copy_len = std::min(output.size(), (num_elements - var_offset) * sizeof(float));
+        mpi_manager->ReduceScatterSum(grad.data(), self_data, counts);
 
-                    butil::IOBuf copy_buf;
-                    CHECK_EQ(copy_len, output.cutn(&copy_buf, copy_len));
+        if (nullptr != opt_kernel) {
+            size_t length = opt_kernel->Length();
+            size_t bytes = length * sizeof(float);
 
-                    copy_buf.copy_to(var_data + var_offset, copy_len);
+            float scale = 1.0 / shard_num;
+            for (size_t i = 0; i < length; ++i) {
+                self_data[i] *= scale;
+            }
 
-                    if (output.size() > 0) {
-                        offset += num_elements;
-                    } else {
-                        break;
-                    }
-                }
+            butil::IOBuf grad_buf;
+            grad_buf.append_user_data(self_data, bytes, NoOpDeleter);
+            opt_kernel->Apply(grad_buf);
 
-                semaphore.Notify();
-            });
+            butil::IOBuf w_buf;
+            opt_kernel->GetWeight(w_buf);
+            CHECK_EQ(w_buf.size(), bytes);
+            w_buf.copy_to(self_data, bytes);
         }
 
-        semaphore.WaitForSemaphore();
+        mpi_manager->AllGatherv(weight.data(), counts);
 
-        done();
-
-        return;
+        CopyToVariables(weight.data(), var_tensors);
     }
 
 private:
@@ -263,7 +547,7 @@ private:
     int N_;
 };
 
-REGISTER_KERNEL_BUILDER(Name("DenseTablePushPull").Device(DEVICE_CPU),
-                        DenseTablePushPullKernel);
+REGISTER_KERNEL_BUILDER(Name("DenseTableAllReduce").Device(DEVICE_CPU),
+                        DenseTableAllReduceKernel);
 
 }  // namespace tensorflow
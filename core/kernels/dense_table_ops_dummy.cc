@@ -53,4 +53,22 @@ private:
 REGISTER_KERNEL_BUILDER(Name("DenseTablePushPull").Device(DEVICE_CPU),
                         DenseTablePushPullKernel);
 
+class DenseTableAllReduceKernel : public OpKernel {
+public:
+    explicit DenseTableAllReduceKernel(OpKernelConstruction* c)
+        : OpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+    }
+
+    void Compute(OpKernelContext* c) override {
+        return;
+    }
+
+private:
+    int table_handle_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("DenseTableAllReduce").Device(DEVICE_CPU),
+                        DenseTableAllReduceKernel);
+
 }  // namespace tensorflow
@@ -0,0 +1,108 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#if GOOGLE_CUDA
+
+#include "core/kernels/gpu_copy.h"
+#include "core/utility/trace.h"
+
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/framework/device_base.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+
+#include <butil/logging.h>
+
+using namespace tensornet;
+
+namespace tensorflow {
+
+Status AllocatePinnedTemp(OpKernelContext* c, const TensorShape& shape, Tensor* out) {
+    AllocatorAttributes attr;
+    attr.set_on_host(true);
+    attr.set_gpu_compatible(true);
+
+    return c->allocate_temp(DT_FLOAT, shape, out, attr);
+}
+
+void ScheduleOnCpuWorker(OpKernelContext* c, std::function<void()> fn) {
+    c->device()->tensorflow_cpu_worker_threads()->workers->Schedule(std::move(fn));
+}
+
+GpuCopyGroup::GpuCopyGroup(OpKernelContext* c, const char* name, Done done)
+    : c_(c)
+    , name_(name)
+    , done_(std::move(done)) {
+    CHECK(nullptr != c_->op_device_context()) << "op is not placed on gpu";
+
+    if (Tracer::Instance()->Enabled()) {
+        begin_us_ = Tracer::NowUs();
+    }
+}
+
+void GpuCopyGroup::ToDevice(const Tensor& host, const Tensor& device) {
+    tensors_.push_back(host);
+    const Tensor* src = &tensors_.back();
+    tensors_.push_back(device);
+    Tensor* dst = &tensors_.back();
+
+    CHECK_EQ(src->TotalBytes(), dst->TotalBytes());
+
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    c_->op_device_context()->CopyCPUTensorToDevice(
+        src, static_cast<Device*>(c_->device()), dst,
+        [this](const Status& status) { Finish_(status); });
+}
+
+void GpuCopyGroup::ToHost(const Tensor& device, const Tensor& host) {
+    tensors_.push_back(device);
+    const Tensor* src = &tensors_.back();
+    tensors_.push_back(host);
+    Tensor* dst = &tensors_.back();
+
+    CHECK_EQ(src->TotalBytes(), dst->TotalBytes());
+
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    c_->op_device_context()->CopyDeviceTensorToCPU(
+        src, name_, static_cast<Device*>(c_->device()), dst,
+        [this](const Status& status) { Finish_(status); });
+}
+
+void GpuCopyGroup::Start() {
+    Finish_(Status::OK());
+}
+
+void GpuCopyGroup::Finish_(const Status& status) {
+    if (!status.ok()) {
+        std::lock_guard<std::mutex> lock(mu_);
+        status_.Update(status);
+    }
+
+    if (1 != pending_.fetch_sub(1, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    if (begin_us_ > 0) {
+        Tracer* tracer = Tracer::Instance();
+        tracer->Record(name_, "gpu", begin_us_, Tracer::NowUs(), tracer->Step(), -1, true);
+    }
+
+    done_(status_);
+    delete this;
+}
+
+} // namespace tensorflow
+
+#endif // GOOGLE_CUDA
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,84 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_KERNEL_GPU_COPY_H_
+#define TENSORNET_KERNEL_GPU_COPY_H_
+
+#if GOOGLE_CUDA
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace tensorflow {
+
+// host tensor in pinned memory, so that rpc buffers are copied to and from gpu by
+// async dma instead of a staging copy of the driver
+Status AllocatePinnedTemp(OpKernelContext* c, const TensorShape& shape, Tensor* out);
+
+// run cpu work of a gpu op in the cpu worker threads of its device, copy callbacks
+// run in the few threads of the gpu event manager which must not block on rpc
+void ScheduleOnCpuWorker(OpKernelContext* c, std::function<void()> fn);
+
+// copies between host tensors and gpu tensors of the op device. they are issued
+// on the host_to_device and device_to_host streams of the device, which wait for
+// work queued on the compute stream first, and finish without blocking the op
+// thread, so that rpc of the op overlaps gpu compute of other ops.
+//
+// done is called once all copies added before Start finish, with the first error
+// if any, the group deletes itself after that.
+class GpuCopyGroup {
+public:
+    typedef std::function<void(const Status&)> Done;
+
+    // name must be a string literal, it is the trace span of the copies
+    GpuCopyGroup(OpKernelContext* c, const char* name, Done done);
+
+    // device is written in place, it may be a slice of a variable tensor
+    void ToDevice(const Tensor& host, const Tensor& device);
+
+    void ToHost(const Tensor& device, const Tensor& host);
+
+    void Start();
+
+private:
+    ~GpuCopyGroup() = default;
+
+    void Finish_(const Status& status);
+
+private:
+    OpKernelContext* c_;
+    const char* name_;
+    Done done_;
+    int64 begin_us_ = 0;
+
+    // copies are given pointers, deque keeps them valid when growing
+    std::deque<Tensor> tensors_;
+
+    std::atomic<int> pending_{1};
+    std::mutex mu_;
+    Status status_;
+};
+
+} // namespace tensorflow
+
+#endif // GOOGLE_CUDA
+
+#endif // TENSORNET_KERNEL_GPU_COPY_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
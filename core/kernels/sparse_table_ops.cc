@@ -12,21 +12,33 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "core/utility/semaphore.h"
-
 #include "tensorflow/core/framework/attr_value.pb.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/refcount.h"
 
+#include "core/kernels/sparse_table_ops.h"
+#include "core/kernels/gpu_copy.h"
 #include "core/kernels/resource_var_wrapper.h"
 #include "core/ps_interface/ps_raw_interface.h"
 
 #include <brpc/controller.h>
+#include <butil/object_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
 #include <sstream>
 
 #include "core/ps/ps_server_interface.h"
+#include "core/ps/host_aggregator.h"
 #include "core/ps/ps_cluster.h"
+#include "core/ps/push_window.h"
+#include "core/ps/table/sparse_table.h"
+#include "core/ps_interface/sparse_codec.h"
+#include "core/utility/metrics.h"
+#include "core/utility/open_hash_map.h"
+#include "core/utility/trace.h"
 
 using namespace tensornet;
 
@@ -37,30 +49,145 @@ Status LookupResource(OpKernelContext* ctx, const ResourceHandle& p, T** value);
 
 const ResourceHandle& HandleFromInput(OpKernelContext* ctx, int input);
 
+// table of dim under handle, every dim of a table has its own cache and hot keys
+static SparseTable* GetDimTable(uint32_t table_handle, int dim) {
+    SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle)->DimTable(dim);
+    CHECK(nullptr != table) << "sparse table " << table_handle << " has no dim:" << dim;
+
+    return table;
+}
+
+// tag request with step and rank of this worker if tracing, return the step
+template <typename Request>
+static uint64_t SetTraceStep(Request* req) {
+    Tracer* tracer = Tracer::Instance();
+    if (!tracer->Enabled()) {
+        return 0;
+    }
+
+    req->set_trace_step(tracer->Step());
+    req->set_trace_rank(PsCluster::Instance()->Rank());
+
+    return req->trace_step();
+}
+
+// calls are created every step for every shard, they are taken from the object pool
+// of butil and returned to it instead of being deleted, so that controller, protobufs
+// and vectors of a reused call keep their buffers.
 class SparsePullCall {
 public:
-    SparsePullCall(int table_handle, int shard_id, int dim)
-        : shard_id_(shard_id) {
-        req.set_table_handle(table_handle);
-        req.set_dim(dim);
-    }
+    SparsePullCall() {}
 
     ~SparsePullCall() {}
 
+    static SparsePullCall* New(int table_handle, int shard_id, int dim,
+                               const SparseWireOption& wire_option) {
+        SparsePullCall* call = butil::get_object<SparsePullCall>();
+        CHECK(nullptr != call);
+
+        call->Reset_(table_handle, shard_id, dim, wire_option);
+        return call;
+    }
+
+    static void Free(SparsePullCall* call) {
+        butil::return_object(call);
+    }
+
     void AddRequestSign(size_t var_index, size_t sign_index, uint64 sign) {
-        req.add_signs(sign);
+        signs_.push_back(sign);
 
         call_sign_infos.emplace_back(var_index, sign_index);
     }
 
+    int ShardId() const {
+        return shard_id_;
+    }
+
+    // self shard is pulled in process, weights are in local_weights instead of the
+    // response attachment
+    bool IsLocal() const {
+        return shard_id_ == PsCluster::Instance()->Rank();
+    }
+
     void Start(const tensornet::Callback& done) {
         if (call_sign_infos.empty()) {
             done();
+        } else if (IsLocal()) {
+            PullLocal();
+            done();
         } else {
+            EncodeSigns();
+
+            uint64_t step = SetTraceStep(&req);
+
             const PsServerInterface* si =
                 PsCluster::Instance()->GetServer(shard_id_);
-            si->SparsePullAsync(&cntl, &req, &resp, done);
+            int64_t begin = butil::gettimeofday_us();
+            si->SparsePullAsync(&cntl, &req, &resp, [this, begin, step, done]() {
+                int64_t end = butil::gettimeofday_us();
+                Metrics::Instance()->client_sparse_pull.Record(end - begin,
+                    req.ByteSizeLong(), cntl.response_attachment().size());
+                Tracer::Instance()->Record("sparse_pull_rpc", "rpc", begin, end, step, shard_id_, true);
+                done();
+            });
+        }
+    }
+
+    void EncodeSigns() {
+        if (!wire_option_.delta_signs) {
+            req.mutable_signs()->Add(signs_.begin(), signs_.end());
+            return;
+        }
+
+        // embeddings are responsed in sorted order, reorder call_sign_infos with them
+        std::vector<size_t> order(signs_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return signs_[a] < signs_[b];
+        });
+
+        std::vector<uint64_t> sorted_signs(signs_.size());
+        std::vector<std::pair<size_t, size_t>> sorted_infos(signs_.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            sorted_signs[i] = signs_[order[i]];
+            sorted_infos[i] = call_sign_infos[order[i]];
         }
+
+        EncodeDeltaSigns(sorted_signs.data(), sorted_signs.size(), req.mutable_signs());
+        call_sign_infos.swap(sorted_infos);
+    }
+
+    void PullLocal() {
+        SparseTable* table = GetDimTable(req.table_handle(), req.dim());
+
+        local_weights.resize(signs_.size() * req.dim());
+
+        std::vector<uint64_t> hot_signs;
+        uint32_t hot_version = table->PullLocal(signs_.data(), signs_.size(),
+                local_weights.data(), req.hot_version(), &hot_signs);
+
+        resp.set_table_handle(req.table_handle());
+        resp.set_dim(req.dim());
+        resp.set_hot_version(hot_version);
+        resp.mutable_hot_signs()->Add(hot_signs.begin(), hot_signs.end());
+    }
+
+private:
+    void Reset_(int table_handle, int shard_id, int dim, const SparseWireOption& wire_option) {
+        cntl.Reset();
+        req.Clear();
+        resp.Clear();
+        call_sign_infos.clear();
+        local_weights.clear();
+        signs_.clear();
+
+        shard_id_ = shard_id;
+        wire_option_ = wire_option;
+
+        req.set_table_handle(table_handle);
+        req.set_dim(dim);
+        req.set_delta_signs(wire_option.delta_signs);
+        req.set_value_encoding(wire_option.pull_encoding);
     }
 
 public:
@@ -69,36 +196,290 @@ public:
     SparsePullResponse resp;
 
     std::vector<std::pair<size_t, size_t>> call_sign_infos;
+    std::vector<float> local_weights;
 
 private:
     int shard_id_ = -1;
+    SparseWireOption wire_option_;
+    std::vector<uint64_t> signs_;
 };
 
-class SparsePushCall {
+// pull of all tables from one shard in one rpc, every table has a SparsePullCall
+// which only its req, resp and call_sign_infos are used.
+class SparseMultiPullCall {
 public:
-    SparsePushCall(int table_handle, int shard_id, int dim)
-        : shard_id_(shard_id) {
-        req.set_table_handle(table_handle);
-        req.set_dim(dim);
+    SparseMultiPullCall() {}
+
+    ~SparseMultiPullCall() {}
+
+    static SparseMultiPullCall* New(int shard_id) {
+        SparseMultiPullCall* call = butil::get_object<SparseMultiPullCall>();
+        CHECK(nullptr != call);
+
+        call->cntl.Reset();
+        call->req.Clear();
+        call->resp.Clear();
+        call->table_calls.clear();
+        call->sent_calls_.clear();
+        call->shard_id_ = shard_id;
+
+        return call;
+    }
+
+    // table calls are freed together
+    static void Free(SparseMultiPullCall* call) {
+        for (auto table_call : call->table_calls) {
+            SparsePullCall::Free(table_call);
+        }
+
+        butil::return_object(call);
+    }
+
+    int ShardId() const {
+        return shard_id_;
+    }
+
+    void Start(const tensornet::Callback& done) {
+        bool is_local = shard_id_ == PsCluster::Instance()->Rank();
+
+        for (auto call : table_calls) {
+            if (call->call_sign_infos.empty()) {
+                continue;
+            }
+
+            if (is_local) {
+                call->PullLocal();
+            } else {
+                call->EncodeSigns();
+                req.add_tables()->Swap(&call->req);
+            }
+
+            sent_calls_.push_back(call);
+        }
+
+        if (sent_calls_.empty() || is_local) {
+            done();
+        } else {
+            uint64_t step = 0;
+            for (auto& table_req : *req.mutable_tables()) {
+                step = SetTraceStep(&table_req);
+            }
+
+            const PsServerInterface* si =
+                PsCluster::Instance()->GetServer(shard_id_);
+            int64_t begin = butil::gettimeofday_us();
+            si->SparseMultiPullAsync(&cntl, &req, &resp, [this, begin, step, done]() {
+                int64_t end = butil::gettimeofday_us();
+                Metrics::Instance()->client_sparse_pull.Record(end - begin,
+                    req.ByteSizeLong(), cntl.response_attachment().size());
+                Tracer::Instance()->Record("sparse_multi_pull_rpc", "rpc", begin, end, step, shard_id_, true);
+                done();
+            });
+        }
+    }
+
+    // move responses of tables back to their calls, return the calls in the
+    // order their embeddings in response attachment
+    const std::vector<SparsePullCall*>& DispatchResponse() {
+        if (shard_id_ == PsCluster::Instance()->Rank()) {
+            return sent_calls_;
+        }
+
+        CHECK_EQ(resp.tables_size(), sent_calls_.size());
+
+        for (size_t i = 0; i < sent_calls_.size(); ++i) {
+            sent_calls_[i]->resp.Swap(resp.mutable_tables(i));
+        }
+
+        return sent_calls_;
     }
 
+public:
+    brpc::Controller cntl;
+    SparseMultiPullRequest req;
+    SparseMultiPullResponse resp;
+
+    std::vector<SparsePullCall*> table_calls;
+
+private:
+    int shard_id_ = -1;
+    std::vector<SparsePullCall*> sent_calls_;
+};
+
+// pooled as SparsePullCall
+class SparsePushCall {
+public:
+    SparsePushCall() {}
+
     ~SparsePushCall() {}
 
+    static SparsePushCall* New(int table_handle, int shard_id, int dim,
+                               const SparseWireOption& wire_option) {
+        SparsePushCall* call = butil::get_object<SparsePushCall>();
+        CHECK(nullptr != call);
+
+        call->Reset_(table_handle, shard_id, dim, wire_option);
+        return call;
+    }
+
+    static void Free(SparsePushCall* call) {
+        butil::return_object(call);
+    }
+
     void AddRequestGrad(const SparsePushSignInfo& sign_info, const float* grad_vec, int dim) {
-        butil::IOBuf &buf = cntl.request_attachment();
-        buf.append(&sign_info, sizeof(sign_info));
-        buf.append(grad_vec, dim * sizeof(float));
+        CHECK_EQ(dim, dim_);
+
+        if (wire_option_.grad_threshold > 0) {
+            bool significant = false;
+            for (int i = 0; i < dim; ++i) {
+                if (std::fabs(grad_vec[i]) >= wire_option_.grad_threshold) {
+                    significant = true;
+                    break;
+                }
+            }
+
+            if (!significant) {
+                return;
+            }
+        }
+
+        sign_infos_.push_back(sign_info);
+
+        // gradients to self shard are applied before op done, no need to copy them
+        if (is_local_) {
+            local_grads_.push_back(grad_vec);
+        } else {
+            grads_.insert(grads_.end(), grad_vec, grad_vec + dim);
+        }
+    }
+
+    bool Empty() const {
+        return sign_infos_.empty();
+    }
+
+    int ShardId() const {
+        return shard_id_;
     }
 
+    // NOTE, push to self shard is done synchronously, gradients added must be alive
+    // until Start return.
     void Start(const tensornet::Callback& done) {
-        butil::IOBuf &buf = cntl.request_attachment();
-        if (buf.size() <= 0) {
+        if (sign_infos_.empty()) {
+            done();
+        } else if (is_local_) {
+            PushLocal();
             done();
         } else {
+            Encode();
+
+            uint64_t step = SetTraceStep(&req);
+
             const PsServerInterface* si =
                 PsCluster::Instance()->GetServer(shard_id_);
-            si->SparsePushAsync(&cntl, &req, &resp, done);
+            int64_t begin = butil::gettimeofday_us();
+            si->SparsePushAsync(&cntl, &req, &resp, [this, begin, step, done]() {
+                int64_t end = butil::gettimeofday_us();
+                Metrics::Instance()->client_sparse_push.Record(end - begin,
+                    req.ByteSizeLong() + cntl.request_attachment().size(), 0);
+                Tracer::Instance()->Record("sparse_push_rpc", "rpc", begin, end, step, shard_id_, true);
+                done();
+            });
+        }
+    }
+
+private:
+    void Reset_(int table_handle, int shard_id, int dim, const SparseWireOption& wire_option) {
+        cntl.Reset();
+        req.Clear();
+        resp.Clear();
+        sign_infos_.clear();
+        grads_.clear();
+        local_grads_.clear();
+
+        shard_id_ = shard_id;
+        dim_ = dim;
+        is_local_ = shard_id == PsCluster::Instance()->Rank();
+        wire_option_ = wire_option;
+        table_ = GetDimTable(table_handle, dim);
+
+        req.set_table_handle(table_handle);
+        req.set_dim(dim);
+        req.set_delta_signs(wire_option.delta_signs);
+        req.set_value_encoding(wire_option.push_encoding);
+    }
+
+public:
+    bool IsLocal() const {
+        return is_local_;
+    }
+
+    void PushLocal() {
+        size_t sign_num = sign_infos_.size();
+
+        std::vector<uint64_t> signs(sign_num);
+        std::vector<SparseGradInfo> grad_infos(sign_num);
+
+        for (size_t i = 0; i < sign_num; ++i) {
+            signs[i] = sign_infos_[i].sign;
+            // gradients are only read by optimizer
+            grad_infos[i].grad = const_cast<float*>(local_grads_[i]);
+            grad_infos[i].batch_show = sign_infos_[i].batch_show;
         }
+
+        table_->PushLocal(signs.data(), grad_infos.data(), sign_num);
+    }
+
+    // signs into req and gradients into request attachment
+    void Encode() {
+        butil::IOBuf &buf = cntl.request_attachment();
+        size_t sign_num = sign_infos_.size();
+
+        req.mutable_batch_shows()->Reserve(sign_num);
+
+        // delta coded signs must be in sign order, otherwise gradients are sent in
+        // order of server kernel block, so that server applies them block by block
+        // reading the request in sequence
+        std::vector<size_t> order(sign_num);
+        std::iota(order.begin(), order.end(), 0);
+
+        if (!wire_option_.delta_signs) {
+            std::vector<int> block_ids(sign_num);
+            for (size_t i = 0; i < sign_num; ++i) {
+                block_ids[i] = table_->BlockId(sign_infos_[i].sign);
+            }
+
+            std::stable_sort(order.begin(), order.end(), [&block_ids](size_t a, size_t b) {
+                return block_ids[a] < block_ids[b];
+            });
+
+            std::vector<float> sorted_grads(grads_.size());
+            req.mutable_signs()->Reserve(sign_num);
+            for (size_t i = 0; i < sign_num; ++i) {
+                const auto& sign_info = sign_infos_[order[i]];
+                req.add_signs(sign_info.sign);
+                req.add_batch_shows(sign_info.batch_show);
+                std::copy_n(grads_.data() + order[i] * dim_, dim_, sorted_grads.data() + i * dim_);
+            }
+
+            EncodeSparseValues(sorted_grads.data(), sorted_grads.size(), wire_option_.push_encoding, &buf);
+            return;
+        }
+
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return sign_infos_[a].sign < sign_infos_[b].sign;
+        });
+
+        std::vector<uint64_t> sorted_signs(sign_num);
+        std::vector<float> sorted_grads(grads_.size());
+        for (size_t i = 0; i < sign_num; ++i) {
+            const auto& sign_info = sign_infos_[order[i]];
+            sorted_signs[i] = sign_info.sign;
+            req.add_batch_shows(sign_info.batch_show);
+            std::copy_n(grads_.data() + order[i] * dim_, dim_, sorted_grads.data() + i * dim_);
+        }
+
+        EncodeDeltaSigns(sorted_signs.data(), sign_num, req.mutable_signs());
+        EncodeSparseValues(sorted_grads.data(), sorted_grads.size(), wire_option_.push_encoding, &buf);
     }
 
 public:
@@ -106,6 +487,106 @@ public:
     SparsePushRequest req;
     SparsePushResponse resp;
 
+private:
+    int shard_id_ = -1;
+    int dim_ = 0;
+    bool is_local_ = false;
+    SparseWireOption wire_option_;
+    SparseTable* table_ = nullptr;
+    std::vector<SparsePushSignInfo> sign_infos_;
+    std::vector<float> grads_;
+    std::vector<const float*> local_grads_;
+};
+
+// push of all dims of one table to one shard in one rpc, as SparseMultiPullCall
+class SparseMultiPushCall {
+public:
+    SparseMultiPushCall() {}
+
+    ~SparseMultiPushCall() {}
+
+    static SparseMultiPushCall* New(int shard_id) {
+        SparseMultiPushCall* call = butil::get_object<SparseMultiPushCall>();
+        CHECK(nullptr != call);
+
+        call->cntl.Reset();
+        call->req.Clear();
+        call->resp.Clear();
+        call->table_calls.clear();
+        call->shard_id_ = shard_id;
+
+        return call;
+    }
+
+    static void Free(SparseMultiPushCall* call) {
+        for (auto table_call : call->table_calls) {
+            SparsePushCall::Free(table_call);
+        }
+
+        butil::return_object(call);
+    }
+
+    bool Empty() const {
+        for (auto table_call : table_calls) {
+            if (!table_call->Empty()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    int ShardId() const {
+        return shard_id_;
+    }
+
+    // NOTE, same as SparsePushCall::Start
+    void Start(const tensornet::Callback& done) {
+        bool is_local = shard_id_ == PsCluster::Instance()->Rank();
+
+        for (auto call : table_calls) {
+            if (call->Empty()) {
+                continue;
+            }
+
+            if (is_local) {
+                call->PushLocal();
+            } else {
+                call->Encode();
+                req.add_tables()->Swap(&call->req);
+                cntl.request_attachment().append(call->cntl.request_attachment());
+            }
+        }
+
+        if (req.tables_size() == 0) {
+            done();
+            return;
+        }
+
+        uint64_t step = 0;
+        for (auto& table_req : *req.mutable_tables()) {
+            step = SetTraceStep(&table_req);
+        }
+
+        const PsServerInterface* si =
+            PsCluster::Instance()->GetServer(shard_id_);
+        int64_t begin = butil::gettimeofday_us();
+        si->SparseMultiPushAsync(&cntl, &req, &resp, [this, begin, step, done]() {
+            int64_t end = butil::gettimeofday_us();
+            Metrics::Instance()->client_sparse_push.Record(end - begin,
+                req.ByteSizeLong() + cntl.request_attachment().size(), 0);
+            Tracer::Instance()->Record("sparse_multi_push_rpc", "rpc", begin, end, step, shard_id_, true);
+            done();
+        });
+    }
+
+public:
+    brpc::Controller cntl;
+    SparseMultiPushRequest req;
+    SparseMultiPushResponse resp;
+
+    std::vector<SparsePushCall*> table_calls;
+
 private:
     int shard_id_ = -1;
 };
@@ -117,19 +598,11 @@ public:
         : var(t_var)
         , sign_value(value) 
         , out_tensor(out_tensor) {
-        const int64* feasign_vec = value->flat<int64>().data();
+        const uint64* feasign_vec = reinterpret_cast<const uint64*>(value->flat<int64>().data());
         int64* out_vec = out_tensor->flat<int64>().data();
 
-        std::map<uint64, size_t> sign_id_mapping;
-        for (int i = 0; i < value->NumElements(); ++i) {
-            const uint64 sign = (uint64)feasign_vec[i];
-            auto inserted = sign_id_mapping.insert({sign, sign_id_mapping.size()});
-            if (inserted.second) {
-                signs.push_back(sign);
-            }
-
-            out_vec[i] = inserted.first->second;
-        }
+        TraceSpan span("sparse_dedup", "worker");
+        DedupSigns(feasign_vec, value->NumElements(), &signs, out_vec);
 
         const Tensor* var_tensor = var->tensor();
 
@@ -142,6 +615,14 @@ public:
         return var_tensor->shape().dim_size(1);
     }
 
+    // pulled weights of signs[sign_index] are written here
+    float* Row(size_t sign_index) {
+        return var->tensor()->matrix<float>().data() + sign_index * VarDim();
+    }
+
+    // variable is ready once all weights are written
+    void Finish() {}
+
 public:
     // sparse feature column embedding variable.
     // shape: [max_var_count, emb_dim]
@@ -160,124 +641,762 @@ public:
     std::vector<uint64> signs;
 };
 
-class SparseTablePullKernel : public AsyncOpKernel {
-public:
-    explicit SparseTablePullKernel(OpKernelConstruction* c)
-        : AsyncOpKernel(c) {
-        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
-        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
-    }
+static Status GetPullVarInfos(OpKernelContext* c, int N,
+                              std::vector<SparsePullVarInfo>* var_infos) {
+    for (int i = 0; i < N; i++) {
+        const ResourceHandle& handle = HandleFromInput(c, i);
 
-    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
-        OP_REQUIRES_ASYNC(c, c->num_inputs() == N_ * 2,
-                          errors::InvalidArgument("SparseTable pull num_inputs:",
-                                                  c->num_inputs(),
-                                                  " not equal:", N_ * 2),
-                          done);
-        std::vector<SparsePullVarInfo> var_infos;
+        Var* variable = nullptr;
+        TF_RETURN_IF_ERROR(LookupResource<Var, false>(c, handle, &variable));
+        CHECK(variable);
 
-        for (int i = 0; i < N_; i++) {
-            const ResourceHandle& handle = HandleFromInput(c, i);
+        const Tensor* var_tensor = variable->tensor();
+        Tensor* out_tensor = nullptr;
+        const Tensor* sign_value = &c->input(N + i);
 
-            Var* variable = nullptr;
-            const auto status = LookupResource<Var, false>(c, handle, &variable);
+        TF_RETURN_IF_ERROR(c->allocate_output(i, sign_value->shape(), &out_tensor));
 
-            OP_REQUIRES_OK_ASYNC(c, status, done);
-            CHECK(variable);
+        if (!TensorShapeUtils::IsMatrix(var_tensor->shape())) {
+            return errors::InvalidArgument(
+                    "sparse pull variable must Matrix(sign_id_cnt, dim), saw: ",
+                    var_tensor->shape().DebugString());
+        }
 
-            const Tensor* var_tensor = variable->tensor();
-            Tensor* out_tensor = nullptr;
-            const Tensor* sign_value = &c->input(N_ + i);
+        var_infos->emplace_back(variable, sign_value, out_tensor);
+    }
 
-            OP_REQUIRES_OK_ASYNC(c, c->allocate_output(i, sign_value->shape(), &out_tensor), done);
+    return Status::OK();
+}
 
-            OP_REQUIRES_ASYNC(
-                c, TensorShapeUtils::IsMatrix(var_tensor->shape()),
-                errors::InvalidArgument(
-                    "sparse pull variable must Matrix(sign_id_cnt, dim), saw: ",
-                    var_tensor->shape().DebugString()),
-                done);
+template <typename VarInfo>
+static void PopulatePulledVariable(std::vector<VarInfo>& var_infos,
+                                   const std::vector<std::pair<size_t, size_t>>& call_sign_infos,
+                                   const SparsePullResponse& resp, butil::IOBuf& emb_buf,
+                                   EmbeddingCache* cache) {
+    int dim = resp.dim();
+    SparseValueEncoding encoding = resp.value_encoding();
 
-            var_infos.emplace_back(variable, sign_value, out_tensor);
-        }
+    for (size_t i = 0; i < call_sign_infos.size(); i++) {
+        size_t var_index = call_sign_infos[i].first;
+        size_t sign_index = call_sign_infos[i].second;
 
-        CHECK_GT(var_infos.size(), 0);
+        CHECK_LT(var_index, var_infos.size());
 
-        int dim = var_infos[0].VarDim();
+        auto& var_info = var_infos[var_index];
+        CHECK_EQ(dim, var_info.VarDim());
 
-        for (size_t i = 0; i < var_infos.size(); i++) {
-            CHECK_EQ(dim, var_infos[i].VarDim());
+        float* w = var_info.Row(sign_index);
+        CHECK(DecodeSparseValues(&emb_buf, dim, encoding, w));
+
+        if (nullptr != cache) {
+            cache->Put(var_info.signs[sign_index], w);
         }
+    }
+}
 
-        PsCluster* cluster = PsCluster::Instance();
-        OP_REQUIRES_ASYNC(
-            c, true == cluster->IsInitialized(),
-            errors::InvalidArgument("cluster instance not initialized:"), done);
+template <typename VarInfo>
+static void PopulateLocalPulledVariable(std::vector<VarInfo>& var_infos,
+                                        const SparsePullCall& call, EmbeddingCache* cache) {
+    int dim = call.resp.dim();
 
-        std::vector<SparsePullCall*> calls;
+    for (size_t i = 0; i < call.call_sign_infos.size(); i++) {
+        size_t var_index = call.call_sign_infos[i].first;
+        size_t sign_index = call.call_sign_infos[i].second;
 
-        for (size_t shard_id = 0; shard_id < cluster->RankNum(); shard_id++) {
-            calls.emplace_back(
-                new SparsePullCall(table_handle_, shard_id, dim));
-        }
+        CHECK_LT(var_index, var_infos.size());
 
-        for (size_t var_index = 0; var_index < var_infos.size(); var_index++) {
-            for (size_t sign_index = 0; sign_index < var_infos[var_index].signs.size(); sign_index++) {
-                const uint64 sign = var_infos[var_index].signs[sign_index];
+        auto& var_info = var_infos[var_index];
+        CHECK_EQ(dim, var_info.VarDim());
 
-                int shard_id = sign % cluster->RankNum();
-                calls[shard_id]->AddRequestSign(var_index, sign_index, sign);
-            }
+        float* w = var_info.Row(sign_index);
+        std::copy_n(call.local_weights.data() + i * dim, dim, w);
+
+        if (nullptr != cache) {
+            cache->Put(var_info.signs[sign_index], w);
         }
+    }
+}
 
-        Semaphore semaphore(calls.size());
+static void UpdateHotKeys(HotKeyCombiner* hot_keys, int shard_id, const SparsePullResponse& resp) {
+    if (nullptr == hot_keys || resp.hot_version() == hot_keys->Version(shard_id)) {
+        return;
+    }
 
-        for (auto& call : calls) {
-            call->Start([this, call, &var_infos, &semaphore]() {
-                PopulatePulledVariable_(var_infos, call->call_sign_infos,
-                    call->resp, call->cntl.response_attachment());
-                semaphore.Notify();
-                delete call;
-            });
-        }
+    const auto& hot_signs = resp.hot_signs();
+    hot_keys->Update(shard_id, resp.hot_version(),
+                     std::vector<uint64_t>(hot_signs.begin(), hot_signs.end()));
+}
+
+// state of one pull op shared by all its rpc, the last finished rpc complete the op
+// so that no TF thread is blocked waiting for rpc.
+template <typename VarInfo>
+class SparsePullCallGroup {
+public:
+    SparsePullCallGroup(std::vector<VarInfo>&& var_infos, int pending,
+                        AsyncOpKernel::DoneCallback done)
+        : var_infos_(std::move(var_infos))
+        , pending_(pending)
+        , done_(std::move(done)) {
+        CHECK_GT(pending, 0);
+    }
 
-        semaphore.WaitForSemaphore();
+    std::vector<VarInfo>& VarInfos() {
+        return var_infos_;
+    }
 
-        done();
+    // called by every finished rpc, group is deleted after the last one
+    void Notify() {
+        if (1 == pending_.fetch_sub(1, std::memory_order_acq_rel)) {
+            for (auto& var_info : var_infos_) {
+                var_info.Finish();
+            }
 
-        return;
+            done_();
+            delete this;
+        }
     }
 
 private:
-    void PopulatePulledVariable_(std::vector<SparsePullVarInfo>& var_infos,
-                                   const std::vector<std::pair<size_t, size_t>>& call_sign_infos,
-                                   const SparsePullResponse& resp, butil::IOBuf& emb_buf) {
-        int dim = resp.dim();
+    ~SparsePullCallGroup() = default;
+
+private:
+    std::vector<VarInfo> var_infos_;
+    std::atomic<int> pending_;
+    AsyncOpKernel::DoneCallback done_;
+};
 
-        for (size_t i = 0; i < call_sign_infos.size(); i++) {
-            size_t var_index = call_sign_infos[i].first;
-            size_t sign_index = call_sign_infos[i].second;
+// pull weights of signs of var_infos into their rows, done is called in the thread
+// of the last finished rpc
+template <typename VarInfo>
+static void PullSparseVarInfos(int table_handle, int dim, std::vector<VarInfo>&& var_infos,
+                               AsyncOpKernel::DoneCallback done) {
+    PsCluster* cluster = PsCluster::Instance();
+    const SignRouter& router = cluster->Router();
 
-            CHECK_LT(var_index, var_infos.size());
+    SparseTable* table = GetDimTable(table_handle, dim);
+    const SparseWireOption& wire_option = table->WireOption();
+    EmbeddingCache* cache = table->Cache();
+    HotKeyCombiner* hot_keys = table->HotKeys();
 
-            auto& var_info = var_infos[var_index];
-            Tensor* var_tensor = var_info.var->tensor();
-            CHECK_EQ(dim, var_info.VarDim());
+    std::vector<SparsePullCall*> calls;
 
-            float* w_matrix = var_tensor->matrix<float>().data();
+    for (size_t shard_id = 0; shard_id < cluster->RankNum(); shard_id++) {
+        calls.emplace_back(
+            SparsePullCall::New(table_handle, shard_id, dim, wire_option));
 
-            size_t emb_size = sizeof(float) * dim;
-            CHECK_EQ(emb_size, emb_buf.cutn(w_matrix + sign_index * dim, emb_size));
+        if (nullptr != hot_keys) {
+            calls.back()->req.set_hot_version(hot_keys->Version(shard_id));
         }
     }
 
-private:
-    int table_handle_;
-    int N_;
-};
+    for (size_t var_index = 0; var_index < var_infos.size(); var_index++) {
+        for (size_t sign_index = 0; sign_index < var_infos[var_index].signs.size(); sign_index++) {
+            const uint64 sign = var_infos[var_index].signs[sign_index];
 
-REGISTER_KERNEL_BUILDER(Name("SparseTablePull").Device(DEVICE_CPU),
-                        SparseTablePullKernel);
+            if (nullptr != cache && cache->Get(sign, var_infos[var_index].Row(sign_index))) {
+                continue;
+            }
+
+            int shard_id = router.Rank(sign);
+            calls[shard_id]->AddRequestSign(var_index, sign_index, sign);
+        }
+    }
+
+    // NOTE, group may be finished and deleted by the last Start
+    auto* group = new SparsePullCallGroup<VarInfo>(std::move(var_infos), calls.size(),
+                                                   std::move(done));
+
+    for (auto& call : calls) {
+        call->Start([call, cache, hot_keys, group]() {
+            if (call->IsLocal()) {
+                PopulateLocalPulledVariable(group->VarInfos(), *call, cache);
+            } else {
+                PopulatePulledVariable(group->VarInfos(), call->call_sign_infos,
+                    call->resp, call->cntl.response_attachment(), cache);
+            }
+
+            if (!call->call_sign_infos.empty()) {
+                UpdateHotKeys(hot_keys, call->ShardId(), call->resp);
+            }
+
+            SparsePullCall::Free(call);
+            group->Notify();
+        });
+    }
+}
+
+// pull vars of several tables or dims, var i is of table var_handles[i]. signs of all
+// tables going to one shard are sent in one rpc, every (table, dim) of them has its
+// own SparsePullCall in it.
+template <typename VarInfo>
+static void MultiPullSparseVarInfos(const std::vector<int>& var_handles,
+                                    std::vector<VarInfo>&& var_infos,
+                                    AsyncOpKernel::DoneCallback done) {
+    PsCluster* cluster = PsCluster::Instance();
+    const SignRouter& router = cluster->Router();
+
+    CHECK_EQ(var_handles.size(), var_infos.size());
+
+    // (table, dim) in order of first appearance
+    std::vector<std::pair<int, int>> keys;
+    std::vector<size_t> var_table_index(var_infos.size());
+
+    for (size_t i = 0; i < var_infos.size(); i++) {
+        std::pair<int, int> key(var_handles[i], var_infos[i].VarDim());
+        auto iter = std::find(keys.begin(), keys.end(), key);
+        var_table_index[i] = iter - keys.begin();
+
+        if (iter == keys.end()) {
+            keys.push_back(key);
+        }
+    }
+
+    std::vector<SparseTable*> tables;
+    for (const auto& key : keys) {
+        tables.push_back(GetDimTable(key.first, key.second));
+    }
+
+    std::vector<SparseMultiPullCall*> calls;
+
+    for (size_t shard_id = 0; shard_id < cluster->RankNum(); shard_id++) {
+        calls.emplace_back(SparseMultiPullCall::New(shard_id));
+
+        for (size_t t = 0; t < keys.size(); t++) {
+            auto* call = SparsePullCall::New(keys[t].first, shard_id, keys[t].second,
+                                             tables[t]->WireOption());
+
+            if (nullptr != tables[t]->HotKeys()) {
+                call->req.set_hot_version(tables[t]->HotKeys()->Version(shard_id));
+            }
+
+            calls.back()->table_calls.push_back(call);
+        }
+    }
+
+    for (size_t var_index = 0; var_index < var_infos.size(); var_index++) {
+        size_t t = var_table_index[var_index];
+        EmbeddingCache* cache = tables[t]->Cache();
+
+        for (size_t sign_index = 0; sign_index < var_infos[var_index].signs.size(); sign_index++) {
+            const uint64 sign = var_infos[var_index].signs[sign_index];
+
+            if (nullptr != cache && cache->Get(sign, var_infos[var_index].Row(sign_index))) {
+                continue;
+            }
+
+            int shard_id = router.Rank(sign);
+            calls[shard_id]->table_calls[t]->AddRequestSign(var_index, sign_index, sign);
+        }
+    }
+
+    auto* group = new SparsePullCallGroup<VarInfo>(std::move(var_infos), calls.size(),
+                                                   std::move(done));
+
+    for (auto& call : calls) {
+        call->Start([call, tables, keys, group]() {
+            for (auto table_call : call->DispatchResponse()) {
+                std::pair<int, int> key(table_call->resp.table_handle(), table_call->resp.dim());
+                size_t t = std::find(keys.begin(), keys.end(), key) - keys.begin();
+                CHECK_LT(t, tables.size());
+
+                if (table_call->IsLocal()) {
+                    PopulateLocalPulledVariable(group->VarInfos(), *table_call,
+                                                tables[t]->Cache());
+                } else {
+                    PopulatePulledVariable(group->VarInfos(), table_call->call_sign_infos,
+                        table_call->resp, call->cntl.response_attachment(), tables[t]->Cache());
+                }
+                UpdateHotKeys(tables[t]->HotKeys(), call->ShardId(), table_call->resp);
+            }
+
+            SparseMultiPullCall::Free(call);
+            group->Notify();
+        });
+    }
+}
+
+// pull vars of one table, vars of several dims of the table are pulled in one rpc
+// to every shard
+template <typename VarInfo>
+static void PullTableVarInfos(int table_handle, std::vector<VarInfo>&& var_infos,
+                              AsyncOpKernel::DoneCallback done) {
+    CHECK_GT(var_infos.size(), 0);
+
+    int dim = var_infos[0].VarDim();
+    bool same_dim = std::all_of(var_infos.begin(), var_infos.end(),
+        [dim](const VarInfo& var_info) { return var_info.VarDim() == dim; });
+
+    if (!same_dim) {
+        std::vector<int> var_handles(var_infos.size(), table_handle);
+        MultiPullSparseVarInfos(var_handles, std::move(var_infos), std::move(done));
+        return;
+    }
+
+    PullSparseVarInfos(table_handle, dim, std::move(var_infos), std::move(done));
+}
+
+class SparseTablePullKernel : public AsyncOpKernel {
+public:
+    explicit SparseTablePullKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        OP_REQUIRES_ASYNC(c, c->num_inputs() == N_ * 2,
+                          errors::InvalidArgument("SparseTable pull num_inputs:",
+                                                  c->num_inputs(),
+                                                  " not equal:", N_ * 2),
+                          done);
+        std::vector<SparsePullVarInfo> var_infos;
+        OP_REQUIRES_OK_ASYNC(c, GetPullVarInfos(c, N_, &var_infos), done);
+
+        CHECK_GT(var_infos.size(), 0);
+
+        PsCluster* cluster = PsCluster::Instance();
+        OP_REQUIRES_ASYNC(
+            c, true == cluster->IsInitialized(),
+            errors::InvalidArgument("cluster instance not initialized:"), done);
+
+        PullTableVarInfos(table_handle_, std::move(var_infos), std::move(done));
+    }
+
+private:
+    int table_handle_;
+    int N_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SparseTablePull").Device(DEVICE_CPU),
+                        SparseTablePullKernel);
+
+#if GOOGLE_CUDA
+// variable of the pull is on gpu, pulled weights are written into pinned rows and
+// copied into the first rows of the variable after all rpc are done.
+struct SparsePullGpuVarInfo : public SparsePullVarInfo {
+public:
+    SparsePullGpuVarInfo(SparsePullVarInfo&& var_info, const Tensor& t_rows)
+        : SparsePullVarInfo(std::move(var_info))
+        , rows(t_rows) {
+    }
+
+    float* Row(size_t sign_index) {
+        return rows.matrix<float>().data() + sign_index * VarDim();
+    }
+
+public:
+    // pinned host rows of signs, shape: [sign_count, emb_dim]
+    Tensor rows;
+};
+
+class SparseTablePullGpuKernel : public AsyncOpKernel {
+public:
+    explicit SparseTablePullGpuKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        OP_REQUIRES_ASYNC(c, c->num_inputs() == N_ * 2,
+                          errors::InvalidArgument("SparseTable pull num_inputs:",
+                                                  c->num_inputs(),
+                                                  " not equal:", N_ * 2),
+                          done);
+        std::vector<SparsePullVarInfo> var_infos;
+        OP_REQUIRES_OK_ASYNC(c, GetPullVarInfos(c, N_, &var_infos), done);
+
+        PsCluster* cluster = PsCluster::Instance();
+        OP_REQUIRES_ASYNC(
+            c, true == cluster->IsInitialized(),
+            errors::InvalidArgument("cluster instance not initialized:"), done);
+
+        std::vector<SparsePullGpuVarInfo> gpu_var_infos;
+        std::vector<Var*> vars;
+        std::vector<Tensor> rows;
+
+        for (auto& var_info : var_infos) {
+            Tensor t_rows;
+            TensorShape shape({(int64)var_info.signs.size(), var_info.VarDim()});
+            OP_REQUIRES_OK_ASYNC(c, AllocatePinnedTemp(c, shape, &t_rows), done);
+
+            vars.push_back(var_info.var);
+            rows.push_back(t_rows);
+            gpu_var_infos.emplace_back(std::move(var_info), t_rows);
+        }
+
+        // rows beyond the pulled signs are left as they are, same as on cpu
+        auto copy_to_vars = [c, vars, rows, done]() {
+            auto* group = new GpuCopyGroup(c, "sparse_pull_h2d", [c, done](const Status& status) {
+                OP_REQUIRES_OK_ASYNC(c, status, done);
+                done();
+            });
+
+            for (size_t i = 0; i < vars.size(); i++) {
+                group->ToDevice(rows[i], vars[i]->tensor()->Slice(0, rows[i].dim_size(0)));
+            }
+
+            group->Start();
+        };
+
+        PullTableVarInfos(table_handle_, std::move(gpu_var_infos), std::move(copy_to_vars));
+    }
+
+private:
+    int table_handle_;
+    int N_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SparseTablePull")
+                            .Device(DEVICE_GPU)
+                            .HostMemory("resources")
+                            .HostMemory("values")
+                            .HostMemory("mapped_values"),
+                        SparseTablePullGpuKernel);
+#endif // GOOGLE_CUDA
+
+enum SparseCombiner {
+    SC_NONE = 0,
+    SC_SUM = 1,
+    SC_MEAN = 2,
+    SC_SQRTN = 3,
+};
+
+static Status ParseSparseCombiner(const std::string& name, SparseCombiner* combiner) {
+    if (name == "none") {
+        *combiner = SC_NONE;
+    } else if (name == "sum") {
+        *combiner = SC_SUM;
+    } else if (name == "mean") {
+        *combiner = SC_MEAN;
+    } else if (name == "sqrtn") {
+        *combiner = SC_SQRTN;
+    } else {
+        return errors::InvalidArgument("unknown sparse combiner:", name);
+    }
+
+    return Status::OK();
+}
+
+// weight of a value pooled into a segment of count values
+static float SparseCombinerScale(SparseCombiner combiner, int64 count) {
+    if (combiner == SC_MEAN) {
+        return 1.0 / count;
+    } else if (combiner == SC_SQRTN) {
+        return 1.0 / std::sqrt((float)count);
+    }
+
+    return 1.0;
+}
+
+// one column of SparseTableGather. without combiner pulled weights of a sign are
+// written into output row of its first value then copied to the others, otherwise
+// they are kept for pooling into rows of segments.
+struct SparseGatherVarInfo {
+public:
+    SparseGatherVarInfo(const Tensor* t_value, const Tensor* t_segment_id, int64 t_num_segments,
+                        int t_dim, SparseCombiner t_combiner, Tensor* t_out)
+        : value(reinterpret_cast<const uint64*>(t_value->flat<int64>().data()))
+        , segment_id(t_segment_id->flat<int64>().data())
+        , value_num(t_value->NumElements())
+        , num_segments(t_num_segments)
+        , dim(t_dim)
+        , combiner(t_combiner)
+        , out(t_out->matrix<float>().data()) {
+        ids.resize(value_num);
+        TraceSpan span("sparse_dedup", "worker");
+        DedupSigns(value, value_num, &signs, ids.data());
+
+        if (combiner == SC_NONE) {
+            first_values.reserve(signs.size());
+            for (size_t i = 0; i < value_num; ++i) {
+                if (ids[i] == first_values.size()) {
+                    first_values.push_back(i);
+                }
+            }
+        } else {
+            weights.resize(signs.size() * dim);
+        }
+    }
+
+    int VarDim() const {
+        return dim;
+    }
+
+    float* Row(size_t sign_index) {
+        if (combiner == SC_NONE) {
+            return out + first_values[sign_index] * dim;
+        }
+
+        return weights.data() + sign_index * dim;
+    }
+
+    void Finish() {
+        if (combiner == SC_NONE) {
+            for (size_t i = 0; i < value_num; ++i) {
+                size_t first = first_values[ids[i]];
+                if (first != i) {
+                    std::copy_n(out + first * dim, dim, out + i * dim);
+                }
+            }
+
+            return;
+        }
+
+        std::vector<int64> counts(num_segments, 0);
+        for (size_t i = 0; i < value_num; ++i) {
+            counts[segment_id[i]] += 1;
+        }
+
+        std::fill_n(out, num_segments * dim, 0);
+        for (size_t i = 0; i < value_num; ++i) {
+            int64 segment = segment_id[i];
+            float scale = SparseCombinerScale(combiner, counts[segment]);
+
+            const float* w = weights.data() + (size_t)ids[i] * dim;
+            float* o = out + segment * dim;
+            for (int k = 0; k < dim; ++k) {
+                o[k] += scale * w[k];
+            }
+        }
+    }
+
+public:
+    const uint64* value = nullptr;
+    const int64* segment_id = nullptr;
+    size_t value_num = 0;
+    int64 num_segments = 0;
+    int dim = 0;
+    SparseCombiner combiner = SC_NONE;
+
+    // output of shape [value_num, dim] without combiner, [num_segments, dim] otherwise
+    float* out = nullptr;
+
+    std::vector<uint64> signs;
+    std::vector<uint32> ids;
+    std::vector<size_t> first_values;
+    std::vector<float> weights;
+};
+
+static Status GetGatherVarInfos(OpKernelContext* c, int N, int dim, SparseCombiner combiner,
+                                std::vector<SparseGatherVarInfo>* var_infos) {
+    for (int i = 0; i < N; i++) {
+        const Tensor* value = &c->input(i);
+        const Tensor* segment_id = &c->input(N + i);
+        const Tensor& num_segments_tensor = c->input(2 * N + i);
+
+        if (!TensorShapeUtils::IsScalar(num_segments_tensor.shape())) {
+            return errors::InvalidArgument("sparse gather num_segments must be scalar, saw: ",
+                                           num_segments_tensor.shape().DebugString());
+        }
+
+        if (segment_id->NumElements() != value->NumElements()) {
+            return errors::InvalidArgument("sparse gather segment_ids size:",
+                                           segment_id->NumElements(), " not equal values size:",
+                                           value->NumElements());
+        }
+
+        int64 num_segments = num_segments_tensor.scalar<int64>()();
+        const int64* segment_vec = segment_id->flat<int64>().data();
+
+        if (combiner != SC_NONE) {
+            for (int64 j = 0; j < segment_id->NumElements(); ++j) {
+                if (segment_vec[j] < 0 || segment_vec[j] >= num_segments) {
+                    return errors::InvalidArgument("sparse gather segment_id:", segment_vec[j],
+                                                   " out of range:", num_segments);
+                }
+            }
+        }
+
+        int64 rows = combiner == SC_NONE ? value->NumElements() : num_segments;
+
+        Tensor* out = nullptr;
+        TF_RETURN_IF_ERROR(c->allocate_output(i, TensorShape({rows, dim}), &out));
+
+        var_infos->emplace_back(value, segment_id, num_segments, dim, combiner, out);
+    }
+
+    return Status::OK();
+}
+
+// pull embeddings of values and write them straight into dense outputs, optionally
+// pooled by segment, no variable is needed.
+class SparseTableGatherKernel : public AsyncOpKernel {
+public:
+    explicit SparseTableGatherKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        std::string combiner;
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+        OP_REQUIRES_OK(c, c->GetAttr("dim", &dim_));
+        OP_REQUIRES_OK(c, c->GetAttr("combiner", &combiner));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+        OP_REQUIRES_OK(c, ParseSparseCombiner(combiner, &combiner_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        OP_REQUIRES_ASYNC(c, c->num_inputs() == N_ * 3,
+                          errors::InvalidArgument("SparseTable gather num_inputs:",
+                                                  c->num_inputs(),
+                                                  " not equal:", N_ * 3),
+                          done);
+
+        PsCluster* cluster = PsCluster::Instance();
+        OP_REQUIRES_ASYNC(
+            c, true == cluster->IsInitialized(),
+            errors::InvalidArgument("cluster instance not initialized:"), done);
+
+        SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle_);
+        OP_REQUIRES_ASYNC(
+            c, nullptr != table->DimTable(dim_),
+            errors::InvalidArgument("SparseTable gather dim:", dim_,
+                                    " not in table dims, first dim:", table->Dim()), done);
+
+        std::vector<SparseGatherVarInfo> var_infos;
+        OP_REQUIRES_OK_ASYNC(c, GetGatherVarInfos(c, N_, dim_, combiner_, &var_infos), done);
+
+        PullSparseVarInfos(table_handle_, dim_, std::move(var_infos), std::move(done));
+    }
+
+private:
+    int table_handle_;
+    int dim_;
+    SparseCombiner combiner_;
+    int N_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SparseTableGather").Device(DEVICE_CPU),
+                        SparseTableGatherKernel);
+
+// pull variables of several tables, signs of all tables going to one shard are
+// sent in one rpc
+class SparseTableMultiPullKernel : public AsyncOpKernel {
+public:
+    explicit SparseTableMultiPullKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handles", &table_handles_));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+        OP_REQUIRES(c, (int)table_handles_.size() == N_,
+                    errors::InvalidArgument("SparseTable multi pull table_handles size:",
+                                            table_handles_.size(), " not equal:", N_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        OP_REQUIRES_ASYNC(c, c->num_inputs() == N_ * 2,
+                          errors::InvalidArgument("SparseTable multi pull num_inputs:",
+                                                  c->num_inputs(),
+                                                  " not equal:", N_ * 2),
+                          done);
+        std::vector<SparsePullVarInfo> var_infos;
+        OP_REQUIRES_OK_ASYNC(c, GetPullVarInfos(c, N_, &var_infos), done);
+
+        PsCluster* cluster = PsCluster::Instance();
+        OP_REQUIRES_ASYNC(
+            c, true == cluster->IsInitialized(),
+            errors::InvalidArgument("cluster instance not initialized:"), done);
+
+        MultiPullSparseVarInfos(table_handles_, std::move(var_infos), std::move(done));
+    }
+
+private:
+    std::vector<int> table_handles_;
+    int N_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SparseTableMultiPull").Device(DEVICE_CPU),
+                        SparseTableMultiPullKernel);
+
+// pull embeddings into worker embedding cache without waiting for them, so that
+// pulling of next batch overlap with computing of current batch.
+class SparseTablePrefetchKernel : public AsyncOpKernel {
+public:
+    explicit SparseTablePrefetchKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        PsCluster* cluster = PsCluster::Instance();
+        const SignRouter& router = cluster->Router();
+        OP_REQUIRES_ASYNC(
+            c, true == cluster->IsInitialized(),
+            errors::InvalidArgument("cluster instance not initialized:"), done);
+
+        SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle_);
+        EmbeddingCache* cache = table->Cache();
+        OP_REQUIRES_ASYNC(
+            c, nullptr != cache,
+            errors::InvalidArgument("sparse table prefetch need cache enabled, table:",
+                                    table_handle_), done);
+
+        size_t total = 0;
+        for (int i = 0; i < N_; i++) {
+            total += c->input(i).NumElements();
+        }
+
+        // signs are shared by all rpc of this prefetch, sign_index of a call index it
+        auto signs = std::make_shared<std::vector<uint64_t>>();
+        signs->reserve(total);
+
+        OpenHashMap<uint64, bool> seen(total);
+
+        for (int i = 0; i < N_; i++) {
+            const int64* feasign_vec = c->input(i).flat<int64>().data();
+
+            for (int j = 0; j < c->input(i).NumElements(); ++j) {
+                uint64 sign = (uint64)feasign_vec[j];
+                if (seen.insert(sign, true).second && !cache->Contains(sign)) {
+                    signs->push_back(sign);
+                }
+            }
+        }
+
+        int dim = table->Dim();
+        std::vector<SparsePullCall*> calls;
+
+        for (size_t shard_id = 0; shard_id < cluster->RankNum(); shard_id++) {
+            calls.emplace_back(
+                SparsePullCall::New(table_handle_, shard_id, dim, table->WireOption()));
+        }
+
+        for (size_t sign_index = 0; sign_index < signs->size(); sign_index++) {
+            uint64_t sign = (*signs)[sign_index];
+            calls[router.Rank(sign)]->AddRequestSign(0, sign_index, sign);
+        }
+
+        for (auto& call : calls) {
+            call->Start([call, cache, signs]() {
+                const SparsePullResponse& resp = call->resp;
+                butil::IOBuf& emb_buf = call->cntl.response_attachment();
+                std::vector<float> w(resp.dim());
+
+                for (size_t i = 0; i < call->call_sign_infos.size(); ++i) {
+                    const auto& sign_info = call->call_sign_infos[i];
+
+                    if (call->IsLocal()) {
+                        cache->Put((*signs)[sign_info.second],
+                                   call->local_weights.data() + i * w.size());
+                        continue;
+                    }
+
+                    CHECK(DecodeSparseValues(&emb_buf, w.size(), resp.value_encoding(), w.data()));
+                    cache->Put((*signs)[sign_info.second], w.data());
+                }
+
+                SparsePullCall::Free(call);
+            });
+        }
+
+        done();
+    }
+
+private:
+    int table_handle_;
+    int N_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SparseTablePrefetch").Device(DEVICE_CPU),
+                        SparseTablePrefetchKernel);
 
 struct SparsePushVarInfo {
 public:
@@ -287,16 +1406,17 @@ public:
 
         const int64* feasign_vec = value->flat<int64>().data();
 
-        std::map<uint64, int> sign_id_mapping;
+        OpenHashMap<uint64, uint32> sign_id_mapping(value->NumElements());
+        virtual_sign_infos.reserve(value->NumElements());
+
         for (int i = 0; i < value->NumElements(); ++i) {
             uint64 sign = (uint64)feasign_vec[i];
-            auto ret = sign_id_mapping.insert({sign, sign_id_mapping.size()});
+            auto ret = sign_id_mapping.insert(sign, virtual_sign_infos.size());
 
             if (ret.second) {
                 virtual_sign_infos.emplace_back(sign, 1);
             } else {
-                auto iter = ret.first;
-                virtual_sign_infos[iter->second].batch_show += 1;
+                virtual_sign_infos[*ret.first].batch_show += 1;
             }
         }
     }
@@ -312,6 +1432,290 @@ public:
     std::vector<SparsePushSignInfo> virtual_sign_infos;
 };
 
+// the same sign of different columns is pushed once, with gradients and shows
+// summed as it is done for the same sign in one column
+static void MergePushVarInfos(const std::vector<SparsePushVarInfo>& var_infos, int dim,
+                              std::vector<SparsePushSignInfo>* sign_infos,
+                              std::vector<float>* grads) {
+    size_t total = 0;
+    for (const auto& var_info : var_infos) {
+        total += var_info.virtual_sign_infos.size();
+    }
+
+    OpenHashMap<uint64, uint32> sign_ids(total);
+    sign_infos->reserve(total);
+    grads->reserve(total * dim);
+
+    for (const auto& var_info : var_infos) {
+        // NOTE, tensorfow use RowMajor layout
+        const float* grad_matrix = var_info.grad->matrix<float>().data();
+
+        for (size_t i = 0; i < var_info.virtual_sign_infos.size(); ++i) {
+            const auto& sign_info = var_info.virtual_sign_infos[i];
+            const float* grad = grad_matrix + dim * i;
+
+            auto ret = sign_ids.insert(sign_info.sign, sign_infos->size());
+            if (ret.second) {
+                sign_infos->push_back(sign_info);
+                grads->insert(grads->end(), grad, grad + dim);
+            } else {
+                (*sign_infos)[*ret.first].batch_show += sign_info.batch_show;
+
+                float* merged = grads->data() + (size_t)*ret.first * dim;
+                for (int k = 0; k < dim; ++k) {
+                    merged[k] += grad[k];
+                }
+            }
+        }
+    }
+}
+
+// gradients of distinct signs of one dim going to be pushed, host_* keep gradients
+// aggregated from ranks of the host and hot_* combined gradients of hot signs until
+// the calls are started, calls to self shard only keep pointers to them.
+struct SparsePushGrads {
+    const SparsePushSignInfo* sign_infos = nullptr;
+    const float* grads = nullptr;
+    size_t sign_num = 0;
+
+    std::vector<SparsePushSignInfo> host_sign_infos;
+    std::vector<float> host_grads;
+
+    std::vector<SparsePushSignInfo> hot_sign_infos;
+    std::vector<float> hot_grads;
+};
+
+// return false if gradients of the host are pushed by another rank
+static bool AggregateSparsePushGrads(int table_handle, int dim, SparsePushGrads* push) {
+    SparseTable* table = GetDimTable(table_handle, dim);
+
+    // cached embeddings miss one more update from now on
+    if (nullptr != table->Cache()) {
+        table->Cache()->NextStep();
+    }
+
+    // gradients of all ranks of the host are pushed once by the host leader
+    HostAggregator* aggregator = HostAggregator::Instance();
+    if (!aggregator->Enabled()) {
+        return true;
+    }
+
+    push->host_sign_infos.assign(push->sign_infos, push->sign_infos + push->sign_num);
+    push->host_grads.assign(push->grads, push->grads + push->sign_num * dim);
+
+    if (!aggregator->AggregateSparse(table_handle, dim, &push->host_sign_infos, &push->host_grads)) {
+        return false;
+    }
+
+    push->sign_infos = push->host_sign_infos.data();
+    push->grads = push->host_grads.data();
+    push->sign_num = push->host_sign_infos.size();
+
+    return true;
+}
+
+// add combined gradients of hot signs in push to calls of their shards
+static void AddHotPushGrads(int dim, const SparsePushGrads& push,
+                            std::vector<SparsePushCall*>* calls) {
+    const SignRouter& router = PsCluster::Instance()->Router();
+
+    for (size_t i = 0; i < push.hot_sign_infos.size(); i++) {
+        int shard_id = router.Rank(push.hot_sign_infos[i].sign);
+        (*calls)[shard_id]->AddRequestGrad(push.hot_sign_infos[i],
+                                           push.hot_grads.data() + i * dim, dim);
+    }
+}
+
+// one call for every shard with gradients of signs routed to it, push must outlive
+// start of the calls
+static std::vector<SparsePushCall*> NewSparsePushCalls(int table_handle, int dim,
+                                                       SparsePushGrads* push) {
+    std::vector<SparsePushCall*> calls;
+    PsCluster* cluster = PsCluster::Instance();
+    const SignRouter& router = cluster->Router();
+
+    SparseTable* table = GetDimTable(table_handle, dim);
+    const SparseWireOption& wire_option = table->WireOption();
+
+    for (size_t shard_id = 0; shard_id < cluster->RankNum(); shard_id++) {
+        calls.emplace_back(
+            SparsePushCall::New(table_handle, shard_id, dim, wire_option));
+    }
+
+    HotKeyCombiner* hot_keys = table->HotKeys();
+    std::shared_ptr<const HotKeySet> hot_set;
+    if (nullptr != hot_keys) {
+        hot_set = hot_keys->HotSet();
+    }
+
+    for (size_t sign_index = 0; sign_index < push->sign_num; sign_index++) {
+        const auto& sign_info = push->sign_infos[sign_index];
+        const float* grad = push->grads + dim * sign_index;
+
+        // gradients of hot signs are combined and pushed later
+        if (hot_set && hot_set->count(sign_info.sign)) {
+            hot_keys->Add(sign_info, grad);
+            continue;
+        }
+
+        int shard_id = router.Rank(sign_info.sign);
+        calls[shard_id]->AddRequestGrad(sign_info, grad, dim);
+    }
+
+    if (nullptr != hot_keys && hot_keys->NextPush(&push->hot_sign_infos, &push->hot_grads)) {
+        AddHotPushGrads(dim, *push, &calls);
+    }
+
+    return calls;
+}
+
+template <typename Call>
+static void StartSparsePushCalls(const std::vector<Call*>& calls) {
+    PushWindow* window = PushWindow::Instance();
+
+    for (auto& call : calls) {
+        if (call->Empty()) {
+            Call::Free(call);
+            continue;
+        }
+
+        // backpressure, wait here if too many pushes to this shard in flight
+        window->Acquire(call->ShardId());
+
+        call->Start([call, window]() {
+            window->Release(call->ShardId());
+            Call::Free(call);
+        });
+    }
+}
+
+// push gradients of distinct signs to their shards, grads are only read before
+// return, the op is done without waiting for rpc
+static void PushSparseGrads(int table_handle, int dim, const SparsePushSignInfo* sign_infos,
+                            const float* grads, size_t sign_num) {
+    SparsePushGrads push;
+    push.sign_infos = sign_infos;
+    push.grads = grads;
+    push.sign_num = sign_num;
+
+    if (!AggregateSparsePushGrads(table_handle, dim, &push)) {
+        return;
+    }
+
+    StartSparsePushCalls(NewSparsePushCalls(table_handle, dim, &push));
+}
+
+void FlushHotKeyPushes() {
+    PsCluster* cluster = PsCluster::Instance();
+
+    for (SparseTable* root : SparseTableRegistry::Instance()->Tables()) {
+        for (int dim : root->Dims()) {
+            SparseTable* table = root->DimTable(dim);
+            HotKeyCombiner* hot_keys = table->HotKeys();
+
+            SparsePushGrads push;
+            if (nullptr == hot_keys || !hot_keys->Flush(&push.hot_sign_infos, &push.hot_grads)) {
+                continue;
+            }
+
+            std::vector<SparsePushCall*> calls;
+            for (size_t shard_id = 0; shard_id < cluster->RankNum(); shard_id++) {
+                calls.emplace_back(SparsePushCall::New(table->GetHandle(), shard_id, dim,
+                                                       table->WireOption()));
+            }
+
+            AddHotPushGrads(dim, push, &calls);
+            StartSparsePushCalls(calls);
+        }
+    }
+}
+
+// push gradients of several dims of one table, every dim in pushes[i] of dims[i].
+// all dims going to one shard are sent in one rpc.
+static void MultiPushSparseGrads(int table_handle, const std::vector<int>& dims,
+                                 std::vector<SparsePushGrads>* pushes) {
+    std::vector<SparseMultiPushCall*> calls;
+    for (size_t shard_id = 0; shard_id < PsCluster::Instance()->RankNum(); shard_id++) {
+        calls.emplace_back(SparseMultiPushCall::New(shard_id));
+    }
+
+    for (size_t i = 0; i < dims.size(); i++) {
+        // NOTE, every rank of the host aggregates dims in the same order
+        if (!AggregateSparsePushGrads(table_handle, dims[i], &(*pushes)[i])) {
+            continue;
+        }
+
+        auto dim_calls = NewSparsePushCalls(table_handle, dims[i], &(*pushes)[i]);
+        for (size_t shard_id = 0; shard_id < calls.size(); shard_id++) {
+            calls[shard_id]->table_calls.push_back(dim_calls[shard_id]);
+        }
+    }
+
+    StartSparsePushCalls(calls);
+}
+
+// columns of every dim are merged as in one dim table, then pushed together
+static void MultiPushTableVarInfos(int table_handle, std::vector<SparsePushVarInfo>&& var_infos) {
+    std::vector<int> dims;
+    std::vector<std::vector<SparsePushVarInfo>> dim_var_infos;
+
+    for (auto& var_info : var_infos) {
+        int dim = var_info.GradDim();
+        size_t d = std::find(dims.begin(), dims.end(), dim) - dims.begin();
+        if (d == dims.size()) {
+            dims.push_back(dim);
+            dim_var_infos.emplace_back();
+        }
+
+        dim_var_infos[d].emplace_back(std::move(var_info));
+    }
+
+    std::vector<std::vector<SparsePushSignInfo>> merged_sign_infos(dims.size());
+    std::vector<std::vector<float>> merged_grads(dims.size());
+    std::vector<SparsePushGrads> pushes(dims.size());
+
+    for (size_t d = 0; d < dims.size(); d++) {
+        MergePushVarInfos(dim_var_infos[d], dims[d], &merged_sign_infos[d], &merged_grads[d]);
+
+        pushes[d].sign_infos = merged_sign_infos[d].data();
+        pushes[d].grads = merged_grads[d].data();
+        pushes[d].sign_num = merged_sign_infos[d].size();
+    }
+
+    MultiPushSparseGrads(table_handle, dims, &pushes);
+}
+
+// push gradients of columns of one table, grads of var_infos are only read before
+// return
+static void PushTableVarInfos(int table_handle, std::vector<SparsePushVarInfo>&& var_infos) {
+    CHECK_GT(var_infos.size(), 0);
+
+    int dim = var_infos[0].GradDim();
+    bool same_dim = std::all_of(var_infos.begin(), var_infos.end(),
+        [dim](const SparsePushVarInfo& var_info) { return var_info.GradDim() == dim; });
+
+    if (!same_dim) {
+        MultiPushTableVarInfos(table_handle, std::move(var_infos));
+        return;
+    }
+
+    // one column is pushed in place
+    std::vector<SparsePushSignInfo> merged_sign_infos;
+    std::vector<float> merged_grads;
+    const SparsePushSignInfo* sign_infos = var_infos[0].virtual_sign_infos.data();
+    const float* grads = var_infos[0].grad->matrix<float>().data();
+    size_t sign_num = var_infos[0].virtual_sign_infos.size();
+
+    if (var_infos.size() > 1) {
+        MergePushVarInfos(var_infos, dim, &merged_sign_infos, &merged_grads);
+        sign_infos = merged_sign_infos.data();
+        grads = merged_grads.data();
+        sign_num = merged_sign_infos.size();
+    }
+
+    PushSparseGrads(table_handle, dim, sign_infos, grads, sign_num);
+}
+
 class SparseTablePushKernel : public AsyncOpKernel {
 public:
     explicit SparseTablePushKernel(OpKernelConstruction* c)
@@ -342,49 +1746,208 @@ public:
             var_infos.emplace_back(value, grad);
         }
 
-        CHECK_GT(var_infos.size(), 0);
+        PushTableVarInfos(table_handle_, std::move(var_infos));
 
-        int dim = var_infos[0].GradDim();
-        for (size_t i = 0; i < var_infos.size(); i++) {
-            CHECK_EQ(dim, var_infos[i].GradDim());
-        }
+        done();
+    }
 
-        std::vector<SparsePushCall*> calls;
-        PsCluster* cluster = PsCluster::Instance();
+private:
+    int table_handle_;
+    int N_;
+};
 
-        for (size_t shard_id = 0; shard_id < cluster->RankNum(); shard_id++) {
-            calls.emplace_back(
-                new SparsePushCall(table_handle_, shard_id, dim));
-        }
+REGISTER_KERNEL_BUILDER(Name("SparseTablePush").Device(DEVICE_CPU),
+                        SparseTablePushKernel);
 
-        for (size_t i = 0; i < var_infos.size(); i++) {
-            // NOTE, tensorfow use RowMajor layout
-            const float* grad_matrix = var_infos[i].grad->matrix<float>().data();
+#if GOOGLE_CUDA
+// gradients on gpu are copied into pinned host tensors first, the push is started
+// in a cpu worker after the copies are done. the op is done without waiting for rpc
+// same as on cpu.
+class SparseTablePushGpuKernel : public AsyncOpKernel {
+public:
+    explicit SparseTablePushGpuKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+    }
 
-            for (size_t sign_index = 0; sign_index < var_infos[i].virtual_sign_infos.size(); sign_index++) {
-                const auto& sign_info = var_infos[i].virtual_sign_infos[sign_index];
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        OP_REQUIRES_ASYNC(c, c->num_inputs() == N_ * 2,
+                          errors::InvalidArgument("SparseTable push num_inputs:",
+                                                  c->num_inputs(),
+                                                  " not equal:", N_ * 2),
+                          done);
+        std::vector<Tensor> host_grads(N_);
 
-                int shard_id = sign_info.sign % cluster->RankNum();
-                const float* grad = grad_matrix + dim * sign_index;
-                calls[shard_id]->AddRequestGrad(sign_info, grad, dim);
-            }
+        for (int i = 0; i < N_; i++) {
+            const Tensor& grad = c->input(N_ + i);
+
+            OP_REQUIRES_ASYNC(
+                c, TensorShapeUtils::IsMatrix(grad.shape()),
+                errors::InvalidArgument(
+                    "sparse push grad must Matrix(sign_id_cnt, dim), saw: ",
+                    grad.shape().DebugString()),
+                done);
+
+            OP_REQUIRES_OK_ASYNC(c, AllocatePinnedTemp(c, grad.shape(), &host_grads[i]), done);
         }
 
-        for (auto& call : calls) {
-            call->Start([this, call]() {
-                delete call;
+        int table_handle = table_handle_;
+        int N = N_;
+
+        auto* group = new GpuCopyGroup(c, "sparse_push_d2h",
+            [c, table_handle, N, host_grads, done](const Status& status) {
+                OP_REQUIRES_OK_ASYNC(c, status, done);
+
+                ScheduleOnCpuWorker(c, [c, table_handle, N, host_grads, done]() {
+                    std::vector<SparsePushVarInfo> var_infos;
+                    for (int i = 0; i < N; i++) {
+                        var_infos.emplace_back(&c->input(i), &host_grads[i]);
+                    }
+
+                    PushTableVarInfos(table_handle, std::move(var_infos));
+                    done();
+                });
             });
+
+        for (int i = 0; i < N_; i++) {
+            group->ToHost(c->input(N_ + i), host_grads[i]);
         }
 
+        group->Start();
+    }
+
+private:
+    int table_handle_;
+    int N_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SparseTablePush")
+                            .Device(DEVICE_GPU)
+                            .HostMemory("values"),
+                        SparseTablePushGpuKernel);
+#endif // GOOGLE_CUDA
+
+// push gradients of SparseTableGather outputs, gradient of a value is its output
+// row, or row of its segment scaled by the combiner. gradients of the same sign in
+// all columns are summed and its show is count of its values.
+class SparseTableGatherPushKernel : public AsyncOpKernel {
+public:
+    explicit SparseTableGatherPushKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        std::string combiner;
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+        OP_REQUIRES_OK(c, c->GetAttr("combiner", &combiner));
+        OP_REQUIRES_OK(c, c->GetAttr("N", &N_));
+        OP_REQUIRES_OK(c, ParseSparseCombiner(combiner, &combiner_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        OP_REQUIRES_ASYNC(c, c->num_inputs() == N_ * 3,
+                          errors::InvalidArgument("SparseTable gather push num_inputs:",
+                                                  c->num_inputs(),
+                                                  " not equal:", N_ * 3),
+                          done);
+
+        std::vector<SparsePushSignInfo> sign_infos;
+        std::vector<float> grads;
+        int dim = 0;
+        OP_REQUIRES_OK_ASYNC(c, MergeGrads_(c, &dim, &sign_infos, &grads), done);
+
+        PushSparseGrads(table_handle_, dim, sign_infos.data(), grads.data(), sign_infos.size());
+
         done();
     }
 
+private:
+    Status MergeGrads_(OpKernelContext* c, int* dim, std::vector<SparsePushSignInfo>* sign_infos,
+                       std::vector<float>* grads) {
+        size_t total = 0;
+        for (int i = 0; i < N_; i++) {
+            total += c->input(i).NumElements();
+        }
+
+        OpenHashMap<uint64, uint32> sign_ids(total);
+        sign_infos->reserve(total);
+
+        for (int i = 0; i < N_; i++) {
+            const Tensor& value = c->input(i);
+            const Tensor& segment_id = c->input(N_ + i);
+            const Tensor& grad = c->input(2 * N_ + i);
+
+            if (!TensorShapeUtils::IsMatrix(grad.shape())) {
+                return errors::InvalidArgument("sparse gather push grad must Matrix, saw: ",
+                                               grad.shape().DebugString());
+            }
+
+            if (0 == i) {
+                *dim = grad.dim_size(1);
+                grads->reserve(total * *dim);
+            } else if (grad.dim_size(1) != *dim) {
+                return errors::InvalidArgument("sparse gather push grad dim:", grad.dim_size(1),
+                                               " not equal:", *dim);
+            }
+
+            int64 value_num = value.NumElements();
+            int64 rows = grad.dim_size(0);
+            const uint64* value_vec = reinterpret_cast<const uint64*>(value.flat<int64>().data());
+            const int64* segment_vec = segment_id.flat<int64>().data();
+            const float* grad_matrix = grad.matrix<float>().data();
+
+            if (segment_id.NumElements() != value_num
+                    || (combiner_ == SC_NONE && rows != value_num)) {
+                return errors::InvalidArgument("sparse gather push values size:", value_num,
+                                               " segment_ids size:", segment_id.NumElements(),
+                                               " grad rows:", rows);
+            }
+
+            std::vector<int64> counts;
+            if (combiner_ != SC_NONE) {
+                counts.resize(rows, 0);
+                for (int64 j = 0; j < value_num; ++j) {
+                    if (segment_vec[j] < 0 || segment_vec[j] >= rows) {
+                        return errors::InvalidArgument("sparse gather push segment_id:",
+                                                       segment_vec[j], " out of range:", rows);
+                    }
+                    counts[segment_vec[j]] += 1;
+                }
+            }
+
+            for (int64 j = 0; j < value_num; ++j) {
+                int64 row = j;
+                float scale = 1.0;
+                if (combiner_ != SC_NONE) {
+                    row = segment_vec[j];
+                    scale = SparseCombinerScale(combiner_, counts[row]);
+                }
+
+                const float* g = grad_matrix + row * *dim;
+
+                auto ret = sign_ids.insert(value_vec[j], sign_infos->size());
+                if (ret.second) {
+                    sign_infos->emplace_back(value_vec[j], 0);
+                    grads->resize(grads->size() + *dim, 0);
+                }
+
+                (*sign_infos)[*ret.first].batch_show += 1;
+
+                float* merged = grads->data() + (size_t)*ret.first * *dim;
+                for (int k = 0; k < *dim; ++k) {
+                    merged[k] += scale * g[k];
+                }
+            }
+        }
+
+        return Status::OK();
+    }
+
 private:
     int table_handle_;
+    SparseCombiner combiner_;
     int N_;
 };
 
-REGISTER_KERNEL_BUILDER(Name("SparseTablePush").Device(DEVICE_CPU),
-                        SparseTablePushKernel);
+REGISTER_KERNEL_BUILDER(Name("SparseTableGatherPush").Device(DEVICE_CPU),
+                        SparseTableGatherPushKernel);
 
 }  // namespace tensorflow
@@ -0,0 +1,27 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_KERNEL_SPARSE_TABLE_OPS_H_
+#define TENSORNET_KERNEL_SPARSE_TABLE_OPS_H_
+
+namespace tensorflow {
+
+// push combined gradients of hot signs of all sparse tables now, they are pushed
+// once every push_interval pushes otherwise. called at end of training and before
+// save, the pushes are started but not waited, see PushWindow::Flush.
+void FlushHotKeyPushes();
+
+}  // namespace tensorflow
+
+#endif  // TENSORNET_KERNEL_SPARSE_TABLE_OPS_H_
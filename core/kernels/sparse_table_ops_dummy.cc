@@ -37,6 +37,46 @@ private:
 REGISTER_KERNEL_BUILDER(Name("SparseTablePull").Device(DEVICE_CPU),
                         SparseTablePullKernel);
 
+class SparseTableMultiPullKernel : public AsyncOpKernel {
+public:
+    explicit SparseTableMultiPullKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handles", &table_handles_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        done();
+
+        return;
+    }
+
+private:
+    std::vector<int> table_handles_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SparseTableMultiPull").Device(DEVICE_CPU),
+                        SparseTableMultiPullKernel);
+
+class SparseTablePrefetchKernel : public AsyncOpKernel {
+public:
+    explicit SparseTablePrefetchKernel(OpKernelConstruction* c)
+        : AsyncOpKernel(c) {
+        OP_REQUIRES_OK(c, c->GetAttr("table_handle", &table_handle_));
+    }
+
+    void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
+        done();
+
+        return;
+    }
+
+private:
+    int table_handle_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SparseTablePrefetch").Device(DEVICE_CPU),
+                        SparseTablePrefetchKernel);
+
 class SparseTablePushKernel : public AsyncOpKernel {
 public:
     explicit SparseTablePushKernel(OpKernelConstruction* c) 
@@ -12,18 +12,25 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "core/ps/host_aggregator.h"
 #include "core/ps/ps_cluster.h"
+#include "core/ps/push_window.h"
 
 #include "core/ps/optimizer/optimizer.h"
 #include "core/ps/table/dense_table.h"
 #include "core/ps/table/sparse_table.h"
 #include "core/kernels/data/balance_dataset_ops.h"
+#include "core/kernels/sparse_table_ops.h"
+#include "core/utility/trace.h"
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include <Python.h>
 
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
 #include <butil/logging.h>
 
 namespace py = pybind11;
@@ -33,14 +40,86 @@ using std::string;
 
 using namespace tensornet;
 
+static SparseValueEncoding ParseSparseValueEncoding(const std::string& encoding) {
+    if (encoding == "float") {
+        return SVE_FLOAT;
+    } else if (encoding == "fp16") {
+        return SVE_FP16;
+    } else if (encoding == "bf16") {
+        return SVE_BF16;
+    }
+
+    throw py::value_error("sparse value encoding must be one of float, fp16, bf16");
+}
+
 PYBIND11_MODULE(_pywrap_tn, m) {
-    m.def("init", []() {
+    m.def("init", [](py::kwargs kwargs) {
         PsCluster* cluster = PsCluster::Instance();
 
         if (cluster->IsInitialized()) {
             return true;
         }
 
+        RpcOption rpc_option;
+
+        auto int_option = [&kwargs](const char* name, int* value) {
+            PyObject* item = PyDict_GetItemString(kwargs.ptr(), name);
+            if (NULL != item) {
+                *value = PyLong_AsLong(item);
+            }
+        };
+
+        int_option("rpc_timeout_ms", &rpc_option.timeout_ms);
+        int_option("rpc_max_retry", &rpc_option.max_retry);
+        int_option("rpc_backoff_base_ms", &rpc_option.backoff_base_ms);
+        int_option("rpc_backoff_max_ms", &rpc_option.backoff_max_ms);
+        int_option("rpc_backup_request_ms", &rpc_option.backup_request_ms);
+        int_option("rpc_channels_per_server", &rpc_option.channels_per_server);
+        int_option("rpc_warmup_concurrency", &rpc_option.warmup_concurrency);
+
+        PyObject* item = PyDict_GetItemString(kwargs.ptr(), "rpc_connection_type");
+        if (NULL != item) {
+            rpc_option.connection_type = py::cast<std::string>(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "rpc_transport");
+        if (NULL != item) {
+            rpc_option.transport = py::cast<std::string>(item);
+        }
+
+        if (rpc_option.transport != "tcp" && rpc_option.transport != "rdma") {
+            throw py::value_error("rpc_transport must be one of tcp, rdma");
+        }
+
+        if (rpc_option.timeout_ms <= 0 || rpc_option.channels_per_server <= 0) {
+            throw py::value_error("rpc_timeout_ms and rpc_channels_per_server must be positive");
+        }
+
+        if (rpc_option.connection_type != "single" && rpc_option.connection_type != "pooled"
+                && rpc_option.connection_type != "short") {
+            throw py::value_error("rpc_connection_type must be one of single, pooled, short");
+        }
+
+        cluster->SetRpcOption(rpc_option);
+
+        ServerOption server_option;
+
+        int_option("server_num_threads", &server_option.num_threads);
+        int_option("server_max_concurrency", &server_option.max_concurrency);
+        int_option("ps_numa_node", &server_option.numa_node);
+        int_option("io_threads", &server_option.io_threads);
+
+        item = PyDict_GetItemString(kwargs.ptr(), "ps_cpus");
+        if (NULL != item) {
+            server_option.cpus = py::cast<std::string>(item);
+        }
+
+        if (server_option.io_threads <= 0) {
+            throw py::value_error("io_threads must be positive");
+        }
+
+        cluster->SetServerOption(server_option);
+
         if (cluster->Init() < 0) {
             throw py::value_error("Init tensornet fail");
         }
@@ -184,13 +263,180 @@ PYBIND11_MODULE(_pywrap_tn, m) {
 
         return py::reinterpret_steal<py::object>(obj);
     })
-    .def("create_sparse_table", [](py::object obj, int dimension) {
+    .def("create_sparse_table", [](py::object obj, int dimension, py::kwargs kwargs) {
         OptimizerBase* opt =
                static_cast<OptimizerBase*>(PyCapsule_GetPointer(obj.ptr(), nullptr));
 
+        SparseKernelOption option;
+
+        PyObject* item = PyDict_GetItemString(kwargs.ptr(), "block_num");
+        if (NULL != item) {
+            long block_num = PyLong_AsLong(item);
+            if (block_num <= 0) {
+                throw py::value_error("block_num of sparse table must be positive");
+            }
+            option.block_num = block_num;
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "weight_type");
+        if (NULL != item) {
+            std::string weight_type = py::cast<std::string>(item);
+            if (weight_type == "float") {
+                option.weight_type = SWT_FLOAT;
+            } else if (weight_type == "fp16") {
+                option.weight_type = SWT_FP16;
+            } else if (weight_type == "bf16") {
+                option.weight_type = SWT_BF16;
+            } else {
+                throw py::value_error("weight_type of sparse table must be one of float, fp16, bf16");
+            }
+        }
+
+        // capacity is the expected key count of whole table, every shard hold a part
+        item = PyDict_GetItemString(kwargs.ptr(), "capacity");
+        if (NULL != item) {
+            long capacity = PyLong_AsLong(item);
+            if (capacity < 0) {
+                throw py::value_error("capacity of sparse table must not be negative");
+            }
+            option.init_keys = capacity / PsCluster::Instance()->RankNum();
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "io_threads");
+        if (NULL != item) {
+            long io_threads = PyLong_AsLong(item);
+            if (io_threads <= 0) {
+                throw py::value_error("io_threads of sparse table must be positive");
+            }
+            option.io_threads = io_threads;
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "cold_dir");
+        if (NULL != item) {
+            option.cold_dir = py::cast<std::string>(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "weight_rows");
+        if (NULL != item) {
+            option.weight_rows = py::cast<bool>(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "admit_shows");
+        if (NULL != item) {
+            long admit_shows = PyLong_AsLong(item);
+            if (admit_shows < 0) {
+                throw py::value_error("admit_shows of sparse table must not be negative");
+            }
+            option.admit_shows = admit_shows;
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "admit_sketch_width");
+        if (NULL != item) {
+            long width = PyLong_AsLong(item);
+            if (width <= 0) {
+                throw py::value_error("admit_sketch_width of sparse table must be positive");
+            }
+            option.admit_sketch_width = width;
+        }
+
+        SparseWireOption wire_option;
+
+        item = PyDict_GetItemString(kwargs.ptr(), "pull_encoding");
+        if (NULL != item) {
+            wire_option.pull_encoding = ParseSparseValueEncoding(py::cast<std::string>(item));
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "push_encoding");
+        if (NULL != item) {
+            wire_option.push_encoding = ParseSparseValueEncoding(py::cast<std::string>(item));
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "delta_signs");
+        if (NULL != item) {
+            wire_option.delta_signs = py::cast<bool>(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "grad_threshold");
+        if (NULL != item) {
+            wire_option.grad_threshold = py::cast<float>(item);
+        }
+
+        SparseCacheOption cache_option;
+
+        item = PyDict_GetItemString(kwargs.ptr(), "cache_staleness");
+        if (NULL != item) {
+            cache_option.staleness = py::cast<int>(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "cache_capacity");
+        if (NULL != item) {
+            long cache_capacity = PyLong_AsLong(item);
+            if (cache_capacity <= 0) {
+                throw py::value_error("cache_capacity of sparse table must be positive");
+            }
+            cache_option.capacity = cache_capacity;
+        }
+
+        HotKeyOption hot_key_option;
+
+        item = PyDict_GetItemString(kwargs.ptr(), "hot_key_num");
+        if (NULL != item) {
+            hot_key_option.hot_key_num = py::cast<int>(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "hot_push_interval");
+        if (NULL != item) {
+            hot_key_option.push_interval = py::cast<int>(item);
+            if (hot_key_option.push_interval <= 0) {
+                throw py::value_error("hot_push_interval of sparse table must be positive");
+            }
+        }
+
+        SparseStreamOption stream_option;
+
+        item = PyDict_GetItemString(kwargs.ptr(), "stream_interval_ms");
+        if (NULL != item) {
+            stream_option.interval_ms = py::cast<int>(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "stream_max_keys_per_second");
+        if (NULL != item) {
+            long max_keys = PyLong_AsLong(item);
+            if (max_keys <= 0) {
+                throw py::value_error("stream_max_keys_per_second of sparse table must be positive");
+            }
+            stream_option.max_keys_per_second = max_keys;
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "stream_max_batches");
+        if (NULL != item) {
+            long max_batches = PyLong_AsLong(item);
+            if (max_batches <= 0) {
+                throw py::value_error("stream_max_batches of sparse table must be positive");
+            }
+            stream_option.max_batches = max_batches;
+        }
+
+        // dims of other columns sharing the table, every dim has a kernel of its own
+        std::vector<int> extra_dims;
+        item = PyDict_GetItemString(kwargs.ptr(), "extra_dims");
+        if (NULL != item) {
+            for (int dim : py::cast<std::vector<int>>(item)) {
+                if (dim <= 0) {
+                    throw py::value_error("extra_dims of sparse table must be positive");
+                }
+                if (dim != dimension
+                        && std::find(extra_dims.begin(), extra_dims.end(), dim) == extra_dims.end()) {
+                    extra_dims.push_back(dim);
+                }
+            }
+        }
+
         PsCluster* cluster = PsCluster::Instance();
 
-        SparseTable* table = CreateSparseTable(opt, dimension, cluster->RankNum(), cluster->Rank());
+        SparseTable* table = CreateSparseTable(opt, dimension, cluster->RankNum(), cluster->Rank(),
+                                               option, wire_option, cache_option, hot_key_option,
+                                               stream_option, extra_dims);
 
         return table->GetHandle();
     })
@@ -204,14 +450,26 @@ PYBIND11_MODULE(_pywrap_tn, m) {
 
         return table->GetHandle();
     })
-    .def("save_sparse_table", [](uint32_t table_handle, std::string filepath) {
+    .def("save_sparse_table", [](uint32_t table_handle, std::string filepath, bool binary, bool delta) {
+        if (delta && !binary) {
+            throw py::value_error("delta save only support binary format");
+        }
+
+        // combined gradients of hot signs this worker holds must reach ps first
+        {
+            py::gil_scoped_release release;
+
+            tensorflow::FlushHotKeyPushes();
+            PushWindow::Instance()->Flush();
+        }
+
         SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle);
-        return table->Save(filepath);
-    })
-    .def("load_sparse_table", [](uint32_t table_handle, std::string filepath) {
+        return table->Save(filepath, binary ? SFF_BINARY : SFF_TEXT, delta);
+    }, py::arg("table_handle"), py::arg("filepath"), py::arg("binary") = false, py::arg("delta") = false)
+    .def("load_sparse_table", [](uint32_t table_handle, std::string filepath, bool lazy) {
         SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle);
-        return table->Load(filepath);
-    })
+        return table->Load(filepath, PsCluster::Instance()->Router(), lazy);
+    }, py::arg("table_handle"), py::arg("filepath"), py::arg("lazy") = false)
     .def("save_dense_table", [](uint32_t table_handle, std::string filepath) {
         DenseTable* table = DenseTableRegistry::Instance()->Get(table_handle);
         return table->Save(filepath);
@@ -237,6 +495,21 @@ PYBIND11_MODULE(_pywrap_tn, m) {
 
         return;
     })
+    .def("set_push_window", [](int window) {
+        PushWindow::Instance()->SetWindow(window);
+    })
+    .def("set_host_aggregate", [](bool enabled) {
+        // ranks of a host wait for each other in every push, must be set the same by
+        // all of them before training
+        HostAggregator::Instance()->SetEnabled(enabled);
+    })
+    .def("flush_push", []() {
+        // pushes are acknowledged by brpc threads, no python needed
+        py::gil_scoped_release release;
+
+        tensorflow::FlushHotKeyPushes();
+        PushWindow::Instance()->Flush();
+    })
     .def("reset_balance_dataset", []() {
         PsCluster* cluster = PsCluster::Instance();
         tensorflow::BalanceInputDataInfo* data_info = tensorflow::BalanceInputDataInfo::Instance();
@@ -248,5 +521,64 @@ PYBIND11_MODULE(_pywrap_tn, m) {
         SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle);
         return table->ShowDecay();
     })
+    .def("evict", [](uint32_t table_handle, py::kwargs kwargs) {
+        SparseEvictOption option;
+
+        PyObject* item = PyDict_GetItemString(kwargs.ptr(), "show_threshold");
+        if (NULL != item) {
+            option.show_threshold = PyFloat_AsDouble(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "ttl_days");
+        if (NULL != item) {
+            option.ttl_days = PyLong_AsLong(item);
+        }
+
+        SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle);
+        return table->Evict(option);
+    })
+    .def("spill", [](uint32_t table_handle, py::kwargs kwargs) {
+        SparseEvictOption option;
+
+        PyObject* item = PyDict_GetItemString(kwargs.ptr(), "show_threshold");
+        if (NULL != item) {
+            option.show_threshold = PyFloat_AsDouble(item);
+        }
+
+        item = PyDict_GetItemString(kwargs.ptr(), "idle_days");
+        if (NULL != item) {
+            option.ttl_days = PyLong_AsLong(item);
+        }
+
+        SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle);
+        return table->Spill(option);
+    })
+    .def("export_sparse_table", [](uint32_t table_handle, std::string filepath,
+                                   std::string weight_type, float show_threshold, bool delta) {
+        EmbeddingWeightType type = EWT_FLOAT;
+        if (weight_type == "fp16") {
+            type = EWT_HALF;
+        } else if (weight_type == "int8") {
+            type = EWT_INT8;
+        } else if (weight_type != "float") {
+            throw py::value_error("export weight_type must be float, fp16 or int8");
+        }
+
+        SparseTable* table = SparseTableRegistry::Instance()->Get(table_handle);
+        return table->Export(filepath, PsCluster::Instance()->Router(), type, show_threshold, delta);
+    }, py::arg("table_handle"), py::arg("filepath"), py::arg("weight_type") = "float",
+       py::arg("show_threshold") = 0, py::arg("delta") = false)
+    .def("trace_start", [](size_t max_events) {
+        Tracer::Instance()->Start(max_events);
+    }, py::arg("max_events") = 1000000)
+    .def("trace_stop", []() {
+        Tracer::Instance()->Stop();
+    })
+    .def("trace_step", [](uint64_t step) {
+        Tracer::Instance()->SetStep(step);
+    })
+    .def("trace_dump", [](std::string file) {
+        return Tracer::Instance()->Dump(file, PsCluster::Instance()->Rank());
+    })
     ;
 };
@@ -25,4 +25,6 @@ REGISTER_OP("BalanceDataset")
     .Output("handle: variant")
     .Attr("output_types: list(type) >= 1")
     .Attr("output_shapes: list(shape) >= 1")
+    .Attr("buffer_size: int = 100")
+    .Attr("compress: {'none', 'snappy', 'gzip'} = 'snappy'")
     .SetShapeFn(shape_inference::ScalarShape);
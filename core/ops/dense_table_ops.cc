@@ -35,3 +35,12 @@ REGISTER_OP("DenseTablePushPull")
     .Attr("table_handle: int")
     .Attr("N: int")
     .SetShapeFn(shape_inference::NoOutputs);
+
+REGISTER_OP("DenseTableAllReduce")
+    .Doc(R"doc(allreduce dense gradients among ranks and apply them locally
+    )doc")
+    .Input("vars: N * resource")
+    .Input("grads: N * float")
+    .Attr("table_handle: int")
+    .Attr("N: int")
+    .SetShapeFn(shape_inference::NoOutputs);
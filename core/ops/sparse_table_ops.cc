@@ -42,6 +42,82 @@ REGISTER_OP("SparseTablePull")
         return Status::OK();
     });
 
+REGISTER_OP("SparseTableMultiPull")
+    .Doc(R"doc(pull variables of several tables from parameter server, one rpc
+    to every shard for all the tables. table_handles[i] is table of resources[i].
+    )doc")
+    .Input("resources: N * resource")
+    .Input("values: N * int64")
+    .Output("mapped_values: N * int64")
+    .Attr("table_handles: list(int)")
+    .Attr("N: int")
+    .SetShapeFn([](shape_inference::InferenceContext* c) {
+        int N = 0;
+
+        TF_CHECK_OK(c->GetAttr("N", &N));
+
+        for (int i = 0; i < N; i++) {
+            shape_inference::ShapeHandle shape;
+
+            TF_RETURN_IF_ERROR(c->WithRank(c->input(N + i), 1, &shape));
+
+            c->set_output(i, shape);
+        }
+
+        return Status::OK();
+    });
+
+REGISTER_OP("SparseTableGather")
+    .Doc(R"doc(pull embeddings of values into dense outputs, no variable is needed.
+    output i is [values_i size, dim] if combiner is 'none', otherwise embeddings of
+    values are pooled into num_segments_i rows by segment_ids_i.
+    )doc")
+    .Input("values: N * int64")
+    .Input("segment_ids: N * int64")
+    .Input("num_segments: N * int64")
+    .Output("embeddings: N * float")
+    .Attr("table_handle: int")
+    .Attr("dim: int")
+    .Attr("combiner: {'none', 'sum', 'mean', 'sqrtn'} = 'none'")
+    .Attr("N: int")
+    .SetShapeFn([](shape_inference::InferenceContext* c) {
+        int N = 0;
+        int dim = 0;
+        std::string combiner;
+
+        TF_CHECK_OK(c->GetAttr("N", &N));
+        TF_CHECK_OK(c->GetAttr("dim", &dim));
+        TF_CHECK_OK(c->GetAttr("combiner", &combiner));
+
+        for (int i = 0; i < N; i++) {
+            shape_inference::ShapeHandle shape;
+            shape_inference::DimensionHandle rows;
+
+            TF_RETURN_IF_ERROR(c->WithRank(c->input(i), 1, &shape));
+            TF_RETURN_IF_ERROR(c->WithRank(c->input(N + i), 1, &shape));
+
+            if (combiner == "none") {
+                rows = c->Dim(c->input(i), 0);
+            } else {
+                TF_RETURN_IF_ERROR(c->MakeDimForScalarInput(2 * N + i, &rows));
+            }
+
+            c->set_output(i, c->Matrix(rows, dim));
+        }
+
+        return Status::OK();
+    });
+
+REGISTER_OP("SparseTablePrefetch")
+    .Doc(R"doc(pull embeddings of values into worker embedding cache in background,
+    the op finish without waiting for rpc. cache of the table must be enabled.
+    )doc")
+    .Input("values: N * int64")
+    .Attr("table_handle: int")
+    .Attr("N: int")
+    .SetIsStateful()
+    .SetShapeFn(shape_inference::NoOutputs);
+
 
 REGISTER_OP("SparseTablePush")
     .Doc(R"doc(push variable from parameter server
@@ -51,3 +127,15 @@ REGISTER_OP("SparseTablePush")
     .Attr("table_handle: int")
     .Attr("N: int")
     .SetShapeFn(shape_inference::NoOutputs);
+
+REGISTER_OP("SparseTableGatherPush")
+    .Doc(R"doc(push gradients of SparseTableGather outputs, values, segment_ids and
+    combiner must be the same as the gather.
+    )doc")
+    .Input("values: N * int64")
+    .Input("segment_ids: N * int64")
+    .Input("grads: N * float")
+    .Attr("table_handle: int")
+    .Attr("combiner: {'none', 'sum', 'mean', 'sqrtn'} = 'none'")
+    .Attr("N: int")
+    .SetShapeFn(shape_inference::NoOutputs);
@@ -0,0 +1,164 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/ps/host_aggregator.h"
+
+#include <string.h>
+
+#include <string>
+
+#include <butil/logging.h>
+
+#include "core/utility/metrics.h"
+#include "core/utility/mpi_manager.h"
+#include "core/utility/open_hash_map.h"
+
+namespace tensornet {
+
+HostAggregator* HostAggregator::Instance() {
+    static HostAggregator instance;
+    return &instance;
+}
+
+bool HostAggregator::Enabled() const {
+    return enabled_.load(std::memory_order_relaxed)
+           && MpiManager::Instance()->LocalRanks().size() > 1;
+}
+
+bool HostAggregator::IsLeader() const {
+    MpiManager* mpi = MpiManager::Instance();
+
+    return mpi->LocalRanks().front() == mpi->Rank();
+}
+
+bool HostAggregator::AggregateSparse(uint32_t table_handle, int dim,
+                                     std::vector<SparsePushSignInfo>* sign_infos,
+                                     std::vector<float>* grads) {
+    MpiManager* mpi = MpiManager::Instance();
+    const std::vector<int>& local_ranks = mpi->LocalRanks();
+    size_t n = sign_infos->size();
+
+    CHECK_EQ(grads->size(), n * dim);
+
+    // signs, batch shows and gradients one after another
+    if (!IsLeader()) {
+        std::string data(n * (sizeof(uint64_t) + sizeof(int32_t) + dim * sizeof(float)), '\0');
+        char* p = &data[0];
+
+        for (const auto& sign_info : *sign_infos) {
+            memcpy(p, &sign_info.sign, sizeof(uint64_t));
+            p += sizeof(uint64_t);
+        }
+
+        for (const auto& sign_info : *sign_infos) {
+            int32_t batch_show = sign_info.batch_show;
+            memcpy(p, &batch_show, sizeof(int32_t));
+            p += sizeof(int32_t);
+        }
+
+        memcpy(p, grads->data(), grads->size() * sizeof(float));
+
+        mpi->Send(local_ranks.front(), SparseTag_(table_handle), data);
+        Metrics::Instance()->host_aggregate_bytes << data.size();
+
+        return false;
+    }
+
+    OpenHashMap<uint64_t, uint32_t> sign_ids(n * local_ranks.size());
+    for (size_t i = 0; i < n; ++i) {
+        sign_ids.insert((*sign_infos)[i].sign, i);
+    }
+
+    std::string data;
+    for (size_t r = 1; r < local_ranks.size(); ++r) {
+        mpi->Recv(local_ranks[r], SparseTag_(table_handle), &data);
+
+        size_t row_bytes = sizeof(uint64_t) + sizeof(int32_t) + dim * sizeof(float);
+        CHECK_EQ(data.size() % row_bytes, 0);
+
+        size_t m = data.size() / row_bytes;
+        const char* signs = data.data();
+        const char* shows = signs + m * sizeof(uint64_t);
+        const float* g = reinterpret_cast<const float*>(shows + m * sizeof(int32_t));
+
+        for (size_t i = 0; i < m; ++i) {
+            uint64_t sign = 0;
+            int32_t batch_show = 0;
+            memcpy(&sign, signs + i * sizeof(uint64_t), sizeof(uint64_t));
+            memcpy(&batch_show, shows + i * sizeof(int32_t), sizeof(int32_t));
+
+            auto ret = sign_ids.insert(sign, sign_infos->size());
+            if (ret.second) {
+                sign_infos->emplace_back(sign, 0);
+                grads->resize(grads->size() + dim, 0);
+            }
+
+            (*sign_infos)[*ret.first].batch_show += batch_show;
+
+            float* merged = grads->data() + (size_t)*ret.first * dim;
+            for (int k = 0; k < dim; ++k) {
+                merged[k] += g[i * dim + k];
+            }
+        }
+    }
+
+    return true;
+}
+
+bool HostAggregator::ReduceDense(uint32_t table_handle, float* data, size_t n) {
+    MpiManager* mpi = MpiManager::Instance();
+    const std::vector<int>& local_ranks = mpi->LocalRanks();
+
+    if (!IsLeader()) {
+        mpi->Send(local_ranks.front(), DenseTag_(table_handle),
+                  std::string(reinterpret_cast<const char*>(data), n * sizeof(float)));
+        Metrics::Instance()->host_aggregate_bytes << n * sizeof(float);
+
+        return false;
+    }
+
+    std::string buf;
+    for (size_t r = 1; r < local_ranks.size(); ++r) {
+        mpi->Recv(local_ranks[r], DenseTag_(table_handle), &buf);
+        CHECK_EQ(buf.size(), n * sizeof(float));
+
+        const float* g = reinterpret_cast<const float*>(buf.data());
+        for (size_t i = 0; i < n; ++i) {
+            data[i] += g[i];
+        }
+    }
+
+    return true;
+}
+
+void HostAggregator::BroadcastDense(uint32_t table_handle, float* data, size_t n) {
+    MpiManager* mpi = MpiManager::Instance();
+    const std::vector<int>& local_ranks = mpi->LocalRanks();
+
+    if (!IsLeader()) {
+        std::string buf;
+        mpi->Recv(local_ranks.front(), DenseTag_(table_handle), &buf);
+        CHECK_EQ(buf.size(), n * sizeof(float));
+
+        memcpy(data, buf.data(), buf.size());
+        return;
+    }
+
+    std::string buf(reinterpret_cast<const char*>(data), n * sizeof(float));
+    for (size_t r = 1; r < local_ranks.size(); ++r) {
+        mpi->Send(local_ranks[r], DenseTag_(table_handle), buf);
+    }
+}
+
+} // namespace tensornet
@@ -0,0 +1,79 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_PS_HOST_AGGREGATOR_H_
+#define TENSORNET_PS_HOST_AGGREGATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "core/ps_interface/ps_raw_interface.h"
+#include "core/utility/mpi_manager.h"
+
+namespace tensornet {
+
+// two level push. ranks on the same host send their gradients to the host leader,
+// the lowest rank of the host, which sums them and pushes once for the whole host.
+// when enabled every rank of a host must push the same tables in every step, as
+// every one of them waits for the others.
+class HostAggregator {
+public:
+    static HostAggregator* Instance();
+
+    // take effect from the next push
+    void SetEnabled(bool enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    // enabled and there is another rank on this host
+    bool Enabled() const;
+
+    bool IsLeader() const;
+
+    // distinct signs and their gradients of all ranks of the host are summed into
+    // sign_infos and grads of the leader. return false on the other ranks, which
+    // have nothing to push
+    bool AggregateSparse(uint32_t table_handle, int dim,
+                         std::vector<SparsePushSignInfo>* sign_infos,
+                         std::vector<float>* grads);
+
+    // gradients of all ranks are summed into data of the leader, return false on the
+    // other ranks, which receive weights pulled by the leader with BroadcastDense
+    bool ReduceDense(uint32_t table_handle, float* data, size_t n);
+
+    // send data of the leader to the other ranks of the host
+    void BroadcastDense(uint32_t table_handle, float* data, size_t n);
+
+private:
+    HostAggregator() { }
+
+    // sparse and dense tables with the same handle do not share messages
+    static int SparseTag_(uint32_t table_handle) {
+        return MpiManager::kUserTagBase + table_handle * 2;
+    }
+
+    static int DenseTag_(uint32_t table_handle) {
+        return MpiManager::kUserTagBase + table_handle * 2 + 1;
+    }
+
+private:
+    std::atomic<bool> enabled_{false};
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_PS_HOST_AGGREGATOR_H_
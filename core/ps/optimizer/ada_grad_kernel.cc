@@ -14,9 +14,12 @@
 
 #include "core/ps/optimizer/ada_grad_kernel.h"
 
+#include <algorithm>
+
 #include <butil/logging.h>
 #include <butil/rand_util.h>
 
+#include "core/ps/optimizer/sparse_simd.h"
 #include "core/utility/random.h"
 
 namespace tensornet {
@@ -24,8 +27,11 @@ namespace tensornet {
 DenseAdaGradValue::DenseAdaGradValue(const AdaGrad* opt, int len) {
     // NOTE, w must initialized as random. You can also call SetWeight initialize.
     // eigen init uniformly spread through [-1:1] default.
-    w_.setRandom(len);
-    w_ *= opt->initial_scale;
+    w_ = DenseWeight(len);
+
+    auto w = w_.Mutable();
+    w.setRandom();
+    w *= opt->initial_scale;
 
     d2sum_.setZero(len);
     g2sum_.setConstant(len, opt->initial_g2sum);
@@ -35,15 +41,26 @@ DenseAdaGradValue::DenseAdaGradValue(const AdaGrad* opt, int len) {
 void DenseAdaGradValue::SetWeight(butil::IOBuf& w_buf) {
     CHECK_EQ(w_.size() * sizeof(float), w_buf.size());
 
-    w_buf.copy_to(w_.data(), w_.size() * sizeof(float));
+    w_buf.copy_to(w_.Mutable().data(), w_.size() * sizeof(float));
 }
 
-void DenseAdaGradValue::Apply(const AdaGrad* opt, const Eigen::ArrayXf& g) {
-    d2sum_ = opt->grad_decay_rate * d2sum_ + 1;
-    g2sum_ = opt->grad_decay_rate * g2sum_ + g.square();
+void DenseAdaGradValue::Apply(const AdaGrad* opt, const DenseGrad& g) {
+    auto w = w_.Mutable();
+
+    for (Eigen::Index i = 0; i < w.size(); i += DENSE_APPLY_CHUNK) {
+        Eigen::Index n = std::min(DENSE_APPLY_CHUNK, w.size() - i);
 
-    m_ += (g - m_) * (1.0 - opt->mom_decay_rate);
-    w_ -= opt->learning_rate * m_ / (g2sum_.sqrt() / d2sum_.sqrt() + opt->epsilon);
+        auto gs = g.segment(i, n);
+        auto d2sum = d2sum_.segment(i, n);
+        auto g2sum = g2sum_.segment(i, n);
+        auto m = m_.segment(i, n);
+
+        d2sum = opt->grad_decay_rate * d2sum + 1;
+        g2sum = opt->grad_decay_rate * g2sum + gs.square();
+
+        m += (gs - m) * (1.0 - opt->mom_decay_rate);
+        w.segment(i, n) -= opt->learning_rate * m / (g2sum.sqrt() / d2sum.sqrt() + opt->epsilon);
+    }
 }
 
 std::ostream& operator<<(std::ostream& os, const DenseAdaGradValue& value) {
@@ -67,8 +84,10 @@ std::istream& operator>>(std::istream& is, DenseAdaGradValue& value) {
 
     CHECK_EQ(array_size, value.w_.size());
 
+    auto w = value.w_.Mutable();
+
     for (int i = 0; i < array_size; i++) {
-        is >> value.w_[i];
+        is >> w[i];
         is >> value.d2sum_[i];
         is >> value.g2sum_[i];
         is >> value.m_[i];
@@ -77,9 +96,9 @@ std::istream& operator>>(std::istream& is, DenseAdaGradValue& value) {
     return is;
 }
 
-SparseAdaGradValue::SparseAdaGradValue(int dim, const AdaGrad* opt) {
-    dim_ = dim;
-
+template <typename WeightType, int DIM>
+SparseAdaGradValue<WeightType, DIM>::SparseAdaGradValue(int dim, const AdaGrad* opt)
+    : SparseValueDim<DIM>(dim) {
     auto& reng = local_random_engine();
     auto distribution = std::normal_distribution<float>(0, 1 / sqrt(Dim()));
 
@@ -90,29 +109,46 @@ SparseAdaGradValue::SparseAdaGradValue(int dim, const AdaGrad* opt) {
     g2sum_ = opt->initial_g2sum;
 }
 
-void SparseAdaGradValue::Apply(const AdaGrad* opt, SparseGradInfo& grad_info) {
-    show_ += grad_info.batch_show;
-
-    float* w = Weight();
+namespace {
 
+// scalar update for 16 bit weight types
+template <typename WeightType>
+void SparseAdaGradUpdate(const AdaGrad* opt, WeightType* w, float& g2sum, const float* g, int dim) {
     double add_g2sum = 0;
 
-    for (int i = 0; i < dim_; ++i) {
-        add_g2sum += grad_info.grad[i] * grad_info.grad[i];
+    for (int i = 0; i < dim; ++i) {
+        add_g2sum += g[i] * g[i];
     }
 
-    g2sum_ += add_g2sum / dim_;
+    g2sum += add_g2sum / dim;
 
-    for (int i = 0; i < dim_; ++i) {
-        w[i] -= opt->learning_rate * grad_info.grad[i] / (opt->epsilon + sqrt(g2sum_));
+    for (int i = 0; i < dim; ++i) {
+        w[i] -= opt->learning_rate * g[i] / (opt->epsilon + sqrt(g2sum));
     }
 }
 
-std::ostream& operator<<(std::ostream& os, const SparseAdaGradValue& value) {
-    os << value.dim_ << "\t";
+void SparseAdaGradUpdate(const AdaGrad* opt, float* w, float& g2sum, const float* g, int dim) {
+    g2sum += SimdSquareSum(g, dim) / dim;
+
+    float scale = opt->learning_rate / (opt->epsilon + sqrt(g2sum));
+    SimdScaledSub(w, g, scale, dim);
+}
+
+} // namespace
+
+template <typename WeightType, int DIM>
+void SparseAdaGradValue<WeightType, DIM>::Apply(const AdaGrad* opt, SparseGradInfo& grad_info) {
+    show_ += grad_info.batch_show;
+
+    SparseAdaGradUpdate(opt, Weight(), g2sum_, grad_info.grad, Dim());
+}
 
-    for (int i = 0; i < value.dim_; i++) {
-        os << value.Weight()[i] << "\t";
+template <typename WeightType, int DIM>
+std::ostream& operator<<(std::ostream& os, const SparseAdaGradValue<WeightType, DIM>& value) {
+    os << value.Dim() << "\t";
+
+    for (int i = 0; i < value.Dim(); i++) {
+        os << float(value.Weight()[i]) << "\t";
     }
 
     os << value.g2sum_ << "\t";
@@ -121,14 +157,17 @@ std::ostream& operator<<(std::ostream& os, const SparseAdaGradValue& value) {
     return os;
 }
 
-std::istream& operator>>(std::istream& is, SparseAdaGradValue& value) {
+template <typename WeightType, int DIM>
+std::istream& operator>>(std::istream& is, SparseAdaGradValue<WeightType, DIM>& value) {
     int dim;
     is >> dim;
 
-    CHECK_EQ(dim, value.dim_);
+    CHECK_EQ(dim, value.Dim());
 
-    for (int i = 0; i < value.dim_; i++) {
-        is >> value.Weight()[i];
+    for (int i = 0; i < value.Dim(); i++) {
+        float w = 0;
+        is >> w;
+        value.Weight()[i] = w;
     }
 
     is >> value.g2sum_;
@@ -137,9 +176,29 @@ std::istream& operator>>(std::istream& is, SparseAdaGradValue& value) {
     return is;
 }
 
-void SparseAdaGradValue::ShowDecay(const AdaGrad* opt) {
+template <typename WeightType, int DIM>
+void SparseAdaGradValue<WeightType, DIM>::ShowDecay(const AdaGrad* opt) {
     show_ *= opt->show_decay_rate;
 }
 
+#define INSTANTIATE_SPARSE_ADA_GRAD_VALUE(T, DIM)                                                    \
+    template struct SparseAdaGradValue<T, DIM>;                                                      \
+    template std::ostream& operator<<(std::ostream& os, const SparseAdaGradValue<T, DIM>& value);    \
+    template std::istream& operator>>(std::istream& is, SparseAdaGradValue<T, DIM>& value);
+
+#define INSTANTIATE_SPARSE_ADA_GRAD_VALUE_DIMS(T)  \
+    INSTANTIATE_SPARSE_ADA_GRAD_VALUE(T, 0)        \
+    INSTANTIATE_SPARSE_ADA_GRAD_VALUE(T, 8)        \
+    INSTANTIATE_SPARSE_ADA_GRAD_VALUE(T, 16)       \
+    INSTANTIATE_SPARSE_ADA_GRAD_VALUE(T, 32)       \
+    INSTANTIATE_SPARSE_ADA_GRAD_VALUE(T, 64)
+
+INSTANTIATE_SPARSE_ADA_GRAD_VALUE_DIMS(float)
+INSTANTIATE_SPARSE_ADA_GRAD_VALUE_DIMS(Half)
+INSTANTIATE_SPARSE_ADA_GRAD_VALUE_DIMS(BFloat16)
+
+#undef INSTANTIATE_SPARSE_ADA_GRAD_VALUE_DIMS
+#undef INSTANTIATE_SPARSE_ADA_GRAD_VALUE
+
 } // namespace tensornet
 
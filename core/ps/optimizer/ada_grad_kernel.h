@@ -17,10 +17,13 @@
 
 #include "core/ps/optimizer/optimizer.h"
 
+#include <algorithm>
+
 #include <butil/iobuf.h>
 #include <Eigen/Dense>
 
 #include "core/ps/optimizer/data_struct.h"
+#include "core/utility/half.h"
 
 namespace tensornet {
 
@@ -30,21 +33,29 @@ public:
 
     void SetWeight(butil::IOBuf& w_buf);
 
-    const Eigen::ArrayXf& GetWeight() const {
+    const DenseWeight& GetWeight() const {
         return w_;
     }
 
-    void Apply(const AdaGrad* opt, const Eigen::ArrayXf& g);
+    void Apply(const AdaGrad* opt, const DenseGrad& g);
 
     size_t DataSize() const {
         return w_.size() * sizeof(float) * 4;
     }
 
+    // copy len elements of other from offset src to offset dst of this
+    void CopyFrom(const DenseAdaGradValue& other, int src, int dst, int len) {
+        w_.Mutable().segment(dst, len) = other.w_.Array().segment(src, len);
+        d2sum_.segment(dst, len) = other.d2sum_.segment(src, len);
+        g2sum_.segment(dst, len) = other.g2sum_.segment(src, len);
+        m_.segment(dst, len) = other.m_.segment(src, len);
+    }
+
     friend std::ostream& operator<<(std::ostream& os, const DenseAdaGradValue& value);
     friend std::istream& operator>>(std::istream& is, DenseAdaGradValue& value);
 
 private:
-    Eigen::ArrayXf w_;
+    DenseWeight w_;
     Eigen::ArrayXf d2sum_;
     Eigen::ArrayXf g2sum_;
     Eigen::ArrayXf m_;
@@ -53,44 +64,76 @@ private:
 std::ostream& operator<<(std::ostream& os, const DenseAdaGradValue& value);
 std::istream& operator>>(std::istream& is, DenseAdaGradValue& value);
 
-struct alignas(4) SparseAdaGradValue {
+// g2sum is placed before dimension of SparseValueDim, so that values with runtime
+// dimension keep the layout of binary files saved before fixed dimension values.
+struct SparseAdaGradG2Sum {
+    float g2sum_ = 0;
+};
+
+// WeightType is the storage type of weight, float or 16 bit float types in
+// core/utility/half.h. computation is always done in float.
+template <typename WeightType, int DIM = 0>
+struct alignas(4) SparseAdaGradValue : public SparseAdaGradG2Sum, public SparseValueDim<DIM> {
 public:
+    typedef WeightType weight_type;
+    // value with runtime dimension, binary files before version 3 are in its layout
+    typedef SparseAdaGradValue<WeightType, 0> DynamicType;
+
+    using SparseValueDim<DIM>::Dim;
+
     SparseAdaGradValue(int dim, const AdaGrad* opt);
 
     ~SparseAdaGradValue() = default;
 
+    // keep 4 bytes aligned so that values can be allocated one by one
     static constexpr int DynSizeof(int dim) {
-        return sizeof(SparseAdaGradValue) + sizeof(float) * dim;
+        return (sizeof(SparseAdaGradValue) + sizeof(WeightType) * (DIM > 0 ? DIM : dim) + 3) / 4 * 4;
     }
 
-    int Dim() const {
-        return dim_;
+    WeightType* Weight() {
+        return data_;
     }
 
-    float* Weight() {
+    const WeightType* Weight() const {
         return data_;
     }
 
-    const float* Weight() const {
-        return data_;
+    // decayed count of batches which this value appear, used by eviction
+    float Show() const {
+        return show_;
+    }
+
+    // copy state from a value of same dimension but maybe different DIM
+    template <int D>
+    void CopyFrom(const SparseAdaGradValue<WeightType, D>& other) {
+        assert(other.Dim() == Dim());
+
+        g2sum_ = other.g2sum_;
+        show_ = other.show_;
+        std::copy_n(other.data_, Dim(), data_);
     }
 
     void Apply(const AdaGrad* opt, SparseGradInfo& grad_info);
 
     void ShowDecay(const AdaGrad* opt);
 
-    friend std::ostream& operator<<(std::ostream& os, const SparseAdaGradValue& value);
-    friend std::istream& operator>>(std::istream& is, SparseAdaGradValue& value);
+    template <typename T, int D>
+    friend std::ostream& operator<<(std::ostream& os, const SparseAdaGradValue<T, D>& value);
+    template <typename T, int D>
+    friend std::istream& operator>>(std::istream& is, SparseAdaGradValue<T, D>& value);
+
+    template <typename T, int D>
+    friend struct SparseAdaGradValue;
 
 private:
-    float g2sum_;
-    int dim_ = 0;
     float show_ = 0.0;
-    float data_[0];
+    WeightType data_[0];
 };
 
-std::ostream& operator<<(std::ostream& os, const SparseAdaGradValue& value);
-std::istream& operator>>(std::istream& is, SparseAdaGradValue& value);
+template <typename WeightType, int DIM>
+std::ostream& operator<<(std::ostream& os, const SparseAdaGradValue<WeightType, DIM>& value);
+template <typename WeightType, int DIM>
+std::istream& operator>>(std::istream& is, SparseAdaGradValue<WeightType, DIM>& value);
 
 }  // namespace tensornet
 
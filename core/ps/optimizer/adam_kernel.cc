@@ -14,8 +14,11 @@
 
 #include "core/ps/optimizer/adam_kernel.h"
 
+#include <algorithm>
+
 #include <butil/logging.h>
 
+#include "core/ps/optimizer/sparse_simd.h"
 #include "core/utility/random.h"
 
 using namespace Eigen;
@@ -28,8 +31,11 @@ DenseAdamValue::DenseAdamValue(const Adam* opt, int len) {
 
     // NOTE, w must initialized as random. You can also call SetWeight initialize.
     // eigen init uniformly spread through [-1:1] default.
-    w_.setRandom(len);
-    w_ *= opt->initial_scale;
+    w_ = DenseWeight(len);
+
+    auto w = w_.Mutable();
+    w.setRandom();
+    w *= opt->initial_scale;
 
     // NOTE, m and v must be initialized zero
     m_.setZero(len);
@@ -39,19 +45,29 @@ DenseAdamValue::DenseAdamValue(const Adam* opt, int len) {
 void DenseAdamValue::SetWeight(butil::IOBuf& w_buf) {
     CHECK_EQ(w_.size() * sizeof(float), w_buf.size());
 
-    w_buf.copy_to(w_.data(), w_.size() * sizeof(float));
+    w_buf.copy_to(w_.Mutable().data(), w_.size() * sizeof(float));
 }
 
-void DenseAdamValue::Apply(const Adam* opt, const Eigen::ArrayXf& g) {
+void DenseAdamValue::Apply(const Adam* opt, const DenseGrad& g) {
     beta1_power_ *= opt->beta1;
     beta2_power_ *= opt->beta2;
 
     const float alpha = opt->learning_rate
         * Eigen::numext::sqrt(1.0 - beta2_power_) / (1.0 - beta1_power_);
 
-    m_ += (g - m_) * (1.0 - opt->beta1);
-    v_ += (g.square() - v_) * (1.0 - opt->beta2);
-    w_ -= (m_ * alpha) / (v_.sqrt() + opt->epsilon);
+    auto w = w_.Mutable();
+
+    for (Eigen::Index i = 0; i < w.size(); i += DENSE_APPLY_CHUNK) {
+        Eigen::Index n = std::min(DENSE_APPLY_CHUNK, w.size() - i);
+
+        auto gs = g.segment(i, n);
+        auto m = m_.segment(i, n);
+        auto v = v_.segment(i, n);
+
+        m += (gs - m) * (1.0 - opt->beta1);
+        v += (gs.square() - v) * (1.0 - opt->beta2);
+        w.segment(i, n) -= (m * alpha) / (v.sqrt() + opt->epsilon);
+    }
 }
 
 std::ostream& operator<<(std::ostream& os, const DenseAdamValue& value) {
@@ -79,8 +95,10 @@ std::istream& operator>>(std::istream& is, DenseAdamValue& value) {
     is.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> value.beta1_power_;
     is.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> value.beta2_power_;
 
+    auto w = value.w_.Mutable();
+
     for (int i = 0; i < array_size; i++) {
-        is >> value.w_[i];
+        is >> w[i];
         is >> value.m_[i];
         is >> value.v_[i];
     }
@@ -88,9 +106,9 @@ std::istream& operator>>(std::istream& is, DenseAdamValue& value) {
     return is;
 }
 
-SparseAdamValue::SparseAdamValue(int dim, const Adam* opt) {
-    dim_ = dim;
-
+template <typename WeightType, int DIM>
+SparseAdamValue<WeightType, DIM>::SparseAdamValue(int dim, const Adam* opt)
+    : SparseValueDim<DIM>(dim) {
     auto& reng = local_random_engine();
     auto distribution = std::normal_distribution<float>(0, 1 / sqrt(Dim()));
 
@@ -101,28 +119,44 @@ SparseAdamValue::SparseAdamValue(int dim, const Adam* opt) {
     }
 }
 
-void SparseAdamValue::Apply(const Adam* opt, SparseGradInfo& grad_info) {
-    show_ += grad_info.batch_show;
+namespace {
 
-    float* w = Weight();
-    float* m = M();
-    float* v = V();
+// scalar update for 16 bit weight types
+template <typename WeightType>
+void SparseAdamUpdate(const Adam* opt, WeightType* w, float* m, float* v,
+                      const float* g, int dim) {
+    for (int i = 0; i < dim; ++i) {
+        float mi = opt->beta1 * m[i] + (1 - opt->beta1) * g[i];
+        float vi = opt->beta2 * v[i] + (1 - opt->beta2) * g[i] * g[i];
 
-    for (int i = 0; i < dim_; ++i) {
-        m[i] = opt->beta1 * m[i] + (1 - opt->beta1) * grad_info.grad[i];
-        v[i] = opt->beta2 * v[i] + (1 - opt->beta2) * grad_info.grad[i] * grad_info.grad[i];
+        m[i] = mi;
+        v[i] = vi;
 
-        w[i] -= opt->learning_rate * m[i] / (opt->epsilon + sqrt(v[i]));
+        w[i] -= opt->learning_rate * mi / (opt->epsilon + sqrt(vi));
     }
 }
 
-std::ostream& operator<<(std::ostream& os, const SparseAdamValue& value) {
-    os << value.dim_ << "\t";
+void SparseAdamUpdate(const Adam* opt, float* w, float* m, float* v, const float* g, int dim) {
+    SimdSparseAdamApply(opt, w, m, v, g, dim);
+}
+
+} // namespace
 
-    for (int i = 0; i < value.dim_; i++) {
-        os << value.Weight()[i] << "\t";
-        os << value.M()[i] << "\t";
-        os << value.V()[i] << "\t";
+template <typename WeightType, int DIM>
+void SparseAdamValue<WeightType, DIM>::Apply(const Adam* opt, SparseGradInfo& grad_info) {
+    show_ += grad_info.batch_show;
+
+    SparseAdamUpdate(opt, Weight(), M(), V(), grad_info.grad, Dim());
+}
+
+template <typename WeightType, int DIM>
+std::ostream& operator<<(std::ostream& os, const SparseAdamValue<WeightType, DIM>& value) {
+    os << value.Dim() << "\t";
+
+    for (int i = 0; i < value.Dim(); i++) {
+        os << float(value.Weight()[i]) << "\t";
+        os << float(value.M()[i]) << "\t";
+        os << float(value.V()[i]) << "\t";
     }
 
     os << value.show_;
@@ -130,16 +164,20 @@ std::ostream& operator<<(std::ostream& os, const SparseAdamValue& value) {
     return os;
 }
 
-std::istream& operator>>(std::istream& is, SparseAdamValue& value) {
+template <typename WeightType, int DIM>
+std::istream& operator>>(std::istream& is, SparseAdamValue<WeightType, DIM>& value) {
     int dim;
     is >> dim;
 
-    CHECK_EQ(dim, value.dim_);
+    CHECK_EQ(dim, value.Dim());
 
-    for (int i = 0; i < value.dim_; i++) {
-        is >> value.Weight()[i];
-        is >> value.M()[i];
-        is >> value.V()[i];
+    for (int i = 0; i < value.Dim(); i++) {
+        float w = 0, m = 0, v = 0;
+        is >> w >> m >> v;
+
+        value.Weight()[i] = w;
+        value.M()[i] = m;
+        value.V()[i] = v;
     }
 
     is >> value.show_;
@@ -147,5 +185,24 @@ std::istream& operator>>(std::istream& is, SparseAdamValue& value) {
     return is;
 }
 
+#define INSTANTIATE_SPARSE_ADAM_VALUE(T, DIM)                                                     \
+    template struct SparseAdamValue<T, DIM>;                                                      \
+    template std::ostream& operator<<(std::ostream& os, const SparseAdamValue<T, DIM>& value);    \
+    template std::istream& operator>>(std::istream& is, SparseAdamValue<T, DIM>& value);
+
+#define INSTANTIATE_SPARSE_ADAM_VALUE_DIMS(T)  \
+    INSTANTIATE_SPARSE_ADAM_VALUE(T, 0)        \
+    INSTANTIATE_SPARSE_ADAM_VALUE(T, 8)        \
+    INSTANTIATE_SPARSE_ADAM_VALUE(T, 16)       \
+    INSTANTIATE_SPARSE_ADAM_VALUE(T, 32)       \
+    INSTANTIATE_SPARSE_ADAM_VALUE(T, 64)
+
+INSTANTIATE_SPARSE_ADAM_VALUE_DIMS(float)
+INSTANTIATE_SPARSE_ADAM_VALUE_DIMS(Half)
+INSTANTIATE_SPARSE_ADAM_VALUE_DIMS(BFloat16)
+
+#undef INSTANTIATE_SPARSE_ADAM_VALUE_DIMS
+#undef INSTANTIATE_SPARSE_ADAM_VALUE
+
 } // namespace tensornet {
 
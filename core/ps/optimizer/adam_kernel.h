@@ -17,10 +17,13 @@
 
 #include "core/ps/optimizer/optimizer.h"
 
+#include <algorithm>
+
 #include <butil/iobuf.h>
 #include <Eigen/Dense>
 
 #include "core/ps/optimizer/data_struct.h"
+#include "core/utility/half.h"
 
 namespace tensornet {
 
@@ -30,17 +33,27 @@ public:
 
     void SetWeight(butil::IOBuf& w_buf);
 
-    const Eigen::ArrayXf& GetWeight() const {
+    const DenseWeight& GetWeight() const {
         return w_;
     }
 
-    void Apply(const Adam* opt, const Eigen::ArrayXf& g);
+    void Apply(const Adam* opt, const DenseGrad& g);
 
     size_t DataSize() const {
         return sizeof(float) * 2
             + (m_.size() + v_.size() + w_.size()) * sizeof(float);
     }
 
+    // copy len elements of other from offset src to offset dst of this, beta powers are copied too
+    void CopyFrom(const DenseAdamValue& other, int src, int dst, int len) {
+        beta1_power_ = other.beta1_power_;
+        beta2_power_ = other.beta2_power_;
+
+        w_.Mutable().segment(dst, len) = other.w_.Array().segment(src, len);
+        m_.segment(dst, len) = other.m_.segment(src, len);
+        v_.segment(dst, len) = other.v_.segment(src, len);
+    }
+
     friend std::ostream& operator<<(std::ostream& os, const DenseAdamValue& value);
     friend std::istream& operator>>(std::istream& is, DenseAdamValue& value);
 
@@ -48,7 +61,7 @@ private:
     float beta1_power_ = 0;
     float beta2_power_ = 0;
 
-    Eigen::ArrayXf w_;
+    DenseWeight w_;
     Eigen::ArrayXf m_;
     Eigen::ArrayXf v_;
 };
@@ -56,25 +69,49 @@ private:
 std::ostream& operator<<(std::ostream& os, const DenseAdamValue& value);
 std::istream& operator>>(std::istream& is, DenseAdamValue& value);
 
-struct alignas(4) SparseAdamValue {
+// WeightType is the storage type of weight, float or 16 bit float types in
+// core/utility/half.h. moments are always float, g*g of usual sparse gradients
+// underflows in fp16. computation is always done in float.
+//
+// data is weight, padded to 4 bytes, then m and v. the layout of float values is
+// the same as when moments were of WeightType too.
+template <typename WeightType, int DIM = 0>
+struct alignas(4) SparseAdamValue : public SparseValueDim<DIM> {
 public:
+    typedef WeightType weight_type;
+    // value with runtime dimension, binary files before version 3 are in its layout
+    typedef SparseAdamValue<WeightType, 0> DynamicType;
+
+    using SparseValueDim<DIM>::Dim;
+
     SparseAdamValue(int dim, const Adam* opt);
     ~SparseAdamValue() = default;
 
+    // keep 4 bytes aligned so that values can be allocated one by one
     static constexpr int DynSizeof(int dim) {
-        return sizeof(SparseAdamValue) + sizeof(float) * dim * 3;
+        return sizeof(SparseAdamValue) + DataSize_(DIM > 0 ? DIM : dim);
     }
 
-    int Dim() const {
-        return dim_;
+    WeightType* Weight() {
+        return reinterpret_cast<WeightType*>(data_);
     }
 
-    float* Weight() {
-        return data_ + Dim() * 0;
+    const WeightType* Weight() const {
+        return reinterpret_cast<const WeightType*>(data_);
     }
 
-    const float* Weight() const {
-        return data_ + Dim() * 0;
+    // decayed count of batches which this value appear, used by eviction
+    float Show() const {
+        return show_;
+    }
+
+    // copy state from a value of same dimension but maybe different DIM
+    template <int D>
+    void CopyFrom(const SparseAdamValue<WeightType, D>& other) {
+        assert(other.Dim() == Dim());
+
+        show_ = other.show_;
+        std::copy_n(other.data_, DataSize_(Dim()), data_);
     }
 
     void Apply(const Adam* opt, SparseGradInfo& grad_info);
@@ -82,34 +119,48 @@ public:
     void ShowDecay(const Adam* opt) {}
 
 protected:
+    // bytes of weight padded to 4 bytes, moments follow it
+    static constexpr int WeightSize_(int dim) {
+        return (sizeof(WeightType) * dim + 3) / 4 * 4;
+    }
+
+    static constexpr int DataSize_(int dim) {
+        return WeightSize_(dim) + sizeof(float) * dim * 2;
+    }
 
     float* M() {
-        return data_ + Dim() * 1;
+        return reinterpret_cast<float*>(data_ + WeightSize_(Dim()));
     }
 
     const float* M() const {
-        return data_ + Dim() * 1;
+        return reinterpret_cast<const float*>(data_ + WeightSize_(Dim()));
     }
 
     float* V() {
-        return data_ + Dim() * 2;
+        return M() + Dim();
     }
 
     const float* V() const {
-        return data_ + Dim() * 2;
+        return M() + Dim();
     }
 
-    friend std::ostream& operator<<(std::ostream& os, const SparseAdamValue& value);
-    friend std::istream& operator>>(std::istream& is, SparseAdamValue& value);
+    template <typename T, int D>
+    friend std::ostream& operator<<(std::ostream& os, const SparseAdamValue<T, D>& value);
+    template <typename T, int D>
+    friend std::istream& operator>>(std::istream& is, SparseAdamValue<T, D>& value);
+
+    template <typename T, int D>
+    friend struct SparseAdamValue;
 
 private:
-    int dim_ = 0;
     float show_ = 0.0;
-    float data_[0];
+    alignas(4) char data_[0];
 };
 
-std::ostream& operator<<(std::ostream& os, const SparseAdamValue& value);
-std::istream& operator>>(std::istream& is, SparseAdamValue& value);
+template <typename WeightType, int DIM>
+std::ostream& operator<<(std::ostream& os, const SparseAdamValue<WeightType, DIM>& value);
+template <typename WeightType, int DIM>
+std::istream& operator>>(std::istream& is, SparseAdamValue<WeightType, DIM>& value);
 
 } // namespace tensornet {
 
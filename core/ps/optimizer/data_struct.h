@@ -15,13 +15,295 @@
 #ifndef TENSORNET_OPTIMIZER_DATA_STRUCT_H_
 #define TENSORNET_OPTIMIZER_DATA_STRUCT_H_
 
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <butil/iobuf.h>
+
 namespace tensornet {
 
+// dense gradient of one kernel block, maps memory of the request attachment directly
+typedef Eigen::Map<const Eigen::ArrayXf> DenseGrad;
+
+// dense optimizer update walks the arrays in chunks of this many floats, so all the
+// arrays of one chunk stay in L1 cache between the statements of an update.
+static constexpr Eigen::Index DENSE_APPLY_CHUNK = 1024;
+
+// dense weights of one kernel block. the buffer is shared copy on write with the
+// iobufs of pull responses, so responding weights appends a reference instead of a
+// copy, and the buffer is only copied when an update comes before the response of
+// last weights is sent out.
+//
+// NOTE, Mutable and AppendTo must be serialized by the owner (block lock), iobufs
+// only release their references from any thread.
+class DenseWeight {
+public:
+    DenseWeight() = default;
+
+    explicit DenseWeight(Eigen::Index size)
+        : data_(Alloc_(size))
+        , size_(size) {
+    }
+
+    DenseWeight(DenseWeight&& other)
+        : data_(other.data_)
+        , size_(other.size_) {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    DenseWeight& operator=(DenseWeight&& other) {
+        if (this != &other) {
+            Unref_(data_);
+
+            data_ = other.data_;
+            size_ = other.size_;
+
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        return *this;
+    }
+
+    DenseWeight(const DenseWeight&) = delete;
+    DenseWeight& operator=(const DenseWeight&) = delete;
+
+    ~DenseWeight() {
+        Unref_(data_);
+    }
+
+    Eigen::Index size() const {
+        return size_;
+    }
+
+    float operator[](Eigen::Index i) const {
+        return data_[i];
+    }
+
+    Eigen::Map<const Eigen::ArrayXf> Array() const {
+        return Eigen::Map<const Eigen::ArrayXf>(data_, size_);
+    }
+
+    // writable weights, buffer still referenced by some response is copied first
+    Eigen::Map<Eigen::ArrayXf> Mutable() {
+        if (nullptr != data_ && HeaderOf_(data_)->ref.load(std::memory_order_acquire) > 1) {
+            float* data = Alloc_(size_);
+            std::copy_n(data_, size_, data);
+
+            Unref_(data_);
+            data_ = data;
+        }
+
+        return Eigen::Map<Eigen::ArrayXf>(data_, size_);
+    }
+
+    // append weights to buf by reference, or by copy if sharing is disabled
+    void AppendTo(butil::IOBuf& buf) const {
+        if (size_ == 0) {
+            return;
+        }
+
+        if (!SharingEnabled_()) {
+            buf.append(data_, size_ * sizeof(float));
+            return;
+        }
+
+        HeaderOf_(data_)->ref.fetch_add(1, std::memory_order_relaxed);
+        buf.append_user_data(data_, size_ * sizeof(float), Unref_);
+    }
+
+    // rdma can only send iobuf blocks in registered memory, user data appended
+    // must be disabled there before any weights are pulled
+    static void EnableSharing(bool enable) {
+        SharingEnabled_() = enable;
+    }
+
+private:
+    struct Header {
+        std::atomic<int> ref{1};
+    };
+
+    static bool& SharingEnabled_() {
+        static bool enabled = true;
+        return enabled;
+    }
+
+    // keeps weights cache line aligned
+    static constexpr size_t HEADER_SIZE = 64;
+
+    static float* Alloc_(Eigen::Index size) {
+        size_t bytes = (HEADER_SIZE + size * sizeof(float) + HEADER_SIZE - 1)
+            / HEADER_SIZE * HEADER_SIZE;
+
+        void* ptr = aligned_alloc(HEADER_SIZE, bytes);
+        assert(nullptr != ptr);
+
+        new (ptr) Header();
+
+        return reinterpret_cast<float*>(static_cast<char*>(ptr) + HEADER_SIZE);
+    }
+
+    static Header* HeaderOf_(const void* data) {
+        return reinterpret_cast<Header*>(
+            const_cast<char*>(static_cast<const char*>(data)) - HEADER_SIZE);
+    }
+
+    static void Unref_(void* data) {
+        if (nullptr == data) {
+            return;
+        }
+
+        Header* header = HeaderOf_(data);
+
+        if (header->ref.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            header->~Header();
+            free(header);
+        }
+    }
+
+private:
+    float* data_ = nullptr;
+    Eigen::Index size_ = 0;
+};
+
 struct SparseGradInfo {
     float* grad;
     int batch_show;
 };
 
+// storage type of sparse weight, 16 bit types use half memory of float for weights
+// at the cost of precision. optimizer state other than weight is kept in float,
+// weights are always pulled as float.
+enum SparseWeightType {
+    SWT_FLOAT = 0,
+    // IEEE half precision, range is limited to 65504
+    SWT_FP16 = 1,
+    // bfloat16, same range as float but only 8 bits precision
+    SWT_BF16 = 2,
+};
+
+// dimension of a sparse value, base class of sparse value types. DIM > 0 is known
+// at compile time and takes no memory, DIM == 0 stores the dimension in value.
+template <int DIM>
+class SparseValueDim {
+public:
+    static constexpr int FIXED_DIM = DIM;
+
+    explicit SparseValueDim(int dim) {
+        assert(dim == DIM);
+    }
+
+    static constexpr int Dim() {
+        return DIM;
+    }
+};
+
+template <>
+class SparseValueDim<0> {
+public:
+    static constexpr int FIXED_DIM = 0;
+
+    explicit SparseValueDim(int dim)
+        : dim_(dim) {
+    }
+
+    int Dim() const {
+        return dim_;
+    }
+
+private:
+    int dim_ = 0;
+};
+
+// options given when sparse table created, they are pass through to the sparse
+// optimizer kernel.
+struct SparseKernelOption {
+    // count of independent blocks of sparse kernel, every block has its own lock and
+    // hash map, more blocks means less lock conflict when pull and push.
+    size_t block_num = 8;
+
+    SparseWeightType weight_type = SWT_FLOAT;
+
+    // expected key count of the kernel, hash maps are reserved for it at creation and
+    // grow incrementally beyond. 0 means start small.
+    size_t init_keys = 0;
+
+    // threads to save and load the kernel. blocks are saved into part files of
+    // bounded size, so both are parallel beyond block_num.
+    size_t io_threads = 16;
+
+    // directory on local disk for values spilled out of memory, cold tier is
+    // disabled if empty. files there are scratch of this process, not checkpoint.
+    std::string cold_dir;
+
+    // remember signs updated by push till they are taken by TakeUpdates, used to
+    // stream updates to serving
+    bool track_updates = false;
+
+    // keep weights as float rows in slabs apart from optimizer state, so that pull
+    // reads dense rows only, in the order keys are created. costs dim floats per key.
+    bool weight_rows = false;
+
+    // a sign is only allocated once its pushed batch shows sum up to admit_shows,
+    // which are counted by a count-min sketch of admit_sketch_width counters per row
+    // in every block. signs not admitted yet are pulled as zeros and their gradients
+    // are dropped. disabled if 0.
+    uint32_t admit_shows = 0;
+    size_t admit_sketch_width = 1 << 18;
+};
+
+// signs with keep[sign % keep.size()] are kept when loading a sparse kernel, used when
+// the model is saved by a different number of ranks or routing. empty keeps all.
+struct SparseShardFilter {
+    std::vector<uint8_t> keep;
+
+    bool Enabled() const {
+        return !keep.empty();
+    }
+
+    bool Match(uint64_t sign) const {
+        return keep[sign % keep.size()];
+    }
+};
+
+// keys match any of the enabled condition are removed from sparse table
+struct SparseEvictOption {
+    // keys with decayed show less than this are evicted, disabled if not positive
+    float show_threshold = 0;
+    // keys not updated in this many days are evicted, disabled if not positive
+    int ttl_days = 0;
+};
+
+// keys match all the enabled condition are exported for serving
+struct SparseExportOption {
+    // keys with decayed show less than this are pruned, disabled if not positive
+    float show_threshold = 0;
+    // only keys created, updated or loaded at or after this unix time are exported
+    // so that the export is a delta, disabled if zero
+    uint32_t updated_since = 0;
+};
+
+// receive a chunk of exported keys, weights of signs[i] are at weights[i * dim]
+typedef std::function<void(const std::vector<uint64_t>& signs, const std::vector<float>& weights)>
+    SparseExportFunc;
+
+enum SparseFileFormat {
+    // gzip'd text, one sign per line, slow but human readable
+    SFF_TEXT = 0,
+    // packed sign and value arrays, see SparseBlockFileHeader
+    SFF_BINARY = 1,
+};
+
 } // namespace tensornet {
 
 #endif // !TENSORNET_OPTIMIZER_DATA_STRUCT_H_
@@ -17,6 +17,7 @@
 #include <butil/logging.h>
 #include <butil/rand_util.h>
 
+#include "core/ps/optimizer/sparse_simd.h"
 #include "core/utility/random.h"
 
 namespace tensornet {
@@ -29,7 +30,7 @@ void DenseFtrlValue::SetWeight(butil::IOBuf& w_buf) {
     return;
 }
 
-void DenseFtrlValue::Apply(const Ftrl* opt, const Eigen::ArrayXf& g) {
+void DenseFtrlValue::Apply(const Ftrl* opt, const DenseGrad& g) {
     return;
 }
 
@@ -41,9 +42,9 @@ std::istream& operator>>(std::istream& is, DenseFtrlValue& value) {
     return is;
 }
 
-SparseFtrlValue::SparseFtrlValue(int dim, const Ftrl* opt) {
-    dim_ = dim;
-
+template <typename WeightType, int DIM>
+SparseFtrlValue<WeightType, DIM>::SparseFtrlValue(int dim, const Ftrl* opt)
+    : SparseValueDim<DIM>(dim) {
     auto& reng = local_random_engine();
     auto distribution = std::normal_distribution<float>(0, 1 / sqrt(Dim()));
 
@@ -54,36 +55,59 @@ SparseFtrlValue::SparseFtrlValue(int dim, const Ftrl* opt) {
     }
 }
 
-void SparseFtrlValue::Apply(const Ftrl* opt, SparseGradInfo& grad_info) {
-    float* w = Weight();
-    float* z = Z();
-    float* n = N();
+namespace {
+
+// scalar update for 16 bit weight types
+template <typename WeightType>
+void SparseFtrlUpdate(const Ftrl* opt, WeightType* w, float* z, float* n,
+                      const float* g, int dim) {
+    for (int i = 0; i < dim; ++i) {
+        float wi = w[i];
+        float zi = z[i];
+        float ni = n[i];
 
-    for (int i = 0; i < dim_; ++i) {
-        float g2 = grad_info.grad[i] * grad_info.grad[i];
+        float g2 = g[i] * g[i];
 
-        z[i] += grad_info.grad[i] - opt->learning_rate * (sqrt(n[i] + g2) - sqrt(n[i])) * w[i];
-        n[i] += g2;
-        if (abs(z[i]) <= opt->lambda1) {
-            w[i] = 0;
+        zi += g[i] - opt->learning_rate * (sqrt(ni + g2) - sqrt(ni)) * wi;
+        ni += g2;
+        if (abs(zi) <= opt->lambda1) {
+            wi = 0;
         } else {
-            w[i] = -1 / ((opt->beta + sqrt(n[i])) * opt->learning_rate + opt->lambda2);
-            if (z[i] > 0) {
-                w[i] *= z[i] - opt->lambda1;
+            wi = -1 / ((opt->beta + sqrt(ni)) * opt->learning_rate + opt->lambda2);
+            if (zi > 0) {
+                wi *= zi - opt->lambda1;
             } else {
-                w[i] *= z[i] + opt->lambda1;
+                wi *= zi + opt->lambda1;
             }
         }
+
+        w[i] = wi;
+        z[i] = zi;
+        n[i] = ni;
     }
 }
 
-std::ostream& operator<<(std::ostream& os, const SparseFtrlValue& value) {
-    os << value.dim_ << "\t";
+void SparseFtrlUpdate(const Ftrl* opt, float* w, float* z, float* n, const float* g, int dim) {
+    SimdSparseFtrlApply(opt, w, z, n, g, dim);
+}
+
+} // namespace
+
+template <typename WeightType, int DIM>
+void SparseFtrlValue<WeightType, DIM>::Apply(const Ftrl* opt, SparseGradInfo& grad_info) {
+    show_ += grad_info.batch_show;
+
+    SparseFtrlUpdate(opt, Weight(), Z(), N(), grad_info.grad, Dim());
+}
+
+template <typename WeightType, int DIM>
+std::ostream& operator<<(std::ostream& os, const SparseFtrlValue<WeightType, DIM>& value) {
+    os << value.Dim() << "\t";
 
-    for (int i = 0; i < value.dim_; i++) {
-        os << value.Weight()[i] << "\t";
-        os << value.Z()[i] << "\t";
-        os << value.N()[i] << "\t";
+    for (int i = 0; i < value.Dim(); i++) {
+        os << float(value.Weight()[i]) << "\t";
+        os << float(value.Z()[i]) << "\t";
+        os << float(value.N()[i]) << "\t";
     }
 
     os << value.show_;
@@ -91,16 +115,20 @@ std::ostream& operator<<(std::ostream& os, const SparseFtrlValue& value) {
     return os;
 }
 
-std::istream& operator>>(std::istream& is, SparseFtrlValue& value) {
+template <typename WeightType, int DIM>
+std::istream& operator>>(std::istream& is, SparseFtrlValue<WeightType, DIM>& value) {
     int dim;
     is >> dim;
 
-    CHECK_EQ(dim, value.dim_);
+    CHECK_EQ(dim, value.Dim());
 
-    for (int i = 0; i < value.dim_; i++) {
-        is >> value.Weight()[i];
-        is >> value.Z()[i];
-        is >> value.N()[i];
+    for (int i = 0; i < value.Dim(); i++) {
+        float w = 0, z = 0, n = 0;
+        is >> w >> z >> n;
+
+        value.Weight()[i] = w;
+        value.Z()[i] = z;
+        value.N()[i] = n;
     }
 
     is >> value.show_;
@@ -108,9 +136,29 @@ std::istream& operator>>(std::istream& is, SparseFtrlValue& value) {
     return is;
 }
 
-void SparseFtrlValue::ShowDecay(const Ftrl* opt) {
+template <typename WeightType, int DIM>
+void SparseFtrlValue<WeightType, DIM>::ShowDecay(const Ftrl* opt) {
     show_ *= opt->show_decay_rate;
 }
 
+#define INSTANTIATE_SPARSE_FTRL_VALUE(T, DIM)                                                     \
+    template struct SparseFtrlValue<T, DIM>;                                                      \
+    template std::ostream& operator<<(std::ostream& os, const SparseFtrlValue<T, DIM>& value);    \
+    template std::istream& operator>>(std::istream& is, SparseFtrlValue<T, DIM>& value);
+
+#define INSTANTIATE_SPARSE_FTRL_VALUE_DIMS(T)  \
+    INSTANTIATE_SPARSE_FTRL_VALUE(T, 0)        \
+    INSTANTIATE_SPARSE_FTRL_VALUE(T, 8)        \
+    INSTANTIATE_SPARSE_FTRL_VALUE(T, 16)       \
+    INSTANTIATE_SPARSE_FTRL_VALUE(T, 32)       \
+    INSTANTIATE_SPARSE_FTRL_VALUE(T, 64)
+
+INSTANTIATE_SPARSE_FTRL_VALUE_DIMS(float)
+INSTANTIATE_SPARSE_FTRL_VALUE_DIMS(Half)
+INSTANTIATE_SPARSE_FTRL_VALUE_DIMS(BFloat16)
+
+#undef INSTANTIATE_SPARSE_FTRL_VALUE_DIMS
+#undef INSTANTIATE_SPARSE_FTRL_VALUE
+
 } // namespace tensornet
 
@@ -17,10 +17,13 @@
 
 #include "core/ps/optimizer/optimizer.h"
 
+#include <algorithm>
+
 #include <butil/iobuf.h>
 #include <Eigen/Dense>
 
 #include "core/ps/optimizer/data_struct.h"
+#include "core/utility/half.h"
 
 namespace tensornet {
 
@@ -30,21 +33,28 @@ public:
 
     void SetWeight(butil::IOBuf& w_buf);
 
-    const Eigen::ArrayXf& GetWeight() const {
+    const DenseWeight& GetWeight() const {
         return w_;
     }
 
-    void Apply(const Ftrl* opt, const Eigen::ArrayXf& g);
+    void Apply(const Ftrl* opt, const DenseGrad& g);
 
     size_t DataSize() const {
         return w_.size() * sizeof(float) * 4;
     }
 
+    // copy len elements of other from offset src to offset dst of this
+    void CopyFrom(const DenseFtrlValue& other, int src, int dst, int len) {
+        w_.Mutable().segment(dst, len) = other.w_.Array().segment(src, len);
+        z_.segment(dst, len) = other.z_.segment(src, len);
+        n_.segment(dst, len) = other.n_.segment(src, len);
+    }
+
     friend std::ostream& operator<<(std::ostream& os, const DenseFtrlValue& value);
     friend std::istream& operator>>(std::istream& is, DenseFtrlValue& value);
 
 private:
-    Eigen::ArrayXf w_;
+    DenseWeight w_;
     Eigen::ArrayXf z_;
     Eigen::ArrayXf n_;
 };
@@ -52,60 +62,99 @@ private:
 std::ostream& operator<<(std::ostream& os, const DenseFtrlValue& value);
 std::istream& operator>>(std::istream& is, DenseFtrlValue& value);
 
-struct alignas(4) SparseFtrlValue {
+// WeightType is the storage type of weight, float or 16 bit float types in
+// core/utility/half.h. z and n are always float, n sums g*g which underflows in
+// fp16 for usual sparse gradients. computation is always done in float.
+//
+// data is weight, padded to 4 bytes, then z and n. the layout of float values is
+// the same as when z and n were of WeightType too.
+template <typename WeightType, int DIM = 0>
+struct alignas(4) SparseFtrlValue : public SparseValueDim<DIM> {
 public:
+    typedef WeightType weight_type;
+    // value with runtime dimension, binary files before version 3 are in its layout
+    typedef SparseFtrlValue<WeightType, 0> DynamicType;
+
+    using SparseValueDim<DIM>::Dim;
+
     SparseFtrlValue(int dim, const Ftrl* opt);
 
     ~SparseFtrlValue() = default;
 
+    // keep 4 bytes aligned so that values can be allocated one by one
     static constexpr int DynSizeof(int dim) {
-        return sizeof(SparseFtrlValue) + sizeof(float) * dim * 3;
+        return sizeof(SparseFtrlValue) + DataSize_(DIM > 0 ? DIM : dim);
+    }
+
+    WeightType* Weight() {
+        return reinterpret_cast<WeightType*>(data_);
     }
 
-    int Dim() const {
-        return dim_;
+    const WeightType* Weight() const {
+        return reinterpret_cast<const WeightType*>(data_);
     }
 
-    float* Weight() {
-        return data_ + Dim() * 0;
+    // decayed count of batches which this value appear, used by eviction
+    float Show() const {
+        return show_;
     }
 
-    const float* Weight() const {
-        return data_ + Dim() * 0;
+    // copy state from a value of same dimension but maybe different DIM
+    template <int D>
+    void CopyFrom(const SparseFtrlValue<WeightType, D>& other) {
+        assert(other.Dim() == Dim());
+
+        show_ = other.show_;
+        std::copy_n(other.data_, DataSize_(Dim()), data_);
     }
 
     void Apply(const Ftrl* opt, SparseGradInfo& grad_info);
 
     void ShowDecay(const Ftrl* opt);
 
-    friend std::ostream& operator<<(std::ostream& os, const SparseFtrlValue& value);
-    friend std::istream& operator>>(std::istream& is, SparseFtrlValue& value);
+    template <typename T, int D>
+    friend std::ostream& operator<<(std::ostream& os, const SparseFtrlValue<T, D>& value);
+    template <typename T, int D>
+    friend std::istream& operator>>(std::istream& is, SparseFtrlValue<T, D>& value);
+
+    template <typename T, int D>
+    friend struct SparseFtrlValue;
 
 protected:
+    // bytes of weight padded to 4 bytes, z and n follow it
+    static constexpr int WeightSize_(int dim) {
+        return (sizeof(WeightType) * dim + 3) / 4 * 4;
+    }
+
+    static constexpr int DataSize_(int dim) {
+        return WeightSize_(dim) + sizeof(float) * dim * 2;
+    }
+
     float* Z() {
-        return data_ + Dim() * 1;
+        return reinterpret_cast<float*>(data_ + WeightSize_(Dim()));
     }
 
     const float* Z() const {
-        return data_ + Dim() * 1;
+        return reinterpret_cast<const float*>(data_ + WeightSize_(Dim()));
     }
 
     float* N() {
-        return data_ + Dim() * 2;
+        return Z() + Dim();
     }
 
     const float* N() const {
-        return data_ + Dim() * 2;
+        return Z() + Dim();
     }
 
 private:
-    int dim_ = 0;
     float show_ = 0.0;
-    float data_[0];
+    alignas(4) char data_[0];
 };
 
-std::ostream& operator<<(std::ostream& os, const SparseFtrlValue& value);
-std::istream& operator>>(std::istream& is, SparseFtrlValue& value);
+template <typename WeightType, int DIM>
+std::ostream& operator<<(std::ostream& os, const SparseFtrlValue<WeightType, DIM>& value);
+template <typename WeightType, int DIM>
+std::istream& operator>>(std::istream& is, SparseFtrlValue<WeightType, DIM>& value);
 
 }  // namespace tensornet
 
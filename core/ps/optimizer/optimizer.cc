@@ -25,10 +25,46 @@ typedef DenseKernelBlock<Adam, DenseAdamValue> DenseAdamKernelBlock;
 typedef DenseKernelBlock<AdaGrad, DenseAdaGradValue> DenseAdaGradKernelBlock;
 typedef DenseKernelBlock<Ftrl, DenseFtrlValue> DenseFtrlKernelBlock;
 
-typedef SparseKernelBlock<Adam, SparseAdamValue> SparseAdamKernelBlock;
-typedef SparseKernelBlock<AdaGrad, SparseAdaGradValue> SparseAdaGradKernelBlock;
-typedef SparseKernelBlock<Ftrl, SparseFtrlValue> SparseFtrlKernelBlock;
+template <typename OptType, typename ValueType>
+SparseOptKernelSharedPtr MakeSparseOptKernel(
+    const OptType* opt, int dimension, const SparseKernelOption& option) {
+    return std::make_shared<SparseOptimizerKernel<SparseKernelBlock<OptType, ValueType>>>(
+            opt, dimension, option);
+}
+
+// common dimensions use value types specialized at compile time, see SparseValueDim
+template <typename OptType, template <typename, int> class ValueType, typename WeightType>
+SparseOptKernelSharedPtr CreateSparseOptKernelByDim(
+    const OptType* opt, int dimension, const SparseKernelOption& option) {
+    switch (dimension) {
+    case 8:
+        return MakeSparseOptKernel<OptType, ValueType<WeightType, 8>>(opt, dimension, option);
+    case 16:
+        return MakeSparseOptKernel<OptType, ValueType<WeightType, 16>>(opt, dimension, option);
+    case 32:
+        return MakeSparseOptKernel<OptType, ValueType<WeightType, 32>>(opt, dimension, option);
+    case 64:
+        return MakeSparseOptKernel<OptType, ValueType<WeightType, 64>>(opt, dimension, option);
+    default:
+        return MakeSparseOptKernel<OptType, ValueType<WeightType, 0>>(opt, dimension, option);
+    }
+}
 
+template <typename OptType, template <typename, int> class ValueType>
+SparseOptKernelSharedPtr CreateSparseOptKernelByWeightType(
+    const OptType* opt, int dimension, const SparseKernelOption& option) {
+    switch (option.weight_type) {
+    case SWT_FLOAT:
+        return CreateSparseOptKernelByDim<OptType, ValueType, float>(opt, dimension, option);
+    case SWT_FP16:
+        return CreateSparseOptKernelByDim<OptType, ValueType, Half>(opt, dimension, option);
+    case SWT_BF16:
+        return CreateSparseOptKernelByDim<OptType, ValueType, BFloat16>(opt, dimension, option);
+    }
+
+    LOG(FATAL) << "unknown sparse weight type:" << option.weight_type;
+    return nullptr;
+}
 
 DenseOptKernelSharedPtr Adam::CreateDenseOptKernel(
     int offset_begin, int offset_end) const {
@@ -36,8 +72,9 @@ DenseOptKernelSharedPtr Adam::CreateDenseOptKernel(
             this, offset_begin, offset_end);
 }
 
-SparseOptKernelSharedPtr Adam::CreateSparseOptKernel(int dimension) const {
-    return std::make_shared<SparseOptimizerKernel<SparseAdamKernelBlock>>(this, dimension);
+SparseOptKernelSharedPtr Adam::CreateSparseOptKernel(
+    int dimension, const SparseKernelOption& option) const {
+    return CreateSparseOptKernelByWeightType<Adam, SparseAdamValue>(this, dimension, option);
 }
 
 DenseOptKernelSharedPtr AdaGrad::CreateDenseOptKernel(
@@ -46,8 +83,9 @@ DenseOptKernelSharedPtr AdaGrad::CreateDenseOptKernel(
             this, offset_begin, offset_end);
 }
 
-SparseOptKernelSharedPtr AdaGrad::CreateSparseOptKernel(int dimension) const {
-    return std::make_shared<SparseOptimizerKernel<SparseAdaGradKernelBlock>>(this, dimension);
+SparseOptKernelSharedPtr AdaGrad::CreateSparseOptKernel(
+    int dimension, const SparseKernelOption& option) const {
+    return CreateSparseOptKernelByWeightType<AdaGrad, SparseAdaGradValue>(this, dimension, option);
 }
 
 DenseOptKernelSharedPtr Ftrl::CreateDenseOptKernel(
@@ -56,8 +94,9 @@ DenseOptKernelSharedPtr Ftrl::CreateDenseOptKernel(
             this, offset_begin, offset_end);
 }
 
-SparseOptKernelSharedPtr Ftrl::CreateSparseOptKernel(int dimension) const {
-    return std::make_shared<SparseOptimizerKernel<SparseFtrlKernelBlock>>(this, dimension);
+SparseOptKernelSharedPtr Ftrl::CreateSparseOptKernel(
+    int dimension, const SparseKernelOption& option) const {
+    return CreateSparseOptKernelByWeightType<Ftrl, SparseFtrlValue>(this, dimension, option);
 }
 
 } // namespace tensornet {
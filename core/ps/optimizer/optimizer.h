@@ -19,6 +19,8 @@
 #include <memory>
 #include <string>
 
+#include "core/ps/optimizer/data_struct.h"
+
 namespace tensornet {
 
 class DenseOptimizerKernelBase;
@@ -38,7 +40,8 @@ public:
     virtual DenseOptKernelSharedPtr CreateDenseOptKernel(
         int offset_begin, int offset_end) const = 0;
 
-    virtual SparseOptKernelSharedPtr CreateSparseOptKernel(int dimension) const = 0;
+    virtual SparseOptKernelSharedPtr CreateSparseOptKernel(
+        int dimension, const SparseKernelOption& option) const = 0;
 
     virtual std::string Name() const = 0;
 
@@ -61,7 +64,8 @@ public:
     virtual DenseOptKernelSharedPtr CreateDenseOptKernel(
         int offset_begin, int offset_end) const;
 
-    virtual SparseOptKernelSharedPtr CreateSparseOptKernel(int dimension) const;
+    virtual SparseOptKernelSharedPtr CreateSparseOptKernel(
+        int dimension, const SparseKernelOption& option) const;
 
     virtual std::string Name() const {
         return "Adam";
@@ -93,7 +97,8 @@ public:
     virtual DenseOptKernelSharedPtr CreateDenseOptKernel(
         int offset_begin, int offset_end) const;
 
-    virtual SparseOptKernelSharedPtr CreateSparseOptKernel(int dimension) const;
+    virtual SparseOptKernelSharedPtr CreateSparseOptKernel(
+        int dimension, const SparseKernelOption& option) const;
 
     virtual std::string Name() const {
         return "AdaGrad";
@@ -125,7 +130,8 @@ public:
     virtual DenseOptKernelSharedPtr CreateDenseOptKernel(
         int offset_begin, int offset_end) const;
 
-    virtual SparseOptKernelSharedPtr CreateSparseOptKernel(int dimension) const;
+    virtual SparseOptKernelSharedPtr CreateSparseOptKernel(
+        int dimension, const SparseKernelOption& option) const;
 
     virtual std::string Name() const {
         return "Ftrl";
@@ -17,27 +17,73 @@
 
 #include "core/ps/optimizer/optimizer.h"
 
+#include <atomic>
 #include <mutex>
-#include <unordered_map>
 #include <functional>
 #include <thread>
 #include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <butil/iobuf.h>
 #include <butil/logging.h>
+#include <butil/time.h>
 #include <Eigen/Dense>
 
 #include <boost/iostreams/stream.hpp>
+#include <bthread/mutex.h>
 
 #include "core/utility/file_io.h"
+#include "core/utility/half.h"
+#include "core/utility/log_store.h"
 #include "core/utility/allocator.h"
+#include "core/utility/count_min_sketch.h"
+#include "core/utility/blocking_queue.h"
+#include "core/utility/metrics.h"
+#include "core/utility/open_hash_map.h"
+#include "core/utility/parallel_for.h"
+#include "core/utility/thread_pool.h"
+#include "core/utility/trace.h"
 
 #include "core/ps/optimizer/data_struct.h"
 
 namespace tensornet {
 
 static constexpr size_t DENSE_KERNEL_BLOCK_NUM = 8;
-static constexpr size_t SPARSE_KERNEL_BLOCK_NUM = 8;
+
+// how many signs ahead to prefetch hash map slot in batch pull and push
+static constexpr size_t SPARSE_KERNEL_PREFETCH_NUM = 8;
+
+// slots of hash map scanned in one lock hold when evict or decay show
+static constexpr size_t SPARSE_KERNEL_EVICT_STEP = 1 << 14;
+
+// batch pull and push with more signs than this run all blocks in parallel
+static constexpr size_t SPARSE_KERNEL_PARALLEL_MIN_SIGNS = 4096;
+
+// cold tier of a block is compacted when it has more garbage than this and than live
+// values
+static constexpr size_t SPARSE_KERNEL_COLD_COMPACT_MIN = 1 << 16;
+
+// lock mu, time waited is recorded if it is held by others
+inline std::unique_lock<std::mutex> LockAndRecordWait(std::mutex& mu) {
+    std::unique_lock<std::mutex> lock(mu, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        int64_t begin = butil::cpuwide_time_us();
+        int64_t trace_begin = Tracer::Instance()->Enabled() ? Tracer::NowUs() : 0;
+        lock.lock();
+        Metrics::Instance()->sparse_block_lock_wait << butil::cpuwide_time_us() - begin;
+        if (trace_begin > 0) {
+            Tracer* tracer = Tracer::Instance();
+            tracer->Record("sparse_block_lock_wait", "ps", trace_begin, Tracer::NowUs(), tracer->Step());
+        }
+    }
+
+    return lock;
+}
 
 class DenseOptimizerKernelBase {
 public:
@@ -71,6 +117,11 @@ public:
 
     virtual void DeSerialized(std::istream& is) = 0;
 
+    // copy state of elements in both kernels from other, which must be created by the
+    // same optimizer. offsets are of the whole table, used to load a model saved by a
+    // different number of ranks.
+    virtual void CopyFrom(const DenseOptimizerKernelBase& other) = 0;
+
     virtual size_t DataSize() = 0;
 
 private:
@@ -84,17 +135,55 @@ public:
 
     ~SparseOptimizerKernelBase() {}
 
-    virtual float* GetWeight(uint64_t sign) = 0;
+    // copy weight of sign to w which must have room for dim floats
+    virtual void GetWeight(uint64_t sign, float* w) = 0;
 
     virtual void Apply(uint64_t sign, SparseGradInfo& grad_info) = 0;
 
-    virtual void Serialized(const std::string& filepath) = 0;
+    // copy weights of n signs into out one by one, out must have room for n * dim floats.
+    // weights is created if sign not exist just like GetWeight
+    virtual void GetWeights(const uint64_t* signs, size_t n, float* out) = 0;
+
+    // apply grad_infos[i] to signs[i], all signs must be pulled before
+    virtual void ApplyBatch(const uint64_t* signs, SparseGradInfo* grad_infos, size_t n) = 0;
+
+    // only values created or updated since last save are written if delta is true,
+    // which is only supported by SFF_BINARY. keys removed by Evict are not recorded,
+    // save fully after evict or loading base and deltas brings them back
+    virtual void Serialized(const std::string& filepath, SparseFileFormat format, bool delta) = 0;
 
-    virtual void DeSerialized(const std::string& filepath) = 0;
+    // file format is detected from the files found in filepath, signs not match
+    // filter are skipped. with lazy, files of a block are read in background or by
+    // the first pull or push of the block, whichever comes first, see DeSerialized
+    // of SparseOptimizerKernel
+    virtual void DeSerialized(const std::string& filepath,
+                              const SparseShardFilter& filter = SparseShardFilter(),
+                              bool lazy = false) = 0;
 
     virtual size_t KeyCount() const = 0;
 
+    // block of sign, same in every kernel created with same option
+    virtual int BlockId(uint64_t sign) const = 0;
+
+    // approximate bytes of values and hash maps
+    virtual size_t MemoryBytes() const = 0;
+
     virtual void ShowDecay() = 0;
+
+    // remove keys match option and free their memory, return count of evicted keys
+    virtual size_t Evict(const SparseEvictOption& option) = 0;
+
+    // move keys match option to cold tier if it is enabled, return count of spilled keys
+    virtual size_t Spill(const SparseEvictOption& option) = 0;
+
+    // call emit with weights of keys match option, one call at a time, return count
+    // of exported keys
+    virtual size_t Export(const SparseExportOption& option, const SparseExportFunc& emit) = 0;
+
+    // append at most max_keys signs updated since they are last taken and their
+    // weights, return count of appended signs. only works if track_updates is set
+    virtual size_t TakeUpdates(size_t max_keys, std::vector<uint64_t>* signs,
+                               std::vector<float>* weights) = 0;
 };
 
 template <typename OptType, typename ValueType>
@@ -133,11 +222,13 @@ public:
         value_.SetWeight(w_buf);
     }
 
-    const Eigen::ArrayXf& GetWeight() const {
-        return value_.GetWeight();
+    // append weights by reference, later updates copy on write
+    void GetWeight(butil::IOBuf& w_buf) const {
+        const std::lock_guard<std::mutex> lock(*mu_);
+        value_.GetWeight().AppendTo(w_buf);
     }
 
-    void Apply(const Eigen::ArrayXf& g) {
+    void Apply(const DenseGrad& g) {
         const std::lock_guard<std::mutex> lock(*mu_);
         value_.Apply(opt_, g);
     }
@@ -146,11 +237,26 @@ public:
         return value_.DataSize();
     }
 
+    void CopyFrom(const DenseKernelBlock& other, size_t src, size_t dst, size_t len) {
+        std::lock(*mu_, *other.mu_);
+        const std::lock_guard<std::mutex> lock(*mu_, std::adopt_lock);
+        const std::lock_guard<std::mutex> other_lock(*other.mu_, std::adopt_lock);
+
+        value_.CopyFrom(other.value_, src, dst, len);
+    }
+
+    // value is copied under lock and formatted without it, so that push of this
+    // block is not stalled by a save
     friend std::ostream& operator<<(std::ostream& os, const DenseKernelBlock& block) {
-        const std::lock_guard<std::mutex> lock(*block.mu_);
+        ValueType value(block.opt_, block.block_size_);
+
+        {
+            const std::lock_guard<std::mutex> lock(*block.mu_);
+            value.CopyFrom(block.value_, 0, 0, block.block_size_);
+        }
 
         os << "opt_name:" << block.opt_->Name() << std::endl;
-        os << block.value_ << std::endl;
+        os << value << std::endl;
 
         return os;
     }
@@ -203,15 +309,30 @@ public:
     virtual void Apply(butil::IOBuf& grad) {
         assert(grad.size() == Length() * sizeof(float));
 
+        // cut only references the iobuf blocks, gradient are copied later and only
+        // when a block spans more than one iobuf block or is not aligned.
+        std::vector<butil::IOBuf> block_grads(blocks_.size());
         for (size_t i = 0; i < blocks_.size(); i++) {
+            size_t bytes = sizeof(float) * blocks_[i].BlockSize();
+            CHECK_EQ(bytes, grad.cutn(&block_grads[i], bytes));
+        }
+
+        ParallelFor(blocks_.size(), [this, &block_grads](size_t i) {
             size_t block_size = blocks_[i].BlockSize();
+            size_t bytes = sizeof(float) * block_size;
 
-            Eigen::ArrayXf g(block_size);
+            std::vector<float> aux;
+            const void* data = block_grads[i].fetch1();
 
-            CHECK_EQ(sizeof(float) * block_size, grad.cutn(g.data(), sizeof(float) * block_size));
+            if (block_grads[i].backing_block_num() != 1
+                    || reinterpret_cast<uintptr_t>(data) % alignof(float) != 0) {
+                aux.resize(block_size);
+                block_grads[i].copy_to(aux.data(), bytes);
+                data = aux.data();
+            }
 
-            blocks_[i].Apply(g);
-        }
+            blocks_[i].Apply(DenseGrad(static_cast<const float*>(data), block_size));
+        });
     }
 
     virtual void SetWeight(butil::IOBuf& w_buf) {
@@ -226,8 +347,7 @@ public:
 
     virtual void GetWeight(butil::IOBuf& w_buf) const {
         for (size_t i = 0; i < blocks_.size(); i++) {
-            const auto& w = blocks_[i].GetWeight();
-            w_buf.append(w.data(), w.size() * sizeof(float));
+            blocks_[i].GetWeight(w_buf);
         }
     }
 
@@ -244,6 +364,36 @@ public:
         }
     }
 
+    virtual void CopyFrom(const DenseOptimizerKernelBase& other_base) {
+        auto other = dynamic_cast<const DenseOptimizerKernel*>(&other_base);
+        CHECK(nullptr != other) << "copy dense kernel of different optimizer";
+
+        // walk blocks of both kernels in order of offset, copy where they overlap
+        size_t i = 0, j = 0;
+        size_t begin = OffsetBegin(), other_begin = other->OffsetBegin();
+
+        while (i < blocks_.size() && j < other->blocks_.size()) {
+            size_t end = begin + blocks_[i].BlockSize();
+            size_t other_end = other_begin + other->blocks_[j].BlockSize();
+
+            size_t overlap_begin = std::max(begin, other_begin);
+            size_t overlap_end = std::min(end, other_end);
+
+            if (overlap_begin < overlap_end) {
+                blocks_[i].CopyFrom(other->blocks_[j], overlap_begin - other_begin,
+                                    overlap_begin - begin, overlap_end - overlap_begin);
+            }
+
+            if (end <= other_end) {
+                begin = end;
+                ++i;
+            } else {
+                other_begin = other_end;
+                ++j;
+            }
+        }
+    }
+
     virtual size_t DataSize() {
         size_t total_size = 0;
         for (size_t i = 0; i < blocks_.size(); i++) {
@@ -256,27 +406,130 @@ private:
     std::vector<KernelBlockType> blocks_;
 };
 
-static auto sparse_key_hasher = [](const uint64_t& sign) {
-    // going to this shard sign always have same remainder of sign % shard_num,
-    // we flip high and low bit to avoid hashmap bucket conflict probability.
-    return std::hash<uint64_t>()(sign >> 32 | sign << 32);
+struct SparseKeyHasher {
+    size_t operator()(const uint64_t& sign) const {
+        // going to this shard sign always have same remainder of sign % shard_num,
+        // we flip high and low bit to avoid hashmap bucket conflict probability.
+        return std::hash<uint64_t>()(sign >> 32 | sign << 32);
+    }
+};
+
+static SparseKeyHasher sparse_key_hasher;
+
+static constexpr uint32_t SPARSE_BLOCK_FILE_MAGIC = 0x42534e54;  // "TNSB"
+// version 2 add weight_type into header
+// version 3 values of fixed dimension no longer store the dimension, see SparseValueDim
+static constexpr uint32_t SPARSE_BLOCK_FILE_VERSION = 3;
+
+// signs count of one chunk in binary block file
+static constexpr uint32_t SPARSE_BLOCK_FILE_CHUNK_SIZE = 1 << 16;
+
+// binary block file is a SparseBlockFileHeader followed by chunks, every chunk is
+//     uint32_t n | uint64_t sign[n] | value[n]
+// value is the raw memory of ValueType whose size is value_size, all integers are
+// stored in host byte order. values are read back by memcpy without any parsing.
+struct SparseBlockFileHeader {
+    uint32_t magic = SPARSE_BLOCK_FILE_MAGIC;
+    uint32_t version = SPARSE_BLOCK_FILE_VERSION;
+    char opt_name[32] = {0};
+    int32_t dim = 0;
+    uint32_t value_size = 0;
+    uint64_t key_count = 0;
+    // SparseWeightType, since version 2
+    uint32_t weight_type = SWT_FLOAT;
+    uint32_t reserved = 0;
+};
+
+// size of header of version 1 file, which is a prefix of current header
+static constexpr size_t SPARSE_BLOCK_FILE_HEADER_V1_SIZE =
+    offsetof(SparseBlockFileHeader, weight_type);
+
+// a block is saved into files of at most this many keys, which are written and read
+// in parallel by io threads of kernel
+static constexpr size_t SPARSE_BLOCK_FILE_PART_KEYS = 1 << 18;
+
+// name of file holding the count of block files saved, files of an older save with
+// larger sequence number may be left in the same directory
+static constexpr const char* SPARSE_BLOCK_NUM_FILE = "sparse_block_num";
+
+// block number of the saving kernel in first line, then block of file i in line i + 1
+static constexpr const char* SPARSE_BLOCK_INDEX_FILE = "sparse_block_index";
+
+// keys of a block file in memory, cut from a kernel block and waiting to be written
+struct SparseBlockFilePart {
+    SparseBlockFileHeader header;
+    std::vector<uint64_t> signs;
+    std::vector<char> values;
+    // block the part is cut from, not written
+    size_t block_id = 0;
+};
+
+template <typename T>
+struct SparseWeightTypeOf;
+
+template <>
+struct SparseWeightTypeOf<float> {
+    static constexpr SparseWeightType value = SWT_FLOAT;
+};
+
+template <>
+struct SparseWeightTypeOf<Half> {
+    static constexpr SparseWeightType value = SWT_FP16;
+};
+
+template <>
+struct SparseWeightTypeOf<BFloat16> {
+    static constexpr SparseWeightType value = SWT_BF16;
 };
 
+// read exactly n bytes, return false if file ends before any byte read
+inline bool ReadFull(FileReaderSource& reader, void* buf, size_t n) {
+    char* p = static_cast<char*>(buf);
+    size_t read_size = 0;
+
+    while (read_size < n) {
+        std::streamsize ret = reader.read(p + read_size, n - read_size);
+        if (ret <= 0) {
+            break;
+        }
+        read_size += ret;
+    }
+
+    CHECK(read_size == 0 || read_size == n) << "binary sparse file is truncated, expect:"
+        << n << " got:" << read_size;
+
+    return read_size == n;
+}
+
 template <typename OptType, typename ValueType>
 class SparseKernelBlock {
 public:
-    // here must be gurantee that hashmap reserve bucket size is a prime number,
-    // 15485863 is close to 16M, its mean that we can store sparse parameter size
-    // in one single node is 16M * SPARSE_KERNEL_BLOCK_NUM, in which setting we can
-    // supporting close to 5B parameter with 50 node run together without rehash.
-    // TODO the initial bucket size maybe expose to user by a configure.
-    SparseKernelBlock(const OptimizerBase* opt, int dimension)
-        : values_(15485863, sparse_key_hasher)
+    // hash map is reserved for the share of option.init_keys of one block and grows
+    // incrementally beyond that, so no pull or push is stalled by a full rehash.
+    //
+    // values spilled are kept in cold_file if it is not empty, see Spill.
+    SparseKernelBlock(const OptimizerBase* opt, int dimension, const SparseKernelOption& option,
+                      const std::string& cold_file = std::string())
+        : values_(option.init_keys / option.block_num, sparse_key_hasher)
         , dim_(dimension)
-        , alloc_(ValueType::DynSizeof(dim_), 1 << 16) {
-        values_.max_load_factor(0.75);
+        , alloc_(ValueType::DynSizeof(dim_), 1 << 16, option.weight_rows ? sizeof(float) * dimension : 0)
+        , weight_rows_(option.weight_rows)
+        , cold_index_(0, sparse_key_hasher)
+        , cold_file_(cold_file)
+        , track_updates_(option.track_updates)
+        , updated_(0, sparse_key_hasher)
+        , admit_shows_(option.admit_shows)
+        , snapshot_copies_(0, sparse_key_hasher) {
         opt_ = dynamic_cast<const OptType*>(opt);
         mutex_ = std::make_unique<std::mutex>();
+
+        if (admit_shows_ > 0) {
+            admission_.reset(new CountMinSketch(option.admit_sketch_width));
+        }
+
+        if (!cold_file_.empty()) {
+            cold_.reset(new LogStore(ColdFile_(), ValueType::DynSizeof(dim_)));
+        }
     }
 
     SparseKernelBlock(SparseKernelBlock&) = delete;
@@ -287,7 +540,23 @@ public:
         , values_(std::move(other.values_))
         , mutex_(std::move(other.mutex_))
         , dim_(other.dim_)
+        , version_(other.version_)
+        , loading_keys_(other.loading_keys_)
         , alloc_(std::move(other.alloc_))
+        , weight_rows_(other.weight_rows_)
+        , cold_index_(std::move(other.cold_index_))
+        , cold_(std::move(other.cold_))
+        , cold_file_(std::move(other.cold_file_))
+        , cold_generation_(other.cold_generation_)
+        , track_updates_(other.track_updates_)
+        , updated_(std::move(other.updated_))
+        , admit_shows_(other.admit_shows_)
+        , admission_(std::move(other.admission_))
+        , snapshotting_(other.snapshotting_)
+        , snapshot_epoch_(other.snapshot_epoch_)
+        , snapshot_copies_(std::move(other.snapshot_copies_))
+        , snapshot_values_(std::move(other.snapshot_values_))
+        , exporting_(other.exporting_)
     { }
 
     SparseKernelBlock& operator=(SparseKernelBlock&& other) {
@@ -295,129 +564,1066 @@ public:
         values_ = std::move(other.values_);
         mutex_ = std::move(other.mutex_);
         dim_ = other.dim_;
+        version_ = other.version_;
+        loading_keys_ = other.loading_keys_;
         alloc_ = std::move(other.alloc_);
-
-        return this;
+        weight_rows_ = other.weight_rows_;
+        cold_index_ = std::move(other.cold_index_);
+        cold_ = std::move(other.cold_);
+        cold_file_ = std::move(other.cold_file_);
+        cold_generation_ = other.cold_generation_;
+        track_updates_ = other.track_updates_;
+        updated_ = std::move(other.updated_);
+        admit_shows_ = other.admit_shows_;
+        admission_ = std::move(other.admission_);
+        snapshotting_ = other.snapshotting_;
+        snapshot_epoch_ = other.snapshot_epoch_;
+        snapshot_copies_ = std::move(other.snapshot_copies_);
+        snapshot_values_ = std::move(other.snapshot_values_);
+        exporting_ = other.exporting_;
+
+        return *this;
     }
 
     ~SparseKernelBlock() {
-        for (const auto& iter : values_) {
-            if (iter.second) {
-                alloc_.deallocate(iter.second);
+        values_.for_each([this](const uint64_t& sign, Entry& entry) {
+            if (entry.value) {
+                alloc_.deallocate(entry.value);
             }
-        }
+        });
     }
 
-    float* GetWeight(uint64_t sign) {
-        const std::lock_guard<std::mutex> lock(*mutex_);
+    void GetWeight(uint64_t sign, float* w) {
+        auto lock = LockAndRecordWait(*mutex_);
 
-        auto inserted = values_.insert({sign, nullptr});
-        if (inserted.second) {
-            inserted.first->second = alloc_.allocate(dim_, opt_);
+        if (cold_index_.size() > 0) {
+            uint32_t index = 0;
+            FaultIn_(lock, &sign, &index, 1);
         }
 
-        return inserted.first->second->Weight();
+        Entry* entry = PullEntry_(sign);
+        if (entry != nullptr) {
+            CopyWeight_(*entry, w);
+        } else {
+            std::fill_n(w, Dim_(), 0);
+        }
     }
 
     void Apply(uint64_t sign, SparseGradInfo& grad_info) {
-        std::lock_guard<std::mutex> lock(*mutex_);
-        auto iter = values_.find(sign);
+        auto lock = LockAndRecordWait(*mutex_);
+
+        if (cold_index_.size() > 0) {
+            uint32_t index = 0;
+            FaultIn_(lock, &sign, &index, 1);
+        }
+
+        Entry* entry = PushEntry_(sign, grad_info.batch_show);
+        if (entry == nullptr) {
+            return;
+        }
+
+        Preserve_(sign, *entry);
+        entry->value->Apply(opt_, grad_info);
+        entry->version = version_;
+        entry->update_time = butil::gettimeofday_s();
+        SyncRow_(*entry);
+
+        if (track_updates_) {
+            updated_.insert(sign, 0);
+        }
+    }
+
+    // signs[index[0, n)] must all belong to this block, weight of signs[index[i]] is
+    // copied to out + index[i] * dim_
+    void GetWeights(const uint64_t* signs, const uint32_t* index, size_t n, float* out) {
+        auto lock = LockAndRecordWait(*mutex_);
+
+        if (cold_index_.size() > 0) {
+            FaultIn_(lock, signs, index, n);
+        }
 
-        // must already meet and created in pull
-        CHECK(iter != values_.end()) << " embedding of sign " << sign
-            << " not create yet, something must be wrong";
+        for (size_t i = 0; i < n; ++i) {
+            if (i + SPARSE_KERNEL_PREFETCH_NUM < n) {
+                values_.prefetch(signs[index[i + SPARSE_KERNEL_PREFETCH_NUM]]);
+            }
+
+            Entry* entry = PullEntry_(signs[index[i]]);
+            float* w = out + (size_t)index[i] * Dim_();
+
+            if (entry != nullptr) {
+                CopyWeight_(*entry, w);
+            } else {
+                std::fill_n(w, Dim_(), 0);
+            }
+        }
+    }
+
+    void ApplyBatch(const uint64_t* signs, SparseGradInfo* grad_infos,
+                    const uint32_t* index, size_t n) {
+        auto lock = LockAndRecordWait(*mutex_);
+
+        if (cold_index_.size() > 0) {
+            FaultIn_(lock, signs, index, n);
+        }
+
+        uint32_t now = butil::gettimeofday_s();
+
+        for (size_t i = 0; i < n; ++i) {
+            if (i + SPARSE_KERNEL_PREFETCH_NUM < n) {
+                values_.prefetch(signs[index[i + SPARSE_KERNEL_PREFETCH_NUM]]);
+            }
 
-        ValueType* value = iter->second;
+            uint64_t sign = signs[index[i]];
+            Entry* entry = PushEntry_(sign, grad_infos[index[i]].batch_show);
+            if (entry == nullptr) {
+                continue;
+            }
+
+            Preserve_(sign, *entry);
+            entry->value->Apply(opt_, grad_infos[index[i]]);
+            entry->version = version_;
+            entry->update_time = now;
+            SyncRow_(*entry);
 
-        value->Apply(opt_, grad_info);
+            if (track_updates_) {
+                updated_.insert(sign, 0);
+            }
+        }
     }
 
+    // keys in both memory and cold tier
     size_t Size() const {
-        return values_.size();
+        return values_.size() + cold_index_.size();
     }
 
-    friend std::ostream& operator<<(std::ostream& os, const SparseKernelBlock& block) {
+    size_t MemoryBytes() const {
+        const std::lock_guard<std::mutex> lock(*mutex_);
+
+        return alloc_.SlabCount() * alloc_.SlabSize() + alloc_.RowMemoryBytes()
+            + values_.capacity() * (sizeof(uint64_t) + sizeof(Entry))
+            + cold_index_.capacity() * (sizeof(uint64_t) + sizeof(ColdEntry))
+            + updated_.capacity() * (sizeof(uint64_t) + sizeof(uint8_t))
+            + (admission_ ? admission_->MemoryBytes() : 0)
+            + snapshot_values_.capacity() + snapshot_copies_.capacity() * (sizeof(uint64_t) + sizeof(size_t));
+    }
+
+    // room for n more keys, called before loading them. files are loaded concurrently,
+    // so keys of all files are added up.
+    void Reserve(size_t n) {
+        std::lock_guard<std::mutex> lock(*mutex_);
+
+        loading_keys_ += n;
+        values_.reserve(std::max(loading_keys_, values_.size() + n));
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, SparseKernelBlock& block) {
         std::lock_guard<std::mutex> lock(*block.mutex_);
 
         os << "opt_name:" << block.opt_->Name() << std::endl;
         os << "dim:" << block.dim_ << std::endl;
 
-        for (const auto& value : block.values_) {
-            os << value.first << "\t" << *(value.second) << std::endl;
-        }
+        block.values_.for_each([&os](const uint64_t& sign, const Entry& entry) {
+            os << sign << "\t" << *entry.value << std::endl;
+        });
+
+        // text file is always a full checkpoint
+        ++block.version_;
 
         return os;
     }
 
-    friend std::istream& operator>>(std::istream& is, SparseKernelBlock& block) {
-        std::lock_guard<std::mutex> lock(*block.mutex_);
+    // cut values of this block into parts of at most SPARSE_BLOCK_FILE_PART_KEYS keys
+    // and call emit(SparseBlockFilePart&&) for each, at least once even if no key is
+    // written. only values created or updated since last save are written if delta is
+    // true.
+    //
+    // parts are a consistent snapshot of the block when dump starts, but the lock is
+    // only held to list signs and to copy values of one part at a time. pull and push
+    // go on while parts are emitted, values changed or freed before they are written
+    // are copied aside first, see Preserve_.
+    template <typename Func>
+    void DumpBinary(bool delta, Func&& emit) {
+        SparseBlockFileHeader header;
+        std::vector<uint64_t> signs;
+        std::vector<std::pair<uint64_t, uint64_t>> colds;
+
+        {
+            std::lock_guard<std::mutex> lock(*mutex_);
+            // saves of a kernel are serialized by SparseOptimizerKernel::save_mu_
+            CHECK(!snapshotting_) << "sparse block is being dumped by another save";
+
+            strncpy(header.opt_name, opt_->Name().c_str(), sizeof(header.opt_name) - 1);
+            header.dim = dim_;
+            header.value_size = ValueType::DynSizeof(dim_);
+            header.weight_type = WeightTypeOfValue_();
+
+            snapshotting_ = true;
+            ++snapshot_epoch_;
+
+            signs.reserve(delta ? 0 : values_.size());
+            values_.for_each([&](const uint64_t& sign, Entry& entry) {
+                if (delta && entry.version != version_) {
+                    entry.snapshot = snapshot_epoch_;
+                    return;
+                }
+
+                signs.push_back(sign);
+            });
+
+            // cold records are never rewritten and compaction waits till dump is done,
+            // cold values are read in order of records
+            cold_index_.for_each([&](const uint64_t& sign, const ColdEntry& entry) {
+                if (!delta || entry.version == version_) {
+                    colds.emplace_back(entry.id, sign);
+                }
+            });
+
+            // values touched from now on belong to next delta
+            ++version_;
+        }
+
+        std::sort(colds.begin(), colds.end());
+
+        const size_t value_size = header.value_size;
+        bool emitted = false;
+
+        auto new_part = [&](size_t n) {
+            SparseBlockFilePart part;
+            part.header = header;
+            part.header.key_count = n;
+            part.signs.reserve(n);
+            part.values.resize(n * value_size);
+            return part;
+        };
+
+        for (size_t i = 0; i < signs.size(); i += SPARSE_BLOCK_FILE_PART_KEYS) {
+            size_t n = std::min(signs.size() - i, SPARSE_BLOCK_FILE_PART_KEYS);
+            SparseBlockFilePart part = new_part(n);
+            part.signs.assign(signs.begin() + i, signs.begin() + i + n);
+
+            {
+                std::lock_guard<std::mutex> lock(*mutex_);
+                for (size_t k = 0; k < n; ++k) {
+                    CopySnapshot_(part.signs[k], part.values.data() + k * value_size);
+                }
+            }
+
+            emit(std::move(part));
+            emitted = true;
+        }
+
+        std::vector<uint64_t> ids;
+        for (size_t i = 0; i < colds.size(); i += SPARSE_BLOCK_FILE_PART_KEYS) {
+            size_t n = std::min(colds.size() - i, SPARSE_BLOCK_FILE_PART_KEYS);
+            SparseBlockFilePart part = new_part(n);
+
+            ids.clear();
+            for (size_t k = i; k < i + n; ++k) {
+                ids.push_back(colds[k].first);
+                part.signs.push_back(colds[k].second);
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(*mutex_);
+                ReadCold_(lock, ids.data(), n, part.values.data());
+            }
+
+            emit(std::move(part));
+            emitted = true;
+        }
 
+        if (!emitted) {
+            emit(new_part(0));
+        }
+
+        std::lock_guard<std::mutex> lock(*mutex_);
+        snapshotting_ = false;
+        snapshot_copies_.clear();
+        std::vector<char>().swap(snapshot_values_);
+    }
+
+    void CheckHeader(const SparseBlockFileHeader& header) const {
+        CHECK_EQ(header.magic, SPARSE_BLOCK_FILE_MAGIC) << "not a binary sparse block file";
+        CHECK(header.version >= 1 && header.version <= SPARSE_BLOCK_FILE_VERSION)
+            << "unsupported sparse block file version:" << header.version;
+
+        CHECK_EQ(header.weight_type, WeightTypeOfValue_()) << "last trained model with weight type:"
+            << header.weight_type << " but current model use:" << WeightTypeOfValue_() << " instead.";
+
+        std::string opt_name(header.opt_name, strnlen(header.opt_name, sizeof(header.opt_name)));
+        CHECK_EQ(opt_name, opt_->Name()) << "last trained model with optimizer is:" << opt_name
+            << " but current model use:" << opt_->Name() << " instead."
+            << " you must make sure that use same optimizer when incremental training";
+
+        CHECK_EQ(header.dim, dim_) << "last trained model with dimension:" << header.dim
+            << " but current model use:" << dim_ << " instead.";
+        CHECK_EQ(header.value_size, FileValueSize_(header.version));
+    }
+
+    // load values[index[i]] as signs[index[i]], signs must all belong to this block.
+    // values are in layout of file version, which is checked by CheckHeader before.
+    void LoadBinary(const uint64_t* signs, const char* values, const uint32_t* index,
+                    size_t n, uint32_t version) {
+        std::lock_guard<std::mutex> lock(*mutex_);
+
+        size_t value_size = FileValueSize_(version);
+        bool convert = value_size != (size_t)ValueType::DynSizeof(dim_);
+        uint32_t now = butil::gettimeofday_s();
+
+        for (size_t i = 0; i < n; ++i) {
+            Entry& entry = FindOrCreate_(signs[index[i]]);
+            const char* value = values + (size_t)index[i] * value_size;
+            Preserve_(signs[index[i]], entry);
+
+            if (convert) {
+                // value size is multiple of 4 and values buffer is allocated by
+                // new, so it is aligned enough to be read in place.
+                entry.value->CopyFrom(*reinterpret_cast<const typename ValueType::DynamicType*>(value));
+            } else {
+                memcpy(entry.value, value, value_size);
+            }
+
+            // already persisted, not need to save in next delta
+            entry.version = 0;
+            entry.update_time = now;
+            SyncRow_(entry);
+        }
+    }
+
+    // check header of a block file which may be saved by any block of a kernel
+    // with same optimizer and dimension
+    void CheckHeader(std::istream& is) const {
         std::string opt_name;
         is.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> opt_name;
 
-        CHECK_EQ(opt_name, block.opt_->Name()) << "last trained model with optimizer is:" << opt_name
-            << " but current model use:" << block.opt_->Name() << " instead."
+        CHECK_EQ(opt_name, opt_->Name()) << "last trained model with optimizer is:" << opt_name
+            << " but current model use:" << opt_->Name() << " instead."
             << " you must make sure that use same optimizer when incremental training";
 
-        is.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> block.dim_;
+        int dim = 0;
+        is.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> dim;
 
-        uint64_t sign = 0;
-        while (is >> sign) {
-            ValueType* value = block.alloc_.allocate(block.dim_, block.opt_);
-            is >> *value;
-            block.values_[sign] = value;
-        }
+        CHECK_EQ(dim, dim_) << "last trained model with dimension:" << dim
+            << " but current model use:" << dim_ << " instead.";
+    }
 
-        return is;
+    // parse one value from is and store it as sign, sign must belong to this block
+    void Load(uint64_t sign, std::istream& is) {
+        std::lock_guard<std::mutex> lock(*mutex_);
+
+        Entry& entry = FindOrCreate_(sign);
+        Preserve_(sign, entry);
+
+        is >> *entry.value;
+        entry.version = 0;
+        entry.update_time = butil::gettimeofday_s();
+        SyncRow_(entry);
     }
 
+    // decay is not idempotent, so unlike Evict it can't sweep slot ranges between
+    // which pushes grow the map or evict shifts entries, that would decay some
+    // values twice and miss others. signs of the block are taken at once instead
+    // and looked up again SPARSE_KERNEL_EVICT_STEP at a time, push of this block
+    // goes on between them. values created after the signs are taken are not
+    // decayed, show of cold values is not in memory and is not decayed either
     void ShowDecay() {
-        for (auto& iter : values_) {
-            ValueType* value = iter.second;
-            value->ShowDecay(opt_);
+        std::vector<uint64_t> signs;
+        {
+            std::lock_guard<std::mutex> lock(*mutex_);
+
+            signs.reserve(values_.size());
+            values_.for_each([&signs](const uint64_t& sign, const Entry& entry) {
+                signs.push_back(sign);
+            });
+        }
+
+        for (size_t begin = 0; begin < signs.size(); begin += SPARSE_KERNEL_EVICT_STEP) {
+            size_t end = std::min(begin + SPARSE_KERNEL_EVICT_STEP, signs.size());
+            std::lock_guard<std::mutex> lock(*mutex_);
+
+            for (size_t i = begin; i < end; ++i) {
+                if (i + SPARSE_KERNEL_PREFETCH_NUM < end) {
+                    values_.prefetch(signs[i + SPARSE_KERNEL_PREFETCH_NUM]);
+                }
+
+                Entry* entry = values_.find(signs[i]);
+                if (entry != nullptr) {
+                    Preserve_(signs[i], *entry);
+                    entry->value->ShowDecay(opt_);
+                }
+            }
+        }
+
+        // shows counted for admission decay too, rare signs are never admitted
+        // however long the table is trained
+        if (admission_) {
+            std::lock_guard<std::mutex> lock(*mutex_);
+            admission_->Halve();
+        }
+    }
+
+    // scan SPARSE_KERNEL_EVICT_STEP slots every time the lock is held, so that pull
+    // and push of this block are never stalled for long.
+    size_t Evict(const SparseEvictOption& option) {
+        uint32_t now = butil::gettimeofday_s();
+        uint32_t ttl = option.ttl_days > 0 ? option.ttl_days * 86400 : 0;
+
+        auto should_evict = [&option, now, ttl](const Entry& entry) {
+            if (option.show_threshold > 0 && entry.value->Show() < option.show_threshold) {
+                return true;
+            }
+
+            return ttl > 0 && now - entry.update_time > ttl;
+        };
+
+        size_t evicted = 0;
+
+        for (size_t begin = 0;; begin += SPARSE_KERNEL_EVICT_STEP) {
+            std::lock_guard<std::mutex> lock(*mutex_);
+
+            if (begin >= values_.capacity()) {
+                break;
+            }
+
+            evicted += values_.erase_if(begin, begin + SPARSE_KERNEL_EVICT_STEP,
+                [this, &should_evict](const uint64_t& sign, Entry& entry) {
+                    if (!should_evict(entry)) {
+                        return false;
+                    }
+
+                    Preserve_(sign, entry);
+                    alloc_.deallocate(entry.value);
+                    return true;
+                });
+        }
+
+        // show of cold values is not in memory, only ttl applies to them
+        for (size_t begin = 0; ttl > 0; begin += SPARSE_KERNEL_EVICT_STEP) {
+            std::lock_guard<std::mutex> lock(*mutex_);
+
+            if (begin >= cold_index_.capacity()) {
+                break;
+            }
+
+            evicted += cold_index_.erase_if(begin, begin + SPARSE_KERNEL_EVICT_STEP,
+                [this, now, ttl](const uint64_t& sign, ColdEntry& entry) {
+                    if (now - entry.update_time <= ttl) {
+                        return false;
+                    }
+
+                    cold_->Free(entry.id);
+                    return true;
+                });
+        }
+
+        return evicted;
+    }
+
+    // move values match option from memory to the cold tier, they are read back when
+    // pulled again. values are appended to cold file in slot order, then a pull
+    // of neighbour values reads them in few reads. return count of spilled keys.
+    //
+    // like Evict, must not be called between pull and push of a batch.
+    size_t Spill(const SparseEvictOption& option) {
+        if (!cold_) {
+            return 0;
+        }
+
+        uint32_t now = butil::gettimeofday_s();
+        uint32_t ttl = option.ttl_days > 0 ? option.ttl_days * 86400 : 0;
+
+        auto should_spill = [&option, now, ttl](const Entry& entry) {
+            if (option.show_threshold > 0 && entry.value->Show() < option.show_threshold) {
+                return true;
+            }
+
+            return ttl > 0 && now - entry.update_time > ttl;
+        };
+
+        size_t spilled = 0;
+
+        for (size_t begin = 0;; begin += SPARSE_KERNEL_EVICT_STEP) {
+            std::lock_guard<std::mutex> lock(*mutex_);
+
+            if (begin >= values_.capacity()) {
+                break;
+            }
+
+            spilled += values_.erase_if(begin, begin + SPARSE_KERNEL_EVICT_STEP,
+                [this, &should_spill](const uint64_t& sign, Entry& entry) {
+                    if (!should_spill(entry)) {
+                        return false;
+                    }
+
+                    Preserve_(sign, entry);
+                    uint64_t id = cold_->Append(entry.value);
+                    cold_index_.insert(sign, ColdEntry{id, entry.version, entry.update_time});
+
+                    alloc_.deallocate(entry.value);
+                    return true;
+                });
+
+            cold_->Flush();
+        }
+
+        // records read by a running snapshot or export must stay in the cold file
+        std::lock_guard<std::mutex> lock(*mutex_);
+        if (!snapshotting_ && exporting_ == 0
+                && cold_->GarbageCount() > SPARSE_KERNEL_COLD_COMPACT_MIN
+                && cold_->GarbageCount() > cold_->LiveCount()) {
+            CompactCold_();
+        }
+
+        return spilled;
+    }
+
+    // weights only, optimizer state is dropped. call emit(signs, weights) for every
+    // chunk of exported values, weights of signs[i] are at weights[i * dim].
+    //
+    // as DumpBinary the lock is only held to list signs, then to copy weights of
+    // SPARSE_KERNEL_EVICT_STEP values or read SPARSE_BLOCK_FILE_PART_KEYS cold values
+    // at a time, emit is called without it. cold values are not faulted into memory,
+    // compaction of cold waits till export is done so that listed records stay.
+    template <typename Func>
+    size_t Export(const SparseExportOption& option, Func&& emit) {
+        std::vector<uint64_t> signs;
+        std::vector<std::pair<uint64_t, uint64_t>> colds;
+
+        {
+            std::lock_guard<std::mutex> lock(*mutex_);
+            ++exporting_;
+
+            signs.reserve(values_.size());
+            values_.for_each([&signs, &option](const uint64_t& sign, const Entry& entry) {
+                if (entry.update_time >= option.updated_since) {
+                    signs.push_back(sign);
+                }
+            });
+
+            cold_index_.for_each([&colds, &option](const uint64_t& sign, const ColdEntry& entry) {
+                if (entry.update_time >= option.updated_since) {
+                    colds.emplace_back(entry.id, sign);
+                }
+            });
+        }
+
+        std::vector<uint64_t> out_signs;
+        std::vector<float> out_weights;
+        size_t exported = 0;
+
+        auto add = [&](uint64_t sign, const ValueType* value) {
+            if (option.show_threshold > 0 && value->Show() < option.show_threshold) {
+                return;
+            }
+
+            out_signs.push_back(sign);
+            out_weights.resize(out_signs.size() * Dim_());
+            std::copy_n(value->Weight(), Dim_(), out_weights.end() - Dim_());
+        };
+
+        auto flush = [&]() {
+            if (!out_signs.empty()) {
+                emit(out_signs, out_weights);
+                exported += out_signs.size();
+            }
+
+            out_signs.clear();
+            out_weights.clear();
+        };
+
+        for (size_t i = 0; i < signs.size(); i += SPARSE_KERNEL_EVICT_STEP) {
+            size_t end = std::min(i + SPARSE_KERNEL_EVICT_STEP, signs.size());
+
+            {
+                std::lock_guard<std::mutex> lock(*mutex_);
+
+                for (size_t k = i; k < end; ++k) {
+                    Entry* entry = values_.find(signs[k]);
+                    if (nullptr != entry) {
+                        add(signs[k], entry->value);
+                        continue;
+                    }
+
+                    // spilled since listed, read with the cold values below
+                    ColdEntry* cold = cold_index_.size() > 0 ? cold_index_.find(signs[k]) : nullptr;
+                    if (nullptr != cold) {
+                        colds.emplace_back(cold->id, signs[k]);
+                    }
+                }
+            }
+
+            flush();
+        }
+
+        std::sort(colds.begin(), colds.end());
+
+        size_t value_size = ValueType::DynSizeof(dim_);
+        std::vector<uint64_t> ids;
+        std::vector<char> buf;
+
+        for (size_t i = 0; i < colds.size(); i += SPARSE_BLOCK_FILE_PART_KEYS) {
+            size_t n = std::min(colds.size() - i, SPARSE_BLOCK_FILE_PART_KEYS);
+
+            ids.clear();
+            for (size_t k = i; k < i + n; ++k) {
+                ids.push_back(colds[k].first);
+            }
+
+            buf.resize(n * value_size);
+            {
+                std::unique_lock<std::mutex> lock(*mutex_);
+                ReadCold_(lock, ids.data(), n, buf.data());
+            }
+
+            for (size_t k = 0; k < n; ++k) {
+                add(colds[i + k].second, reinterpret_cast<const ValueType*>(buf.data() + k * value_size));
+            }
+
+            flush();
+        }
+
+        std::lock_guard<std::mutex> lock(*mutex_);
+        --exporting_;
+
+        return exported;
+    }
+
+    // signs taken are forgotten, those deleted since updated are skipped
+    size_t TakeUpdates(size_t max_keys, std::vector<uint64_t>* signs, std::vector<float>* weights) {
+        std::lock_guard<std::mutex> lock(*mutex_);
+
+        std::vector<uint64_t> taken;
+        taken.reserve(std::min(max_keys, updated_.size()));
+        updated_.for_each([&taken, max_keys](const uint64_t& sign, const uint8_t&) {
+            if (taken.size() < max_keys) {
+                taken.push_back(sign);
+            }
+        });
+
+        std::vector<std::pair<uint64_t, uint64_t>> colds;
+        size_t count = 0;
+
+        for (auto sign : taken) {
+            updated_.erase(sign);
+
+            Entry* entry = values_.find(sign);
+            if (entry != nullptr) {
+                signs->push_back(sign);
+                weights->insert(weights->end(), entry->value->Weight(), entry->value->Weight() + Dim_());
+                ++count;
+                continue;
+            }
+
+            ColdEntry* cold = cold_index_.size() > 0 ? cold_index_.find(sign) : nullptr;
+            if (cold != nullptr) {
+                colds.emplace_back(cold->id, sign);
+            }
+        }
+
+        size_t value_size = ValueType::DynSizeof(dim_);
+        std::vector<uint64_t> ids;
+        std::vector<char> buf;
+
+        for (size_t i = 0; i < colds.size(); i += SPARSE_BLOCK_FILE_PART_KEYS) {
+            size_t n = std::min(colds.size() - i, SPARSE_BLOCK_FILE_PART_KEYS);
+
+            ids.clear();
+            for (size_t k = i; k < i + n; ++k) {
+                ids.push_back(colds[k].first);
+            }
+
+            buf.resize(n * value_size);
+            cold_->ReadBatch(ids.data(), n, buf.data());
+
+            for (size_t k = 0; k < n; ++k) {
+                const ValueType* value = reinterpret_cast<const ValueType*>(buf.data() + k * value_size);
+                signs->push_back(colds[i + k].second);
+                weights->insert(weights->end(), value->Weight(), value->Weight() + Dim_());
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+private:
+    // compile time dimension if value type is specialized for it, so that weight
+    // copy loops are unrolled
+    int Dim_() const {
+        return ValueType::FIXED_DIM > 0 ? ValueType::FIXED_DIM : dim_;
+    }
+
+    // file before version 3 always store values with dimension
+    size_t FileValueSize_(uint32_t version) const {
+        if (version < 3) {
+            return ValueType::DynamicType::DynSizeof(dim_);
+        }
+
+        return ValueType::DynSizeof(dim_);
+    }
+
+    static uint32_t WeightTypeOfValue_() {
+        return SparseWeightTypeOf<typename ValueType::weight_type>::value;
+    }
+
+    struct Entry {
+        ValueType* value;
+        // version_ of block when value last created or updated, used by delta save
+        uint32_t version;
+        // seconds of last created, updated or loaded, used by eviction
+        uint32_t update_time;
+        // snapshot_epoch_ of the last snapshot which has written or kept this value,
+        // value is still to be written by the running snapshot if it is older
+        uint32_t snapshot;
+    };
+
+    // value in cold tier, id is of record in cold_, version and update_time are of
+    // Entry when spilled
+    struct ColdEntry {
+        uint64_t id;
+        uint32_t version;
+        uint32_t update_time;
+    };
+
+    // must be called with mutex_ held. a cold value is read back with the lock held,
+    // pull and push fault their cold values in by FaultIn_ first, which does not.
+    Entry& FindOrCreate_(uint64_t sign) {
+        auto inserted = values_.insert(sign, Entry{nullptr, version_, 0, snapshot_epoch_});
+        if (inserted.second) {
+            inserted.first->value = alloc_.allocate(dim_, opt_);
+            inserted.first->update_time = butil::gettimeofday_s();
+
+            ColdEntry* cold = cold_index_.size() > 0 ? cold_index_.find(sign) : nullptr;
+            if (nullptr != cold) {
+                cold_->Read(cold->id, inserted.first->value);
+                RestoreCold_(sign, *cold, inserted.first);
+            }
+
+            SyncRow_(*inserted.first);
+        }
+
+        return *inserted.first;
+    }
+
+    // value to pull, nullptr if sign is not admitted yet. must be called with
+    // mutex_ held
+    Entry* PullEntry_(uint64_t sign) {
+        if (!admission_) {
+            return &FindOrCreate_(sign);
+        }
+
+        Entry* entry = values_.find(sign);
+        if (entry == nullptr && cold_index_.size() > 0 && cold_index_.find(sign) != nullptr) {
+            entry = &FindOrCreate_(sign);
+        }
+
+        return entry;
+    }
+
+    // value to push, nullptr if sign is not admitted even with batch_show of this
+    // push. must be called with mutex_ held
+    //
+    // a pushed sign is not always pulled just before, its pull may be served by the
+    // worker cache, prefetch or hot keys, and it may be evicted or spilled between
+    // pull and push. a spilled sign is read back from cold, a missing one is created
+    // again as the pull would do.
+    Entry* PushEntry_(uint64_t sign, int batch_show) {
+        Entry* entry = values_.find(sign);
+        if (entry != nullptr) {
+            return entry;
+        }
+
+        bool cold = cold_index_.size() > 0 && cold_index_.find(sign) != nullptr;
+        if (!cold && admission_ && admission_->Add(sign, std::max(batch_show, 0)) < admit_shows_) {
+            return nullptr;
+        }
+
+        return &FindOrCreate_(sign);
+    }
+
+    // weights to pull, must be called with mutex_ held
+    void CopyWeight_(const Entry& entry, float* out) const {
+        if (weight_rows_) {
+            std::copy_n(static_cast<const float*>(alloc_.Row(entry.value)), Dim_(), out);
+        } else {
+            std::copy_n(entry.value->Weight(), Dim_(), out);
+        }
+    }
+
+    // copy weights into row after value is changed, must be called with mutex_ held
+    void SyncRow_(const Entry& entry) {
+        if (weight_rows_) {
+            std::copy_n(entry.value->Weight(), Dim_(), static_cast<float*>(alloc_.Row(entry.value)));
+        }
+    }
+
+    // read cold values of signs[index[0, n)] back into memory with one batch read,
+    // must be called with lock of mutex_ held, see ReadCold_. values faulted in,
+    // evicted or compacted by others meanwhile are skipped.
+    void FaultIn_(std::unique_lock<std::mutex>& lock, const uint64_t* signs,
+                  const uint32_t* index, size_t n) {
+        std::vector<uint64_t> cold_signs;
+        std::vector<uint64_t> ids;
+
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t sign = signs[index[i]];
+            ColdEntry* cold = cold_index_.find(sign);
+
+            if (nullptr != cold && nullptr == values_.find(sign)) {
+                cold_signs.push_back(sign);
+                ids.push_back(cold->id);
+            }
+        }
+
+        if (cold_signs.empty()) {
+            return;
+        }
+
+        size_t value_size = ValueType::DynSizeof(dim_);
+        std::vector<char> buf(cold_signs.size() * value_size);
+
+        uint32_t generation = cold_generation_;
+        ReadCold_(lock, ids.data(), ids.size(), buf.data());
+
+        for (size_t i = 0; i < cold_signs.size(); ++i) {
+            // a sign may appear more than once in a pull
+            ColdEntry* cold = cold_index_.find(cold_signs[i]);
+            if (nullptr == cold || cold->id != ids[i] || cold_generation_ != generation) {
+                continue;
+            }
+
+            Entry* entry = values_.insert(cold_signs[i], Entry{nullptr, 0, 0, snapshot_epoch_}).first;
+            entry->value = alloc_.allocate(dim_, opt_);
+            memcpy(entry->value, buf.data() + i * value_size, value_size);
+
+            RestoreCold_(cold_signs[i], *cold, entry);
+            SyncRow_(*entry);
+        }
+    }
+
+    // read cold records of ids[0, n) into out. records still buffered by cold_ are
+    // copied with lock held, the others are read from file with lock released, so
+    // that pull and push of the block are not stalled by disk. lock is held again
+    // on return, caller must check that what it read is still cold.
+    void ReadCold_(std::unique_lock<std::mutex>& lock, const uint64_t* ids, size_t n, char* out) {
+        size_t value_size = ValueType::DynSizeof(dim_);
+
+        // records are never rewritten, store is kept alive if compacted meanwhile
+        std::shared_ptr<LogStore> store = cold_;
+
+        std::vector<uint64_t> file_ids;
+        std::vector<size_t> file_index;
+
+        for (size_t i = 0; i < n; ++i) {
+            if (store->Flushed(ids[i])) {
+                file_ids.push_back(ids[i]);
+                file_index.push_back(i);
+            } else {
+                store->Read(ids[i], out + i * value_size);
+            }
+        }
+
+        if (file_ids.empty()) {
+            return;
+        }
+
+        std::vector<char> buf(file_ids.size() * value_size);
+
+        lock.unlock();
+        store->ReadFlushed(file_ids.data(), file_ids.size(), buf.data());
+        lock.lock();
+
+        for (size_t i = 0; i < file_ids.size(); ++i) {
+            memcpy(out + file_index[i] * value_size, buf.data() + i * value_size, value_size);
+        }
+    }
+
+    // keep value of entry for the running snapshot if it is not written yet, called
+    // before value is changed or freed with mutex_ held
+    void Preserve_(uint64_t sign, Entry& entry) {
+        if (!snapshotting_ || entry.snapshot == snapshot_epoch_) {
+            return;
+        }
+
+        entry.snapshot = snapshot_epoch_;
+
+        size_t value_size = ValueType::DynSizeof(dim_);
+        size_t offset = snapshot_values_.size();
+        snapshot_values_.resize(offset + value_size);
+        memcpy(snapshot_values_.data() + offset, entry.value, value_size);
+
+        snapshot_copies_.insert(sign, offset);
+    }
+
+    // value of sign when the running snapshot started, with mutex_ held
+    void CopySnapshot_(uint64_t sign, char* out) {
+        size_t value_size = ValueType::DynSizeof(dim_);
+
+        const size_t* offset = snapshot_copies_.size() > 0 ? snapshot_copies_.find(sign) : nullptr;
+        if (nullptr != offset) {
+            memcpy(out, snapshot_values_.data() + *offset, value_size);
+            return;
         }
+
+        Entry* entry = values_.find(sign);
+        CHECK(nullptr != entry) << "value of sign " << sign << " is lost in snapshot";
+
+        memcpy(out, entry->value, value_size);
+        entry->snapshot = snapshot_epoch_;
+    }
+
+    // entry is read from cold, remove sign from cold tier
+    void RestoreCold_(uint64_t sign, const ColdEntry& cold, Entry* entry) {
+        entry->version = cold.version;
+        entry->update_time = cold.update_time;
+
+        cold_->Free(cold.id);
+        cold_index_.erase(sign);
+    }
+
+    // copy live cold values into a new file and drop the old one, must be called
+    // with mutex_ held
+    void CompactCold_() {
+        ++cold_generation_;
+        std::unique_ptr<LogStore> store(new LogStore(ColdFile_(), cold_->RecordSize()));
+
+        std::vector<char> buf(cold_->RecordSize());
+        cold_index_.for_each([this, &store, &buf](const uint64_t& sign, ColdEntry& entry) {
+            cold_->Read(entry.id, buf.data());
+            entry.id = store->Append(buf.data());
+        });
+
+        store->Flush();
+        cold_ = std::move(store);
+    }
+
+    std::string ColdFile_() const {
+        return cold_file_ + "." + std::to_string(cold_generation_);
     }
 
 private:
     const OptType* opt_ = nullptr;
-    std::unordered_map<uint64_t, ValueType*, decltype(sparse_key_hasher)> values_;
+    OpenHashMap<uint64_t, Entry, SparseKeyHasher> values_;
 
     std::unique_ptr<std::mutex> mutex_;
     int dim_ = 0;
 
+    // increased after every save, start from 1 so that loaded values with version 0
+    // are never treat as updated
+    uint32_t version_ = 1;
+
+    // keys announced by Reserve
+    size_t loading_keys_ = 0;
+
     Allocator<ValueType> alloc_;
+
+    // weights are also kept as float rows of alloc_, pull reads only them
+    bool weight_rows_ = false;
+
+    // values spilled out of memory, cold_ is null if cold tier is disabled
+    OpenHashMap<uint64_t, ColdEntry, SparseKeyHasher> cold_index_;
+    std::shared_ptr<LogStore> cold_;
+    std::string cold_file_;
+    uint32_t cold_generation_ = 0;
+
+    // signs updated since last TakeUpdates, value is unused
+    bool track_updates_ = false;
+    OpenHashMap<uint64_t, uint8_t, SparseKeyHasher> updated_;
+
+    // counts of pushed shows of signs not allocated yet, null if admission disabled
+    uint32_t admit_shows_ = 0;
+    std::unique_ptr<CountMinSketch> admission_;
+
+    // values of the running DumpBinary, copied out of values before they are changed
+    // or freed. value of snapshot_copies_ is offset in snapshot_values_
+    bool snapshotting_ = false;
+    uint32_t snapshot_epoch_ = 0;
+    OpenHashMap<uint64_t, size_t, SparseKeyHasher> snapshot_copies_;
+    std::vector<char> snapshot_values_;
+
+    // running Export calls, cold records they listed must stay till they are read
+    size_t exporting_ = 0;
 };
 
 template <typename KernelBlockType>
 class SparseOptimizerKernel : public SparseOptimizerKernelBase {
 public:
-    SparseOptimizerKernel(const OptimizerBase* opt, int dimension) {
+    SparseOptimizerKernel(const OptimizerBase* opt, int dimension,
+                          const SparseKernelOption& option) {
         assert(nullptr != opt);
+        CHECK_GT(option.block_num, 0);
+
+        CHECK_GT(option.io_threads, 0);
+
+        std::string cold_prefix;
+        if (!option.cold_dir.empty()) {
+            static std::atomic<int> kernel_seq(0);
+
+            cold_prefix = option.cold_dir + "/sparse_cold_" + std::to_string(getpid())
+                + "_" + std::to_string(kernel_seq++) + "_";
+        }
 
-        for (size_t i = 0; i < SPARSE_KERNEL_BLOCK_NUM; ++i) {
-            blocks_.emplace_back(opt, dimension);
+        for (size_t i = 0; i < option.block_num; ++i) {
+            blocks_.emplace_back(opt, dimension, option,
+                                 cold_prefix.empty() ? cold_prefix : cold_prefix + std::to_string(i));
         }
+
+        io_threads_ = option.io_threads;
+
+        lazy_mu_.reset(new bthread::Mutex[option.block_num]);
+        lazy_files_.resize(option.block_num);
     }
 
-    ~SparseOptimizerKernel() = default;
+    ~SparseOptimizerKernel() {
+        std::for_each(loaders_.begin(), loaders_.end(), [](std::thread& t) {
+            t.join();
+        });
+    }
 
-    float* GetWeight(uint64_t sign) {
+    void GetWeight(uint64_t sign, float* w) {
         int block_num = GetBlockId_(sign);
-        return blocks_[block_num].GetWeight(sign);
+        LoadLazy_(block_num);
+        blocks_[block_num].GetWeight(sign, w);
     }
 
     void Apply(uint64_t sign, SparseGradInfo& grad_info) {
         int block_num = GetBlockId_(sign);
+        LoadLazy_(block_num);
         blocks_[block_num].Apply(sign, grad_info);
     }
 
-    void Serialized(const std::string& filepath) {
-        std::vector<std::thread> threads;
+    void GetWeights(const uint64_t* signs, size_t n, float* out) {
+        GroupByBlock_(signs, n, [this, signs, out](size_t block_id, const uint32_t* index, size_t count) {
+            LoadLazy_(block_id);
+            blocks_[block_id].GetWeights(signs, index, count, out);
+        });
+    }
+
+    void ApplyBatch(const uint64_t* signs, SparseGradInfo* grad_infos, size_t n) {
+        GroupByBlock_(signs, n, [this, signs, grad_infos](size_t block_id, const uint32_t* index, size_t count) {
+            LoadLazy_(block_id);
+            blocks_[block_id].ApplyBatch(signs, grad_infos, index, count);
+        });
+    }
+
+    // saves overlapped, e.g. by save rpc of two workers, are done one after another
+    void Serialized(const std::string& filepath, SparseFileFormat format, bool delta) {
+        CHECK(!delta || SFF_BINARY == format) << "delta save only support binary format";
 
-        for (size_t i = 0; i < SPARSE_KERNEL_BLOCK_NUM; ++i) {
-            threads.push_back(std::thread([this, i, &filepath]() {
-                std::string file = filepath;
-                file.append("/sparse_block_").append(std::to_string(i)).append(".gz");
+        const std::lock_guard<std::mutex> save_lock(save_mu_);
+
+        LoadAllLazy_();
+
+        if (SFF_BINARY == format) {
+            SerializedBinary_(filepath, delta);
+            return;
+        }
+
+        std::atomic<size_t> next_block(0);
+
+        RunThreads_(std::min(io_threads_, blocks_.size()), [&]() {
+            for (size_t i = next_block++; i < blocks_.size(); i = next_block++) {
+                std::string file = BlockFile_(filepath, i, format);
 
                 FileWriterSink writer_sink(file, FCT_ZLIB);
 
@@ -425,56 +1631,517 @@ public:
 
                 out_stream << blocks_[i] << std::endl;
                 out_stream.flush();
-            }));
-        }
-
-        std::for_each(threads.begin(), threads.end(), [](std::thread& t) {
-            t.join();
+            }
         });
     }
 
-    void DeSerialized(const std::string& filepath) {
-        std::vector<std::thread> threads;
+    // block number of saved model may be different with current kernel, so we read
+    // every block file found and dispatch each sign to the block it belongs now.
+    //
+    // with lazy, a binary checkpoint saved by a kernel with same block number is not
+    // read here. files are queued to the blocks they are cut from and loaded by
+    // background threads in block order, pull or push of a block not loaded yet loads
+    // it first. checkpoints loaded one after another, like base and deltas, are
+    // queued in order. other checkpoints are loaded at once after queued ones.
+    void DeSerialized(const std::string& filepath,
+                      const SparseShardFilter& filter = SparseShardFilter(),
+                      bool lazy = false) {
+        SparseFileFormat format = SFF_BINARY;
+        size_t file_num = 0;
+
+        std::string num_file = filepath + "/" + SPARSE_BLOCK_NUM_FILE;
+        if (FileExists(num_file)) {
+            file_num = ReadBlockFileNum_(num_file);
+        } else {
+            // saved before block files are split into parts
+            if (!FileExists(BlockFile_(filepath, 0, SFF_BINARY))) {
+                format = SFF_TEXT;
+            }
+
+            while (FileExists(BlockFile_(filepath, file_num, format))) {
+                ++file_num;
+            }
+        }
+
+        if (lazy && SFF_BINARY == format && file_num > 0 && QueueLazy_(filepath, file_num, filter)) {
+            return;
+        }
+
+        LoadAllLazy_();
 
-        for (size_t i = 0; i < SPARSE_KERNEL_BLOCK_NUM; ++i) {
-            threads.push_back(std::thread([this, i, &filepath]() {
-                std::string file = filepath;
-                file.append("/sparse_block_").append(std::to_string(i)).append(".gz");
+        std::atomic<size_t> next_file(0);
+
+        RunThreads_(std::min(io_threads_, file_num), [&]() {
+            for (size_t i = next_file++; i < file_num; i = next_file++) {
+                std::string file = BlockFile_(filepath, i, format);
+
+                if (SFF_BINARY == format) {
+                    DeSerializedBinary_(file, filter);
+                    continue;
+                }
 
                 FileReaderSource reader_source(file, FCT_ZLIB);
                 boost::iostreams::stream<FileReaderSource> in_stream(reader_source);
 
-                in_stream >> blocks_[i];
-            }));
-        }
+                blocks_[0].CheckHeader(in_stream);
 
-        std::for_each(threads.begin(), threads.end(), [](std::thread& t) {
-            t.join();
+                uint64_t sign = 0;
+                while (in_stream >> sign) {
+                    if (filter.Enabled() && !filter.Match(sign)) {
+                        // every value is in one line
+                        in_stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                        continue;
+                    }
+
+                    blocks_[GetBlockId_(sign)].Load(sign, in_stream);
+                }
+            }
         });
     }
 
     size_t KeyCount() const {
         size_t key_count = 0;
-        for (size_t i = 0; i < SPARSE_KERNEL_BLOCK_NUM; ++i) {
+        for (size_t i = 0; i < blocks_.size(); ++i) {
             key_count += blocks_[i].Size();
         }
 
         return key_count;
     }
 
+    int BlockId(uint64_t sign) const {
+        return GetBlockId_(sign);
+    }
+
+    size_t MemoryBytes() const {
+        size_t bytes = 0;
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            bytes += blocks_[i].MemoryBytes();
+        }
+
+        return bytes;
+    }
+
+    // blocks are decayed concurrently in io threads, bthreads are left to rpc
     void ShowDecay() {
-        for (size_t i = 0; i < SPARSE_KERNEL_BLOCK_NUM; ++i) {
-            blocks_[i].ShowDecay();
+        LoadAllLazy_();
+
+        std::atomic<size_t> next_block(0);
+
+        RunThreads_(std::min(io_threads_, blocks_.size()), [&]() {
+            for (size_t i = next_block++; i < blocks_.size(); i = next_block++) {
+                blocks_[i].ShowDecay();
+            }
+        });
+    }
+
+    size_t Evict(const SparseEvictOption& option) {
+        LoadAllLazy_();
+
+        size_t evicted = 0;
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            evicted += blocks_[i].Evict(option);
         }
+
+        return evicted;
+    }
+
+    size_t Spill(const SparseEvictOption& option) {
+        LoadAllLazy_();
+
+        size_t spilled = 0;
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            spilled += blocks_[i].Spill(option);
+        }
+
+        return spilled;
+    }
+
+    // blocks are exported concurrently in io threads as ShowDecay, chunks of blocks
+    // are passed to emit one at a time
+    size_t Export(const SparseExportOption& option, const SparseExportFunc& emit) {
+        LoadAllLazy_();
+
+        std::mutex emit_mu;
+        std::atomic<size_t> next_block(0);
+        std::atomic<size_t> exported(0);
+
+        auto emit_chunk = [&emit_mu, &emit](const std::vector<uint64_t>& signs,
+                                            const std::vector<float>& weights) {
+            std::lock_guard<std::mutex> lock(emit_mu);
+            emit(signs, weights);
+        };
+
+        RunThreads_(std::min(io_threads_, blocks_.size()), [&]() {
+            for (size_t i = next_block++; i < blocks_.size(); i = next_block++) {
+                exported += blocks_[i].Export(option, emit_chunk);
+            }
+        });
+
+        return exported;
+    }
+
+    // blocks are taken in turns from where last call stopped, so that every block
+    // gets its share when updates are more than max_keys
+    size_t TakeUpdates(size_t max_keys, std::vector<uint64_t>* signs, std::vector<float>* weights) {
+        LoadAllLazy_();
+
+        size_t taken = 0;
+        for (size_t i = 0; i < blocks_.size() && taken < max_keys; ++i) {
+            size_t block_id = (take_block_ + i) % blocks_.size();
+            taken += blocks_[block_id].TakeUpdates(max_keys - taken, signs, weights);
+        }
+
+        take_block_ = (take_block_ + 1) % blocks_.size();
+
+        return taken;
     }
 
 private:
-    int GetBlockId_(uint64_t sign) {
-        return sparse_key_hasher(sign) % SPARSE_KERNEL_BLOCK_NUM;
+    int GetBlockId_(uint64_t sign) const {
+        return sparse_key_hasher(sign) % blocks_.size();
+    }
+
+    // counting sort index of signs by block id, then call func(block_id, index, count)
+    // for every block which has signs, so that every block lock is taken only once.
+    // blocks are independent, big request are processed by all blocks in parallel.
+    template <typename Func>
+    void GroupByBlock_(const uint64_t* signs, size_t n, Func&& func) {
+        // NOTE, do not use thread_local buffer here, ParallelFor may yield current
+        // bthread and resume it in another pthread.
+        std::vector<uint32_t> block_ids(n);
+        std::vector<uint32_t> index(n);
+        std::vector<size_t> offsets(blocks_.size() + 1, 0);
+
+        for (size_t i = 0; i < n; ++i) {
+            block_ids[i] = GetBlockId_(signs[i]);
+            ++offsets[block_ids[i] + 1];
+        }
+
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            offsets[i + 1] += offsets[i];
+        }
+
+        std::vector<size_t> non_empty_blocks;
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            if (offsets[i + 1] > offsets[i]) {
+                non_empty_blocks.push_back(i);
+            }
+        }
+
+        std::vector<size_t> begins(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < n; ++i) {
+            index[begins[block_ids[i]]++] = i;
+        }
+
+        auto run_block = [&](size_t i) {
+            size_t block_id = non_empty_blocks[i];
+            func(block_id, index.data() + offsets[block_id],
+                 offsets[block_id + 1] - offsets[block_id]);
+        };
+
+        if (n < SPARSE_KERNEL_PARALLEL_MIN_SIGNS || non_empty_blocks.size() < 2) {
+            for (size_t i = 0; i < non_empty_blocks.size(); ++i) {
+                run_block(i);
+            }
+        } else {
+            ParallelFor(non_empty_blocks.size(), run_block);
+        }
+    }
+
+    static SparseBlockFileHeader ReadHeader_(FileReaderSource& reader_source, const std::string& file) {
+        SparseBlockFileHeader header;
+        CHECK(ReadFull(reader_source, &header, SPARSE_BLOCK_FILE_HEADER_V1_SIZE))
+            << "empty sparse block file:" << file;
+
+        if (header.version >= 2) {
+            CHECK(ReadFull(reader_source, &header.weight_type,
+                           sizeof(header) - SPARSE_BLOCK_FILE_HEADER_V1_SIZE));
+        }
+
+        return header;
+    }
+
+    void DeSerializedBinary_(const std::string& file, const SparseShardFilter& filter) {
+        FileReaderSource reader_source(file, FCT_NONE);
+
+        SparseBlockFileHeader header = ReadHeader_(reader_source, file);
+        blocks_[0].CheckHeader(header);
+
+        // keys spread evenly over blocks, size hash maps before inserting them
+        size_t keep_count = header.key_count;
+        if (filter.Enabled()) {
+            keep_count = header.key_count * std::count(filter.keep.begin(), filter.keep.end(), 1)
+                / filter.keep.size();
+        }
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            blocks_[i].Reserve(keep_count / blocks_.size() + 1);
+        }
+
+        std::vector<uint64_t> signs;
+        std::vector<char> values;
+        uint64_t key_count = 0;
+        uint32_t n = 0;
+
+        while (ReadFull(reader_source, &n, sizeof(n))) {
+            CHECK_LE(n, SPARSE_BLOCK_FILE_CHUNK_SIZE) << "bad chunk in sparse block file:" << file;
+
+            signs.resize(n);
+            values.resize((size_t)n * header.value_size);
+
+            CHECK(ReadFull(reader_source, signs.data(), sizeof(uint64_t) * n));
+            CHECK(ReadFull(reader_source, values.data(), values.size()));
+
+            key_count += n;
+
+            if (filter.Enabled()) {
+                n = FilterChunk_(filter, signs.data(), values.data(), n, header.value_size);
+            }
+
+            GroupByBlock_(signs.data(), n, [this, &signs, &values, &header](size_t block_id, const uint32_t* index, size_t count) {
+                blocks_[block_id].LoadBinary(signs.data(), values.data(), index, count, header.version);
+            });
+        }
+
+        CHECK_EQ(key_count, header.key_count) << "sparse block file is truncated:" << file;
+    }
+
+    // save is a pipeline of two stages. dumpers cut snapshots of blocks into parts,
+    // writers take parts from a bounded queue and write them into files without
+    // any lock. queue bounds memory held by parts and lets dumpers wait for slow
+    // storage, every stage runs with io_threads_ at most.
+    void SerializedBinary_(const std::string& filepath, bool delta) {
+        BlockingQueue<SparseBlockFilePart> parts(io_threads_);
+
+        std::atomic<size_t> next_block(0);
+        std::atomic<size_t> file_num(0);
+
+        std::mutex index_mu;
+        std::vector<std::pair<size_t, size_t>> file_blocks;
+
+        std::thread dump_thread([&]() {
+            RunThreads_(std::min(io_threads_, blocks_.size()), [&]() {
+                for (size_t i = next_block++; i < blocks_.size(); i = next_block++) {
+                    blocks_[i].DumpBinary(delta, [&parts, i](SparseBlockFilePart&& part) {
+                        part.block_id = i;
+                        parts.Push(std::move(part));
+                    });
+                }
+            });
+
+            parts.Close();
+        });
+
+        RunThreads_(io_threads_, [&]() {
+            SparseBlockFilePart part;
+            while (parts.Pop(&part)) {
+                size_t file_id = file_num++;
+                WriteBlockFile_(BlockFile_(filepath, file_id, SFF_BINARY), part);
+
+                const std::lock_guard<std::mutex> lock(index_mu);
+                file_blocks.emplace_back(file_id, part.block_id);
+            }
+        });
+
+        dump_thread.join();
+
+        std::sort(file_blocks.begin(), file_blocks.end());
+
+        std::string index = std::to_string(blocks_.size()) + "\n";
+        for (const auto& file_block : file_blocks) {
+            index.append(std::to_string(file_block.second)).append("\n");
+        }
+
+        FileWriterSink index_sink(filepath + "/" + SPARSE_BLOCK_INDEX_FILE, FCT_NONE);
+        index_sink.write(index.data(), index.size());
+
+        // written last, a save broken in middle is not taken as a complete one
+        FileWriterSink writer_sink(filepath + "/" + SPARSE_BLOCK_NUM_FILE, FCT_NONE);
+        std::string num = std::to_string(file_num.load());
+        writer_sink.write(num.data(), num.size());
+    }
+
+    static void WriteBlockFile_(const std::string& file, const SparseBlockFilePart& part) {
+        FileWriterSink writer(file, FCT_NONE);
+        writer.write(reinterpret_cast<const char*>(&part.header), sizeof(part.header));
+
+        const size_t value_size = part.header.value_size;
+
+        for (size_t begin = 0; begin < part.signs.size(); begin += SPARSE_BLOCK_FILE_CHUNK_SIZE) {
+            uint32_t n = std::min(part.signs.size() - begin, (size_t)SPARSE_BLOCK_FILE_CHUNK_SIZE);
+
+            writer.write(reinterpret_cast<const char*>(&n), sizeof(n));
+            writer.write(reinterpret_cast<const char*>(part.signs.data() + begin), sizeof(uint64_t) * n);
+            writer.write(part.values.data() + begin * value_size, value_size * n);
+        }
+    }
+
+    static std::string ReadSmallFile_(const std::string& file) {
+        FileReaderSource reader(file, FCT_NONE);
+
+        std::string content;
+        char buf[4096];
+        std::streamsize n = 0;
+        while ((n = reader.read(buf, sizeof(buf))) > 0) {
+            content.append(buf, n);
+        }
+
+        return content;
+    }
+
+    static size_t ReadBlockFileNum_(const std::string& file) {
+        std::string num = ReadSmallFile_(file);
+
+        CHECK(!num.empty()) << "empty sparse block num file:" << file;
+
+        return std::stoul(num);
+    }
+
+    // queue files of checkpoint to blocks they are cut from, false if checkpoint has
+    // no index or it is saved with another block number
+    bool QueueLazy_(const std::string& filepath, size_t file_num, const SparseShardFilter& filter) {
+        std::string index_file = filepath + "/" + SPARSE_BLOCK_INDEX_FILE;
+        if (!FileExists(index_file)) {
+            LOG(WARNING) << "no block index in " << filepath << ", load it at once";
+            return false;
+        }
+
+        std::istringstream is(ReadSmallFile_(index_file));
+
+        size_t block_num = 0;
+        is >> block_num;
+        if (block_num != blocks_.size()) {
+            LOG(WARNING) << filepath << " is saved with " << block_num << " blocks but kernel has "
+                << blocks_.size() << ", load it at once";
+            return false;
+        }
+
+        std::vector<size_t> file_blocks(file_num);
+        for (size_t i = 0; i < file_num; ++i) {
+            CHECK(is >> file_blocks[i]) << "bad sparse block index:" << index_file;
+            CHECK_LT(file_blocks[i], blocks_.size()) << "bad sparse block index:" << index_file;
+        }
+
+        // mismatched checkpoint fails here rather than in background
+        {
+            std::string file = BlockFile_(filepath, 0, SFF_BINARY);
+            FileReaderSource reader_source(file, FCT_NONE);
+            blocks_[0].CheckHeader(ReadHeader_(reader_source, file));
+        }
+
+        for (size_t i = 0; i < file_num; ++i) {
+            size_t block_id = file_blocks[i];
+            const std::lock_guard<bthread::Mutex> lock(lazy_mu_[block_id]);
+
+            if (lazy_files_[block_id].empty()) {
+                ++lazy_blocks_;
+            }
+
+            lazy_files_[block_id].push_back(LazyFile{BlockFile_(filepath, i, SFF_BINARY), filter});
+        }
+
+        const std::lock_guard<std::mutex> lock(loader_mu_);
+        loaders_.emplace_back([this]() {
+            std::atomic<size_t> next_block(0);
+
+            RunThreads_(std::min(io_threads_, blocks_.size()), [&]() {
+                for (size_t i = next_block++; i < blocks_.size(); i = next_block++) {
+                    LoadLazy_(i);
+                }
+            });
+        });
+
+        return true;
+    }
+
+    // read queued files of block, pull and push of the block wait till they are read.
+    // they come from bthreads of rpc handlers, lazy_mu_ is a bthread mutex so that a
+    // waiting handler only suspends its bthread instead of a worker pthread for the
+    // whole file read
+    void LoadLazy_(size_t block_id) {
+        if (lazy_blocks_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+
+        const std::lock_guard<bthread::Mutex> lock(lazy_mu_[block_id]);
+
+        auto& files = lazy_files_[block_id];
+        if (files.empty()) {
+            return;
+        }
+
+        for (const auto& lazy_file : files) {
+            DeSerializedBinary_(lazy_file.file, lazy_file.filter);
+        }
+
+        files.clear();
+        --lazy_blocks_;
+    }
+
+    void LoadAllLazy_() {
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            LoadLazy_(i);
+        }
+    }
+
+    // move signs match filter and their values to front, return count of them
+    static uint32_t FilterChunk_(const SparseShardFilter& filter, uint64_t* signs, char* values,
+                                 uint32_t n, size_t value_size) {
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            if (!filter.Match(signs[i])) {
+                continue;
+            }
+
+            if (kept != i) {
+                signs[kept] = signs[i];
+                memcpy(values + kept * value_size, values + i * value_size, value_size);
+            }
+            ++kept;
+        }
+
+        return kept;
+    }
+
+    // run func in thread_num threads at most and wait them all. threads are taken
+    // from the io pool shared by all tables, func must loop over work it claims,
+    // a copy started after the work is all taken just returns.
+    template <typename Func>
+    static void RunThreads_(size_t thread_num, Func&& func) {
+        ThreadPool::Io()->Run(thread_num, [&func](size_t) {
+            func();
+        });
+    }
+
+    std::string BlockFile_(const std::string& filepath, size_t block_id, SparseFileFormat format) const {
+        std::string file = filepath;
+        file.append("/sparse_block_").append(std::to_string(block_id));
+        file.append(SFF_BINARY == format ? ".bin" : ".gz");
+        return file;
     }
 
 private:
     std::vector<KernelBlockType> blocks_;
+
+    size_t io_threads_ = 0;
+
+    // block TakeUpdates starts with
+    size_t take_block_ = 0;
+
+    // files of lazy loads not read yet by block, count of blocks having any
+    struct LazyFile {
+        std::string file;
+        SparseShardFilter filter;
+    };
+
+    std::unique_ptr<bthread::Mutex[]> lazy_mu_;
+    std::vector<std::vector<LazyFile>> lazy_files_;
+    std::atomic<size_t> lazy_blocks_{0};
+
+    std::mutex loader_mu_;
+    std::vector<std::thread> loaders_;
+
+    // one save at a time, a block keeps only one snapshot
+    std::mutex save_mu_;
 };
 
 } // namespace tensornet {
@@ -0,0 +1,431 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/ps/optimizer/sparse_simd.h"
+
+#include <math.h>
+
+#include <atomic>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TENSORNET_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace tensornet {
+
+namespace {
+
+inline void AdamOne(const Adam* opt, float& w, float& m, float& v, float g) {
+    m = opt->beta1 * m + (1 - opt->beta1) * g;
+    v = opt->beta2 * v + (1 - opt->beta2) * g * g;
+    w -= opt->learning_rate * m / (opt->epsilon + sqrtf(v));
+}
+
+inline void FtrlOne(const Ftrl* opt, float& w, float& z, float& n, float g) {
+    float g2 = g * g;
+    float sn = sqrtf(n);
+
+    n += g2;
+    float sng = sqrtf(n);
+
+    z += g - opt->learning_rate * (sng - sn) * w;
+
+    if (fabsf(z) <= opt->lambda1) {
+        w = 0;
+    } else {
+        float t = z > 0 ? z - opt->lambda1 : z + opt->lambda1;
+        w = -1 / ((opt->beta + sng) * opt->learning_rate + opt->lambda2) * t;
+    }
+}
+
+// every kernel below takes a compile time DIM, DIM == 0 means dimension is only
+// known at runtime and dim is used instead. loops with constant trip count are
+// fully unrolled.
+
+template <int DIM>
+void AdamScalar(const Adam* opt, float* w, float* m, float* v, const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    for (int i = 0; i < d; ++i) {
+        AdamOne(opt, w[i], m[i], v[i], g[i]);
+    }
+}
+
+template <int DIM>
+float SquareSumScalar(const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    float sum = 0;
+    for (int i = 0; i < d; ++i) {
+        sum += g[i] * g[i];
+    }
+
+    return sum;
+}
+
+template <int DIM>
+void ScaledSubScalar(float* w, const float* g, float scale, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    for (int i = 0; i < d; ++i) {
+        w[i] -= scale * g[i];
+    }
+}
+
+template <int DIM>
+void FtrlScalar(const Ftrl* opt, float* w, float* z, float* n, const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    for (int i = 0; i < d; ++i) {
+        FtrlOne(opt, w[i], z[i], n[i], g[i]);
+    }
+}
+
+#ifdef TENSORNET_SIMD_X86
+
+// values are only 4 bytes aligned, all loads and stores are unaligned. mul and add
+// are not fused so that results are the same as the scalar version.
+
+template <int DIM>
+__attribute__((target("avx2")))
+void AdamAvx2(const Adam* opt, float* w, float* m, float* v, const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    const __m256 beta1 = _mm256_set1_ps(opt->beta1);
+    const __m256 beta2 = _mm256_set1_ps(opt->beta2);
+    const __m256 one_beta1 = _mm256_set1_ps(1 - opt->beta1);
+    const __m256 one_beta2 = _mm256_set1_ps(1 - opt->beta2);
+    const __m256 lr = _mm256_set1_ps(opt->learning_rate);
+    const __m256 eps = _mm256_set1_ps(opt->epsilon);
+
+    int i = 0;
+    for (; i + 8 <= d; i += 8) {
+        __m256 gi = _mm256_loadu_ps(g + i);
+        __m256 mi = _mm256_add_ps(_mm256_mul_ps(beta1, _mm256_loadu_ps(m + i)),
+                                  _mm256_mul_ps(one_beta1, gi));
+        __m256 vi = _mm256_add_ps(_mm256_mul_ps(beta2, _mm256_loadu_ps(v + i)),
+                                  _mm256_mul_ps(_mm256_mul_ps(one_beta2, gi), gi));
+        __m256 delta = _mm256_div_ps(_mm256_mul_ps(lr, mi),
+                                     _mm256_add_ps(eps, _mm256_sqrt_ps(vi)));
+
+        _mm256_storeu_ps(m + i, mi);
+        _mm256_storeu_ps(v + i, vi);
+        _mm256_storeu_ps(w + i, _mm256_sub_ps(_mm256_loadu_ps(w + i), delta));
+    }
+
+    for (; i < d; ++i) {
+        AdamOne(opt, w[i], m[i], v[i], g[i]);
+    }
+}
+
+template <int DIM>
+__attribute__((target("avx2")))
+float SquareSumAvx2(const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    __m256 acc = _mm256_setzero_ps();
+
+    int i = 0;
+    for (; i + 8 <= d; i += 8) {
+        __m256 gi = _mm256_loadu_ps(g + i);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(gi, gi));
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+
+    float result = _mm_cvtss_f32(sum);
+    for (; i < d; ++i) {
+        result += g[i] * g[i];
+    }
+
+    return result;
+}
+
+template <int DIM>
+__attribute__((target("avx2")))
+void ScaledSubAvx2(float* w, const float* g, float scale, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    const __m256 s = _mm256_set1_ps(scale);
+
+    int i = 0;
+    for (; i + 8 <= d; i += 8) {
+        __m256 wi = _mm256_sub_ps(_mm256_loadu_ps(w + i),
+                                  _mm256_mul_ps(s, _mm256_loadu_ps(g + i)));
+        _mm256_storeu_ps(w + i, wi);
+    }
+
+    for (; i < d; ++i) {
+        w[i] -= scale * g[i];
+    }
+}
+
+template <int DIM>
+__attribute__((target("avx2")))
+void FtrlAvx2(const Ftrl* opt, float* w, float* z, float* n, const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    const __m256 minus_one = _mm256_set1_ps(-1.0f);
+    const __m256 lr = _mm256_set1_ps(opt->learning_rate);
+    const __m256 beta = _mm256_set1_ps(opt->beta);
+    const __m256 lambda1 = _mm256_set1_ps(opt->lambda1);
+    const __m256 lambda2 = _mm256_set1_ps(opt->lambda2);
+
+    int i = 0;
+    for (; i + 8 <= d; i += 8) {
+        __m256 gi = _mm256_loadu_ps(g + i);
+        __m256 ni = _mm256_loadu_ps(n + i);
+        __m256 zi = _mm256_loadu_ps(z + i);
+        __m256 wi = _mm256_loadu_ps(w + i);
+
+        __m256 sn = _mm256_sqrt_ps(ni);
+        ni = _mm256_add_ps(ni, _mm256_mul_ps(gi, gi));
+        __m256 sng = _mm256_sqrt_ps(ni);
+
+        zi = _mm256_add_ps(zi, _mm256_sub_ps(gi,
+                    _mm256_mul_ps(_mm256_mul_ps(lr, _mm256_sub_ps(sng, sn)), wi)));
+
+        // w = 0 if |z| <= lambda1 else -(z - sign(z) * lambda1) / denom
+        __m256 keep = _mm256_cmp_ps(_mm256_andnot_ps(sign_mask, zi), lambda1, _CMP_GT_OQ);
+        __m256 t = _mm256_sub_ps(zi, _mm256_or_ps(_mm256_and_ps(zi, sign_mask), lambda1));
+        __m256 denom = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(beta, sng), lr), lambda2);
+        wi = _mm256_and_ps(keep, _mm256_mul_ps(_mm256_div_ps(minus_one, denom), t));
+
+        _mm256_storeu_ps(w + i, wi);
+        _mm256_storeu_ps(z + i, zi);
+        _mm256_storeu_ps(n + i, ni);
+    }
+
+    for (; i < d; ++i) {
+        FtrlOne(opt, w[i], z[i], n[i], g[i]);
+    }
+}
+
+template <int DIM>
+__attribute__((target("avx512f")))
+void AdamAvx512(const Adam* opt, float* w, float* m, float* v, const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    const __m512 beta1 = _mm512_set1_ps(opt->beta1);
+    const __m512 beta2 = _mm512_set1_ps(opt->beta2);
+    const __m512 one_beta1 = _mm512_set1_ps(1 - opt->beta1);
+    const __m512 one_beta2 = _mm512_set1_ps(1 - opt->beta2);
+    const __m512 lr = _mm512_set1_ps(opt->learning_rate);
+    const __m512 eps = _mm512_set1_ps(opt->epsilon);
+
+    int i = 0;
+    for (; i + 16 <= d; i += 16) {
+        __m512 gi = _mm512_loadu_ps(g + i);
+        __m512 mi = _mm512_add_ps(_mm512_mul_ps(beta1, _mm512_loadu_ps(m + i)),
+                                  _mm512_mul_ps(one_beta1, gi));
+        __m512 vi = _mm512_add_ps(_mm512_mul_ps(beta2, _mm512_loadu_ps(v + i)),
+                                  _mm512_mul_ps(_mm512_mul_ps(one_beta2, gi), gi));
+        __m512 delta = _mm512_div_ps(_mm512_mul_ps(lr, mi),
+                                     _mm512_add_ps(eps, _mm512_sqrt_ps(vi)));
+
+        _mm512_storeu_ps(m + i, mi);
+        _mm512_storeu_ps(v + i, vi);
+        _mm512_storeu_ps(w + i, _mm512_sub_ps(_mm512_loadu_ps(w + i), delta));
+    }
+
+    for (; i < d; ++i) {
+        AdamOne(opt, w[i], m[i], v[i], g[i]);
+    }
+}
+
+template <int DIM>
+__attribute__((target("avx512f")))
+float SquareSumAvx512(const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    __m512 acc = _mm512_setzero_ps();
+
+    int i = 0;
+    for (; i + 16 <= d; i += 16) {
+        __m512 gi = _mm512_loadu_ps(g + i);
+        acc = _mm512_add_ps(acc, _mm512_mul_ps(gi, gi));
+    }
+
+    float result = _mm512_reduce_add_ps(acc);
+    for (; i < d; ++i) {
+        result += g[i] * g[i];
+    }
+
+    return result;
+}
+
+template <int DIM>
+__attribute__((target("avx512f")))
+void ScaledSubAvx512(float* w, const float* g, float scale, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    const __m512 s = _mm512_set1_ps(scale);
+
+    int i = 0;
+    for (; i + 16 <= d; i += 16) {
+        __m512 wi = _mm512_sub_ps(_mm512_loadu_ps(w + i),
+                                  _mm512_mul_ps(s, _mm512_loadu_ps(g + i)));
+        _mm512_storeu_ps(w + i, wi);
+    }
+
+    for (; i < d; ++i) {
+        w[i] -= scale * g[i];
+    }
+}
+
+template <int DIM>
+__attribute__((target("avx512f")))
+void FtrlAvx512(const Ftrl* opt, float* w, float* z, float* n, const float* g, int dim) {
+    const int d = DIM > 0 ? DIM : dim;
+
+    // avx512f has no float logic ops, sign bits are handled as integers
+    const __m512i sign_mask = _mm512_set1_epi32(0x80000000);
+    const __m512 minus_one = _mm512_set1_ps(-1.0f);
+    const __m512 lr = _mm512_set1_ps(opt->learning_rate);
+    const __m512 beta = _mm512_set1_ps(opt->beta);
+    const __m512 lambda1 = _mm512_set1_ps(opt->lambda1);
+    const __m512 lambda2 = _mm512_set1_ps(opt->lambda2);
+
+    int i = 0;
+    for (; i + 16 <= d; i += 16) {
+        __m512 gi = _mm512_loadu_ps(g + i);
+        __m512 ni = _mm512_loadu_ps(n + i);
+        __m512 zi = _mm512_loadu_ps(z + i);
+        __m512 wi = _mm512_loadu_ps(w + i);
+
+        __m512 sn = _mm512_sqrt_ps(ni);
+        ni = _mm512_add_ps(ni, _mm512_mul_ps(gi, gi));
+        __m512 sng = _mm512_sqrt_ps(ni);
+
+        zi = _mm512_add_ps(zi, _mm512_sub_ps(gi,
+                    _mm512_mul_ps(_mm512_mul_ps(lr, _mm512_sub_ps(sng, sn)), wi)));
+
+        __mmask16 keep = _mm512_cmp_ps_mask(_mm512_abs_ps(zi), lambda1, _CMP_GT_OQ);
+        __m512 signed_lambda1 = _mm512_castsi512_ps(_mm512_or_epi32(
+                    _mm512_and_epi32(_mm512_castps_si512(zi), sign_mask),
+                    _mm512_castps_si512(lambda1)));
+        __m512 t = _mm512_sub_ps(zi, signed_lambda1);
+        __m512 denom = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(beta, sng), lr), lambda2);
+        wi = _mm512_maskz_mov_ps(keep, _mm512_mul_ps(_mm512_div_ps(minus_one, denom), t));
+
+        _mm512_storeu_ps(w + i, wi);
+        _mm512_storeu_ps(z + i, zi);
+        _mm512_storeu_ps(n + i, ni);
+    }
+
+    for (; i < d; ++i) {
+        FtrlOne(opt, w[i], z[i], n[i], g[i]);
+    }
+}
+
+#endif // TENSORNET_SIMD_X86
+
+struct SimdKernels {
+    void (*adam)(const Adam*, float*, float*, float*, const float*, int);
+    float (*square_sum)(const float*, int);
+    void (*scaled_sub)(float*, const float*, float, int);
+    void (*ftrl)(const Ftrl*, float*, float*, float*, const float*, int);
+};
+
+#define SIMD_KERNELS(ISA, DIM) \
+    { Adam##ISA<DIM>, SquareSum##ISA<DIM>, ScaledSub##ISA<DIM>, Ftrl##ISA<DIM> }
+
+#define SIMD_KERNELS_ROW(ISA)                                                   \
+    { SIMD_KERNELS(ISA, 0), SIMD_KERNELS(ISA, 8), SIMD_KERNELS(ISA, 16),        \
+      SIMD_KERNELS(ISA, 32), SIMD_KERNELS(ISA, 64) }
+
+// indexed by SimdIsa and DimIndex
+const SimdKernels SIMD_KERNELS_TABLE[3][5] = {
+    SIMD_KERNELS_ROW(Scalar),
+#ifdef TENSORNET_SIMD_X86
+    SIMD_KERNELS_ROW(Avx2),
+    SIMD_KERNELS_ROW(Avx512),
+#else
+    SIMD_KERNELS_ROW(Scalar),
+    SIMD_KERNELS_ROW(Scalar),
+#endif
+};
+
+#undef SIMD_KERNELS_ROW
+#undef SIMD_KERNELS
+
+inline int DimIndex(int dim) {
+    switch (dim) {
+    case 8: return 1;
+    case 16: return 2;
+    case 32: return 3;
+    case 64: return 4;
+    default: return 0;
+    }
+}
+
+std::atomic<int>& SimdIsaState() {
+    static std::atomic<int> isa(SupportedSimdIsa());
+    return isa;
+}
+
+inline const SimdKernels& Kernels(int dim) {
+    return SIMD_KERNELS_TABLE[SimdIsaState().load(std::memory_order_relaxed)][DimIndex(dim)];
+}
+
+} // namespace
+
+SimdIsa SupportedSimdIsa() {
+#ifdef TENSORNET_SIMD_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        return SIMD_AVX512;
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+#endif
+
+    return SIMD_NONE;
+}
+
+SimdIsa CurrentSimdIsa() {
+    return static_cast<SimdIsa>(SimdIsaState().load());
+}
+
+void SetSimdIsa(SimdIsa isa) {
+    SimdIsa supported = SupportedSimdIsa();
+    SimdIsaState().store(isa > supported ? supported : isa);
+}
+
+void SimdSparseAdamApply(const Adam* opt, float* w, float* m, float* v,
+                         const float* g, int dim) {
+    Kernels(dim).adam(opt, w, m, v, g, dim);
+}
+
+float SimdSquareSum(const float* g, int dim) {
+    return Kernels(dim).square_sum(g, dim);
+}
+
+void SimdScaledSub(float* w, const float* g, float scale, int dim) {
+    Kernels(dim).scaled_sub(w, g, scale, dim);
+}
+
+void SimdSparseFtrlApply(const Ftrl* opt, float* w, float* z, float* n,
+                         const float* g, int dim) {
+    Kernels(dim).ftrl(opt, w, z, n, g, dim);
+}
+
+} // namespace tensornet
@@ -0,0 +1,54 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_OPTIMIZER_SPARSE_SIMD_H_
+#define TENSORNET_OPTIMIZER_SPARSE_SIMD_H_
+
+#include "core/ps/optimizer/optimizer.h"
+
+namespace tensornet {
+
+// vectorized sparse optimizer updates of float weights. the instruction set is
+// chosen once by cpu features, common dims (8, 16, 32, 64) have fully unrolled
+// versions.
+enum SimdIsa {
+    SIMD_NONE = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2,
+};
+
+// best instruction set supported by both the compiler and the running cpu
+SimdIsa SupportedSimdIsa();
+
+SimdIsa CurrentSimdIsa();
+
+// force a lower instruction set, mostly for test and benchmark. isa higher than
+// supported is clamped.
+void SetSimdIsa(SimdIsa isa);
+
+void SimdSparseAdamApply(const Adam* opt, float* w, float* m, float* v,
+                         const float* g, int dim);
+
+// return sum of g * g
+float SimdSquareSum(const float* g, int dim);
+
+// w -= scale * g
+void SimdScaledSub(float* w, const float* g, float scale, int dim);
+
+void SimdSparseFtrlApply(const Ftrl* opt, float* w, float* z, float* n,
+                         const float* g, int dim);
+
+} // namespace tensornet
+
+#endif // TENSORNET_OPTIMIZER_SPARSE_SIMD_H_
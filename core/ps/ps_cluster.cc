@@ -13,10 +13,23 @@
 // limitations under the License.
 
 #include "core/ps/ps_cluster.h"
+#include "core/ps/optimizer/data_struct.h"
+#include "core/utility/cpu_affinity.h"
 #include "core/utility/mpi_manager.h"
+#include "core/utility/parallel_for.h"
+#include "core/utility/thread_pool.h"
 
 #include <brpc/server.h>
 #include <brpc/channel.h>
+#include <bthread/bthread.h>
+#include <bthread/unstable.h>
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef BRPC_WITH_RDMA
+#include <brpc/rdma/rdma_helper.h>
+#endif
 
 namespace tensornet {
 
@@ -38,6 +51,11 @@ int PsCluster::Init() {
         return -1;
     }
 
+    // before anything starts bthread workers
+    if (0 != InitThreads_()) {
+        return -1;
+    }
+
     if (server_->AddService(&ps_service_impl_, brpc::SERVER_DOESNT_OWN_SERVICE) != 0) {
         LOG(ERROR) << "Fail to add ps_service_impl";
         return -1;
@@ -51,11 +69,27 @@ int PsCluster::Init() {
 
     CHECK_GT(workers_.size(), 0);
 
+    router_.reset(new SignRouter(workers_.size()));
+
+    if (0 != InitTransport_()) {
+        return -1;
+    }
+
     CHECK_EQ(0, InitRemoteServers_());
 
     uint16_t self_port = GetSelfPort_();
 
+    // builtin services are kept, metrics are at http://<ip>:<port>/vars
     brpc::ServerOptions server_options;
+    if (server_option_.num_threads > 0) {
+        server_options.num_threads = server_option_.num_threads;
+    }
+    if (server_option_.max_concurrency > 0) {
+        server_options.max_concurrency = server_option_.max_concurrency;
+    }
+#ifdef BRPC_WITH_RDMA
+    server_options.use_rdma = UseRdma_();
+#endif
 
     if (server_->Start(self_port, &server_options) != 0) {
         LOG(ERROR) << "tensornet fail to bind port:" << self_port;
@@ -64,6 +98,10 @@ int PsCluster::Init() {
 
     Barrier();
 
+    if (0 != WarmupRemoteServers_()) {
+        return -1;
+    }
+
     is_initialized_ = true;
 
     return 0;
@@ -77,27 +115,142 @@ int PsCluster::Rank() const {
     return MpiManager::Instance()->Rank();
 }
 
+// cpus bthread workers are bound to, read by workers when they start
+static std::vector<int> ps_cpus;
+
+static void PinBthreadWorker() {
+    PinCurrentThread(ps_cpus);
+}
+
+int PsCluster::InitThreads_() {
+    if (!server_option_.cpus.empty()) {
+        if (!ParseCpuList(server_option_.cpus, &ps_cpus)) {
+            LOG(ERROR) << "invalid ps cpus:" << server_option_.cpus;
+            return -1;
+        }
+    } else if (server_option_.numa_node >= 0) {
+        if (!NumaNodeCpus(server_option_.numa_node, &ps_cpus)) {
+            LOG(ERROR) << "fail to get cpus of numa node:" << server_option_.numa_node;
+            return -1;
+        }
+    }
+
+    if (!ps_cpus.empty()) {
+        if (0 != bthread_set_worker_startfn(PinBthreadWorker)) {
+            LOG(ERROR) << "fail to bind bthread workers to ps cpus";
+            return -1;
+        }
+    }
+
+    // fails to lower it when workers are started already by an earlier bthread
+    if (server_option_.num_threads > 0 && 0 != bthread_setconcurrency(server_option_.num_threads)) {
+        LOG(WARNING) << "fail to set bthread concurrency:" << server_option_.num_threads
+                     << ", keep:" << bthread_getconcurrency();
+    }
+
+    ThreadPool::InitIo(server_option_.io_threads, ps_cpus);
+
+    LOG(INFO) << "ps threads, bthread workers:" << bthread_getconcurrency()
+              << " io threads:" << server_option_.io_threads << " cpus:" << ps_cpus.size();
+
+    return 0;
+}
+
+bool PsCluster::UseRdma_() const {
+    return rpc_option_.transport == "rdma";
+}
+
+int PsCluster::InitTransport_() {
+    if (rpc_option_.transport == "tcp") {
+        return 0;
+    }
+
+    if (!UseRdma_()) {
+        LOG(ERROR) << "unknown transport:" << rpc_option_.transport;
+        return -1;
+    }
+
+#ifdef BRPC_WITH_RDMA
+    // must be done before any channel or server, iobuf blocks are allocated from
+    // registered memory after it
+    brpc::rdma::GlobalRdmaInitializeOrDie();
+
+    // dense weights are not in registered memory, copy them into iobuf blocks
+    DenseWeight::EnableSharing(false);
+
+    return 0;
+#else
+    LOG(ERROR) << "rdma transport needs tensornet built with BRPC_WITH_RDMA";
+    return -1;
+#endif
+}
+
 int PsCluster::InitRemoteServers_() {
+    CHECK_GT(rpc_option_.channels_per_server, 0);
+
+    remote_servers_.resize(workers_.size());
+    remote_server_once_.reset(new std::once_flag[workers_.size()]);
+
+    return 0;
+}
+
+std::unique_ptr<PsRemoteServer> PsCluster::NewRemoteServer_(size_t shard_id) const {
     brpc::ChannelOptions options;
 
     options.protocol = "baidu_std";
-    options.connection_type = "single";
-    options.timeout_ms = 60000;
+    options.connection_type = rpc_option_.connection_type;
+    options.timeout_ms = rpc_option_.timeout_ms;
     options.max_retry = 1;
+#ifdef BRPC_WITH_RDMA
+    options.use_rdma = UseRdma_();
+#endif
+
+    std::vector<std::shared_ptr<brpc::Channel>> channels;
+
+    for (int c = 0; c < rpc_option_.channels_per_server; c++) {
+        // channels of different group do not share connections
+        options.connection_group = std::to_string(c);
 
-    for (size_t i = 0; i < workers_.size(); i++) {
         std::shared_ptr<brpc::Channel> channel =
             std::make_shared<brpc::Channel>();
 
-        if (channel->Init(workers_[i].c_str(), "", &options) != 0) {
-            LOG(ERROR) << "Fail to initialize channel with " << workers_[i];
-            return -1;
-        }
+        CHECK_EQ(0, channel->Init(workers_[shard_id].c_str(), "", &options))
+            << "Fail to initialize channel with " << workers_[shard_id];
 
-        remote_servers_.emplace_back(std::make_unique<PsRemoteServer>(channel));
+        channels.emplace_back(channel);
     }
 
-    return 0;
+    return std::make_unique<PsRemoteServer>(std::move(channels), shard_id, rpc_option_);
+}
+
+int PsCluster::WarmupRemoteServers_() const {
+    int concurrency = std::min<int>(rpc_option_.warmup_concurrency, workers_.size());
+    if (concurrency <= 0) {
+        return 0;
+    }
+
+    // every worker pings servers in turn from its own offset, so that servers are
+    // not connected by all ranks at the same time
+    std::atomic<size_t> next{0};
+    std::atomic<int> failed{0};
+
+    ParallelFor(concurrency, [&](size_t) {
+        for (size_t i = next++; i < workers_.size(); i = next++) {
+            int shard_id = (Rank() + 1 + i) % workers_.size();
+            if (shard_id == Rank()) {
+                continue;
+            }
+
+            const PsRemoteServer* server =
+                static_cast<const PsRemoteServer*>(GetServer(shard_id));
+            if (0 != server->Ping()) {
+                LOG(ERROR) << "Fail to warm up connection with " << workers_[shard_id];
+                failed++;
+            }
+        }
+    });
+
+    return failed > 0 ? -1 : 0;
 }
 
 const PsServerInterface* PsCluster::GetServer(int shard_id) const {
@@ -105,6 +258,11 @@ const PsServerInterface* PsCluster::GetServer(int shard_id) const {
         return &local_server;
     } else {
         CHECK_LT(shard_id, (int)remote_servers_.size());
+
+        std::call_once(remote_server_once_[shard_id], [this, shard_id]() {
+            remote_servers_[shard_id] = NewRemoteServer_(shard_id);
+        });
+
         return remote_servers_[shard_id].get();
     }
 }
@@ -18,10 +18,12 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
 
 #include "core/ps/ps_service_impl.h"
 #include "core/ps/ps_local_server.h"
 #include "core/ps/ps_remote_server.h"
+#include "core/ps/table/sign_router.h"
 
 namespace brpc {
 // NOTE! do not inlcude brpc/server.h in this header file,
@@ -32,12 +34,51 @@ class Server;
 
 namespace tensornet {
 
+// threads of ps side in the process, the rest of cores are left to tensorflow
+struct ServerOption {
+    // pthreads running bthreads, which serve rpc of this server and run callbacks
+    // of rpc sent by this worker, brpc default when not positive
+    int num_threads = 0;
+
+    // requests processed by the server at the same time, unlimited when not positive
+    int max_concurrency = 0;
+
+    // cpus bthread workers and io threads are bound to, like "0-7,16-23", not bound
+    // when empty
+    std::string cpus;
+
+    // take cpus of this numa node when cpus is empty, not bound when negative
+    int numa_node = -1;
+
+    // pool shared by save, load and show decay of all tables, a table uses as much
+    // as its io_threads of them in one call
+    int io_threads = 16;
+};
+
 class PsCluster {
 public:
     static PsCluster* Instance();
 
     int Init();
 
+    // take effect only when set before Init
+    void SetRpcOption(const RpcOption& option) {
+        rpc_option_ = option;
+    }
+
+    const RpcOption& GetRpcOption() const {
+        return rpc_option_;
+    }
+
+    // take effect only when set before Init
+    void SetServerOption(const ServerOption& option) {
+        server_option_ = option;
+    }
+
+    const ServerOption& GetServerOption() const {
+        return server_option_;
+    }
+
     bool IsInitialized() const {
         return is_initialized_;
     }
@@ -48,6 +89,15 @@ public:
 
     const PsServerInterface* GetServer(int shard_id) const;
 
+    // shard of sparse signs, valid after Init
+    const SignRouter& Router() const {
+        return *router_;
+    }
+
+    SignRouter* MutableRouter() {
+        return router_.get();
+    }
+
     void Barrier() const;
 
 public:
@@ -58,8 +108,18 @@ private:
 
     ~PsCluster();
 
+    bool UseRdma_() const;
+
+    int InitTransport_();
+
+    int InitThreads_();
+
     int InitRemoteServers_();
 
+    std::unique_ptr<PsRemoteServer> NewRemoteServer_(size_t shard_id) const;
+
+    int WarmupRemoteServers_() const;
+
     uint16_t GetSelfPort_();
 
 private:
@@ -68,9 +128,17 @@ private:
 
     PsServiceImpl ps_service_impl_;
 
-    std::vector<std::unique_ptr<PsRemoteServer>> remote_servers_;
+    // created by the first rpc to the server
+    mutable std::vector<std::unique_ptr<PsRemoteServer>> remote_servers_;
+    std::unique_ptr<std::once_flag[]> remote_server_once_;
 
     std::vector<std::string> workers_;
+
+    std::unique_ptr<SignRouter> router_;
+
+    RpcOption rpc_option_;
+
+    ServerOption server_option_;
 };
 
 } // namespace tensornet
@@ -19,6 +19,8 @@
 #include "core/ps/table/sparse_table.h"
 #include "core/kernels/data/balance_dataset_ops.h"
 #include "core/ps/optimizer/optimizer_kernel.h"
+#include "core/utility/metrics.h"
+#include "core/utility/trace.h"
 
 #include <brpc/server.h>
 
@@ -32,9 +34,46 @@ void PsLocalServer::SparsePullAsync(brpc::Controller *cntl,
         SparseTableRegistry::Instance()->Get(request->table_handle());
     CHECK(nullptr != table);
 
+    TraceSpan span("sparse_pull", "server", request->trace_rank());
+    span.SetStep(request->trace_step());
+
+    int64_t begin = butil::gettimeofday_us();
+
     butil::IOBuf& output = cntl->response_attachment();
     table->Pull(request, output, response);
 
+    Metrics::Instance()->server_sparse_pull.Record(butil::gettimeofday_us() - begin,
+        request->ByteSizeLong(), output.size());
+
+    done();
+}
+
+void PsLocalServer::SparseMultiPullAsync(brpc::Controller *cntl,
+                                         const SparseMultiPullRequest *request,
+                                         SparseMultiPullResponse *response,
+                                         Callback done) const {
+    // tables of one request are tagged with the same step and rank
+    TraceSpan span("sparse_multi_pull", "server",
+                   request->tables_size() > 0 ? request->tables(0).trace_rank() : -1);
+    if (request->tables_size() > 0) {
+        span.SetStep(request->tables(0).trace_step());
+    }
+
+    int64_t begin = butil::gettimeofday_us();
+
+    butil::IOBuf& output = cntl->response_attachment();
+
+    for (const auto& table_req : request->tables()) {
+        SparseTable *table =
+            SparseTableRegistry::Instance()->Get(table_req.table_handle());
+        CHECK(nullptr != table);
+
+        table->Pull(&table_req, output, response->add_tables());
+    }
+
+    Metrics::Instance()->server_sparse_pull.Record(butil::gettimeofday_us() - begin,
+        request->ByteSizeLong(), output.size());
+
     done();
 }
 
@@ -46,9 +85,49 @@ void PsLocalServer::SparsePushAsync(brpc::Controller *cntl,
         SparseTableRegistry::Instance()->Get(request->table_handle());
     CHECK(nullptr != table);
 
+    TraceSpan span("sparse_push", "server", request->trace_rank());
+    span.SetStep(request->trace_step());
+
+    int64_t begin = butil::gettimeofday_us();
+    size_t request_bytes = request->ByteSizeLong() + cntl->request_attachment().size();
+
     butil::IOBuf& grad_buf = cntl->request_attachment();
     table->Push(request, grad_buf, response);
 
+    Metrics::Instance()->server_sparse_push.Record(butil::gettimeofday_us() - begin,
+        request_bytes, 0);
+
+    done();
+}
+
+void PsLocalServer::SparseMultiPushAsync(brpc::Controller *cntl,
+                                         const SparseMultiPushRequest *request,
+                                         SparseMultiPushResponse *response,
+                                         Callback done) const {
+    TraceSpan span("sparse_multi_push", "server",
+                   request->tables_size() > 0 ? request->tables(0).trace_rank() : -1);
+    if (request->tables_size() > 0) {
+        span.SetStep(request->tables(0).trace_step());
+    }
+
+    int64_t begin = butil::gettimeofday_us();
+    size_t request_bytes = request->ByteSizeLong() + cntl->request_attachment().size();
+
+    // every table takes its gradients off the front of attachment
+    butil::IOBuf& grad_buf = cntl->request_attachment();
+    SparsePushResponse table_resp;
+
+    for (const auto& table_req : request->tables()) {
+        SparseTable *table =
+            SparseTableRegistry::Instance()->Get(table_req.table_handle());
+        CHECK(nullptr != table);
+
+        table->Push(&table_req, grad_buf, &table_resp);
+    }
+
+    Metrics::Instance()->server_sparse_push.Record(butil::gettimeofday_us() - begin,
+        request_bytes, 0);
+
     done();
 }
 
@@ -66,12 +145,21 @@ void PsLocalServer::DensePushPullAsync(brpc::Controller *cntl,
 
     CHECK(nullptr != opt_kernel);
 
+    TraceSpan span("dense_push_pull", "server", request->trace_rank());
+    span.SetStep(request->trace_step());
+
+    int64_t begin = butil::gettimeofday_us();
+    size_t request_bytes = cntl->request_attachment().size();
+
     butil::IOBuf& grad_buf = cntl->request_attachment();
     opt_kernel->Apply(grad_buf);
 
     butil::IOBuf& output = cntl->response_attachment();
     opt_kernel->GetWeight(output);
 
+    Metrics::Instance()->server_dense_push_pull.Record(butil::gettimeofday_us() - begin,
+        request_bytes, output.size());
+
     done();
 }
 
@@ -79,8 +167,11 @@ void PsLocalServer::DatasetPullAsync(brpc::Controller *cntl,
                                      const DatasetPullRequest *request,
                                      DatasetPullResponse *response,
                                      Callback done) const {
+    TraceSpan span("dataset_pull", "server", request->trace_rank());
+    span.SetStep(request->trace_step());
+
     tensorflow::BalanceInputDataInfo::Instance()
-        ->ProcessBrpcDatasetPullReq(request, response);
+        ->ProcessBrpcDatasetPullReq(request, response, &cntl->response_attachment());
 
     done();
 }
@@ -16,49 +16,74 @@
 
 #include <brpc/server.h>
 #include <brpc/channel.h>
+#include <butil/object_pool.h>
 #include <butil/rand_util.h>
 
+#include <algorithm>
+
+#include "core/utility/metrics.h"
+
 using namespace google::protobuf;
 
 namespace tensornet {
 
 namespace {
 
+// closure of one rpc, taken from the object pool of butil and returned to it once
+// done. a failed rpc is retried with the same closure.
 template <typename TypeRequest, typename TypeResponse>
 class Call : public Closure {
 public:
-    explicit Call(const MethodDescriptor* method_dp,
-         std::shared_ptr<brpc::Channel> channel,
-         brpc::Controller *cntl,
-         const TypeRequest* req,
-         TypeResponse* resp,
-         Callback &&done,
-         int req_cnt=1)
-        : method_dp_(method_dp)
-        , channel_(channel)
-        , cntl_(cntl)
-        , req_(req)
-        , resp_(resp)
-        , done_(done)
-        , req_cnt_(req_cnt) {
-        CHECK(nullptr != method_dp_);
-        Process_();
+    Call() {}
+
+    static void Start(const MethodDescriptor* method_dp,
+                      std::shared_ptr<brpc::Channel> channel,
+                      size_t shard_id,
+                      const RpcOption& option,
+                      bool idempotent,
+                      brpc::Controller *cntl,
+                      const TypeRequest* req,
+                      TypeResponse* resp,
+                      Callback &&done) {
+        CHECK(nullptr != method_dp);
+
+        Call* call = butil::get_object<Call>();
+        CHECK(nullptr != call);
+
+        call->method_dp_ = method_dp;
+        call->channel_ = std::move(channel);
+        call->shard_id_ = shard_id;
+        call->option_ = &option;
+        call->idempotent_ = idempotent;
+        call->cntl_ = cntl;
+        call->req_ = req;
+        call->resp_ = resp;
+        call->done_ = std::move(done);
+        call->req_cnt_ = 1;
+
+        call->Process_();
     }
 
     void Run() {
-        std::unique_ptr<Call> self_guard(this);
         if (cntl_->Failed()) {
-            if (3 < req_cnt_) {
-                LOG(ERROR) << method_dp_->name() << " retry fail";
+            if (option_->max_retry < req_cnt_) {
+                // callers can not handle a failed rpc yet, the job is aborted
+                LOG(ERROR) << method_dp_->name() << " to shard " << shard_id_ << " failed after "
+                    << req_cnt_ << " attempts, last error: " << cntl_->ErrorText();
                 abort();
-                //done_();
             } else {
-                LOG(INFO) << method_dp_->name() << cntl_->ErrorText()
-                    << ", do retry[" << req_cnt_ << "]";
-
-                // random sleep 1s~5s
-                int sleep_us = butil::RandInt(1 * 1000 * 1000, 5 * 1000 * 1000);
-                bthread_usleep(sleep_us);
+                LOG(INFO) << method_dp_->name() << " to shard " << shard_id_ << " failed: "
+                    << cntl_->ErrorText() << ", do retry[" << req_cnt_ << "]";
+                Metrics::Instance()->rpc_retry << 1;
+
+                // exponential backoff with full jitter, so that workers do not retry
+                // a recovering server at the same time
+                int64_t backoff_ms = std::min<int64_t>(
+                        (int64_t)option_->backoff_base_ms << std::min(req_cnt_ - 1, 20),
+                        option_->backoff_max_ms);
+                if (backoff_ms > 0) {
+                    bthread_usleep(butil::RandInt(0, (int)(backoff_ms * 1000)));
+                }
 
                 // backup request setting
                 butil::IOBuf req_buf;
@@ -74,25 +99,41 @@ public:
                 cntl_->set_request_compress_type(req_compress_type);
                 cntl_->request_attachment().swap(req_buf);
 
-                new Call<TypeRequest, TypeResponse>(method_dp_,
-                        channel_, cntl_, req_, resp_,
-                        std::move(done_), req_cnt_ + 1);
+                ++req_cnt_;
+                Process_();
             }
 
-        } else {
-            done_();
+            return;
         }
+
+        // closure is returned before done, done may start another rpc
+        Callback done;
+        done.swap(done_);
+        channel_.reset();
+        butil::return_object(this);
+
+        done();
     }
 
 protected:
     void Process_() {
-         channel_->CallMethod(method_dp_, cntl_, req_, resp_, this);
+        // controller is reset by retry, set deadline of every attempt
+        cntl_->set_timeout_ms(option_->timeout_ms);
+
+        if (idempotent_ && option_->backup_request_ms > 0) {
+            cntl_->set_backup_request_ms(option_->backup_request_ms);
+        }
+
+        channel_->CallMethod(method_dp_, cntl_, req_, resp_, this);
     }
 
 private:
     const MethodDescriptor* method_dp_ = nullptr;
 
     std::shared_ptr<brpc::Channel> channel_;
+    size_t shard_id_ = 0;
+    const RpcOption* option_ = nullptr;
+    bool idempotent_ = false;
     brpc::Controller* cntl_ = nullptr;
     const TypeRequest* req_ = nullptr;
     TypeResponse* resp_ = nullptr;
@@ -102,46 +143,98 @@ private:
 
 }  // namespace
 
-PsRemoteServer::PsRemoteServer(std::shared_ptr<brpc::Channel> &channel)
-    : channel_(channel) {
+PsRemoteServer::PsRemoteServer(std::vector<std::shared_ptr<brpc::Channel>>&& channels,
+                               size_t shard_id, const RpcOption& option)
+    : channels_(std::move(channels))
+    , shard_id_(shard_id)
+    , option_(option) {
+    CHECK(!channels_.empty());
+
     sparse_pull_dp_ = PsService::descriptor()->FindMethodByName("SparsePull");
+    sparse_multi_pull_dp_ = PsService::descriptor()->FindMethodByName("SparseMultiPull");
     sparse_push_dp_ = PsService::descriptor()->FindMethodByName("SparsePush");
+    sparse_multi_push_dp_ = PsService::descriptor()->FindMethodByName("SparseMultiPush");
     dense_push_pull_dp_ = PsService::descriptor()->FindMethodByName("DensePushPull");
     dataset_pull_dp_ = PsService::descriptor()->FindMethodByName("DatasetPull");
+    ping_dp_ = PsService::descriptor()->FindMethodByName("Ping");
 }
 
 PsRemoteServer::~PsRemoteServer() {}
 
+std::shared_ptr<brpc::Channel> PsRemoteServer::NextChannel_() const {
+    if (channels_.size() == 1) {
+        return channels_[0];
+    }
+
+    // retries of a call stay on its channel
+    size_t i = next_channel_.fetch_add(1, std::memory_order_relaxed);
+    return channels_[i % channels_.size()];
+}
+
 void PsRemoteServer::SparsePullAsync(brpc::Controller *cntl,
                                      const SparsePullRequest *request,
                                      SparsePullResponse *response,
                                      Callback done) const {
-    new Call<SparsePullRequest, SparsePullResponse>(sparse_pull_dp_,
-            channel_, cntl, request, response, std::move(done));
+    Call<SparsePullRequest, SparsePullResponse>::Start(sparse_pull_dp_,
+            NextChannel_(), shard_id_, option_, true, cntl, request, response, std::move(done));
+}
+
+void PsRemoteServer::SparseMultiPullAsync(brpc::Controller *cntl,
+                                          const SparseMultiPullRequest *request,
+                                          SparseMultiPullResponse *response,
+                                          Callback done) const {
+    Call<SparseMultiPullRequest, SparseMultiPullResponse>::Start(sparse_multi_pull_dp_,
+            NextChannel_(), shard_id_, option_, true, cntl, request, response, std::move(done));
 }
 
 void PsRemoteServer::SparsePushAsync(brpc::Controller *cntl,
                                      const SparsePushRequest *request,
                                      SparsePushResponse *response,
                                      Callback done) const {
-    new Call<SparsePushRequest, SparsePushResponse>(sparse_push_dp_,
-            channel_, cntl, request, response, std::move(done));
+    Call<SparsePushRequest, SparsePushResponse>::Start(sparse_push_dp_,
+            NextChannel_(), shard_id_, option_, false, cntl, request, response, std::move(done));
+}
+
+void PsRemoteServer::SparseMultiPushAsync(brpc::Controller *cntl,
+                                          const SparseMultiPushRequest *request,
+                                          SparseMultiPushResponse *response,
+                                          Callback done) const {
+    Call<SparseMultiPushRequest, SparseMultiPushResponse>::Start(sparse_multi_push_dp_,
+            NextChannel_(), shard_id_, option_, false, cntl, request, response, std::move(done));
 }
 
 void PsRemoteServer::DensePushPullAsync(brpc::Controller *cntl,
                                         const DensePushPullRequest *request,
                                         DensePushPullResponse *response,
                                         Callback done) const {
-    new Call<DensePushPullRequest, DensePushPullResponse>(dense_push_pull_dp_,
-            channel_, cntl, request, response, std::move(done));
+    Call<DensePushPullRequest, DensePushPullResponse>::Start(dense_push_pull_dp_,
+            NextChannel_(), shard_id_, option_, false, cntl, request, response, std::move(done));
 }
 
 void PsRemoteServer::DatasetPullAsync(brpc::Controller *cntl,
                                       const DatasetPullRequest *request,
                                       DatasetPullResponse *response,
                                       Callback done) const {
-    new Call<DatasetPullRequest, DatasetPullResponse>(dataset_pull_dp_,
-            channel_, cntl, request, response, std::move(done));
+    Call<DatasetPullRequest, DatasetPullResponse>::Start(dataset_pull_dp_,
+            NextChannel_(), shard_id_, option_, false, cntl, request, response, std::move(done));
+}
+
+int PsRemoteServer::Ping() const {
+    for (const auto& channel : channels_) {
+        brpc::Controller cntl;
+        PingRequest request;
+        PingResponse response;
+
+        cntl.set_timeout_ms(option_.timeout_ms);
+        channel->CallMethod(ping_dp_, &cntl, &request, &response, nullptr);
+
+        if (cntl.Failed()) {
+            LOG(ERROR) << "ping fail, " << cntl.ErrorText();
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 }  // namespace tensornet
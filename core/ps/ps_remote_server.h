@@ -17,6 +17,11 @@
 
 #include "core/ps/ps_server_interface.h"
 
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace brpc {
 
 class Channel;
@@ -25,9 +30,44 @@ class Channel;
 
 namespace tensornet {
 
+// rpc behaviour of remote servers, must be set before cluster init
+struct RpcOption {
+    // deadline of one attempt
+    int timeout_ms = 60000;
+
+    // attempts after the first failure, job is aborted when all of them failed
+    int max_retry = 3;
+
+    // backoff before the n-th retry is a random time in
+    // [0, min(backoff_base_ms * 2^n, backoff_max_ms)]
+    int backoff_base_ms = 100;
+    int backoff_max_ms = 5000;
+
+    // send a backup request if a pull has no response in this time, disabled when
+    // not positive. only pulls are idempotent and get backup requests.
+    int backup_request_ms = 0;
+
+    // brpc connection type, one of single, pooled, short
+    std::string connection_type = "single";
+
+    // tcp or rdma. rdma needs tensornet and brpc built with BRPC_WITH_RDMA, with it
+    // iobuf blocks are allocated from memory registered to the nic, so attachments
+    // are sent without copy.
+    std::string transport = "tcp";
+
+    // channels with their own connections to every server, rpc are spread over
+    // them round robin. more than one only makes sense with single connection.
+    int channels_per_server = 1;
+
+    // servers pinged at the same time by cluster init to open connections before
+    // the first step, disabled when not positive
+    int warmup_concurrency = 64;
+};
+
 class PsRemoteServer : public PsServerInterface {
 public:
-    PsRemoteServer(std::shared_ptr<brpc::Channel> &channel);
+    PsRemoteServer(std::vector<std::shared_ptr<brpc::Channel>>&& channels,
+                   size_t shard_id, const RpcOption& option);
 
     ~PsRemoteServer();
 
@@ -36,11 +76,21 @@ public:
                                  SparsePullResponse *response,
                                  Callback done) const override;
 
+    virtual void SparseMultiPullAsync(brpc::Controller *cntl,
+                                      const SparseMultiPullRequest *request,
+                                      SparseMultiPullResponse *response,
+                                      Callback done) const override;
+
     virtual void SparsePushAsync(brpc::Controller *cntl,
                                  const SparsePushRequest *request,
                                  SparsePushResponse *response,
                                  Callback done) const override;
 
+    virtual void SparseMultiPushAsync(brpc::Controller *cntl,
+                                      const SparseMultiPushRequest *request,
+                                      SparseMultiPushResponse *response,
+                                      Callback done) const override;
+
     virtual void DensePushPullAsync(brpc::Controller *cntl,
                                     const DensePushPullRequest *request,
                                     DensePushPullResponse *response,
@@ -51,13 +101,25 @@ public:
                                   DatasetPullResponse *response,
                                   Callback done) const override;
 
+    // synchronous empty rpc on every channel, returns 0 if all of them succeed
+    int Ping() const;
+
+private:
+    std::shared_ptr<brpc::Channel> NextChannel_() const;
+
 private:
-    std::shared_ptr<brpc::Channel> channel_;
+    std::vector<std::shared_ptr<brpc::Channel>> channels_;
+    mutable std::atomic<size_t> next_channel_{0};
+    size_t shard_id_ = 0;
+    RpcOption option_;
 
     const google::protobuf::MethodDescriptor* sparse_pull_dp_ = nullptr;
+    const google::protobuf::MethodDescriptor* sparse_multi_pull_dp_ = nullptr;
     const google::protobuf::MethodDescriptor* sparse_push_dp_ = nullptr;
+    const google::protobuf::MethodDescriptor* sparse_multi_push_dp_ = nullptr;
     const google::protobuf::MethodDescriptor* dense_push_pull_dp_ = nullptr;
     const google::protobuf::MethodDescriptor* dataset_pull_dp_ = nullptr;
+    const google::protobuf::MethodDescriptor* ping_dp_ = nullptr;
 };
 
 }  // namespace tensornet
@@ -38,11 +38,21 @@ public:
                                  SparsePullResponse *response,
                                  Callback done) const = 0;
 
+    virtual void SparseMultiPullAsync(brpc::Controller *cntl,
+                                      const SparseMultiPullRequest *request,
+                                      SparseMultiPullResponse *response,
+                                      Callback done) const = 0;
+
     virtual void SparsePushAsync(brpc::Controller *cntl,
                                  const SparsePushRequest *request,
                                  SparsePushResponse *response,
                                  Callback done) const = 0;
 
+    virtual void SparseMultiPushAsync(brpc::Controller *cntl,
+                                      const SparseMultiPushRequest *request,
+                                      SparseMultiPushResponse *response,
+                                      Callback done) const = 0;
+
     virtual void DensePushPullAsync(brpc::Controller *cntl,
                                     const DensePushPullRequest *request,
                                     DensePushPullResponse *response,
@@ -14,9 +14,11 @@
 
 #include "core/ps/ps_service_impl.h"
 
+#include <brpc/closure_guard.h>
 #include <brpc/server.h>
 
 #include "core/ps/ps_cluster.h"
+#include "core/ps/table/sparse_table.h"
 
 namespace tensornet {
 
@@ -36,6 +38,19 @@ void PsServiceImpl::SparsePull(google::protobuf::RpcController* cntl_base,
                         [done]() { done->Run(); });
 }
 
+void PsServiceImpl::SparseMultiPull(google::protobuf::RpcController* cntl_base,
+                                    const SparseMultiPullRequest* request,
+                                    SparseMultiPullResponse* response,
+                                    google::protobuf::Closure* done) {
+    brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+
+    auto* cluster = PsCluster::Instance();
+    const auto* si = cluster->GetServer(cluster->Rank());
+
+    si->SparseMultiPullAsync(cntl, request, response,
+                             [done]() { done->Run(); });
+}
+
 void PsServiceImpl::SparsePush(google::protobuf::RpcController* cntl_base,
                                const SparsePushRequest* request,
                                SparsePushResponse* response,
@@ -49,6 +64,19 @@ void PsServiceImpl::SparsePush(google::protobuf::RpcController* cntl_base,
                         [done]() { done->Run(); });
 }
 
+void PsServiceImpl::SparseMultiPush(google::protobuf::RpcController* cntl_base,
+                                    const SparseMultiPushRequest* request,
+                                    SparseMultiPushResponse* response,
+                                    google::protobuf::Closure* done) {
+    brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+
+    auto* cluster = PsCluster::Instance();
+    const auto* si = cluster->GetServer(cluster->Rank());
+
+    si->SparseMultiPushAsync(cntl, request, response,
+                             [done]() { done->Run(); });
+}
+
 void PsServiceImpl::DensePushPull(google::protobuf::RpcController* cntl_base,
                                   const DensePushPullRequest* request,
                                   DensePushPullResponse* response,
@@ -67,8 +95,8 @@ void PsServiceImpl::DatasetPull(google::protobuf::RpcController* cntl_base,
                                 DatasetPullResponse* response,
                                 google::protobuf::Closure* done) {
     brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
-    cntl->set_response_compress_type(brpc::COMPRESS_TYPE_GZIP);
 
+    // elements are in attachment, compressed as the requester asks
     auto* cluster = PsCluster::Instance();
     const auto* si = cluster->GetServer(cluster->Rank());
 
@@ -76,4 +104,29 @@ void PsServiceImpl::DatasetPull(google::protobuf::RpcController* cntl_base,
                          [done]() { done->Run(); });
 }
 
+// serving subscribers are not members of the cluster, stream of this rank is read
+// directly
+void PsServiceImpl::SparseSubscribe(google::protobuf::RpcController* cntl_base,
+                                    const SparseSubscribeRequest* request,
+                                    SparseSubscribeResponse* response,
+                                    google::protobuf::Closure* done) {
+    brpc::ClosureGuard done_guard(done);
+    brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+
+    SparseTable* table = SparseTableRegistry::Instance()->Find(request->table_handle());
+    if (table == nullptr || table->Stream() == nullptr) {
+        cntl->SetFailed("sparse table %u has no update stream", request->table_handle());
+        return;
+    }
+
+    table->Stream()->Read(request, response, &cntl->response_attachment());
+}
+
+void PsServiceImpl::Ping(google::protobuf::RpcController* cntl_base,
+                         const PingRequest* request,
+                         PingResponse* response,
+                         google::protobuf::Closure* done) {
+    brpc::ClosureGuard done_guard(done);
+}
+
 }  // end of namespace tensornet
@@ -29,11 +29,21 @@ public:
                             SparsePullResponse* response,
                             google::protobuf::Closure* done);
 
+    virtual void SparseMultiPull(google::protobuf::RpcController* cntl_base,
+                                 const SparseMultiPullRequest* request,
+                                 SparseMultiPullResponse* response,
+                                 google::protobuf::Closure* done);
+
     virtual void SparsePush(google::protobuf::RpcController* cntl_base,
                             const SparsePushRequest* request,
                             SparsePushResponse* response,
                             google::protobuf::Closure* done);
 
+    virtual void SparseMultiPush(google::protobuf::RpcController* cntl_base,
+                                 const SparseMultiPushRequest* request,
+                                 SparseMultiPushResponse* response,
+                                 google::protobuf::Closure* done);
+
     virtual void DensePushPull(google::protobuf::RpcController* cntl_base,
                                const DensePushPullRequest* request,
                                DensePushPullResponse* response,
@@ -43,6 +53,16 @@ public:
                              const DatasetPullRequest* request,
                              DatasetPullResponse* response,
                              google::protobuf::Closure* done);
+
+    virtual void SparseSubscribe(google::protobuf::RpcController* cntl_base,
+                                 const SparseSubscribeRequest* request,
+                                 SparseSubscribeResponse* response,
+                                 google::protobuf::Closure* done);
+
+    virtual void Ping(google::protobuf::RpcController* cntl_base,
+                      const PingRequest* request,
+                      PingResponse* response,
+                      google::protobuf::Closure* done);
 };
 
 }  // end of namespace tensornet
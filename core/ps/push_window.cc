@@ -0,0 +1,82 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/ps/push_window.h"
+
+#include <butil/logging.h>
+
+namespace tensornet {
+
+PushWindow* PushWindow::Instance() {
+    static PushWindow instance;
+    return &instance;
+}
+
+void PushWindow::SetWindow(int window) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    window_ = window;
+
+    // a larger window may let waiting pushes go
+    cond_.notify_all();
+}
+
+int PushWindow::Window() const {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    return window_;
+}
+
+int& PushWindow::InFlight_(int shard_id) {
+    CHECK_GE(shard_id, 0);
+
+    if ((size_t)shard_id >= in_flight_.size()) {
+        in_flight_.resize(shard_id + 1, 0);
+    }
+
+    return in_flight_[shard_id];
+}
+
+void PushWindow::Acquire(int shard_id) {
+    std::unique_lock<std::mutex> lock(mu_);
+
+    cond_.wait(lock, [this, shard_id]() {
+        return window_ <= 0 || InFlight_(shard_id) < window_;
+    });
+
+    ++InFlight_(shard_id);
+    ++total_;
+}
+
+void PushWindow::Release(int shard_id) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    int& in_flight = InFlight_(shard_id);
+    CHECK_GT(in_flight, 0) << "push window release without acquire, shard:" << shard_id;
+
+    --in_flight;
+    --total_;
+
+    cond_.notify_all();
+}
+
+void PushWindow::Flush() {
+    std::unique_lock<std::mutex> lock(mu_);
+
+    cond_.wait(lock, [this]() {
+        return 0 == total_;
+    });
+}
+
+} // namespace tensornet
@@ -0,0 +1,61 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_PS_PUSH_WINDOW_H_
+#define TENSORNET_PS_PUSH_WINDOW_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace tensornet {
+
+// track sparse push rpc in flight of every shard. pushing to a shard wait while
+// its window is full so slow servers slow down workers instead of piling up
+// requests in worker memory, Flush wait until all pushes are acknowledged.
+class PushWindow {
+public:
+    static PushWindow* Instance();
+
+    // max pushes in flight of one shard, not limited when not positive
+    void SetWindow(int window);
+
+    int Window() const;
+
+    // block until the shard has room for one more push
+    void Acquire(int shard_id);
+
+    // called when the push is acknowledged
+    void Release(int shard_id);
+
+    // block until no pushes in flight
+    void Flush();
+
+private:
+    PushWindow() { }
+
+    int& InFlight_(int shard_id);
+
+private:
+    mutable std::mutex mu_;
+    std::condition_variable cond_;
+
+    int window_ = 0;
+    int total_ = 0;
+    std::vector<int> in_flight_;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_PS_PUSH_WINDOW_H_
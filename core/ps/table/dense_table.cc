@@ -18,6 +18,7 @@
 
 #include "core/utility/file_io.h"
 
+#include <algorithm>
 #include <cmath>
 #include <functional>
 
@@ -44,20 +45,14 @@ int DenseTable::Init(int total_elements) {
         return 0;
     }
 
-    int every_kernel_size = std::ceil(total_elements * 1.0 / shard_num_);
-
     for (int i = 0; i < shard_num_; i++) {
-        int offset_begin = i * every_kernel_size;
-        int offset_end = (i + 1) * every_kernel_size;
+        int offset_begin = 0;
+        int offset_end = 0;
 
-        if (offset_begin >= total_elements) {
+        if (!ShardRange(total_elements, shard_num_, i, &offset_begin, &offset_end)) {
             continue;
         }
 
-        if (offset_end > total_elements) {
-            offset_end = total_elements;
-        }
-
         if (i == self_shard_id_) {
             LOG(INFO) << "init dense table:" << GetHandle() << " rank:" << i
                       << " elements:" << total_elements
@@ -74,6 +69,16 @@ int DenseTable::Init(int total_elements) {
     return 0;
 }
 
+bool DenseTable::ShardRange(int total_elements, int shard_num, int shard_id,
+                            int* offset_begin, int* offset_end) {
+    int every_kernel_size = std::ceil(total_elements * 1.0 / shard_num);
+
+    *offset_begin = shard_id * every_kernel_size;
+    *offset_end = std::min((shard_id + 1) * every_kernel_size, total_elements);
+
+    return *offset_begin < total_elements;
+}
+
 int DenseTable::SetWeight(butil::IOBuf& w_buf) {
     for (size_t i = 0; i < opt_kernels_.size(); i++) {
         butil::IOBuf buf;
@@ -134,17 +139,11 @@ void DenseTable::Save(std::string filepath) const {
 void DenseTable::Load(std::string filepath) {
     butil::Timer timer(butil::Timer::STARTED);
 
-    std::string file = filepath + "/dense_table/" + std::to_string(GetHandle())
-                            + "/" + std::to_string(self_shard_id_);
-
-    FileReaderSource reader_source(file);
-    boost::iostreams::stream<FileReaderSource> in_stream(reader_source);
-
-    int rank_num = 0;
-    in_stream.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> total_elements_;
-    in_stream.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> rank_num;
+    std::string dir = filepath + "/dense_table/" + std::to_string(GetHandle());
 
-    CHECK_EQ(shard_num_, rank_num);
+    // rank 0 always has a file if there is any element
+    int saved_rank_num = 0;
+    LoadHeader_(dir + "/0", &total_elements_, &saved_rank_num);
 
     CHECK_EQ(0, Init(total_elements_));
 
@@ -153,15 +152,62 @@ void DenseTable::Load(std::string filepath) {
         return;
     }
 
-    opt_kernel->DeSerialized(in_stream);
+    if (saved_rank_num == shard_num_) {
+        FileReaderSource reader_source(dir + "/" + std::to_string(self_shard_id_));
+        boost::iostreams::stream<FileReaderSource> in_stream(reader_source);
+
+        int total_elements = 0, rank_num = 0;
+        ReadHeader_(in_stream, &total_elements, &rank_num);
+
+        opt_kernel->DeSerialized(in_stream);
+    } else {
+        // load every saved shard overlapping ours and copy the overlapped elements
+        for (int i = 0; i < saved_rank_num; i++) {
+            int offset_begin = 0;
+            int offset_end = 0;
+
+            if (!ShardRange(total_elements_, saved_rank_num, i, &offset_begin, &offset_end)
+                    || offset_end <= opt_kernel->OffsetBegin()
+                    || offset_begin >= opt_kernel->OffsetEnd()) {
+                continue;
+            }
+
+            FileReaderSource reader_source(dir + "/" + std::to_string(i));
+            boost::iostreams::stream<FileReaderSource> in_stream(reader_source);
+
+            int total_elements = 0, rank_num = 0;
+            ReadHeader_(in_stream, &total_elements, &rank_num);
+
+            CHECK_EQ(total_elements, total_elements_);
+            CHECK_EQ(rank_num, saved_rank_num);
+
+            auto saved_kernel = opt_->CreateDenseOptKernel(offset_begin, offset_end);
+            saved_kernel->DeSerialized(in_stream);
+
+            opt_kernel->CopyFrom(*saved_kernel);
+        }
+    }
 
     timer.stop();
 
     LOG(INFO) << "DenseTable load, rank:" << self_shard_id_
+        << " saved_rank_num:" << saved_rank_num
         << " size:" << opt_kernel->DataSize()
         << " latency:" << timer.s_elapsed() << "s";
 }
 
+void DenseTable::ReadHeader_(std::istream& is, int* total_elements, int* rank_num) {
+    is.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> *total_elements;
+    is.ignore(std::numeric_limits<std::streamsize>::max(), ':') >> *rank_num;
+}
+
+void DenseTable::LoadHeader_(const std::string& file, int* total_elements, int* rank_num) {
+    FileReaderSource reader_source(file);
+    boost::iostreams::stream<FileReaderSource> in_stream(reader_source);
+
+    ReadHeader_(in_stream, total_elements, rank_num);
+}
+
 DenseTableRegistry* DenseTableRegistry::Instance() {
     static DenseTableRegistry singleton;
     return &singleton;
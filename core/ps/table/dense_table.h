@@ -17,6 +17,7 @@
 
 #include "core/ps/optimizer/optimizer.h"
 
+#include <iosfwd>
 #include <map>
 #include <vector>
 #include <mutex>
@@ -52,8 +53,20 @@ public:
 
     void Save(std::string filepath) const;
 
+    // model saved by a different number of ranks is loaded too, every rank reads
+    // saved shards overlapping its own range
     void Load(std::string filepath);
 
+    // range [offset_begin, offset_end) of shard_id when total_elements are split into
+    // shard_num shards, return false if the shard has no element
+    static bool ShardRange(int total_elements, int shard_num, int shard_id,
+                           int* offset_begin, int* offset_end);
+
+private:
+    static void ReadHeader_(std::istream& is, int* total_elements, int* rank_num);
+
+    static void LoadHeader_(const std::string& file, int* total_elements, int* rank_num);
+
 private:
     int shard_num_ = 0;
     int self_shard_id_ = 0;
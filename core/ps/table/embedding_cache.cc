@@ -0,0 +1,129 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/ps/table/embedding_cache.h"
+
+#include <algorithm>
+
+#include <butil/logging.h>
+
+namespace tensornet {
+
+static constexpr size_t EMBEDDING_CACHE_SHARD_NUM = 16;
+
+EmbeddingCache::EmbeddingCache(int dim, const SparseCacheOption& option)
+    : dim_(dim)
+    , option_(option)
+    , shards_(EMBEDDING_CACHE_SHARD_NUM) {
+    CHECK_GT(option_.staleness, 0);
+    CHECK_GT(option_.capacity, 0);
+
+    size_t shard_capacity = (option_.capacity + shards_.size() - 1) / shards_.size();
+    for (auto& shard : shards_) {
+        shard.capacity = shard_capacity;
+        shard.map.reserve(shard_capacity);
+    }
+}
+
+bool EmbeddingCache::Get(uint64_t sign, float* w) {
+    Shard& shard = GetShard_(sign);
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mu);
+
+        Entry* entry = shard.map.find(sign);
+        if (nullptr != entry && !Expired_(entry->step)) {
+            std::copy_n(shard.values.data() + entry->offset, dim_, w);
+            hit_count_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    miss_count_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool EmbeddingCache::Contains(uint64_t sign) {
+    Shard& shard = GetShard_(sign);
+
+    std::lock_guard<std::mutex> lock(shard.mu);
+
+    Entry* entry = shard.map.find(sign);
+    return nullptr != entry && !Expired_(entry->step);
+}
+
+void EmbeddingCache::Put(uint64_t sign, const float* w) {
+    Shard& shard = GetShard_(sign);
+    uint32_t step = step_.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(shard.mu);
+
+    Entry* entry = shard.map.find(sign);
+    if (nullptr == entry) {
+        uint32_t offset = 0;
+        if (!Allocate_(shard, &offset)) {
+            return;
+        }
+
+        entry = shard.map.insert(sign, Entry{step, offset}).first;
+    }
+
+    entry->step = step;
+    std::copy_n(w, dim_, shard.values.data() + entry->offset);
+}
+
+bool EmbeddingCache::Allocate_(Shard& shard, uint32_t* offset) {
+    uint32_t step = step_.load(std::memory_order_relaxed);
+
+    if (shard.free_offsets.empty() && shard.map.size() >= shard.capacity
+            && shard.swept_step != step) {
+        shard.swept_step = step;
+        shard.map.erase_if(0, shard.map.capacity(), [&shard, this](const uint64_t& sign, Entry& entry) {
+            if (!Expired_(entry.step)) {
+                return false;
+            }
+
+            shard.free_offsets.push_back(entry.offset);
+            return true;
+        });
+    }
+
+    if (!shard.free_offsets.empty()) {
+        *offset = shard.free_offsets.back();
+        shard.free_offsets.pop_back();
+        return true;
+    }
+
+    if (shard.map.size() >= shard.capacity) {
+        return false;
+    }
+
+    *offset = shard.values.size();
+    shard.values.resize(shard.values.size() + dim_);
+
+    return true;
+}
+
+size_t EmbeddingCache::Size() const {
+    size_t size = 0;
+
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mu);
+        size += shard.map.size();
+    }
+
+    return size;
+}
+
+} // namespace tensornet
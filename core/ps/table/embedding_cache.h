@@ -0,0 +1,116 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_PS_TABLE_EMBEDDING_CACHE_H_
+#define TENSORNET_PS_TABLE_EMBEDDING_CACHE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "core/ps/optimizer/optimizer_kernel.h"
+#include "core/utility/open_hash_map.h"
+
+namespace tensornet {
+
+struct SparseCacheOption {
+    // max steps a cached embedding may lag behind ps, one step is one push of the
+    // table. cache is disabled if not positive.
+    int staleness = 0;
+
+    // max count of cached embeddings
+    size_t capacity = 1 << 20;
+};
+
+// worker side cache of pulled embeddings, hot signs pulled in recent steps are
+// served from here without rpc. all methods are thread safe.
+class EmbeddingCache {
+public:
+    EmbeddingCache(int dim, const SparseCacheOption& option);
+
+    ~EmbeddingCache() = default;
+
+    // copy embedding of sign into w, return false if not cached or too stale
+    bool Get(uint64_t sign, float* w);
+
+    void Put(uint64_t sign, const float* w);
+
+    // whether sign is cached and not too stale, hit and miss are not counted
+    bool Contains(uint64_t sign);
+
+    // called by every push of the table, cached embeddings expire after
+    // option.staleness steps
+    void NextStep() {
+        step_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t Size() const;
+
+    uint64_t HitCount() const {
+        return hit_count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t MissCount() const {
+        return miss_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        uint32_t step;
+        uint32_t offset;
+    };
+
+    // embeddings are kept in a preallocated pool of each shard, freed offsets are
+    // reused by later Put
+    struct Shard {
+        mutable std::mutex mu;
+        OpenHashMap<uint64_t, Entry, SparseKeyHasher> map;
+        std::vector<float> values;
+        std::vector<uint32_t> free_offsets;
+        size_t capacity = 0;
+
+        // entries only expire when step changes, so a full shard is swept for
+        // expired entries at most once every step
+        uint32_t swept_step = 0;
+    };
+
+    Shard& GetShard_(uint64_t sign) {
+        // fibonacci hashing like OpenHashMap, signs routed to one ps shard share
+        // some bits and must not all fall into one cache shard
+        return shards_[((sign * 0x9E3779B97F4A7C15ULL) >> 32) % shards_.size()];
+    }
+
+    bool Expired_(uint32_t step) const {
+        return step_.load(std::memory_order_relaxed) - step >= (uint32_t)option_.staleness;
+    }
+
+    // return false if no space left even after expired entries of this step removed
+    bool Allocate_(Shard& shard, uint32_t* offset);
+
+private:
+    int dim_ = 0;
+    SparseCacheOption option_;
+    std::vector<Shard> shards_;
+
+    std::atomic<uint32_t> step_{0};
+    std::atomic<uint64_t> hit_count_{0};
+    std::atomic<uint64_t> miss_count_{0};
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_PS_TABLE_EMBEDDING_CACHE_H_
@@ -0,0 +1,185 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/ps/table/hot_key.h"
+
+#include <algorithm>
+
+#include <butil/logging.h>
+
+namespace tensornet {
+
+HotKeyDetector::HotKeyDetector(const HotKeyOption& option)
+    : option_(option) {
+    CHECK_GT(option_.hot_key_num, 0);
+    CHECK_GT(option_.sample_rate, 0);
+    CHECK_GT(option_.refresh_samples, 0);
+}
+
+void HotKeyDetector::Sample(const uint64_t* signs, size_t n) {
+    size_t rate = option_.sample_rate;
+
+    // continue the sampling stride from previous requests
+    uint64_t seen = seen_.fetch_add(n, std::memory_order_relaxed);
+    size_t begin = (rate - seen % rate) % rate;
+
+    if (begin >= n) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    for (size_t i = begin; i < n; i += rate) {
+        uint32_t* count = counts_.insert(signs[i], 0).first;
+        ++*count;
+        ++sampled_;
+    }
+
+    if (sampled_ >= option_.refresh_samples) {
+        Refresh_();
+    }
+}
+
+void HotKeyDetector::Refresh_() {
+    std::vector<std::pair<uint32_t, uint64_t>> ranks;
+    ranks.reserve(counts_.size());
+
+    counts_.for_each([&ranks](const uint64_t& sign, uint32_t& count) {
+        ranks.emplace_back(count, sign);
+    });
+
+    size_t hot_num = std::min(ranks.size(), (size_t)option_.hot_key_num);
+    std::nth_element(ranks.begin(), ranks.begin() + hot_num, ranks.end(),
+                     std::greater<std::pair<uint32_t, uint64_t>>());
+
+    hot_signs_.resize(hot_num);
+    for (size_t i = 0; i < hot_num; ++i) {
+        hot_signs_[i] = ranks[i].second;
+    }
+    std::sort(hot_signs_.begin(), hot_signs_.end());
+
+    ++version_;
+    sampled_ = 0;
+
+    // decay counts and drop the cold ones, erase_if may miss some moved by backward
+    // shift, they will be decayed next time
+    counts_.erase_if(0, counts_.capacity(), [](const uint64_t& sign, uint32_t& count) {
+        count >>= 1;
+        return count == 0;
+    });
+}
+
+uint32_t HotKeyDetector::GetHotKeys(uint32_t version, std::vector<uint64_t>* signs) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    if (version != version_) {
+        *signs = hot_signs_;
+    }
+
+    return version_;
+}
+
+HotKeyCombiner::HotKeyCombiner(int dim, int shard_num, const HotKeyOption& option)
+    : dim_(dim)
+    , option_(option)
+    , versions_(shard_num, 0)
+    , shard_hot_signs_(shard_num)
+    , hot_set_(std::make_shared<HotKeySet>()) {
+    CHECK_GT(option_.push_interval, 0);
+}
+
+uint32_t HotKeyCombiner::Version(int shard_id) const {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    return versions_[shard_id];
+}
+
+void HotKeyCombiner::Update(int shard_id, uint32_t version, const std::vector<uint64_t>& signs) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    if (versions_[shard_id] == version) {
+        return;
+    }
+
+    versions_[shard_id] = version;
+    shard_hot_signs_[shard_id] = signs;
+
+    auto hot_set = std::make_shared<HotKeySet>();
+    for (const auto& shard_signs : shard_hot_signs_) {
+        hot_set->insert(shard_signs.begin(), shard_signs.end());
+    }
+
+    std::atomic_store(&hot_set_, std::shared_ptr<const HotKeySet>(hot_set));
+}
+
+void HotKeyCombiner::Add(const SparsePushSignInfo& sign_info, const float* grad) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    auto inserted = grad_index_.insert(sign_info.sign, sign_infos_.size());
+    if (inserted.second) {
+        sign_infos_.push_back(sign_info);
+        grads_.insert(grads_.end(), grad, grad + dim_);
+        return;
+    }
+
+    uint32_t index = *inserted.first;
+    sign_infos_[index].batch_show += sign_info.batch_show;
+
+    float* combined = grads_.data() + (size_t)index * dim_;
+    for (int i = 0; i < dim_; ++i) {
+        combined[i] += grad[i];
+    }
+}
+
+bool HotKeyCombiner::NextPush(std::vector<SparsePushSignInfo>* sign_infos,
+                              std::vector<float>* grads) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    if (++push_count_ < option_.push_interval) {
+        return false;
+    }
+
+    TakeCombined_(sign_infos, grads);
+
+    return true;
+}
+
+bool HotKeyCombiner::Flush(std::vector<SparsePushSignInfo>* sign_infos,
+                           std::vector<float>* grads) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    if (sign_infos_.empty()) {
+        sign_infos->clear();
+        grads->clear();
+        return false;
+    }
+
+    TakeCombined_(sign_infos, grads);
+
+    return true;
+}
+
+void HotKeyCombiner::TakeCombined_(std::vector<SparsePushSignInfo>* sign_infos,
+                                   std::vector<float>* grads) {
+    push_count_ = 0;
+
+    sign_infos->swap(sign_infos_);
+    grads->swap(grads_);
+
+    sign_infos_.clear();
+    grads_.clear();
+    grad_index_.clear();
+}
+
+} // namespace tensornet
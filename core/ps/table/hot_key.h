@@ -0,0 +1,123 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_PS_TABLE_HOT_KEY_H_
+#define TENSORNET_PS_TABLE_HOT_KEY_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "core/ps/optimizer/optimizer_kernel.h"
+#include "core/ps_interface/ps_raw_interface.h"
+#include "core/utility/open_hash_map.h"
+
+namespace tensornet {
+
+struct HotKeyOption {
+    // count of hot signs detected by every shard, disabled if not positive
+    int hot_key_num = 0;
+
+    // gradients of hot signs are combined at worker and pushed once every
+    // push_interval pushes
+    int push_interval = 4;
+
+    // one of every sample_rate pulled signs is counted
+    int sample_rate = 16;
+
+    // hot signs are picked again every refresh_samples sampled signs
+    size_t refresh_samples = 1 << 20;
+};
+
+// server side, count sampled signs of pull requests and pick the most frequent as
+// hot signs. counts are halved every refresh so hot signs follow the data.
+class HotKeyDetector {
+public:
+    explicit HotKeyDetector(const HotKeyOption& option);
+
+    void Sample(const uint64_t* signs, size_t n);
+
+    // fill hot signs if they are newer than version, return current version
+    uint32_t GetHotKeys(uint32_t version, std::vector<uint64_t>* signs);
+
+private:
+    void Refresh_();
+
+private:
+    HotKeyOption option_;
+
+    std::mutex mu_;
+    OpenHashMap<uint64_t, uint32_t, SparseKeyHasher> counts_;
+    size_t sampled_ = 0;
+
+    uint32_t version_ = 0;
+    std::vector<uint64_t> hot_signs_;
+
+    std::atomic<uint64_t> seen_{0};
+};
+
+typedef std::unordered_set<uint64_t> HotKeySet;
+
+// worker side, know hot signs of all shards then combine their gradients over
+// several pushes so that hot shards receive less requests.
+class HotKeyCombiner {
+public:
+    HotKeyCombiner(int dim, int shard_num, const HotKeyOption& option);
+
+    uint32_t Version(int shard_id) const;
+
+    void Update(int shard_id, uint32_t version, const std::vector<uint64_t>& signs);
+
+    // snapshot of current hot signs, looking up a snapshot need no lock
+    std::shared_ptr<const HotKeySet> HotSet() const {
+        return std::atomic_load(&hot_set_);
+    }
+
+    void Add(const SparsePushSignInfo& sign_info, const float* grad);
+
+    // called by every push, when pushing combined gradients is due return true and
+    // move them out
+    bool NextPush(std::vector<SparsePushSignInfo>* sign_infos, std::vector<float>* grads);
+
+    // move combined gradients out whether pushing them is due or not, return false
+    // if there is none. called at end of training and before save so that none of
+    // them is lost
+    bool Flush(std::vector<SparsePushSignInfo>* sign_infos, std::vector<float>* grads);
+
+private:
+    // must be called with mu_ held
+    void TakeCombined_(std::vector<SparsePushSignInfo>* sign_infos, std::vector<float>* grads);
+
+private:
+    int dim_ = 0;
+    HotKeyOption option_;
+
+    mutable std::mutex mu_;
+    std::vector<uint32_t> versions_;
+    std::vector<std::vector<uint64_t>> shard_hot_signs_;
+    std::shared_ptr<const HotKeySet> hot_set_;
+
+    OpenHashMap<uint64_t, uint32_t, SparseKeyHasher> grad_index_;
+    std::vector<SparsePushSignInfo> sign_infos_;
+    std::vector<float> grads_;
+    int push_count_ = 0;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_PS_TABLE_HOT_KEY_H_
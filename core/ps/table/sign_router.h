@@ -0,0 +1,131 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_PS_TABLE_SIGN_ROUTER_H_
+#define TENSORNET_PS_TABLE_SIGN_ROUTER_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <butil/logging.h>
+
+#include "core/ps/optimizer/data_struct.h"
+
+namespace tensornet {
+
+// virtual shards of a router are at least this many
+static constexpr int SIGN_ROUTER_MIN_VIRTUAL_SHARD_NUM = 4096;
+
+// route sparse signs to ranks through a fixed number of virtual shards. sign is in
+// virtual shard sign % VirtualShardNum(), every virtual shard is owned by one rank,
+// so that load can be balanced or a rank drained by moving virtual shards only.
+//
+// virtual shard number is a multiple of rank number, virtual shard v is owned by rank
+// v % rank_num by default, then a sign goes to rank sign % rank_num as it was before
+// routing table, models saved by then are still in right place.
+//
+// NOTE, owners are read without lock by every pull and push, Assign must be done by
+// all ranks the same way while there is no pull or push.
+class SignRouter {
+public:
+    explicit SignRouter(int rank_num, int min_virtual_shard_num = SIGN_ROUTER_MIN_VIRTUAL_SHARD_NUM)
+        : rank_num_(rank_num) {
+        CHECK_GT(rank_num, 0);
+
+        int per_rank = (min_virtual_shard_num + rank_num - 1) / rank_num;
+        virtual_shard_num_ = std::max(per_rank, 1) * rank_num;
+
+        owners_.resize(virtual_shard_num_);
+        for (int v = 0; v < virtual_shard_num_; ++v) {
+            owners_[v] = v % rank_num_;
+        }
+    }
+
+    int RankNum() const {
+        return rank_num_;
+    }
+
+    int VirtualShardNum() const {
+        return virtual_shard_num_;
+    }
+
+    int VirtualShard(uint64_t sign) const {
+        return sign % virtual_shard_num_;
+    }
+
+    int Rank(uint64_t sign) const {
+        return owners_[VirtualShard(sign)];
+    }
+
+    int Owner(int virtual_shard) const {
+        return owners_[virtual_shard];
+    }
+
+    void Assign(int virtual_shard, int rank) {
+        CHECK(virtual_shard >= 0 && virtual_shard < virtual_shard_num_)
+            << "bad virtual shard:" << virtual_shard;
+        CHECK(rank >= 0 && rank < rank_num_) << "bad rank:" << rank;
+
+        owners_[virtual_shard] = rank;
+    }
+
+    // virtual shards owned by rank
+    std::vector<int> VirtualShardsOf(int rank) const {
+        std::vector<int> virtual_shards;
+        for (int v = 0; v < virtual_shard_num_; ++v) {
+            if (owners_[v] == rank) {
+                virtual_shards.push_back(v);
+            }
+        }
+
+        return virtual_shards;
+    }
+
+    // true if no virtual shard is moved from its default owner
+    bool IsDefault() const {
+        for (int v = 0; v < virtual_shard_num_; ++v) {
+            if (owners_[v] != v % rank_num_) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // filter keeping signs of rank when loading sparse kernels
+    SparseShardFilter FilterOf(int rank) const {
+        SparseShardFilter filter;
+        filter.keep.resize(virtual_shard_num_);
+
+        for (int v = 0; v < virtual_shard_num_; ++v) {
+            filter.keep[v] = owners_[v] == rank;
+        }
+
+        return filter;
+    }
+
+private:
+    int rank_num_ = 0;
+    int virtual_shard_num_ = 0;
+
+    std::vector<int> owners_;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_PS_TABLE_SIGN_ROUTER_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,134 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/ps/table/sparse_stream.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <butil/logging.h>
+#include <butil/time.h>
+
+#include "core/ps_interface/sparse_codec.h"
+
+namespace tensornet {
+
+SparseUpdateStream::SparseUpdateStream(SparseOptimizerKernelBase* kernel, int dim,
+                                       const SparseStreamOption& option)
+    : kernel_(kernel)
+    , dim_(dim)
+    , option_(option)
+    , stream_id_(butil::gettimeofday_us()) {
+    CHECK(kernel_ != nullptr);
+    CHECK_GT(option_.max_batches, 0);
+
+    if (option_.interval_ms > 0) {
+        thread_ = std::thread(&SparseUpdateStream::Run_, this);
+    }
+}
+
+SparseUpdateStream::~SparseUpdateStream() {
+    {
+        std::lock_guard<std::mutex> lock(run_mu_);
+        stop_ = true;
+    }
+    run_cond_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SparseUpdateStream::Run_() {
+    std::unique_lock<std::mutex> lock(run_mu_);
+
+    while (!stop_) {
+        run_cond_.wait_for(lock, std::chrono::milliseconds(option_.interval_ms));
+        if (stop_) {
+            break;
+        }
+
+        lock.unlock();
+        Collect();
+        lock.lock();
+    }
+}
+
+size_t SparseUpdateStream::Collect() {
+    // a stream collected by hand is rated as once a second
+    size_t interval_ms = option_.interval_ms > 0 ? option_.interval_ms : 1000;
+    size_t max_keys = std::max<size_t>(1, option_.max_keys_per_second * interval_ms / 1000);
+
+    Batch batch;
+    size_t n = kernel_->TakeUpdates(max_keys, &batch.signs, &batch.weights);
+    if (n == 0) {
+        return 0;
+    }
+
+    CHECK_EQ(batch.weights.size(), n * dim_);
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    batch.seq = next_seq_++;
+    batches_.emplace_back(std::move(batch));
+
+    while (batches_.size() > option_.max_batches) {
+        batches_.pop_front();
+    }
+
+    return n;
+}
+
+void SparseUpdateStream::Read(const SparseSubscribeRequest* req, SparseSubscribeResponse* resp,
+                              butil::IOBuf* attachment) {
+    resp->set_table_handle(req->table_handle());
+    resp->set_dim(dim_);
+    resp->set_stream_id(stream_id_);
+    resp->set_value_encoding(req->value_encoding());
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    uint64_t first_seq = batches_.empty() ? next_seq_ : batches_.front().seq;
+    uint64_t seq = req->next_seq();
+
+    // a new subscriber starts with the oldest batch kept, one from another stream or
+    // fallen behind continues with it too but knows some updates are lost
+    if (req->stream_id() == 0) {
+        seq = first_seq;
+    } else if (req->stream_id() != stream_id_ || seq < first_seq || seq > next_seq_) {
+        resp->set_lost(true);
+        seq = first_seq;
+    }
+
+    size_t max_keys = req->max_keys() > 0 ? req->max_keys() : option_.max_keys_per_second;
+    size_t taken = 0;
+
+    for (size_t i = seq - first_seq; i < batches_.size(); ++i) {
+        const Batch& batch = batches_[i];
+        if (taken > 0 && taken + batch.signs.size() > max_keys) {
+            break;
+        }
+
+        resp->mutable_signs()->Add(batch.signs.begin(), batch.signs.end());
+        EncodeSparseValues(batch.weights.data(), batch.weights.size(), req->value_encoding(),
+                           attachment);
+
+        taken += batch.signs.size();
+        seq = batch.seq + 1;
+    }
+
+    resp->set_next_seq(seq);
+}
+
+}  // namespace tensornet
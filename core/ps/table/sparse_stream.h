@@ -0,0 +1,92 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_PS_TABLE_SPARSE_STREAM_H_
+#define TENSORNET_PS_TABLE_SPARSE_STREAM_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <butil/iobuf.h>
+
+#include "core/ps/optimizer/optimizer_kernel.h"
+#include "core/ps_interface/ps_server.pb.h"
+
+namespace tensornet {
+
+struct SparseStreamOption {
+    // updated weights are collected every interval_ms, disabled if not positive
+    int interval_ms = 0;
+
+    // at most this many signs are collected per second, the rest wait for next
+    // interval. a sign updated many times in between is sent once
+    size_t max_keys_per_second = 100000;
+
+    // batches kept for subscribers, a subscriber falls behind more than this
+    // loses updates and has to reload a full snapshot
+    size_t max_batches = 600;
+};
+
+// server side, collect weights of signs updated by push in background and keep
+// them as numbered batches, serving subscribers poll batches after what they have.
+class SparseUpdateStream {
+public:
+    // kernel must outlive the stream
+    SparseUpdateStream(SparseOptimizerKernelBase* kernel, int dim, const SparseStreamOption& option);
+
+    ~SparseUpdateStream();
+
+    // fill response and attachment with batches from request next_seq
+    void Read(const SparseSubscribeRequest* req, SparseSubscribeResponse* resp,
+              butil::IOBuf* attachment);
+
+    // collect one batch in caller thread, return count of collected signs
+    size_t Collect();
+
+private:
+    void Run_();
+
+private:
+    struct Batch {
+        uint64_t seq = 0;
+        std::vector<uint64_t> signs;
+        std::vector<float> weights;
+    };
+
+    SparseOptimizerKernelBase* kernel_ = nullptr;
+    int dim_ = 0;
+    SparseStreamOption option_;
+
+    // a restarted server has another stream id, so that subscribers know their
+    // next_seq is meaningless
+    uint64_t stream_id_ = 0;
+
+    std::mutex mu_;
+    std::deque<Batch> batches_;
+    uint64_t next_seq_ = 0;
+
+    std::mutex run_mu_;
+    std::condition_variable run_cond_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+}  // namespace tensornet
+
+#endif  // TENSORNET_PS_TABLE_SPARSE_STREAM_H_
@@ -16,101 +16,377 @@
 
 #include <set>
 #include <string>
+#include <vector>
 
 #include <butil/containers/flat_map.h>
 #include <butil/logging.h>
 #include <butil/object_pool.h>
 
+#include <boost/iostreams/stream.hpp>
+
 #include "core/ps/optimizer/optimizer_kernel.h"
-#include "core/ps_interface/ps_raw_interface.h"
+#include "core/utility/file_io.h"
 
 namespace tensornet {
 
 SparseTable::SparseTable(const OptimizerBase* opt, int dimension,
-        int shard_num, int self_shard_id)
+        int shard_num, int self_shard_id, const SparseKernelOption& option,
+        const SparseWireOption& wire_option, const SparseCacheOption& cache_option,
+        const HotKeyOption& hot_key_option, const SparseStreamOption& stream_option)
     : shard_num_(shard_num)
     , self_shard_id_(self_shard_id)
     , opt_(opt)
-    , dim_(dimension) {
+    , dim_(dimension)
+    , wire_option_(wire_option)
+    , kernel_option_(option)
+    , cache_option_(cache_option)
+    , hot_key_option_(hot_key_option)
+    , stream_option_(stream_option) {
     CHECK(opt_ != nullptr);
 
-    op_kernel_ = opt_->CreateSparseOptKernel(dim_);
+    if (stream_option.interval_ms > 0) {
+        SparseKernelOption stream_kernel_option = option;
+        stream_kernel_option.track_updates = true;
+
+        op_kernel_ = opt_->CreateSparseOptKernel(dim_, stream_kernel_option);
+        stream_.reset(new SparseUpdateStream(op_kernel_.get(), dim_, stream_option));
+    } else {
+        op_kernel_ = opt_->CreateSparseOptKernel(dim_, option);
+    }
+
+    if (cache_option.staleness > 0) {
+        cache_.reset(new EmbeddingCache(dim_, cache_option));
+    }
+
+    if (hot_key_option.hot_key_num > 0) {
+        hot_key_detector_.reset(new HotKeyDetector(hot_key_option));
+        hot_key_combiner_.reset(new HotKeyCombiner(dim_, shard_num_, hot_key_option));
+    }
 }
 
 void SparseTable::SetHandle(uint32_t handle) {
+    SetHandle_(handle, "");
+}
+
+void SparseTable::AddDim(int dim) {
+    CHECK(handle_ == 0) << "dim must be added before sparse table handle is set";
+    CHECK_GT(dim, 0);
+    CHECK(nullptr == DimTable(dim)) << "sparse table dim already exists:" << dim;
+
+    dim_tables_.emplace_back(new SparseTable(opt_, dim, shard_num_, self_shard_id_,
+            kernel_option_, wire_option_, cache_option_, hot_key_option_, stream_option_));
+}
+
+SparseTable* SparseTable::DimTable(int dim) {
+    if (dim == dim_) {
+        return this;
+    }
+
+    for (auto& table : dim_tables_) {
+        if (table->Dim() == dim) {
+            return table.get();
+        }
+    }
+
+    return nullptr;
+}
+
+std::vector<int> SparseTable::Dims() const {
+    std::vector<int> dims = {dim_};
+    for (const auto& table : dim_tables_) {
+        dims.push_back(table->Dim());
+    }
+
+    return dims;
+}
+
+std::string SparseTable::Dir_(const std::string& filepath, const char* kind) const {
+    std::string dir = filepath + "/" + kind + "/" + std::to_string(GetHandle());
+    if (!dim_suffix_.empty()) {
+        dir.append("/").append(dim_suffix_);
+    }
+
+    return dir;
+}
+
+void SparseTable::SetHandle_(uint32_t handle, const std::string& dim_suffix) {
     CHECK(handle_ == 0) << "sparse table handle has already set:" << handle_;
 
     handle_ = handle;
+    dim_suffix_ = dim_suffix;
+
+    for (auto& table : dim_tables_) {
+        table->SetHandle_(handle, "dim_" + std::to_string(table->Dim()));
+    }
+
+    std::string prefix = "tensornet_sparse_table_" + std::to_string(handle_);
+    if (!dim_suffix_.empty()) {
+        prefix.append("_").append(dim_suffix_);
+    }
+
+    key_count_var_.reset(new bvar::PassiveStatus<int64_t>(prefix + "_key_count",
+        [](void* arg) -> int64_t {
+            return static_cast<SparseOptimizerKernelBase*>(arg)->KeyCount();
+        }, op_kernel_.get()));
+
+    memory_bytes_var_.reset(new bvar::PassiveStatus<int64_t>(prefix + "_memory_bytes",
+        [](void* arg) -> int64_t {
+            return static_cast<SparseOptimizerKernelBase*>(arg)->MemoryBytes();
+        }, op_kernel_.get()));
 }
 
 void SparseTable::Pull(const SparsePullRequest* req, butil::IOBuf& out_emb_buf, SparsePullResponse* resp) {
-    resp->set_table_handle(req->table_handle());
+    if (req->dim() != (uint32_t)dim_) {
+        SparseTable* table = DimTable(req->dim());
+        CHECK(nullptr != table) << "sparse table " << handle_ << " has no dim:" << req->dim();
+        return table->Pull(req, out_emb_buf, resp);
+    }
 
-    CHECK_EQ(dim_, req->dim());
+    resp->set_table_handle(req->table_handle());
     resp->set_dim(req->dim());
 
-    for (int i = 0; i < req->signs_size(); ++i) {
-        uint64_t sign = req->signs(i);
+    // response is encoded as the client request, so client decide the wire format
+    resp->set_value_encoding(req->value_encoding());
 
-        // w.size() is guaranteed by op_kernel_ same with dim_
-        float* w = op_kernel_->GetWeight(sign);
-        CHECK(nullptr != w);
+    std::vector<uint64_t> signs;
+    DecodeSigns(req->signs(), req->delta_signs(), &signs);
 
-        out_emb_buf.append(w, sizeof(float) * dim_);
+    size_t sign_num = signs.size();
+
+    std::vector<float> weights(sign_num * dim_);
+    std::vector<uint64_t> hot_signs;
+    uint32_t hot_version = PullLocal(signs.data(), sign_num, weights.data(),
+                                     req->hot_version(), &hot_signs);
+
+    if (hot_key_detector_) {
+        resp->set_hot_version(hot_version);
+        resp->mutable_hot_signs()->Add(hot_signs.begin(), hot_signs.end());
     }
+
+    EncodeSparseValues(weights.data(), weights.size(), req->value_encoding(), &out_emb_buf);
+}
+
+uint32_t SparseTable::PullLocal(const uint64_t* signs, size_t sign_num, float* weights,
+                                uint32_t hot_version, std::vector<uint64_t>* hot_signs) {
+    op_kernel_->GetWeights(signs, sign_num, weights);
+
+    if (hot_key_detector_) {
+        hot_key_detector_->Sample(signs, sign_num);
+        hot_version = hot_key_detector_->GetHotKeys(hot_version, hot_signs);
+    }
+
+    return hot_version;
 }
 
 void SparseTable::Push(const SparsePushRequest* req, butil::IOBuf& grad_buf, SparsePushResponse* resp) {
-    CHECK_EQ(dim_, req->dim());
+    if (req->dim() != (uint32_t)dim_) {
+        SparseTable* table = DimTable(req->dim());
+        CHECK(nullptr != table) << "sparse table " << handle_ << " has no dim:" << req->dim();
+        return table->Push(req, grad_buf, resp);
+    }
+
+    std::vector<uint64_t> signs;
+    DecodeSigns(req->signs(), req->delta_signs(), &signs);
 
-    float grad[dim_];
-    SparsePushSignInfo sign_info;
+    size_t sign_num = signs.size();
+    CHECK_EQ(sign_num, req->batch_shows_size());
 
-    while (sizeof(sign_info) == grad_buf.cutn(&sign_info, sizeof(sign_info))) {
-        size_t grad_size = sizeof(float) * dim_;
-        CHECK_EQ(grad_size, grad_buf.cutn(grad, grad_size));
+    std::vector<float> grads(sign_num * dim_);
+    CHECK(DecodeSparseValues(&grad_buf, grads.size(), req->value_encoding(), grads.data()))
+        << "sparse push gradients not complete, sign_num:" << sign_num
+        << " left size:" << grad_buf.size();
 
-        SparseGradInfo grad_info;
-        grad_info.grad = grad;
-        grad_info.batch_show = sign_info.batch_show;
+    std::vector<SparseGradInfo> grad_infos(sign_num);
 
-        op_kernel_->Apply(sign_info.sign, grad_info);
+    for (size_t i = 0; i < sign_num; ++i) {
+        grad_infos[i].grad = grads.data() + i * dim_;
+        grad_infos[i].batch_show = req->batch_shows(i);
     }
+
+    PushLocal(signs.data(), grad_infos.data(), sign_num);
 }
 
-void SparseTable::Save(const std::string& filepath) const {
+void SparseTable::PushLocal(const uint64_t* signs, SparseGradInfo* grad_infos, size_t sign_num) {
+    op_kernel_->ApplyBatch(signs, grad_infos, sign_num);
+}
+
+void SparseTable::Save(const std::string& filepath, SparseFileFormat format, bool delta) const {
     butil::Timer timer(butil::Timer::STARTED);
 
-    std::string file = filepath + "/sparse_table/" + std::to_string(GetHandle())
-                             + "/rank_" + std::to_string(self_shard_id_);
+    std::string file = Dir_(filepath, "sparse_table") + "/rank_" + std::to_string(self_shard_id_);
 
-    op_kernel_->Serialized(file);
+    op_kernel_->Serialized(file, format, delta);
 
     timer.stop();
 
     LOG(INFO) << "SparseTable save. rank:" << self_shard_id_
               << " table_id:" << GetHandle()
+              << " dim:" << dim_
+              << " delta:" << delta
               << " latency:" << timer.s_elapsed() << "s"
               << " keys_count:" << op_kernel_->KeyCount();
+
+    for (const auto& table : dim_tables_) {
+        table->Save(filepath, format, delta);
+    }
 }
 
-void SparseTable::Load(const std::string& filepath) const {
+// signs saved by rank r of saved_num ranks are those sign % saved_num == r if the
+// routing is default when saving, some of them belong to this rank if r and
+// self_shard_id are same modulo gcd of the two rank numbers. when routing is same
+// as saved, only rank_<self_shard_id> is read. a model saved by moved virtual shards
+// is read by all ranks with filter.
+void SparseTable::Load(const std::string& filepath, const SignRouter& router, bool lazy) const {
     butil::Timer timer(butil::Timer::STARTED);
 
-    std::string file = filepath + "/sparse_table/" + std::to_string(GetHandle())
-                             + "/rank_" + std::to_string(self_shard_id_);
-    op_kernel_->DeSerialized(file);
+    CHECK_EQ(router.RankNum(), shard_num_);
+
+    std::string dir = Dir_(filepath, "sparse_table");
+
+    int saved_num = 0;
+    while (FileExists(dir + "/rank_" + std::to_string(saved_num))) {
+        ++saved_num;
+    }
+
+    CHECK_GT(saved_num, 0) << "no sparse table saved in " << dir << ", rank_0 not found";
+
+    int gcd = shard_num_;
+    for (int b = saved_num; b != 0;) {
+        int t = gcd % b;
+        gcd = b;
+        b = t;
+    }
+
+    bool same_routing = router.IsDefault() && saved_num == shard_num_;
+
+    SparseShardFilter filter;
+    if (!same_routing && !(router.IsDefault() && saved_num % shard_num_ == 0)) {
+        filter = router.FilterOf(self_shard_id_);
+    }
+
+    for (int r = 0; r < saved_num; ++r) {
+        if (router.IsDefault() && r % gcd != self_shard_id_ % gcd) {
+            continue;
+        }
+
+        op_kernel_->DeSerialized(dir + "/rank_" + std::to_string(r), filter, lazy);
+    }
 
     timer.stop();
 
     LOG(INFO) << "SparseTable load. rank:" << self_shard_id_
               << " table_id:" << GetHandle()
+              << " saved_rank_num:" << saved_num
+              << " dim:" << dim_
+              << " lazy:" << lazy
               << " latency:" << timer.s_elapsed() << "s"
               << " keys_count:" << op_kernel_->KeyCount();
+
+    for (const auto& table : dim_tables_) {
+        table->Load(filepath, router, lazy);
+    }
 }
 
 void SparseTable::ShowDecay() const {
     op_kernel_->ShowDecay();
+
+    for (const auto& table : dim_tables_) {
+        table->ShowDecay();
+    }
+}
+
+size_t SparseTable::Evict(const SparseEvictOption& option) const {
+    butil::Timer timer(butil::Timer::STARTED);
+
+    size_t evicted = op_kernel_->Evict(option);
+
+    timer.stop();
+
+    LOG(INFO) << "SparseTable evict. rank:" << self_shard_id_
+              << " table_id:" << GetHandle()
+              << " latency:" << timer.s_elapsed() << "s"
+              << " dim:" << dim_
+              << " evicted:" << evicted
+              << " keys_count:" << op_kernel_->KeyCount();
+
+    for (const auto& table : dim_tables_) {
+        evicted += table->Evict(option);
+    }
+
+    return evicted;
+}
+
+size_t SparseTable::Spill(const SparseEvictOption& option) const {
+    butil::Timer timer(butil::Timer::STARTED);
+
+    size_t spilled = op_kernel_->Spill(option);
+
+    timer.stop();
+
+    LOG(INFO) << "SparseTable spill. rank:" << self_shard_id_
+              << " table_id:" << GetHandle()
+              << " latency:" << timer.s_elapsed() << "s"
+              << " dim:" << dim_
+              << " spilled:" << spilled
+              << " keys_count:" << op_kernel_->KeyCount();
+
+    for (const auto& table : dim_tables_) {
+        spilled += table->Spill(option);
+    }
+
+    return spilled;
+}
+
+// the serving store finds sign in shard sign % shard_num, a rank holds exactly the
+// signs of that shard only by default routing.
+size_t SparseTable::Export(const std::string& filepath, const SignRouter& router,
+                           EmbeddingWeightType weight_type, float show_threshold, bool delta) {
+    butil::Timer timer(butil::Timer::STARTED);
+
+    CHECK(router.IsDefault()) << "export of sparse table with moved virtual shards is not supported";
+
+    std::string file = Dir_(filepath, "serving") + "/shard_" + std::to_string(self_shard_id_);
+
+    // keys updated while exporting are written again by next delta
+    uint32_t now = butil::gettimeofday_s();
+
+    SparseExportOption option;
+    option.show_threshold = show_threshold;
+    option.updated_since = delta ? last_export_time_ : 0;
+
+    EmbeddingStoreWriter writer(dim_);
+    size_t exported = op_kernel_->Export(option, [&writer](const std::vector<uint64_t>& signs,
+                                                           const std::vector<float>& weights) {
+        for (size_t i = 0; i < signs.size(); ++i) {
+            writer.Add(signs[i], weights.data() + i * writer.Dim());
+        }
+    });
+    last_export_time_ = now;
+
+    {
+        FileWriterSink writer_sink(file, FCT_NONE);
+        boost::iostreams::stream<FileWriterSink> out_stream(writer_sink);
+
+        writer.Write(out_stream, self_shard_id_, shard_num_, weight_type);
+        out_stream.flush();
+    }
+
+    timer.stop();
+
+    LOG(INFO) << "SparseTable export. rank:" << self_shard_id_
+              << " table_id:" << GetHandle()
+              << " weight_type:" << weight_type
+              << " delta:" << delta
+              << " latency:" << timer.s_elapsed() << "s"
+              << " dim:" << dim_
+              << " exported:" << exported
+              << " keys_count:" << op_kernel_->KeyCount();
+
+    for (auto& table : dim_tables_) {
+        exported += table->Export(filepath, router, weight_type, show_threshold, delta);
+    }
+
+    return exported;
 }
 
 SparseTableRegistry* SparseTableRegistry::Instance() {
@@ -124,6 +400,18 @@ SparseTable* SparseTableRegistry::Get(uint32_t table_handle) {
     return tables_[table_handle];
 }
 
+SparseTable* SparseTableRegistry::Find(uint32_t table_handle) {
+    const std::lock_guard<std::mutex> lock(mu_);
+
+    return table_handle < tables_.size() ? tables_[table_handle] : nullptr;
+}
+
+std::vector<SparseTable*> SparseTableRegistry::Tables() {
+    const std::lock_guard<std::mutex> lock(mu_);
+
+    return tables_;
+}
+
 uint32_t SparseTableRegistry::Register(SparseTable* table) {
     const std::lock_guard<std::mutex> lock(mu_);
 
@@ -133,8 +421,17 @@ uint32_t SparseTableRegistry::Register(SparseTable* table) {
 }
 
 SparseTable* CreateSparseTable(const OptimizerBase* opt, int dimension,
-        int shard_num, int self_shard_id) {
-    SparseTable* table = new SparseTable(opt, dimension, shard_num, self_shard_id);
+        int shard_num, int self_shard_id, const SparseKernelOption& option,
+        const SparseWireOption& wire_option, const SparseCacheOption& cache_option,
+        const HotKeyOption& hot_key_option, const SparseStreamOption& stream_option,
+        const std::vector<int>& extra_dims) {
+    SparseTable* table = new SparseTable(opt, dimension, shard_num, self_shard_id,
+                                         option, wire_option, cache_option, hot_key_option,
+                                         stream_option);
+
+    for (int dim : extra_dims) {
+        table->AddDim(dim);
+    }
 
     table->SetHandle(SparseTableRegistry::Instance()->Register(table));
 
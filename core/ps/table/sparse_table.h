@@ -23,16 +23,28 @@
 #include <mutex>
 
 #include <butil/iobuf.h>
+#include <bvar/bvar.h>
 
 #include "core/ps/optimizer/optimizer.h"
+#include "core/ps/table/embedding_cache.h"
+#include "core/ps/table/hot_key.h"
+#include "core/ps/table/sign_router.h"
+#include "core/ps/table/sparse_stream.h"
 #include "core/ps_interface/ps_server.pb.h"
+#include "core/ps_interface/sparse_codec.h"
+#include "core/serving/embedding_store.h"
 
 namespace tensornet {
 
 class SparseTable {
 public:
     SparseTable(const OptimizerBase* opt, int dimension,
-            int shard_num, int self_shard_id);
+            int shard_num, int self_shard_id,
+            const SparseKernelOption& option = SparseKernelOption(),
+            const SparseWireOption& wire_option = SparseWireOption(),
+            const SparseCacheOption& cache_option = SparseCacheOption(),
+            const HotKeyOption& hot_key_option = HotKeyOption(),
+            const SparseStreamOption& stream_option = SparseStreamOption());
 
     ~SparseTable() = default;
 
@@ -40,18 +52,96 @@ public:
 
     void Push(const SparsePushRequest* req, butil::IOBuf& grad_buf, SparsePushResponse* resp);
 
+    // in process pull of self shard, no serialization. hot signs are returned if
+    // hot keys changed since hot_version, return the current hot version.
+    uint32_t PullLocal(const uint64_t* signs, size_t sign_num, float* weights,
+                       uint32_t hot_version, std::vector<uint64_t>* hot_signs);
+
+    // in process push of self shard, gradients are applied in place
+    void PushLocal(const uint64_t* signs, SparseGradInfo* grad_infos, size_t sign_num);
+
+    // metrics of table are exposed with handle as name once it is set
     void SetHandle(uint32_t handle);
 
+    // embeddings of another dim in the same table, for columns of different sizes
+    // under one handle. signs of every dim are kept by a kernel of their own, so the
+    // same sign may be in several dims. must be called before SetHandle.
+    void AddDim(int dim);
+
+    // table of the dim, the first dim is this one, nullptr if dim is not added.
+    // pull and push requests are dispatched to it by their dim.
+    SparseTable* DimTable(int dim);
+
+    // all dims of the table, the first dim comes first
+    std::vector<int> Dims() const;
+
     uint32_t GetHandle() const {
         return handle_;
     }
 
-    void Save(const std::string& filepath) const;
+    int Dim() const {
+        return dim_;
+    }
+
+    // kernel block that sign is applied by, tables of all ranks are the same
+    int BlockId(uint64_t sign) const {
+        return op_kernel_->BlockId(sign);
+    }
+
+    const SparseWireOption& WireOption() const {
+        return wire_option_;
+    }
+
+    // worker side embedding cache, nullptr if disabled
+    EmbeddingCache* Cache() const {
+        return cache_.get();
+    }
+
+    // worker side combiner of hot sign gradients, nullptr if disabled
+    HotKeyCombiner* HotKeys() const {
+        return hot_key_combiner_.get();
+    }
+
+    // server side stream of updated weights for serving, nullptr if disabled
+    SparseUpdateStream* Stream() const {
+        return stream_.get();
+    }
+
+    // dims other than the first are saved in sub directories of the table, as well
+    // as loaded, exported and evicted along with it.
+    //
+    // only keys updated since last save are written if delta is true, load a delta
+    // checkpoint after its base checkpoint to replay it.
+    void Save(const std::string& filepath, SparseFileFormat format = SFF_BINARY,
+              bool delta = false) const;
 
-    void Load(const std::string& filepath) const;
+    // only signs routed to this rank by router are loaded, the model may be saved
+    // by another number of ranks. with lazy, files are read in background and pull or
+    // push of keys not read yet waits for them, see SparseOptimizerKernel::DeSerialized
+    void Load(const std::string& filepath, const SignRouter& router, bool lazy = false) const;
 
     void ShowDecay() const;
 
+    // return count of evicted keys
+    size_t Evict(const SparseEvictOption& option) const;
+
+    // move keys match option to cold tier of table, return count of spilled keys
+    size_t Spill(const SparseEvictOption& option) const;
+
+    // write weights of this rank in layout of serving embedding store, keys shown less
+    // than show_threshold times are pruned. only keys updated since last export are
+    // written if delta is true, serving applies it on top of its snapshot. return
+    // count of exported keys
+    size_t Export(const std::string& filepath, const SignRouter& router,
+                  EmbeddingWeightType weight_type, float show_threshold, bool delta = false);
+
+private:
+    // dims other than the first have suffix like dim_16 in file paths and metrics
+    void SetHandle_(uint32_t handle, const std::string& dim_suffix);
+
+    // filepath/<kind>/<handle>[/<dim_suffix>]
+    std::string Dir_(const std::string& filepath, const char* kind) const;
+
 private:
     int shard_num_ = 0;
     int self_shard_id_ = 0;
@@ -59,6 +149,28 @@ private:
     const OptimizerBase* opt_ = nullptr;
     std::shared_ptr<SparseOptimizerKernelBase> op_kernel_;
     int dim_;
+    SparseWireOption wire_option_;
+    std::unique_ptr<EmbeddingCache> cache_;
+
+    // unix time when last export started, 0 if never exported
+    uint32_t last_export_time_ = 0;
+    std::unique_ptr<HotKeyDetector> hot_key_detector_;
+    std::unique_ptr<HotKeyCombiner> hot_key_combiner_;
+
+    // declared after op_kernel_ so that it stops before kernel is released
+    std::unique_ptr<SparseUpdateStream> stream_;
+
+    // tables of dims added, they share handle and options of this one
+    std::vector<std::unique_ptr<SparseTable>> dim_tables_;
+    std::string dim_suffix_;
+
+    SparseKernelOption kernel_option_;
+    SparseCacheOption cache_option_;
+    HotKeyOption hot_key_option_;
+    SparseStreamOption stream_option_;
+
+    std::unique_ptr<bvar::PassiveStatus<int64_t>> key_count_var_;
+    std::unique_ptr<bvar::PassiveStatus<int64_t>> memory_bytes_var_;
 };
 
 class SparseTableRegistry {
@@ -73,8 +185,14 @@ public:
 
     SparseTable* Get(uint32_t table_handle);
 
+    // nullptr if table_handle is not registered, for handles from outside cluster
+    SparseTable* Find(uint32_t table_handle);
+
     uint32_t Register(SparseTable* table);
 
+    // all registered tables in order of handles
+    std::vector<SparseTable*> Tables();
+
 private:
     SparseTableRegistry() { }
 
@@ -84,7 +202,13 @@ private:
 };
 
 SparseTable* CreateSparseTable(const OptimizerBase* opt, int dimension,
-        int shard_num, int self_shard_id);
+        int shard_num, int self_shard_id,
+        const SparseKernelOption& option = SparseKernelOption(),
+        const SparseWireOption& wire_option = SparseWireOption(),
+        const SparseCacheOption& cache_option = SparseCacheOption(),
+        const HotKeyOption& hot_key_option = HotKeyOption(),
+        const SparseStreamOption& stream_option = SparseStreamOption(),
+        const std::vector<int>& extra_dims = {});
 
 }  // namespace tensornet
 
@@ -0,0 +1,129 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/ps_interface/sparse_codec.h"
+
+#include <butil/logging.h>
+
+#include "core/utility/half.h"
+
+namespace tensornet {
+
+namespace {
+
+// values are converted by small batch on stack so that there is no allocation
+constexpr size_t kCodecBatch = 1024;
+
+template <typename T>
+void EncodeAs(const float* values, size_t n, butil::IOBuf* buf) {
+    T converted[kCodecBatch];
+
+    for (size_t begin = 0; begin < n; begin += kCodecBatch) {
+        size_t count = std::min(kCodecBatch, n - begin);
+        for (size_t i = 0; i < count; ++i) {
+            converted[i] = values[begin + i];
+        }
+        buf->append(converted, sizeof(T) * count);
+    }
+}
+
+template <typename T>
+bool DecodeAs(butil::IOBuf* buf, size_t n, float* out) {
+    T converted[kCodecBatch];
+
+    for (size_t begin = 0; begin < n; begin += kCodecBatch) {
+        size_t count = std::min(kCodecBatch, n - begin);
+        if (sizeof(T) * count != buf->cutn(converted, sizeof(T) * count)) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            out[begin + i] = converted[i];
+        }
+    }
+
+    return true;
+}
+
+} // namespace
+
+size_t SparseValueSize(SparseValueEncoding encoding) {
+    switch (encoding) {
+    case SVE_FP16:
+    case SVE_BF16:
+        return 2;
+    default:
+        return sizeof(float);
+    }
+}
+
+void EncodeSparseValues(const float* values, size_t n, SparseValueEncoding encoding,
+                        butil::IOBuf* buf) {
+    switch (encoding) {
+    case SVE_FP16:
+        EncodeAs<Half>(values, n, buf);
+        break;
+    case SVE_BF16:
+        EncodeAs<BFloat16>(values, n, buf);
+        break;
+    case SVE_FLOAT:
+        buf->append(values, sizeof(float) * n);
+        break;
+    default:
+        LOG(FATAL) << "unknown sparse value encoding:" << encoding;
+    }
+}
+
+bool DecodeSparseValues(butil::IOBuf* buf, size_t n, SparseValueEncoding encoding, float* out) {
+    switch (encoding) {
+    case SVE_FP16:
+        return DecodeAs<Half>(buf, n, out);
+    case SVE_BF16:
+        return DecodeAs<BFloat16>(buf, n, out);
+    case SVE_FLOAT:
+        return sizeof(float) * n == buf->cutn(out, sizeof(float) * n);
+    default:
+        LOG(FATAL) << "unknown sparse value encoding:" << encoding;
+    }
+
+    return false;
+}
+
+void EncodeDeltaSigns(const uint64_t* signs, size_t n,
+                      google::protobuf::RepeatedField<google::protobuf::uint64>* out) {
+    out->Reserve(out->size() + n);
+
+    uint64_t last = 0;
+    for (size_t i = 0; i < n; ++i) {
+        CHECK_GE(signs[i], last) << "signs must be sorted to be delta coded";
+        out->AddAlreadyReserved(signs[i] - last);
+        last = signs[i];
+    }
+}
+
+void DecodeSigns(const google::protobuf::RepeatedField<google::protobuf::uint64>& in,
+                 bool delta_signs, std::vector<uint64_t>* signs) {
+    signs->resize(in.size());
+
+    uint64_t last = 0;
+    for (int i = 0; i < in.size(); ++i) {
+        if (delta_signs) {
+            last += in.Get(i);
+            (*signs)[i] = last;
+        } else {
+            (*signs)[i] = in.Get(i);
+        }
+    }
+}
+
+} // namespace tensornet
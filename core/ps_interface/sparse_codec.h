@@ -0,0 +1,89 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_PS_INTERFACE_SPARSE_CODEC_H_
+#define TENSORNET_PS_INTERFACE_SPARSE_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include <butil/iobuf.h>
+#include <google/protobuf/repeated_field.h>
+
+#include "core/ps_interface/ps_server.pb.h"
+#include "core/utility/open_hash_map.h"
+
+namespace tensornet {
+
+// how a sparse table talk with remote shards, all nodes of a cluster create tables
+// with same option so the client set what it want in every request and server
+// follow the request.
+struct SparseWireOption {
+    // encoding of pulled embeddings
+    SparseValueEncoding pull_encoding = SVE_FLOAT;
+
+    // encoding of pushed gradients
+    SparseValueEncoding push_encoding = SVE_FLOAT;
+
+    // send signs sorted and delta coded, varint of delta need less bytes
+    bool delta_signs = false;
+
+    // gradient rows with all elements' absolute value less than this are not pushed,
+    // disabled when not positive. NOTE show of dropped rows are not counted either.
+    float grad_threshold = 0;
+};
+
+// bytes of one encoded value
+size_t SparseValueSize(SparseValueEncoding encoding);
+
+// append n values to buf in encoding
+void EncodeSparseValues(const float* values, size_t n, SparseValueEncoding encoding,
+                        butil::IOBuf* buf);
+
+// cut n values from buf and decode them into out, return false if buf has not
+// enough data
+bool DecodeSparseValues(butil::IOBuf* buf, size_t n, SparseValueEncoding encoding, float* out);
+
+// signs must be sorted
+void EncodeDeltaSigns(const uint64_t* signs, size_t n,
+                      google::protobuf::RepeatedField<google::protobuf::uint64>* out);
+
+void DecodeSigns(const google::protobuf::RepeatedField<google::protobuf::uint64>& in,
+                 bool delta_signs, std::vector<uint64_t>* signs);
+
+// append distinct signs to unique in the order they first appear, ids[i] is set to
+// the index of signs[i] in unique
+template <typename SignType, typename IdType>
+void DedupSigns(const SignType* signs, size_t n, std::vector<SignType>* unique, IdType* ids) {
+    // one flat allocation for the whole batch, no node allocation per sign
+    OpenHashMap<SignType, IdType> sign_ids(n);
+    unique->reserve(unique->size() + n);
+
+    for (size_t i = 0; i < n; ++i) {
+        auto inserted = sign_ids.insert(signs[i], (IdType)unique->size());
+        if (inserted.second) {
+            unique->push_back(signs[i]);
+        }
+
+        ids[i] = *inserted.first;
+    }
+}
+
+} // namespace tensornet
+
+#endif // TENSORNET_PS_INTERFACE_SPARSE_CODEC_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,297 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/serving/embedding_snapshot.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include <Eigen/Dense>
+#include <butil/logging.h>
+
+namespace tensornet {
+
+EmbeddingBase::~EmbeddingBase() {
+    for (const auto& file : owned_files) {
+        unlink(file.c_str());
+    }
+}
+
+bool EmbeddingSnapshot::Find(uint64_t sign, float* out) const {
+    if (overlay) {
+        const uint32_t* row = overlay->rows.find(sign);
+        if (row != nullptr) {
+            const float* w = overlay->weights.data() + (size_t)*row * Dim();
+            std::copy(w, w + Dim(), out);
+            return true;
+        }
+    }
+
+    return base->store.Find(sign, out);
+}
+
+size_t EmbeddingSnapshot::Lookup(const uint64_t* signs, size_t n, float* out) const {
+    if (!overlay || overlay->rows.size() == 0) {
+        return base->store.Lookup(signs, n, out);
+    }
+
+    size_t found = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (Find(signs[i], out + i * Dim())) {
+            ++found;
+        } else {
+            std::fill(out + i * Dim(), out + (i + 1) * Dim(), 0);
+        }
+    }
+
+    return found;
+}
+
+size_t EmbeddingSnapshot::Pool(const uint64_t* signs, size_t n, EmbeddingPoolingType type,
+                               float* out) const {
+    if (!overlay || overlay->rows.size() == 0) {
+        return base->store.Pool(signs, n, type, out);
+    }
+
+    int dim = Dim();
+    Eigen::Map<Eigen::ArrayXf> pooled(out, dim);
+    pooled.setZero();
+
+    // signs not in overlay are looked up in base in batch, buffer is kept by thread
+    thread_local std::vector<uint64_t> rest;
+    rest.clear();
+
+    size_t found = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t* row = overlay->rows.find(signs[i]);
+        if (row != nullptr) {
+            pooled += Eigen::Map<const Eigen::ArrayXf>(overlay->weights.data() + (size_t)*row * dim, dim);
+            ++found;
+        } else {
+            rest.push_back(signs[i]);
+        }
+    }
+
+    found += base->store.Accumulate(rest.data(), rest.size(), out);
+
+    if (type == EPT_MEAN && n > 1) {
+        pooled /= n;
+    }
+
+    return found;
+}
+
+HotSwapEmbeddingStore::HotSwapEmbeddingStore(const std::string& work_dir, int dim,
+                                             size_t max_overlay_keys)
+    : work_dir_(work_dir)
+    , dim_(dim)
+    , max_overlay_keys_(max_overlay_keys)
+    , version_(0) {
+}
+
+int HotSwapEmbeddingStore::Load(const std::vector<std::string>& files) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+
+    std::shared_ptr<EmbeddingBase> base(new EmbeddingBase());
+    if (base->store.Open(files) != 0) {
+        return -1;
+    }
+
+    if (dim_ > 0 && base->store.Dim() != dim_) {
+        LOG(ERROR) << "embedding snapshot dim:" << base->store.Dim()
+            << " not match, expect dim:" << dim_;
+        return -1;
+    }
+
+    std::shared_ptr<EmbeddingSnapshot> snapshot(new EmbeddingSnapshot());
+    snapshot->version = Version() + 1;
+    snapshot->base = base;
+    Swap_(snapshot);
+
+    LOG(INFO) << "embedding snapshot loaded. version:" << snapshot->version
+              << " keys_count:" << base->store.KeyCount();
+
+    return 0;
+}
+
+int HotSwapEmbeddingStore::ApplyDelta(const std::vector<std::string>& files) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+
+    SnapshotPtr current = Current_();
+    if (!current) {
+        LOG(ERROR) << "delta can not be applied before a full snapshot is loaded";
+        return -1;
+    }
+
+    EmbeddingStore delta;
+    if (delta.Open(files) != 0) {
+        return -1;
+    }
+
+    std::shared_ptr<EmbeddingSnapshot> snapshot(new EmbeddingSnapshot());
+    snapshot->version = current->version + 1;
+    snapshot->overlay = current->overlay;
+
+    std::shared_ptr<EmbeddingBase> merged;
+    if (Merge_(*current->base, delta, &merged) != 0) {
+        return -1;
+    }
+    snapshot->base = merged;
+
+    Swap_(snapshot);
+
+    LOG(INFO) << "embedding snapshot delta applied. version:" << snapshot->version
+              << " delta_keys_count:" << delta.KeyCount()
+              << " keys_count:" << merged->store.KeyCount();
+
+    // current is the last reference of old snapshot, it is released here, not in
+    // any reader
+    return 0;
+}
+
+int HotSwapEmbeddingStore::ApplyUpdates(const uint64_t* signs, const float* weights, size_t n) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+
+    SnapshotPtr current = Current_();
+    if (!current) {
+        LOG(ERROR) << "updates can not be applied before a full snapshot is loaded";
+        return -1;
+    }
+
+    int dim = current->Dim();
+
+    std::shared_ptr<EmbeddingOverlay> overlay(new EmbeddingOverlay());
+    if (current->overlay) {
+        overlay->rows.reserve(current->overlay->rows.size() + n);
+        overlay->weights = current->overlay->weights;
+        current->overlay->rows.for_each([&overlay](const uint64_t& sign, const uint32_t& row) {
+            overlay->rows.insert(sign, row);
+        });
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        auto inserted = overlay->rows.insert(signs[i], overlay->weights.size() / dim);
+        const float* w = weights + i * dim;
+
+        if (inserted.second) {
+            overlay->weights.insert(overlay->weights.end(), w, w + dim);
+        } else {
+            std::copy(w, w + dim, overlay->weights.begin() + (size_t)*inserted.first * dim);
+        }
+    }
+
+    std::shared_ptr<EmbeddingSnapshot> snapshot(new EmbeddingSnapshot());
+    snapshot->version = current->version + 1;
+    snapshot->base = current->base;
+    snapshot->overlay = overlay;
+
+    if (overlay->rows.size() > max_overlay_keys_ && Fold_(snapshot.get()) != 0) {
+        return -1;
+    }
+
+    Swap_(snapshot);
+
+    return 0;
+}
+
+int HotSwapEmbeddingStore::Merge_(const EmbeddingBase& base, const EmbeddingStore& delta,
+                                  std::shared_ptr<EmbeddingBase>* merged) {
+    merged->reset(new EmbeddingBase());
+
+    for (size_t i = 0; i < base.store.ShardNum(); ++i) {
+        (*merged)->owned_files.push_back(NewFile_());
+    }
+
+    if (base.store.Merge(delta, (*merged)->owned_files) != 0
+            || (*merged)->store.Open((*merged)->owned_files) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int HotSwapEmbeddingStore::Fold_(EmbeddingSnapshot* snapshot) {
+    const EmbeddingStore& store = snapshot->base->store;
+    int dim = store.Dim();
+    size_t shard_num = store.ShardNum();
+
+    std::vector<EmbeddingStoreWriter> writers(shard_num, EmbeddingStoreWriter(dim));
+    const std::vector<float>& weights = snapshot->overlay->weights;
+
+    snapshot->overlay->rows.for_each([&](const uint64_t& sign, const uint32_t& row) {
+        writers[sign % shard_num].Add(sign, weights.data() + (size_t)row * dim);
+    });
+
+    // overlay is written as a delta of same layout as base then merged, files of delta
+    // are removed once it is merged
+    EmbeddingBase delta;
+    for (size_t i = 0; i < shard_num; ++i) {
+        delta.owned_files.push_back(NewFile_());
+
+        std::ofstream os(delta.owned_files.back(), std::ios::binary | std::ios::trunc);
+        writers[i].Write(os, i, shard_num, store.WeightType());
+        os.close();
+        if (!os) {
+            LOG(ERROR) << "write embedding overlay to " << delta.owned_files.back() << " failed";
+            return -1;
+        }
+    }
+
+    std::shared_ptr<EmbeddingBase> merged;
+    if (delta.store.Open(delta.owned_files) != 0
+            || Merge_(*snapshot->base, delta.store, &merged) != 0) {
+        return -1;
+    }
+
+    LOG(INFO) << "embedding snapshot overlay merged. version:" << snapshot->version
+              << " overlay_keys_count:" << snapshot->overlay->rows.size()
+              << " keys_count:" << merged->store.KeyCount();
+
+    snapshot->base = merged;
+    snapshot->overlay.reset();
+
+    return 0;
+}
+
+std::string HotSwapEmbeddingStore::NewFile_() const {
+    static std::atomic<uint64_t> seq(0);
+
+    return work_dir_ + "/embedding_snapshot_" + std::to_string(getpid())
+           + "_" + std::to_string(seq.fetch_add(1));
+}
+
+void HotSwapEmbeddingStore::Swap_(const SnapshotPtr& snapshot) {
+    auto swap = [](SnapshotPtr& bg, const SnapshotPtr& next) -> size_t {
+        bg = next;
+        return 1;
+    };
+
+    data_.Modify(swap, snapshot);
+    version_.store(snapshot->version, std::memory_order_release);
+}
+
+HotSwapEmbeddingStore::SnapshotPtr HotSwapEmbeddingStore::Current_() {
+    ScopedPtr ptr;
+    if (data_.Read(&ptr) != 0) {
+        return nullptr;
+    }
+
+    return *ptr;
+}
+
+} // namespace tensornet
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
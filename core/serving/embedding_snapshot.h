@@ -0,0 +1,136 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_SERVING_EMBEDDING_SNAPSHOT_H_
+#define TENSORNET_SERVING_EMBEDDING_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <butil/containers/doubly_buffered_data.h>
+
+#include "core/serving/embedding_store.h"
+#include "core/utility/open_hash_map.h"
+
+namespace tensornet {
+
+// mapped files of a serving table, files written by merging are owned by it and
+// removed when it is released
+struct EmbeddingBase {
+    EmbeddingStore store;
+    std::vector<std::string> owned_files;
+
+    ~EmbeddingBase();
+};
+
+// weights of signs streamed after base was written, row of sign in rows is the
+// offset of its weights in weights divided by dim
+struct EmbeddingOverlay {
+    OpenHashMap<uint64_t, uint32_t> rows;
+    std::vector<float> weights;
+};
+
+// one version of a serving table, weights in overlay take place of those in base.
+// versions share base and overlay which are not changed
+struct EmbeddingSnapshot {
+    uint64_t version = 0;
+    std::shared_ptr<const EmbeddingBase> base;
+    std::shared_ptr<const EmbeddingOverlay> overlay;
+
+    int Dim() const {
+        return base->store.Dim();
+    }
+
+    // same as those of EmbeddingStore
+    bool Find(uint64_t sign, float* out) const;
+
+    size_t Lookup(const uint64_t* signs, size_t n, float* out) const;
+
+    size_t Pool(const uint64_t* signs, size_t n, EmbeddingPoolingType type, float* out) const;
+};
+
+// serving table which is updated while serving. readers only take a thread local
+// lock of DoublyBufferedData, an update opens or merges the new snapshot in caller
+// thread, swaps it in and waits readers of old snapshot to leave, so that a request
+// never waits for loading. old snapshot is unmapped by updater thread.
+class HotSwapEmbeddingStore {
+public:
+    typedef std::shared_ptr<const EmbeddingSnapshot> SnapshotPtr;
+    typedef butil::DoublyBufferedData<SnapshotPtr>::ScopedPtr ScopedPtr;
+
+    // merged files of delta are written in work_dir, which should be on local disk.
+    // snapshot of other dim is refused if dim is positive. streamed updates are merged
+    // into files once more than max_overlay_keys signs are in overlay
+    explicit HotSwapEmbeddingStore(const std::string& work_dir, int dim = 0,
+                                   size_t max_overlay_keys = 1 << 20);
+
+    // open files as a full snapshot and swap it in, streamed updates are dropped.
+    // return 0 if done
+    int Load(const std::vector<std::string>& files);
+
+    // merge delta files exported by incremental export into current snapshot and swap
+    // the merged one in, streamed updates are kept since they are usually newer.
+    // return 0 if done
+    int ApplyDelta(const std::vector<std::string>& files);
+
+    // put weights of signs[0, n) streamed from ps over current snapshot and swap it in.
+    // overlay is copied on write so it should be kept small, return 0 if done
+    int ApplyUpdates(const uint64_t* signs, const float* weights, size_t n);
+
+    // *ptr is null before first Load, hold ptr only for one request since updater waits
+    // for it
+    int Read(ScopedPtr* ptr) {
+        return data_.Read(ptr);
+    }
+
+    // version of current snapshot, 0 before first Load
+    uint64_t Version() const {
+        return version_.load(std::memory_order_acquire);
+    }
+
+private:
+    // write base overwritten by delta into new owned files of merged
+    int Merge_(const EmbeddingBase& base, const EmbeddingStore& delta,
+               std::shared_ptr<EmbeddingBase>* merged);
+
+    // merge overlay into base of snapshot
+    int Fold_(EmbeddingSnapshot* snapshot);
+
+    std::string NewFile_() const;
+
+    void Swap_(const SnapshotPtr& snapshot);
+
+    SnapshotPtr Current_();
+
+private:
+    std::string work_dir_;
+    int dim_ = 0;
+    size_t max_overlay_keys_ = 0;
+
+    // updates are done one by one
+    std::mutex update_mutex_;
+    butil::DoublyBufferedData<SnapshotPtr> data_;
+    std::atomic<uint64_t> version_;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_SERVING_EMBEDDING_SNAPSHOT_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
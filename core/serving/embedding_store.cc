@@ -0,0 +1,557 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/serving/embedding_store.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <ostream>
+
+#include <butil/logging.h>
+
+#include <Eigen/Dense>
+
+#include "core/utility/half.h"
+
+namespace tensornet {
+
+// signs searched in one dir slot on average
+static constexpr uint64_t EMBEDDING_STORE_SIGNS_PER_DIR = 4;
+
+// signs looked up in one batch, dir slots of a batch are prefetched before search
+static constexpr size_t EMBEDDING_STORE_LOOKUP_BATCH = 16;
+
+static size_t AlignUp(size_t n) {
+    return (n + EMBEDDING_STORE_ALIGN - 1) / EMBEDDING_STORE_ALIGN * EMBEDDING_STORE_ALIGN;
+}
+
+static uint32_t DirBits(uint64_t key_count) {
+    uint32_t bits = 0;
+    while (bits < 32 && (key_count >> bits) > EMBEDDING_STORE_SIGNS_PER_DIR) {
+        ++bits;
+    }
+
+    return bits;
+}
+
+static uint64_t DirSlot(uint64_t sign, uint32_t dir_bits) {
+    return dir_bits == 0 ? 0 : sign >> (64 - dir_bits);
+}
+
+static void WritePadding(std::ostream& os, size_t n) {
+    static const char zeros[EMBEDDING_STORE_ALIGN] = {0};
+    os.write(zeros, AlignUp(n) - n);
+}
+
+static size_t WeightSize(uint32_t weight_type) {
+    switch (weight_type) {
+    case EWT_FLOAT:
+        return sizeof(float);
+    case EWT_HALF:
+        return sizeof(Half);
+    case EWT_INT8:
+        return sizeof(int8_t);
+    default:
+        return 0;
+    }
+}
+
+// write header, dir and signs, key_count and dir_bits of header are set by signs
+// which must be sorted and unique
+static void WriteIndex(std::ostream& os, EmbeddingStoreHeader* header,
+                       const std::vector<uint64_t>& signs) {
+    header->key_count = signs.size();
+    header->dir_bits = DirBits(signs.size());
+
+    os.write(reinterpret_cast<const char*>(header), sizeof(*header));
+
+    uint64_t dir_size = 1ul << header->dir_bits;
+    std::vector<uint64_t> dir(dir_size + 1, signs.size());
+
+    for (size_t i = signs.size(); i > 0; --i) {
+        dir[DirSlot(signs[i - 1], header->dir_bits)] = i - 1;
+    }
+    for (size_t i = dir_size; i > 0; --i) {
+        dir[i - 1] = std::min(dir[i - 1], dir[i]);
+    }
+
+    os.write(reinterpret_cast<const char*>(dir.data()), dir.size() * sizeof(uint64_t));
+    WritePadding(os, dir.size() * sizeof(uint64_t));
+
+    os.write(reinterpret_cast<const char*>(signs.data()), signs.size() * sizeof(uint64_t));
+    WritePadding(os, signs.size() * sizeof(uint64_t));
+}
+
+EmbeddingStoreWriter::EmbeddingStoreWriter(int dim)
+    : dim_(dim) {
+    CHECK_GT(dim, 0);
+}
+
+void EmbeddingStoreWriter::Add(uint64_t sign, const float* weights) {
+    signs_.push_back(sign);
+    weights_.insert(weights_.end(), weights, weights + dim_);
+}
+
+void EmbeddingStoreWriter::Write(std::ostream& os, uint32_t shard_id, uint32_t shard_num,
+                                 EmbeddingWeightType weight_type) {
+    CHECK_LT(shard_id, shard_num);
+    CHECK_GT(WeightSize(weight_type), 0) << "bad weight type:" << weight_type;
+
+    std::vector<size_t> order(signs_.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    // stable so that last one of same sign is kept by unique below
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return signs_[a] < signs_[b];
+    });
+
+    std::vector<size_t> kept;
+    kept.reserve(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i + 1 < order.size() && signs_[order[i + 1]] == signs_[order[i]]) {
+            continue;
+        }
+        kept.push_back(order[i]);
+    }
+
+    std::vector<uint64_t> signs;
+    signs.reserve(kept.size());
+    for (size_t i : kept) {
+        signs.push_back(signs_[i]);
+    }
+
+    EmbeddingStoreHeader header;
+    header.dim = dim_;
+    header.weight_type = weight_type;
+    header.shard_id = shard_id;
+    header.shard_num = shard_num;
+
+    WriteIndex(os, &header, signs);
+
+    std::vector<float> scales;
+    if (weight_type == EWT_INT8) {
+        for (size_t i : kept) {
+            const float* w = &weights_[i * dim_];
+            float max_abs = 0;
+            for (int j = 0; j < dim_; ++j) {
+                max_abs = std::max(max_abs, std::abs(w[j]));
+            }
+            scales.push_back(max_abs / 127);
+        }
+
+        os.write(reinterpret_cast<const char*>(scales.data()), scales.size() * sizeof(float));
+        WritePadding(os, scales.size() * sizeof(float));
+    }
+
+    std::vector<Half> halfs(dim_);
+    std::vector<int8_t> quants(dim_);
+
+    for (size_t k = 0; k < kept.size(); ++k) {
+        const float* w = &weights_[kept[k] * dim_];
+
+        if (weight_type == EWT_FLOAT) {
+            os.write(reinterpret_cast<const char*>(w), dim_ * sizeof(float));
+        } else if (weight_type == EWT_HALF) {
+            std::copy_n(w, dim_, halfs.begin());
+            os.write(reinterpret_cast<const char*>(halfs.data()), dim_ * sizeof(Half));
+        } else {
+            float inv = scales[k] > 0 ? 1 / scales[k] : 0;
+            for (int j = 0; j < dim_; ++j) {
+                quants[j] = std::max(-127l, std::min(127l, std::lround(w[j] * inv)));
+            }
+            os.write(reinterpret_cast<const char*>(quants.data()), dim_ * sizeof(int8_t));
+        }
+    }
+    WritePadding(os, kept.size() * dim_ * WeightSize(weight_type));
+}
+
+static void Unmap(void* addr, size_t length) {
+    if (addr != nullptr) {
+        munmap(addr, length);
+    }
+}
+
+EmbeddingStore::~EmbeddingStore() {
+    for (auto& shard : shards_) {
+        Unmap(shard.addr, shard.length);
+    }
+}
+
+int EmbeddingStore::Open(const std::vector<std::string>& files) {
+    CHECK(shards_.empty()) << "embedding store is already opened";
+
+    if (files.empty()) {
+        LOG(ERROR) << "no embedding store file";
+        return -1;
+    }
+
+    std::vector<Shard> opened(files.size());
+    std::vector<Shard> shards(files.size());
+    int ret = 0;
+
+    for (size_t i = 0; i < files.size() && 0 == ret; ++i) {
+        ret = OpenShard_(files[i], &opened[i]);
+        if (0 != ret) {
+            break;
+        }
+
+        const EmbeddingStoreHeader* header = opened[i].header;
+
+        if (header->dim != opened[0].header->dim || header->shard_num != files.size()) {
+            LOG(ERROR) << "embedding store file " << files[i] << " dim:" << header->dim
+                << " shard_num:" << header->shard_num << " not match, expect dim:"
+                << opened[0].header->dim << " shard_num:" << files.size();
+            ret = -1;
+        } else if (shards[header->shard_id].header != nullptr) {
+            LOG(ERROR) << "embedding store file " << files[i] << " shard:"
+                << header->shard_id << " is opened twice";
+            ret = -1;
+        } else {
+            shards[header->shard_id] = opened[i];
+        }
+    }
+
+    if (0 != ret) {
+        for (auto& shard : opened) {
+            Unmap(shard.addr, shard.length);
+        }
+        return -1;
+    }
+
+    dim_ = shards[0].header->dim;
+    shards_.swap(shards);
+
+    return 0;
+}
+
+int EmbeddingStore::OpenShard_(const std::string& file, Shard* shard) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        PLOG(ERROR) << "open embedding store file " << file << " failed";
+        return -1;
+    }
+
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        PLOG(ERROR) << "stat embedding store file " << file << " failed";
+        close(fd);
+        return -1;
+    }
+
+    size_t length = st.st_size;
+    if (length < sizeof(EmbeddingStoreHeader)) {
+        LOG(ERROR) << "embedding store file " << file << " is truncated, size:" << length;
+        close(fd);
+        return -1;
+    }
+
+    // pages are populated now, first requests should not wait for page faults
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        PLOG(ERROR) << "mmap embedding store file " << file << " failed";
+        return -1;
+    }
+
+    madvise(addr, length, MADV_RANDOM);
+
+    const char* base = static_cast<const char*>(addr);
+    const EmbeddingStoreHeader* header = reinterpret_cast<const EmbeddingStoreHeader*>(base);
+
+    if (header->magic != EMBEDDING_STORE_MAGIC || header->version != EMBEDDING_STORE_VERSION
+            || WeightSize(header->weight_type) == 0 || header->dim <= 0 || header->dir_bits > 32
+            || header->shard_num == 0 || header->shard_id >= header->shard_num) {
+        LOG(ERROR) << "embedding store file " << file << " has bad header, magic:" << header->magic
+            << " version:" << header->version << " weight_type:" << header->weight_type;
+        munmap(addr, length);
+        return -1;
+    }
+
+    size_t dir_offset = sizeof(EmbeddingStoreHeader);
+    size_t sign_offset = dir_offset + AlignUp(((1ul << header->dir_bits) + 1) * sizeof(uint64_t));
+    size_t scale_offset = sign_offset + AlignUp(header->key_count * sizeof(uint64_t));
+    size_t weight_offset = scale_offset;
+    if (header->weight_type == EWT_INT8) {
+        weight_offset += AlignUp(header->key_count * sizeof(float));
+    }
+
+    size_t row_bytes = header->dim * WeightSize(header->weight_type);
+    size_t end = weight_offset + AlignUp(header->key_count * row_bytes);
+
+    if (end > length) {
+        LOG(ERROR) << "embedding store file " << file << " is truncated, size:" << length
+            << " expect:" << end;
+        munmap(addr, length);
+        return -1;
+    }
+
+    shard->header = header;
+    shard->dir = reinterpret_cast<const uint64_t*>(base + dir_offset);
+    shard->signs = reinterpret_cast<const uint64_t*>(base + sign_offset);
+    shard->scales = reinterpret_cast<const float*>(base + scale_offset);
+    shard->weights = base + weight_offset;
+    shard->row_bytes = row_bytes;
+    shard->addr = addr;
+    shard->length = length;
+
+    return 0;
+}
+
+int EmbeddingStore::Merge(const EmbeddingStore& delta, const std::vector<std::string>& files) const {
+    if (delta.shards_.size() != shards_.size() || files.size() != shards_.size()
+            || delta.dim_ != dim_) {
+        LOG(ERROR) << "embedding store delta shard_num:" << delta.shards_.size()
+            << " dim:" << delta.dim_ << " not match, expect shard_num:" << shards_.size()
+            << " dim:" << dim_;
+        return -1;
+    }
+
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        const Shard& base = shards_[s];
+        const Shard& patch = delta.shards_[s];
+
+        if (base.header->weight_type != patch.header->weight_type) {
+            LOG(ERROR) << "embedding store delta weight_type:" << patch.header->weight_type
+                << " not match, expect weight_type:" << base.header->weight_type;
+            return -1;
+        }
+
+        // both are sorted, index of row in merged store is from base if first is 0
+        std::vector<std::pair<int, uint64_t>> rows;
+        std::vector<uint64_t> signs;
+        uint64_t i = 0;
+        uint64_t j = 0;
+
+        while (i < base.header->key_count || j < patch.header->key_count) {
+            if (j == patch.header->key_count
+                    || (i < base.header->key_count && base.signs[i] < patch.signs[j])) {
+                rows.emplace_back(0, i);
+                signs.push_back(base.signs[i++]);
+            } else {
+                if (i < base.header->key_count && base.signs[i] == patch.signs[j]) {
+                    ++i;
+                }
+                rows.emplace_back(1, j);
+                signs.push_back(patch.signs[j++]);
+            }
+        }
+
+        std::ofstream os(files[s], std::ios::binary | std::ios::trunc);
+
+        EmbeddingStoreHeader header = *base.header;
+        WriteIndex(os, &header, signs);
+
+        const Shard* from[] = {&base, &patch};
+
+        if (header.weight_type == EWT_INT8) {
+            for (const auto& row : rows) {
+                os.write(reinterpret_cast<const char*>(from[row.first]->scales + row.second), sizeof(float));
+            }
+            WritePadding(os, rows.size() * sizeof(float));
+        }
+
+        for (const auto& row : rows) {
+            os.write(from[row.first]->weights + row.second * base.row_bytes, base.row_bytes);
+        }
+        WritePadding(os, rows.size() * base.row_bytes);
+
+        os.close();
+        if (!os) {
+            LOG(ERROR) << "write embedding store file " << files[s] << " failed";
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+size_t EmbeddingStore::KeyCount() const {
+    size_t count = 0;
+    for (const auto& shard : shards_) {
+        count += shard.header->key_count;
+    }
+
+    return count;
+}
+
+void EmbeddingStore::Range_(const Shard& shard, uint64_t sign, uint64_t* begin, uint64_t* end) {
+    uint64_t slot = DirSlot(sign, shard.header->dir_bits);
+
+    *begin = shard.dir[slot];
+    *end = shard.dir[slot + 1];
+
+    __builtin_prefetch(shard.signs + *begin);
+}
+
+uint64_t EmbeddingStore::Search_(const Shard& shard, uint64_t sign, uint64_t begin, uint64_t end) {
+    // a slot has few signs, binary search only for skewed ones
+    while (end - begin > 8) {
+        uint64_t mid = begin + (end - begin) / 2;
+        if (shard.signs[mid] < sign) {
+            begin = mid + 1;
+        } else {
+            end = mid + 1;
+        }
+    }
+
+    for (; begin < end; ++begin) {
+        if (shard.signs[begin] == sign) {
+            return begin;
+        }
+    }
+
+    return EMBEDDING_STORE_NOT_FOUND;
+}
+
+void EmbeddingStore::CopyRow_(const Shard& shard, uint64_t i, float* out) {
+    int dim = shard.header->dim;
+    const char* row = shard.weights + i * shard.row_bytes;
+
+    switch (shard.header->weight_type) {
+    case EWT_FLOAT:
+        memcpy(out, row, shard.row_bytes);
+        break;
+    case EWT_HALF:
+        std::copy_n(reinterpret_cast<const Half*>(row), dim, out);
+        break;
+    case EWT_INT8:
+        Eigen::Map<Eigen::ArrayXf>(out, dim) = shard.scales[i]
+            * Eigen::Map<const Eigen::Array<int8_t, Eigen::Dynamic, 1>>(
+                reinterpret_cast<const int8_t*>(row), dim).cast<float>();
+        break;
+    }
+}
+
+void EmbeddingStore::AddRow_(const Shard& shard, uint64_t i, float* out) {
+    int dim = shard.header->dim;
+    const char* row = shard.weights + i * shard.row_bytes;
+    Eigen::Map<Eigen::ArrayXf> pooled(out, dim);
+
+    switch (shard.header->weight_type) {
+    case EWT_FLOAT:
+        pooled += Eigen::Map<const Eigen::ArrayXf>(reinterpret_cast<const float*>(row), dim);
+        break;
+    case EWT_HALF:
+        for (int j = 0; j < dim; ++j) {
+            out[j] += reinterpret_cast<const Half*>(row)[j];
+        }
+        break;
+    case EWT_INT8:
+        pooled += shard.scales[i]
+            * Eigen::Map<const Eigen::Array<int8_t, Eigen::Dynamic, 1>>(
+                reinterpret_cast<const int8_t*>(row), dim).cast<float>();
+        break;
+    }
+}
+
+bool EmbeddingStore::Find(uint64_t sign, float* out) const {
+    const Shard& shard = ShardOf_(sign);
+
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    Range_(shard, sign, &begin, &end);
+
+    uint64_t i = Search_(shard, sign, begin, end);
+    if (i == EMBEDDING_STORE_NOT_FOUND) {
+        return false;
+    }
+
+    CopyRow_(shard, i, out);
+    return true;
+}
+
+size_t EmbeddingStore::Lookup(const uint64_t* signs, size_t n, float* out) const {
+    uint64_t begins[EMBEDDING_STORE_LOOKUP_BATCH];
+    uint64_t ends[EMBEDDING_STORE_LOOKUP_BATCH];
+    size_t found = 0;
+
+    for (size_t offset = 0; offset < n; offset += EMBEDDING_STORE_LOOKUP_BATCH) {
+        size_t batch = std::min(n - offset, EMBEDDING_STORE_LOOKUP_BATCH);
+
+        // dir slots and sign ranges of whole batch are fetched first, so that cache
+        // misses of different signs overlap instead of one after another
+        for (size_t i = 0; i < batch; ++i) {
+            Range_(ShardOf_(signs[offset + i]), signs[offset + i], &begins[i], &ends[i]);
+        }
+
+        for (size_t i = 0; i < batch; ++i) {
+            uint64_t sign = signs[offset + i];
+            const Shard& shard = ShardOf_(sign);
+            float* dst = out + (offset + i) * dim_;
+
+            uint64_t k = Search_(shard, sign, begins[i], ends[i]);
+            if (k != EMBEDDING_STORE_NOT_FOUND) {
+                CopyRow_(shard, k, dst);
+                ++found;
+            } else {
+                memset(dst, 0, dim_ * sizeof(float));
+            }
+        }
+    }
+
+    return found;
+}
+
+size_t EmbeddingStore::Pool(const uint64_t* signs, size_t n, EmbeddingPoolingType type, float* out) const {
+    Eigen::Map<Eigen::ArrayXf> pooled(out, dim_);
+    pooled.setZero();
+
+    size_t found = Accumulate(signs, n, out);
+
+    if (type == EPT_MEAN && n > 1) {
+        pooled /= n;
+    }
+
+    return found;
+}
+
+size_t EmbeddingStore::Accumulate(const uint64_t* signs, size_t n, float* out) const {
+    uint64_t begins[EMBEDDING_STORE_LOOKUP_BATCH];
+    uint64_t ends[EMBEDDING_STORE_LOOKUP_BATCH];
+    size_t found = 0;
+
+    for (size_t offset = 0; offset < n; offset += EMBEDDING_STORE_LOOKUP_BATCH) {
+        size_t batch = std::min(n - offset, EMBEDDING_STORE_LOOKUP_BATCH);
+
+        for (size_t i = 0; i < batch; ++i) {
+            Range_(ShardOf_(signs[offset + i]), signs[offset + i], &begins[i], &ends[i]);
+        }
+
+        for (size_t i = 0; i < batch; ++i) {
+            uint64_t sign = signs[offset + i];
+            const Shard& shard = ShardOf_(sign);
+
+            uint64_t k = Search_(shard, sign, begins[i], ends[i]);
+            if (k != EMBEDDING_STORE_NOT_FOUND) {
+                AddRow_(shard, k, out);
+                ++found;
+            }
+        }
+    }
+
+    return found;
+}
+
+} // namespace tensornet
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
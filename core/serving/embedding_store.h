@@ -0,0 +1,183 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_SERVING_EMBEDDING_STORE_H_
+#define TENSORNET_SERVING_EMBEDDING_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tensornet {
+
+static constexpr uint32_t EMBEDDING_STORE_MAGIC = 0x45534e54;  // "TNSE"
+static constexpr uint32_t EMBEDDING_STORE_VERSION = 1;
+
+// sections are aligned to this from file begin, weights rows are read by SIMD loads
+static constexpr size_t EMBEDDING_STORE_ALIGN = 64;
+
+static constexpr uint64_t EMBEDDING_STORE_NOT_FOUND = UINT64_MAX;
+
+enum EmbeddingWeightType {
+    EWT_FLOAT = 0,
+    // IEEE 754 binary16
+    EWT_HALF = 1,
+    // symmetric int8 with one float scale per row, weight = scale * q
+    EWT_INT8 = 2,
+};
+
+// a serving embedding file is a read only map of sign to weights of one shard of a
+// sparse table, without any optimizer state. the layout is
+//     header | dir[dir_size + 1] | sign[key_count] | [scale[key_count]] | weight[key_count][dim]
+// signs are sorted, dir[i] is the index of the first sign whose top dir_bits bits are
+// not less than i, so that a lookup only searches a few signs. scale is only there
+// for EWT_INT8. every section begins at a multiple of EMBEDDING_STORE_ALIGN, integers
+// are in host byte order.
+struct EmbeddingStoreHeader {
+    uint32_t magic = EMBEDDING_STORE_MAGIC;
+    uint32_t version = EMBEDDING_STORE_VERSION;
+    int32_t dim = 0;
+    uint32_t weight_type = EWT_FLOAT;
+    uint64_t key_count = 0;
+    uint32_t dir_bits = 0;
+    // sign belongs to shard_id of shard_num shards if sign % shard_num == shard_id
+    uint32_t shard_id = 0;
+    uint32_t shard_num = 1;
+    uint32_t reserved[7] = {0};
+};
+
+static_assert(sizeof(EmbeddingStoreHeader) == EMBEDDING_STORE_ALIGN,
+              "header of embedding store must be one align unit");
+
+// collect weights of one shard and write them in layout of serving embedding file
+class EmbeddingStoreWriter {
+public:
+    explicit EmbeddingStoreWriter(int dim);
+
+    // weights are copied, a sign added twice keeps the last
+    void Add(uint64_t sign, const float* weights);
+
+    int Dim() const {
+        return dim_;
+    }
+
+    size_t KeyCount() const {
+        return signs_.size();
+    }
+
+    void Write(std::ostream& os, uint32_t shard_id = 0, uint32_t shard_num = 1,
+               EmbeddingWeightType weight_type = EWT_FLOAT);
+
+private:
+    int dim_ = 0;
+    std::vector<uint64_t> signs_;
+    std::vector<float> weights_;
+};
+
+enum EmbeddingPoolingType {
+    EPT_SUM = 0,
+    EPT_MEAN = 1,
+};
+
+// memory mapped serving embedding files of all shards of a table. lookups never
+// allocate or lock, weights are read from the mapped pages in place and converted
+// to float if quantized.
+class EmbeddingStore {
+public:
+    EmbeddingStore() = default;
+    ~EmbeddingStore();
+
+    EmbeddingStore(const EmbeddingStore&) = delete;
+    EmbeddingStore& operator=(const EmbeddingStore&) = delete;
+
+    // files are shards of one table in any order, return 0 if all are mapped
+    int Open(const std::vector<std::string>& files);
+
+    int Dim() const {
+        return dim_;
+    }
+
+    size_t KeyCount() const;
+
+    size_t ShardNum() const {
+        return shards_.size();
+    }
+
+    // weight type of shards, EWT_FLOAT if not opened
+    EmbeddingWeightType WeightType() const {
+        return shards_.empty() ? EWT_FLOAT
+            : static_cast<EmbeddingWeightType>(shards_[0].header->weight_type);
+    }
+
+    // write this store overwritten by signs of delta to files, one per shard in order
+    // of shard id. delta must have same shards, dim and weight type. return 0 if done
+    int Merge(const EmbeddingStore& delta, const std::vector<std::string>& files) const;
+
+    // copy weights of sign to out[0, dim), return false if not found
+    bool Find(uint64_t sign, float* out) const;
+
+    // copy weights of signs[0, n) to out + i * dim, weights of missing signs are
+    // zeros. return count of signs found.
+    size_t Lookup(const uint64_t* signs, size_t n, float* out) const;
+
+    // pool weights of signs[0, n) into out[0, dim), missing signs count as zeros as
+    // they are in Lookup. return count of signs found.
+    size_t Pool(const uint64_t* signs, size_t n, EmbeddingPoolingType type, float* out) const;
+
+    // add weights of found signs of signs[0, n) to out[0, dim), return count of them
+    size_t Accumulate(const uint64_t* signs, size_t n, float* out) const;
+
+private:
+    struct Shard {
+        const EmbeddingStoreHeader* header = nullptr;
+        const uint64_t* dir = nullptr;
+        const uint64_t* signs = nullptr;
+        const float* scales = nullptr;
+        const char* weights = nullptr;
+        size_t row_bytes = 0;
+
+        void* addr = nullptr;
+        size_t length = 0;
+    };
+
+    int OpenShard_(const std::string& file, Shard* shard);
+
+    const Shard& ShardOf_(uint64_t sign) const {
+        return shards_[sign % shards_.size()];
+    }
+
+    // search range of sign in dir, start of range is prefetched
+    static void Range_(const Shard& shard, uint64_t sign, uint64_t* begin, uint64_t* end);
+
+    // index of sign in shard, EMBEDDING_STORE_NOT_FOUND if not found
+    static uint64_t Search_(const Shard& shard, uint64_t sign, uint64_t begin, uint64_t end);
+
+    static void CopyRow_(const Shard& shard, uint64_t i, float* out);
+
+    static void AddRow_(const Shard& shard, uint64_t i, float* out);
+
+private:
+    int dim_ = 0;
+    std::vector<Shard> shards_;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_SERVING_EMBEDDING_STORE_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
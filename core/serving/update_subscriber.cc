@@ -0,0 +1,166 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/serving/update_subscriber.h"
+
+#include <chrono>
+
+#include <brpc/controller.h>
+#include <butil/logging.h>
+
+#include "core/ps_interface/sparse_codec.h"
+
+namespace tensornet {
+
+SparseUpdateSubscriber::SparseUpdateSubscriber(HotSwapEmbeddingStore* store, uint32_t table_handle,
+                                               const std::vector<std::string>& servers,
+                                               const SparseSubscribeOption& option)
+    : store_(store)
+    , table_handle_(table_handle)
+    , option_(option)
+    , servers_(servers.size()) {
+    CHECK(store_ != nullptr);
+
+    for (size_t i = 0; i < servers.size(); ++i) {
+        servers_[i].addr = servers[i];
+    }
+}
+
+SparseUpdateSubscriber::~SparseUpdateSubscriber() {
+    Stop();
+}
+
+int SparseUpdateSubscriber::Start() {
+    brpc::ChannelOptions options;
+
+    options.protocol = "baidu_std";
+    options.timeout_ms = option_.timeout_ms;
+    options.max_retry = 1;
+
+    for (auto& server : servers_) {
+        server.channel.reset(new brpc::Channel());
+
+        if (server.channel->Init(server.addr.c_str(), "", &options) != 0) {
+            LOG(ERROR) << "Fail to initialize channel with " << server.addr;
+            return -1;
+        }
+    }
+
+    thread_ = std::thread(&SparseUpdateSubscriber::Run_, this);
+
+    return 0;
+}
+
+void SparseUpdateSubscriber::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(run_mu_);
+        stop_ = true;
+    }
+    run_cond_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SparseUpdateSubscriber::Run_() {
+    std::unique_lock<std::mutex> lock(run_mu_);
+
+    while (!stop_) {
+        run_cond_.wait_for(lock, std::chrono::milliseconds(option_.interval_ms));
+        if (stop_) {
+            break;
+        }
+
+        lock.unlock();
+        Poll();
+        lock.lock();
+    }
+}
+
+size_t SparseUpdateSubscriber::Poll() {
+    size_t applied = 0;
+
+    for (auto& server : servers_) {
+        bool more = true;
+        while (more) {
+            applied += PollServer_(&server, &more);
+        }
+    }
+
+    return applied;
+}
+
+size_t SparseUpdateSubscriber::PollServer_(Server* server, bool* more) {
+    *more = false;
+
+    SparseSubscribeRequest req;
+    req.set_table_handle(table_handle_);
+    req.set_stream_id(server->stream_id);
+    req.set_next_seq(server->next_seq);
+    req.set_max_keys(option_.max_keys);
+    req.set_value_encoding(option_.value_encoding);
+
+    SparseSubscribeResponse resp;
+    brpc::Controller cntl;
+
+    PsService_Stub stub(server->channel.get());
+    stub.SparseSubscribe(&cntl, &req, &resp, nullptr);
+
+    if (cntl.Failed()) {
+        LOG(WARNING) << "subscribe table " << table_handle_ << " from " << server->addr
+                     << " failed: " << cntl.ErrorText();
+        return 0;
+    }
+
+    if (resp.lost()) {
+        LOG(WARNING) << "updates of table " << table_handle_ << " from " << server->addr
+                     << " after seq " << server->next_seq << " are lost, reload a full snapshot"
+                     << " to recover them";
+    }
+
+    {
+        // released before applying, updater waits for readers
+        HotSwapEmbeddingStore::ScopedPtr ptr;
+        if (store_->Read(&ptr) != 0 || !*ptr || (*ptr)->Dim() != (int)resp.dim()) {
+            LOG(ERROR) << "subscribe table " << table_handle_ << " dim:" << resp.dim()
+                       << " not match serving table or it is not loaded";
+            return 0;
+        }
+    }
+
+    size_t n = resp.signs_size();
+    std::vector<uint64_t> signs(resp.signs().begin(), resp.signs().end());
+    std::vector<float> weights(n * resp.dim());
+    if (!DecodeSparseValues(&cntl.response_attachment(), weights.size(), resp.value_encoding(),
+                            weights.data())) {
+        LOG(ERROR) << "bad subscribe response of table " << table_handle_ << " from " << server->addr;
+        return 0;
+    }
+
+    if (n > 0 && store_->ApplyUpdates(signs.data(), weights.data(), n) != 0) {
+        // position is kept so that updates are fetched again
+        return 0;
+    }
+
+    server->stream_id = resp.stream_id();
+    server->next_seq = resp.next_seq();
+    *more = n >= option_.max_keys;
+
+    return n;
+}
+
+} // namespace tensornet
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,93 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_SERVING_UPDATE_SUBSCRIBER_H_
+#define TENSORNET_SERVING_UPDATE_SUBSCRIBER_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <brpc/channel.h>
+
+#include "core/ps_interface/ps_server.pb.h"
+#include "core/serving/embedding_snapshot.h"
+
+namespace tensornet {
+
+struct SparseSubscribeOption {
+    // every ps shard is polled once every interval_ms, and at once again if it
+    // returned max_keys signs
+    int interval_ms = 1000;
+    uint32_t max_keys = 100000;
+
+    SparseValueEncoding value_encoding = SVE_FLOAT;
+    int timeout_ms = 3000;
+};
+
+// serving side, poll weights streamed by ps shards of a table and apply them over
+// the hot swap store in background. store must outlive the subscriber.
+class SparseUpdateSubscriber {
+public:
+    // servers are brpc addresses of all ps ranks, table_handle is the handle of
+    // the table in training, which is the same on every rank
+    SparseUpdateSubscriber(HotSwapEmbeddingStore* store, uint32_t table_handle,
+                           const std::vector<std::string>& servers,
+                           const SparseSubscribeOption& option = SparseSubscribeOption());
+
+    ~SparseUpdateSubscriber();
+
+    // connect servers and start polling, return 0 if done
+    int Start();
+
+    void Stop();
+
+    // poll every server once in caller thread, return count of applied signs
+    size_t Poll();
+
+private:
+    struct Server {
+        std::string addr;
+        std::unique_ptr<brpc::Channel> channel;
+        uint64_t stream_id = 0;
+        uint64_t next_seq = 0;
+    };
+
+    // return count of applied signs, more is set if server has more batches
+    size_t PollServer_(Server* server, bool* more);
+
+    void Run_();
+
+private:
+    HotSwapEmbeddingStore* store_ = nullptr;
+    uint32_t table_handle_ = 0;
+    SparseSubscribeOption option_;
+    std::vector<Server> servers_;
+
+    std::mutex run_mu_;
+    std::condition_variable run_cond_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_SERVING_UPDATE_SUBSCRIBER_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -15,14 +15,31 @@
 #ifndef TENSORNET_UTILITY_ALLOCATOR_H_
 #define TENSORNET_UTILITY_ALLOCATOR_H_
 
-#include <atomic>
-#include <random>
-#include <ctime>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include <utility>
 
 #include <butil/logging.h>
 
 namespace tensornet {
 
+// slab allocator of fixed size objects. memory is mmap'd in slabs aligned to their
+// power of two size, so the slab of an object is found by masking its address.
+//
+// - slabs are at least 2M and advised to use transparent huge pages, which cut
+//   page faults and tlb misses of big tables.
+// - objects are carved from a slab lazily, pages are only touched when used. with
+//   first touch policy they are placed on the numa node of the thread creating
+//   the values.
+// - a slab whose objects are all freed is returned to os, except one spare slab is
+//   kept to avoid map and unmap repeatedly around the boundary.
+// - every slab may have rows of row_bytes in a separate mapping, row of an object
+//   is addressed by its index in slab. rows of objects carved one after another are
+//   contiguous, without headers or other fields of objects between them.
+//
+// NOTE, allocator is not thread safe. every sparse kernel block owns one and only
+// use it with block lock held, a per thread cache would only add memory there.
 template<typename T>
 class Allocator {
 public:
@@ -30,42 +47,52 @@ public:
         : Allocator(type_sizeof, 1<<16) {
     }
 
-    Allocator(int type_sizeof, int block_len)
-        : pool_(nullptr)
-        , type_sizeof_(type_sizeof)
-        , block_len_(block_len)
-        , useable_block_(nullptr) {
+    // block_len is the number of objects wanted in one slab, slab size is rounded up
+    // to power of two so that a slab may hold more. objects have no row if row_bytes
+    // is 0.
+    Allocator(int type_sizeof, int block_len, size_t row_bytes = 0)
+        : type_sizeof_(type_sizeof)
+        , row_bytes_(row_bytes) {
         CHECK_GE(type_sizeof, sizeof(T));
         CHECK_GE(type_sizeof, sizeof(Block));
+        CHECK_GT(block_len, 0);
+
+        slab_size_ = MIN_SLAB_SIZE;
+        while (slab_size_ < HeaderSize_() + (size_t)type_sizeof_ * block_len) {
+            slab_size_ <<= 1;
+        }
 
-        create_new_pool_();
+        slab_capacity_ = (slab_size_ - HeaderSize_()) / type_sizeof_;
     }
 
     ~Allocator() {
-        while (pool_) {
-            Pool* next = pool_->next;
-            free(pool_);
-            pool_ = next;
-        }
+        Release_();
     }
 
-    Allocator(Allocator&& other)
-        : pool_(other.pool_)
-        , type_sizeof_(other.type_sizeof_)
-        , block_len_(other.block_len_)
-        , useable_block_(other.useable_block_) {
-        other.pool_ = nullptr;
-        other.useable_block_ = nullptr;
+    Allocator(Allocator&& other) {
+        *this = std::move(other);
     }
 
-    Allocator operator=(Allocator&& other) {
-        pool_ = other.pool_;
-        type_sizeof_ = other.type_sizeof_;
-        block_len_ = other.block_len_;
-        useable_block_ = other.useable_block_;
+    Allocator& operator=(Allocator&& other) {
+        if (this != &other) {
+            Release_();
+
+            type_sizeof_ = other.type_sizeof_;
+            row_bytes_ = other.row_bytes_;
+            slab_size_ = other.slab_size_;
+            slab_capacity_ = other.slab_capacity_;
+            slabs_ = other.slabs_;
+            partial_ = other.partial_;
+            slab_num_ = other.slab_num_;
+            empty_slab_num_ = other.empty_slab_num_;
+
+            other.slabs_ = nullptr;
+            other.partial_ = nullptr;
+            other.slab_num_ = 0;
+            other.empty_slab_num_ = 0;
+        }
 
-        other.pool_ = nullptr;
-        other.useable_block_ = nullptr;
+        return *this;
     }
 
     Allocator(const Allocator&) = delete;
@@ -73,60 +100,216 @@ public:
 
     template<class... ARGS>
     T* allocate(ARGS&&... args) {
-        if (!useable_block_) {
-            create_new_pool_();
+        if (!partial_) {
+            CreateSlab_();
         }
 
-        T* value = (T*)useable_block_;
-        useable_block_ = useable_block_->next;
+        Slab* slab = partial_;
+        void* ptr = nullptr;
 
-        new (value) T(std::forward<ARGS>(args)...);
+        if (slab->free) {
+            ptr = slab->free;
+            slab->free = slab->free->next;
+        } else {
+            ptr = (char*)slab + HeaderSize_() + (size_t)type_sizeof_ * slab->carved;
+            ++slab->carved;
+        }
+
+        if (slab->used++ == 0) {
+            --empty_slab_num_;
+        }
+
+        if (slab->used == slab_capacity_) {
+            partial_ = slab->next_partial;
+            slab->next_partial = nullptr;
+            slab->in_partial = false;
+        }
 
-        return value;
+        return new (ptr) T(std::forward<ARGS>(args)...);
     }
 
     void deallocate(T* ptr) {
         ptr->~T();
+
+        Slab* slab = SlabOf_(ptr);
+
         auto block = (Block*)ptr;
-        block->next = useable_block_;
-        useable_block_ = block;
+        block->next = slab->free;
+        slab->free = block;
+
+        if (!slab->in_partial) {
+            slab->next_partial = partial_;
+            partial_ = slab;
+            slab->in_partial = true;
+        }
+
+        if (--slab->used == 0 && ++empty_slab_num_ > 1) {
+            DestroySlab_(slab);
+        }
     }
 
-private:
-    void create_new_pool_() {
-        Pool* pool = nullptr;
+    // number of slabs mapped now
+    size_t SlabCount() const {
+        return slab_num_;
+    }
 
-        PCHECK(0 == posix_memalign((void**)&pool, alignof(Pool), sizeof(Pool) + type_sizeof_ * block_len_));
+    size_t SlabSize() const {
+        return slab_size_;
+    }
 
-        pool->next = pool_;
-        pool_ = pool;
+    // bytes of rows mapped now
+    size_t RowMemoryBytes() const {
+        return slab_num_ * slab_capacity_ * row_bytes_;
+    }
 
-        for (int i = 0; i < block_len_; i++) {
-            auto block = (Block*)(pool_->block + type_sizeof_ * i);
-            block->next = useable_block_;
-            useable_block_ = block;
-        }
+    // row of an object allocated by this allocator, row_bytes must not be 0
+    void* Row(const T* ptr) const {
+        Slab* slab = SlabOf_(ptr);
+        size_t index = (reinterpret_cast<const char*>(ptr) - reinterpret_cast<const char*>(slab)
+                        - HeaderSize_()) / type_sizeof_;
 
-        return;
+        return slab->rows + index * row_bytes_;
     }
 
 private:
+    static constexpr size_t MIN_SLAB_SIZE = 2 << 20;
+
     union Block {
         Block* next;
         char data[0];
     };
 
-    struct Pool {
-        Pool* next;
-        char block[0];
+    struct Slab {
+        Slab* prev = nullptr;
+        Slab* next = nullptr;
+        // slabs which have free objects
+        Slab* next_partial = nullptr;
+        bool in_partial = false;
+        Block* free = nullptr;
+        // objects carved from the slab, the rest are never touched yet
+        size_t carved = 0;
+        size_t used = 0;
+        // rows of objects, nullptr if row_bytes is 0
+        char* rows = nullptr;
     };
 
-    Pool* pool_ = nullptr;
+    static constexpr size_t HeaderSize_() {
+        return (sizeof(Slab) + 63) / 64 * 64;
+    }
+
+    Slab* SlabOf_(const void* ptr) const {
+        return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t)(slab_size_ - 1));
+    }
+
+    void CreateSlab_() {
+        // map twice the size and trim, so that the slab is aligned to its size
+        size_t map_size = slab_size_ * 2;
+        void* addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        PCHECK(addr != MAP_FAILED) << "mmap slab of size " << map_size << " failed";
+
+        uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+        uintptr_t aligned = (begin + slab_size_ - 1) & ~(uintptr_t)(slab_size_ - 1);
+
+        if (aligned > begin) {
+            munmap(addr, aligned - begin);
+        }
 
+        if (begin + map_size > aligned + slab_size_) {
+            munmap(reinterpret_cast<void*>(aligned + slab_size_), begin + map_size - aligned - slab_size_);
+        }
+
+#ifdef MADV_HUGEPAGE
+        madvise(reinterpret_cast<void*>(aligned), slab_size_, MADV_HUGEPAGE);
+#endif
+
+        Slab* slab = new (reinterpret_cast<void*>(aligned)) Slab();
+
+        if (row_bytes_ > 0) {
+            void* rows = mmap(nullptr, RowsSize_(), PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            PCHECK(rows != MAP_FAILED) << "mmap rows of size " << RowsSize_() << " failed";
+#ifdef MADV_HUGEPAGE
+            madvise(rows, RowsSize_(), MADV_HUGEPAGE);
+#endif
+            slab->rows = static_cast<char*>(rows);
+        }
+
+        slab->next = slabs_;
+        if (slabs_) {
+            slabs_->prev = slab;
+        }
+        slabs_ = slab;
+
+        slab->next_partial = partial_;
+        slab->in_partial = true;
+        partial_ = slab;
+
+        ++slab_num_;
+        ++empty_slab_num_;
+    }
+
+    // slab must have no used object
+    void DestroySlab_(Slab* slab) {
+        if (slab->prev) {
+            slab->prev->next = slab->next;
+        } else {
+            slabs_ = slab->next;
+        }
+
+        if (slab->next) {
+            slab->next->prev = slab->prev;
+        }
+
+        for (Slab** p = &partial_; *p; p = &(*p)->next_partial) {
+            if (*p == slab) {
+                *p = slab->next_partial;
+                break;
+            }
+        }
+
+        UnmapSlab_(slab);
+
+        --slab_num_;
+        --empty_slab_num_;
+    }
+
+    void Release_() {
+        while (slabs_) {
+            Slab* next = slabs_->next;
+            UnmapSlab_(slabs_);
+            slabs_ = next;
+        }
+
+        partial_ = nullptr;
+        slab_num_ = 0;
+        empty_slab_num_ = 0;
+    }
+
+    size_t RowsSize_() const {
+        return slab_capacity_ * row_bytes_;
+    }
+
+    void UnmapSlab_(Slab* slab) {
+        if (slab->rows) {
+            munmap(slab->rows, RowsSize_());
+        }
+
+        munmap(slab, slab_size_);
+    }
+
+private:
     int type_sizeof_ = 0;
-    int block_len_ = 0;
+    size_t row_bytes_ = 0;
+    size_t slab_size_ = 0;
+    size_t slab_capacity_ = 0;
+
+    // all slabs
+    Slab* slabs_ = nullptr;
+    Slab* partial_ = nullptr;
 
-    Block* useable_block_ = nullptr;
+    size_t slab_num_ = 0;
+    size_t empty_slab_num_ = 0;
 };
 
 } // namespace tensornet
@@ -0,0 +1,85 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_BLOCKING_QUEUE_H_
+#define TENSORNET_UTILITY_BLOCKING_QUEUE_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace tensornet {
+
+// bounded queue between pipeline stages of pthreads, push waits while queue is full
+// and pop waits while it is empty, so a slow stage holds back the others instead of
+// piling up memory. not for bthreads, waits block the worker pthread.
+template <typename T>
+class BlockingQueue {
+public:
+    explicit BlockingQueue(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1) {
+    }
+
+    BlockingQueue(const BlockingQueue&) = delete;
+    BlockingQueue& operator=(const BlockingQueue&) = delete;
+
+    void Push(T&& value) {
+        std::unique_lock<std::mutex> lock(mu_);
+        not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+
+        items_.push_back(std::move(value));
+        not_empty_.notify_one();
+    }
+
+    // return false when queue is closed and all values are popped
+    bool Pop(T* value) {
+        std::unique_lock<std::mutex> lock(mu_);
+        not_empty_.wait(lock, [this] { return !items_.empty() || closed_; });
+
+        if (items_.empty()) {
+            return false;
+        }
+
+        *value = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+
+        return true;
+    }
+
+    // no more push, consumers drain what is left
+    void Close() {
+        std::lock_guard<std::mutex> lock(mu_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t capacity_ = 0;
+    bool closed_ = false;
+
+    std::mutex mu_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_BLOCKING_QUEUE_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
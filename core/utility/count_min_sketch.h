@@ -0,0 +1,110 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_COUNT_MIN_SKETCH_H_
+#define TENSORNET_UTILITY_COUNT_MIN_SKETCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace tensornet {
+
+// approximate counts of uint64 keys in fixed memory, a count is never less than the
+// real one. counters saturate at uint16 max, conservative update only increases the
+// least counters of a key so that keys sharing a counter inflate each other less.
+//
+// NOTE, not thread safe.
+class CountMinSketch {
+public:
+    // width is rounded up to power of two
+    explicit CountMinSketch(size_t width = 1 << 16) {
+        width_bits_ = 1;
+        while (((size_t)1 << width_bits_) < width) {
+            ++width_bits_;
+        }
+
+        counters_.assign(DEPTH << width_bits_, 0);
+    }
+
+    // add count to key, return the estimated count after it
+    uint32_t Add(uint64_t key, uint32_t count) {
+        size_t pos[DEPTH];
+        uint32_t least = std::numeric_limits<uint32_t>::max();
+
+        for (size_t d = 0; d < DEPTH; ++d) {
+            pos[d] = Pos_(key, d);
+            least = std::min<uint32_t>(least, counters_[pos[d]]);
+        }
+
+        uint32_t estimate = std::min<uint32_t>(least + count, std::numeric_limits<uint16_t>::max());
+        for (size_t d = 0; d < DEPTH; ++d) {
+            if (counters_[pos[d]] < estimate) {
+                counters_[pos[d]] = estimate;
+            }
+        }
+
+        return estimate;
+    }
+
+    uint32_t Estimate(uint64_t key) const {
+        uint32_t least = std::numeric_limits<uint32_t>::max();
+        for (size_t d = 0; d < DEPTH; ++d) {
+            least = std::min<uint32_t>(least, counters_[Pos_(key, d)]);
+        }
+
+        return least;
+    }
+
+    // halve all counters, so that counts follow recent keys
+    void Halve() {
+        for (auto& counter : counters_) {
+            counter >>= 1;
+        }
+    }
+
+    void Clear() {
+        std::fill(counters_.begin(), counters_.end(), 0);
+    }
+
+    size_t MemoryBytes() const {
+        return counters_.size() * sizeof(uint16_t);
+    }
+
+private:
+    static constexpr size_t DEPTH = 4;
+
+    // every row is indexed by high bits of a different multiplicative hash
+    size_t Pos_(uint64_t key, size_t d) const {
+        static constexpr uint64_t SEEDS[DEPTH] = {
+            0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+            0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL,
+        };
+
+        return (d << width_bits_) + ((key * SEEDS[d]) >> (64 - width_bits_));
+    }
+
+private:
+    size_t width_bits_ = 0;
+    std::vector<uint16_t> counters_;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_COUNT_MIN_SKETCH_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,103 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/utility/cpu_affinity.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+
+#include <butil/logging.h>
+
+namespace tensornet {
+
+static bool ParseCpu(const std::string& s, int* cpu) {
+    if (s.empty()) {
+        return false;
+    }
+
+    char* end = nullptr;
+    long value = strtol(s.c_str(), &end, 10);
+    if (*end != '\0' || value < 0 || value >= CPU_SETSIZE) {
+        return false;
+    }
+
+    *cpu = value;
+    return true;
+}
+
+bool ParseCpuList(const std::string& list, std::vector<int>* cpus) {
+    cpus->clear();
+
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        size_t dash = range.find('-');
+
+        int first = 0;
+        int last = 0;
+        if (dash == std::string::npos) {
+            if (!ParseCpu(range, &first)) {
+                return false;
+            }
+            last = first;
+        } else if (!ParseCpu(range.substr(0, dash), &first)
+                || !ParseCpu(range.substr(dash + 1), &last) || first > last) {
+            return false;
+        }
+
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus->push_back(cpu);
+        }
+    }
+
+    return !cpus->empty();
+}
+
+bool NumaNodeCpus(int node, std::vector<int>* cpus) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+    std::string list;
+    if (!std::getline(in, list)) {
+        return false;
+    }
+
+    return ParseCpuList(list, cpus);
+}
+
+int PinCurrentThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return 0;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (0 != ret) {
+        LOG(WARNING) << "fail to set cpu affinity of thread, error:" << ret;
+    }
+
+    return ret;
+}
+
+} // namespace tensornet
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,36 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_CPU_AFFINITY_H_
+#define TENSORNET_UTILITY_CPU_AFFINITY_H_
+
+#include <string>
+#include <vector>
+
+namespace tensornet {
+
+// parse cpu list like "0-7,16,18-19" as in /sys and taskset, return false if malformed
+bool ParseCpuList(const std::string& list, std::vector<int>* cpus);
+
+// cpus of numa node from /sys/devices/system/node, return false if there is no such node
+bool NumaNodeCpus(int node, std::vector<int>* cpus);
+
+// bind calling thread to cpus, nothing is done if cpus is empty
+int PinCurrentThread(const std::vector<int>& cpus);
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_CPU_AFFINITY_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -162,5 +162,9 @@ std::streamsize FileReaderSource::read(char_type* str, std::streamsize n) {
     return buffer.size();
 }
 
+bool FileExists(const std::string& file) {
+    return tensorflow::Env::Default()->FileExists(file).ok();
+}
+
 } // namespace tensornet
 
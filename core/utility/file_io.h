@@ -70,6 +70,9 @@ private:
 
 };
 
+// return true if file exist in any file system supported by tensorflow
+bool FileExists(const std::string& file);
+
 }  // namespace tensornet
 
 #endif  // TENSORNET_UTILITY_SEMAPHORE_H_
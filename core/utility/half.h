@@ -0,0 +1,159 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_HALF_H_
+#define TENSORNET_UTILITY_HALF_H_
+
+#include <stdint.h>
+#include <string.h>
+
+namespace tensornet {
+
+// 16 bit floating point types used as compact storage only. they convert to and
+// from float implicitly, all arithmetic is done in float.
+
+inline uint32_t FloatBits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+inline float BitsFloat(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// IEEE 754 binary16, 5 bits exponent and 10 bits mantissa. better precision than
+// bfloat16 but only range in [6e-8, 65504].
+struct Half {
+    uint16_t bits;
+
+    Half() = default;
+
+    Half(float f) : bits(FromFloat(f)) { }
+
+    operator float() const {
+        return ToFloat(bits);
+    }
+
+    Half& operator+=(float v) {
+        return *this = float(*this) + v;
+    }
+
+    Half& operator-=(float v) {
+        return *this = float(*this) - v;
+    }
+
+    Half& operator*=(float v) {
+        return *this = float(*this) * v;
+    }
+
+    // round to nearest even, overflow to inf, nan is kept as quiet nan
+    static uint16_t FromFloat(float f) {
+        uint32_t x = FloatBits(f);
+        uint16_t sign = (x >> 16) & 0x8000;
+        uint32_t abs = x & 0x7fffffff;
+
+        if (abs >= 0x7f800000) {
+            return sign | (abs > 0x7f800000 ? 0x7e00 : 0x7c00);
+        }
+
+        // too large, round to inf
+        if (abs >= 0x477ff000) {
+            return sign | 0x7c00;
+        }
+
+        // subnormal or zero in half
+        if (abs < 0x38800000) {
+            // float(abs) + 0.5 let float rounding do the job, the result mantissa
+            // is the half subnormal mantissa.
+            float r = BitsFloat(abs) + 0.5f;
+            return sign | (uint16_t)(FloatBits(r) - FloatBits(0.5f));
+        }
+
+        uint32_t mant_odd = (abs >> 13) & 1;
+        abs += 0xc8000fff + mant_odd;  // rebias exponent by -112 and round
+        return sign | (uint16_t)(abs >> 13);
+    }
+
+    static float ToFloat(uint16_t h) {
+        uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+        uint32_t exp = (h >> 10) & 0x1f;
+        uint32_t mant = h & 0x3ff;
+
+        if (exp == 0x1f) {
+            return BitsFloat(sign | 0x7f800000 | (mant << 13));
+        }
+
+        if (exp == 0) {
+            // zero or subnormal, mant * 2^-24
+            float f = mant * (1.0f / (1 << 24));
+            return BitsFloat(sign | FloatBits(f));
+        }
+
+        return BitsFloat(sign | ((exp + 112) << 23) | (mant << 13));
+    }
+};
+
+// brain floating point, same exponent as float so never overflow before float does,
+// only 7 bits mantissa.
+struct BFloat16 {
+    uint16_t bits;
+
+    BFloat16() = default;
+
+    BFloat16(float f) : bits(FromFloat(f)) { }
+
+    operator float() const {
+        return ToFloat(bits);
+    }
+
+    BFloat16& operator+=(float v) {
+        return *this = float(*this) + v;
+    }
+
+    BFloat16& operator-=(float v) {
+        return *this = float(*this) - v;
+    }
+
+    BFloat16& operator*=(float v) {
+        return *this = float(*this) * v;
+    }
+
+    // round to nearest even, nan is kept as quiet nan
+    static uint16_t FromFloat(float f) {
+        uint32_t x = FloatBits(f);
+
+        if ((x & 0x7fffffff) > 0x7f800000) {
+            return (x >> 16) | 0x40;
+        }
+
+        x += 0x7fff + ((x >> 16) & 1);
+        return x >> 16;
+    }
+
+    static float ToFloat(uint16_t b) {
+        return BitsFloat((uint32_t)b << 16);
+    }
+};
+
+static_assert(sizeof(Half) == 2, "sizeof Half must be 2");
+static_assert(sizeof(BFloat16) == 2, "sizeof BFloat16 must be 2");
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_HALF_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,157 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/utility/log_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include <butil/logging.h>
+
+namespace tensornet {
+
+// appended records are written when buffer grows beyond this
+static constexpr size_t LOG_STORE_BUFFER_SIZE = 4 << 20;
+
+// adjacent records merged into one read at most
+static constexpr size_t LOG_STORE_MAX_READ_RECORDS = 256;
+
+LogStore::LogStore(const std::string& file, size_t record_size)
+    : file_(file)
+    , record_size_(record_size) {
+    CHECK_GT(record_size, 0);
+
+    fd_ = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    PCHECK(fd_ >= 0) << "open log store file " << file << " failed";
+
+    buffer_.reserve(LOG_STORE_BUFFER_SIZE + record_size);
+}
+
+LogStore::~LogStore() {
+    if (fd_ >= 0) {
+        close(fd_);
+        unlink(file_.c_str());
+    }
+}
+
+uint64_t LogStore::Append(const void* record) {
+    const char* p = static_cast<const char*>(record);
+    buffer_.insert(buffer_.end(), p, p + record_size_);
+
+    if (buffer_.size() >= LOG_STORE_BUFFER_SIZE) {
+        Flush();
+    }
+
+    return count_++;
+}
+
+void LogStore::Flush() {
+    size_t written = 0;
+    uint64_t offset = flushed_count_ * record_size_;
+
+    while (written < buffer_.size()) {
+        ssize_t ret = pwrite(fd_, buffer_.data() + written, buffer_.size() - written, offset + written);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        PCHECK(ret > 0) << "write log store file " << file_ << " failed";
+
+        written += ret;
+    }
+
+    flushed_count_ = count_;
+    buffer_.clear();
+}
+
+void LogStore::Read(uint64_t id, void* record) const {
+    CHECK_LT(id, count_) << "bad record id of log store " << file_;
+
+    if (id >= flushed_count_) {
+        memcpy(record, buffer_.data() + (id - flushed_count_) * record_size_, record_size_);
+        return;
+    }
+
+    PRead_(record, record_size_, id * record_size_);
+}
+
+void LogStore::ReadBatch(const uint64_t* ids, size_t n, char* out) const {
+    ReadBatch_(ids, n, out, flushed_count_);
+}
+
+void LogStore::ReadFlushed(const uint64_t* ids, size_t n, char* out) const {
+    ReadBatch_(ids, n, out, std::numeric_limits<uint64_t>::max());
+}
+
+void LogStore::ReadBatch_(const uint64_t* ids, size_t n, char* out, uint64_t flushed) const {
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [ids](size_t a, size_t b) {
+        return ids[a] < ids[b];
+    });
+
+    std::vector<char> buf;
+
+    for (size_t i = 0; i < n;) {
+        uint64_t first = ids[order[i]];
+
+        if (first >= flushed) {
+            Read(first, out + order[i] * record_size_);
+            ++i;
+            continue;
+        }
+
+        // run of records i, ... j - 1 which are in file and at most one apart
+        size_t j = i + 1;
+        while (j < n && ids[order[j]] < flushed && ids[order[j]] - ids[order[j - 1]] <= 1
+                && ids[order[j]] - first < LOG_STORE_MAX_READ_RECORDS) {
+            ++j;
+        }
+
+        uint64_t last = ids[order[j - 1]];
+        buf.resize((last - first + 1) * record_size_);
+        PRead_(buf.data(), buf.size(), first * record_size_);
+
+        for (size_t k = i; k < j; ++k) {
+            memcpy(out + order[k] * record_size_, buf.data() + (ids[order[k]] - first) * record_size_,
+                   record_size_);
+        }
+
+        i = j;
+    }
+}
+
+void LogStore::PRead_(void* buf, size_t n, uint64_t offset) const {
+    char* p = static_cast<char*>(buf);
+    size_t read_size = 0;
+
+    while (read_size < n) {
+        ssize_t ret = pread(fd_, p + read_size, n - read_size, offset + read_size);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        PCHECK(ret > 0) << "read log store file " << file_ << " failed";
+
+        read_size += ret;
+    }
+}
+
+} // namespace tensornet
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,104 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_LOG_STORE_H_
+#define TENSORNET_UTILITY_LOG_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace tensornet {
+
+// append only file of fixed size records on local disk, record is addressed by the
+// id returned by Append. records are never rewritten, Free only counts garbage and
+// owner compacts by appending live records into a new store when garbage piles up.
+//
+// file is scratch space of this process, it is truncated when opened and removed
+// when store is destroyed. not thread safe, except ReadFlushed.
+class LogStore {
+public:
+    LogStore(const std::string& file, size_t record_size);
+
+    ~LogStore();
+
+    LogStore(const LogStore&) = delete;
+    LogStore& operator=(const LogStore&) = delete;
+
+    // appended records are buffered until Flush or buffer is full
+    uint64_t Append(const void* record);
+
+    void Flush();
+
+    void Read(uint64_t id, void* record) const;
+
+    // read records of ids[0, n) into out one by one, adjacent records are read
+    // with one pread so that records appended together come back in few reads
+    void ReadBatch(const uint64_t* ids, size_t n, char* out) const;
+
+    // whether record is written to file, records in file are never changed
+    bool Flushed(uint64_t id) const {
+        return id < flushed_count_;
+    }
+
+    // as ReadBatch, but all ids must be Flushed. only file is read, so it may run
+    // concurrently with other methods as long as store is alive.
+    void ReadFlushed(const uint64_t* ids, size_t n, char* out) const;
+
+    void Free(uint64_t id) {
+        ++garbage_;
+    }
+
+    size_t RecordSize() const {
+        return record_size_;
+    }
+
+    size_t LiveCount() const {
+        return count_ - garbage_;
+    }
+
+    size_t GarbageCount() const {
+        return garbage_;
+    }
+
+    const std::string& File() const {
+        return file_;
+    }
+
+private:
+    // records of ids not less than flushed are copied from buffer one by one
+    void ReadBatch_(const uint64_t* ids, size_t n, char* out, uint64_t flushed) const;
+
+    void PRead_(void* buf, size_t n, uint64_t offset) const;
+
+private:
+    std::string file_;
+    int fd_ = -1;
+    size_t record_size_ = 0;
+
+    // records appended, live or not
+    uint64_t count_ = 0;
+    uint64_t flushed_count_ = 0;
+    uint64_t garbage_ = 0;
+
+    std::vector<char> buffer_;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_LOG_STORE_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
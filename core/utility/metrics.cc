@@ -0,0 +1,30 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/utility/metrics.h"
+
+namespace tensornet {
+
+RpcMetrics::RpcMetrics(const std::string& prefix)
+    : latency(prefix)
+    , request_bytes_adder(prefix + "_request_bytes")
+    , response_bytes_adder(prefix + "_response_bytes") {
+}
+
+Metrics* Metrics::Instance() {
+    static Metrics instance;
+    return &instance;
+}
+
+} // namespace tensornet
@@ -0,0 +1,74 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_METRICS_H_
+#define TENSORNET_UTILITY_METRICS_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include <bvar/bvar.h>
+
+namespace tensornet {
+
+// latency in us and bytes of one kind of rpc
+struct RpcMetrics {
+    explicit RpcMetrics(const std::string& prefix);
+
+    void Record(int64_t latency_us, size_t request_bytes, size_t response_bytes) {
+        latency << latency_us;
+        request_bytes_adder << request_bytes;
+        response_bytes_adder << response_bytes;
+    }
+
+    bvar::LatencyRecorder latency;
+    bvar::Adder<int64_t> request_bytes_adder;
+    bvar::Adder<int64_t> response_bytes_adder;
+};
+
+// process wide metrics of ps hot paths. they are exposed by the builtin services
+// of the brpc server started by PsCluster, see http://<ip>:<port>/vars/tensornet*
+//
+// per table metrics, e.g. key count, are exposed by the table itself with names
+// started with tensornet_sparse_table_<handle>.
+class Metrics {
+public:
+    static Metrics* Instance();
+
+    // worker side, from rpc start to response arrived
+    RpcMetrics client_sparse_pull{"tensornet_client_sparse_pull"};
+    RpcMetrics client_sparse_push{"tensornet_client_sparse_push"};
+    RpcMetrics client_dense_push_pull{"tensornet_client_dense_push_pull"};
+
+    // server side, time of processing only
+    RpcMetrics server_sparse_pull{"tensornet_server_sparse_pull"};
+    RpcMetrics server_sparse_push{"tensornet_server_sparse_push"};
+    RpcMetrics server_dense_push_pull{"tensornet_server_dense_push_pull"};
+
+    bvar::Adder<int64_t> rpc_retry{"tensornet_rpc_retry"};
+
+    // gradient bytes sent to the host leader instead of ps shards
+    bvar::Adder<int64_t> host_aggregate_bytes{"tensornet_host_aggregate_bytes"};
+
+    // wait of sparse kernel block lock in us, only contended locks are recorded
+    bvar::LatencyRecorder sparse_block_lock_wait{"tensornet_sparse_block_lock_wait"};
+
+private:
+    Metrics() = default;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_METRICS_H_
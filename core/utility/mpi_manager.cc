@@ -16,6 +16,8 @@
 
 #include <unistd.h>
 
+#include <butil/logging.h>
+
 #include "core/utility/net_util.h"
 
 namespace tensornet {
@@ -45,7 +47,13 @@ MpiManager* MpiManager::Instance() {
 }
 
 int MpiManager::Init() {
-    MPICHECK(MPI_Init(NULL, NULL));
+    // dense allreduce runs on op threads other than the one calling init
+    int provided = MPI_THREAD_SINGLE;
+    MPICHECK(MPI_Init_thread(NULL, NULL, MPI_THREAD_SERIALIZED, &provided));
+    if (provided < MPI_THREAD_SERIALIZED) {
+        LOG(WARNING) << "MPI thread level " << provided << " provided, serialized is expected";
+    }
+
     MPICHECK(MPI_Comm_rank(MPI_COMM_WORLD, &rank_));
     MPICHECK(MPI_Comm_size(MPI_COMM_WORLD, &rank_num_));
 
@@ -55,48 +63,133 @@ int MpiManager::Init() {
     ip_table_[rank_] = get_local_ip_internal();
     port_table_[rank_] = get_useable_port();
 
-    for (int rank = 0; rank < rank_num_; ++rank) {
-        int len = ip_table_[rank].size();
-        MPI_Bcast(&len, 1, MPI_INT, rank, MPI_COMM_WORLD);
+    // addresses are exchanged by two collectives whatever the number of ranks
+    std::vector<int> lens(rank_num_, 0);
+    lens[rank_] = ip_table_[rank_].size();
 
-        if (Rank() != rank) {
-            ip_table_[rank].resize(len);
-        }
+    MPICHECK(MPI_Allgather(MPI_IN_PLACE, 0, MPI_INT, lens.data(), 1, MPI_INT,
+                           MPI_COMM_WORLD));
 
-        MPI_Bcast(const_cast<char*>(ip_table_[rank].data()), len,
-                MPI_BYTE, rank, MPI_COMM_WORLD);
+    std::vector<int> displs(rank_num_, 0);
+    for (int rank = 1; rank < rank_num_; ++rank) {
+        displs[rank] = displs[rank - 1] + lens[rank - 1];
+    }
+
+    std::string ips(displs[rank_num_ - 1] + lens[rank_num_ - 1], '\0');
+    ips.replace(displs[rank_], lens[rank_], ip_table_[rank_]);
+
+    MPICHECK(MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_BYTE, &ips[0], lens.data(),
+                            displs.data(), MPI_BYTE, MPI_COMM_WORLD));
+
+    for (int rank = 0; rank < rank_num_; ++rank) {
+        ip_table_[rank] = ips.substr(displs[rank], lens[rank]);
     }
 
     MPICHECK(MPI_Allgather(MPI_IN_PLACE, 0, MPI_SHORT, &port_table_[0], 1,
                              MPI_SHORT, MPI_COMM_WORLD));
 
+    for (int rank = 0; rank < rank_num_; ++rank) {
+        if (ip_table_[rank] == ip_table_[rank_]) {
+            local_ranks_.push_back(rank);
+        }
+    }
+
     is_initialized_ = true;
 
     return 0;
 }
 
 void MpiManager::Barrier() {
-    std::vector<MPI_Request> reqs(RankNum(), MPI_REQUEST_NULL);
-    int dummy = 0;
+    // dissemination barrier by point to point messages, so that it is not ordered
+    // with collectives of other threads. in round k every rank notifies the one
+    // 2^k after it, all ranks have heard of all the others after log(n) rounds.
+    const std::lock_guard<std::mutex> barrier_lock(barrier_mu_);
+
+    for (int step = 1; step < RankNum(); step *= 2) {
+        int to = (Rank() + step) % RankNum();
+        int from = (Rank() - step + RankNum()) % RankNum();
+        int send_dummy = 0;
+        int recv_dummy = 0;
+        MPI_Request reqs[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+
+        {
+            const std::lock_guard<std::mutex> lock(collective_mu_);
+            MPICHECK(MPI_Irecv(&recv_dummy, 1, MPI_INT, from, kBarrierTag, MPI_COMM_WORLD, &reqs[0]));
+            MPICHECK(MPI_Isend(&send_dummy, 1, MPI_INT, to, kBarrierTag, MPI_COMM_WORLD, &reqs[1]));
+        }
 
-    for (int i = 0; i < RankNum(); ++i) {
-        MPI_Irecv(&dummy, 1, MPI_INT, i, 0, MPI_COMM_WORLD, &reqs[i]);
+        Wait_(&reqs[0]);
+        Wait_(&reqs[1]);
     }
+}
+
+void MpiManager::ReduceScatterSum(const float* send, float* recv,
+                                  const std::vector<int>& counts) {
+    const std::lock_guard<std::mutex> lock(collective_mu_);
+
+    MPICHECK(MPI_Reduce_scatter(send, recv, counts.data(), MPI_FLOAT, MPI_SUM,
+                                MPI_COMM_WORLD));
+}
 
-    for (int i = 0; i < RankNum(); ++i) {
-        MPI_Send(&dummy, 1, MPI_INT, i, 0, MPI_COMM_WORLD);
+void MpiManager::AllGatherv(float* data, const std::vector<int>& counts) {
+    std::vector<int> displs(counts.size(), 0);
+
+    for (size_t i = 1; i < counts.size(); ++i) {
+        displs[i] = displs[i - 1] + counts[i - 1];
     }
 
-    for (int i = 0; i < RankNum(); ++i) {
-        for (unsigned long x = 1;; x = std::min(x * 2, 2000UL)) {
-            int flag = 0;
-            MPI_Test(&reqs[i], &flag, MPI_STATUSES_IGNORE);
-            if (flag) {
-                break;
-            }
-            usleep(x);
+    const std::lock_guard<std::mutex> lock(collective_mu_);
+
+    MPICHECK(MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_FLOAT, data, counts.data(),
+                            displs.data(), MPI_FLOAT, MPI_COMM_WORLD));
+}
+
+void MpiManager::Wait_(MPI_Request* req) {
+    for (unsigned long x = 1;; x = std::min(x * 2, 2000UL)) {
+        int flag = 0;
+        {
+            const std::lock_guard<std::mutex> lock(collective_mu_);
+            MPICHECK(MPI_Test(req, &flag, MPI_STATUS_IGNORE));
         }
+
+        if (flag) {
+            break;
+        }
+        usleep(x);
+    }
+}
+
+void MpiManager::Send(int rank, int tag, const std::string& data) {
+    uint64_t size = data.size();
+    MPI_Request reqs[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+
+    {
+        const std::lock_guard<std::mutex> lock(collective_mu_);
+        MPICHECK(MPI_Isend(&size, 1, MPI_UINT64_T, rank, tag, MPI_COMM_WORLD, &reqs[0]));
+        MPICHECK(MPI_Isend(data.data(), data.size(), MPI_BYTE, rank, tag, MPI_COMM_WORLD, &reqs[1]));
+    }
+
+    Wait_(&reqs[0]);
+    Wait_(&reqs[1]);
+}
+
+void MpiManager::Recv(int rank, int tag, std::string* data) {
+    uint64_t size = 0;
+    MPI_Request req = MPI_REQUEST_NULL;
+
+    {
+        const std::lock_guard<std::mutex> lock(collective_mu_);
+        MPICHECK(MPI_Irecv(&size, 1, MPI_UINT64_T, rank, tag, MPI_COMM_WORLD, &req));
+    }
+    Wait_(&req);
+
+    data->resize(size);
+
+    {
+        const std::lock_guard<std::mutex> lock(collective_mu_);
+        MPICHECK(MPI_Irecv(&(*data)[0], size, MPI_BYTE, rank, tag, MPI_COMM_WORLD, &req));
     }
+    Wait_(&req);
 }
 
 std::vector<std::string> MpiManager::GetWorkers() {
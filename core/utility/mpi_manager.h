@@ -17,6 +17,7 @@
 
 #include <vector>
 #include <string>
+#include <mutex>
 #include <mpi.h>
 
 namespace tensornet {
@@ -25,6 +26,9 @@ class MpiManager {
 public:
     static MpiManager* Instance();
 
+    static const int kBarrierTag = 0;
+    static const int kUserTagBase = 1;
+
     int Init();
 
     int Rank() const {
@@ -39,10 +43,34 @@ public:
 
     void Barrier();
 
+    // collectives below must be called by all ranks in the same order, calls from
+    // different threads are serialized with barrier.
+
+    // sum send of all ranks, rank i receives counts[i] elements of the result
+    void ReduceScatterSum(const float* send, float* recv, const std::vector<int>& counts);
+
+    // data is slices of all ranks concatenated, rank i fills its counts[i] elements
+    // and gets the others in place
+    void AllGatherv(float* data, const std::vector<int>& counts);
+
+    // ranks with the same ip in rank order, self included
+    const std::vector<int>& LocalRanks() const {
+        return local_ranks_;
+    }
+
+    // point to point messages, pairs of calls are matched by rank and tag in order.
+    // they are polled without holding the lock of collectives, so that callers with
+    // different tags do not block each other. tags below kUserTagBase are reserved.
+    void Send(int rank, int tag, const std::string& data);
+
+    void Recv(int rank, int tag, std::string* data);
+
 private:
     MpiManager();
     ~MpiManager();
 
+    void Wait_(MPI_Request* req);
+
 private:
     bool is_initialized_ = false;
     int rank_ = 0;
@@ -50,6 +78,10 @@ private:
 
     std::vector<std::string> ip_table_;
     std::vector<uint16_t> port_table_;
+    std::vector<int> local_ranks_;
+
+    std::mutex collective_mu_;
+    std::mutex barrier_mu_;
 };
 
 } // namespace tensornet
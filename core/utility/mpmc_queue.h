@@ -0,0 +1,139 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_MPMC_QUEUE_H_
+#define TENSORNET_UTILITY_MPMC_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace tensornet {
+
+// bounded lock free multi producer multi consumer queue, every slot has a sequence
+// number telling whether it is ready for push or pop of a position, so producers
+// and consumers only contend on their own position counter.
+//
+// capacity is rounded up to power of two. push fails instead of blocking when the
+// queue is full, callers decide how to wait.
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity) {
+        capacity_ = 1;
+        while (capacity_ < capacity) {
+            capacity_ <<= 1;
+        }
+
+        mask_ = capacity_ - 1;
+        slots_.reset(new Slot[capacity_]);
+
+        for (size_t i = 0; i < capacity_; ++i) {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    // return false if queue is full, value is not moved then
+    bool try_push(T&& value) {
+        size_t pos = push_pos_.load(std::memory_order_relaxed);
+
+        for (;;) {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if (diff == 0) {
+                if (push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = push_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // return false if queue is empty
+    bool try_pop(T* value) {
+        size_t pos = pop_pos_.load(std::memory_order_relaxed);
+
+        for (;;) {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            if (diff == 0) {
+                if (pop_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    *value = std::move(slot.value);
+                    slot.value = T();
+                    slot.seq.store(pos + capacity_, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = pop_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // approximate while pushing or popping concurrently
+    size_t size() const {
+        size_t push_pos = push_pos_.load(std::memory_order_acquire);
+        size_t pop_pos = pop_pos_.load(std::memory_order_acquire);
+
+        return push_pos > pop_pos ? push_pos - pop_pos : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool full() const {
+        return size() >= capacity_;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    std::unique_ptr<Slot[]> slots_;
+
+    // producers and consumers are on different cache lines
+    alignas(64) std::atomic<size_t> push_pos_{0};
+    alignas(64) std::atomic<size_t> pop_pos_{0};
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_MPMC_QUEUE_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
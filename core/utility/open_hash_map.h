@@ -0,0 +1,486 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_OPEN_HASH_MAP_H_
+#define TENSORNET_UTILITY_OPEN_HASH_MAP_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include <butil/logging.h>
+
+namespace tensornet {
+
+// open addressing hash map with linear probing, keys and values are stored in one
+// flat slot array and one control byte per slot tell whether the slot is used.
+// compared with std::unordered_map there is no node allocation per key and a
+// lookup usually touch only one or two cache lines.
+//
+// growing is incremental, a bigger slot array is allocated and every following
+// insert move a few slots of the old array, so that no single insert stall for a
+// full rehash. lookup check both arrays until the old one is drained.
+//
+// NOTE, not thread safe, user must guarantee exclusive access, SparseKernelBlock
+// use it under the block mutex. V must be trivially copyable. pointers returned are
+// valid until next insert, erase or reserve.
+template <typename K, typename V, typename Hasher = std::hash<K>>
+class OpenHashMap {
+public:
+    explicit OpenHashMap(size_t capacity = 0, const Hasher& hasher = Hasher())
+        : hasher_(hasher) {
+        reserve(capacity);
+    }
+
+    ~OpenHashMap() {
+        free(slots_);
+        free(ctrl_);
+        free(old_slots_);
+        free(old_ctrl_);
+    }
+
+    OpenHashMap(OpenHashMap&& other)
+        : hasher_(other.hasher_) {
+        *this = std::move(other);
+    }
+
+    OpenHashMap& operator=(OpenHashMap&& other) {
+        if (this != &other) {
+            free(slots_);
+            free(ctrl_);
+            free(old_slots_);
+            free(old_ctrl_);
+
+            hasher_ = other.hasher_;
+            slots_ = other.slots_;
+            ctrl_ = other.ctrl_;
+            mask_ = other.mask_;
+            old_slots_ = other.old_slots_;
+            old_ctrl_ = other.old_ctrl_;
+            old_mask_ = other.old_mask_;
+            migrate_pos_ = other.migrate_pos_;
+            size_ = other.size_;
+            max_load_factor_ = other.max_load_factor_;
+
+            other.slots_ = nullptr;
+            other.ctrl_ = nullptr;
+            other.mask_ = 0;
+            other.old_slots_ = nullptr;
+            other.old_ctrl_ = nullptr;
+            other.old_mask_ = 0;
+            other.migrate_pos_ = 0;
+            other.size_ = 0;
+        }
+
+        return *this;
+    }
+
+    OpenHashMap(const OpenHashMap&) = delete;
+    OpenHashMap& operator=(const OpenHashMap&) = delete;
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    size_t capacity() const {
+        return slots_ ? mask_ + 1 : 0;
+    }
+
+    void max_load_factor(float factor) {
+        CHECK(factor > 0 && factor < 1) << "max_load_factor must in (0, 1):" << factor;
+        max_load_factor_ = factor;
+    }
+
+    // make sure that there is enough room for n keys without growing, rehash is
+    // done at once here, it is meant to be called before the map is filled.
+    void reserve(size_t n) {
+        size_t capacity = 16;
+        while (capacity * max_load_factor_ < n) {
+            capacity <<= 1;
+        }
+
+        if (capacity > this->capacity()) {
+            migrate_(SIZE_MAX);
+            rehash_(capacity);
+        }
+    }
+
+    // whether an old slot array is still being moved
+    bool rehashing() const {
+        return nullptr != old_slots_;
+    }
+
+    V* find(const K& key) {
+        if (old_slots_) {
+            V* value = find_old_(key);
+            if (value) {
+                return value;
+            }
+        }
+
+        if (nullptr == slots_) {
+            return nullptr;
+        }
+
+        for (size_t pos = bucket_(key);; pos = (pos + 1) & mask_) {
+            if (kEmpty == ctrl_[pos]) {
+                return nullptr;
+            }
+
+            if (slots_[pos].key == key) {
+                return &slots_[pos].value;
+            }
+        }
+    }
+
+    const V* find(const K& key) const {
+        return const_cast<OpenHashMap*>(this)->find(key);
+    }
+
+    // insert key with value if key not exist. return the pointer to the stored value
+    // and whether insertion took place, just like std::unordered_map::insert
+    std::pair<V*, bool> insert(const K& key, const V& value) {
+        if (size_ + 1 > capacity() * max_load_factor_) {
+            grow_();
+        }
+
+        if (old_slots_) {
+            migrate_(MIGRATE_STEP);
+
+            V* old_value = old_slots_ ? find_old_(key) : nullptr;
+            if (old_value) {
+                return {old_value, false};
+            }
+        }
+
+        size_t pos = bucket_(key);
+        for (; kEmpty != ctrl_[pos]; pos = (pos + 1) & mask_) {
+            if (slots_[pos].key == key) {
+                return {&slots_[pos].value, false};
+            }
+        }
+
+        ctrl_[pos] = kFull;
+        slots_[pos].key = key;
+        slots_[pos].value = value;
+        ++size_;
+
+        return {&slots_[pos].value, true};
+    }
+
+    // erase with backward shift, no tombstone left behind so that lookup never
+    // degrade after lots of insert and erase.
+    size_t erase(const K& key) {
+        if (old_slots_) {
+            for (size_t pos = old_bucket_(key); kEmpty != old_ctrl_[pos]; pos = (pos + 1) & old_mask_) {
+                if (kFull == old_ctrl_[pos] && old_slots_[pos].key == key) {
+                    // not shift in old array, migration just skip it
+                    old_ctrl_[pos] = kMoved;
+                    --size_;
+                    return 1;
+                }
+            }
+        }
+
+        if (nullptr == slots_) {
+            return 0;
+        }
+
+        size_t pos = bucket_(key);
+        for (;; pos = (pos + 1) & mask_) {
+            if (kEmpty == ctrl_[pos]) {
+                return 0;
+            }
+
+            if (slots_[pos].key == key) {
+                break;
+            }
+        }
+
+        erase_at_(pos);
+
+        return 1;
+    }
+
+    // erase elements stored in slot range [begin, end) which pred(const K& key, V& value)
+    // return true, return the count of erased. it is used to scan a big map in small
+    // steps, elements moved by backward shift across begin may be skipped. pending
+    // incremental rehash is finished first so that slot range is stable.
+    template <typename Pred>
+    size_t erase_if(size_t begin, size_t end, Pred&& pred) {
+        migrate_(SIZE_MAX);
+
+        size_t erased = 0;
+        end = std::min(end, capacity());
+
+        for (size_t pos = begin; pos < end;) {
+            if (kFull == ctrl_[pos] && pred(slots_[pos].key, slots_[pos].value)) {
+                erase_at_(pos);
+                ++erased;
+                // another element may be shift into pos, check it again
+                continue;
+            }
+            ++pos;
+        }
+
+        return erased;
+    }
+
+    void clear() {
+        free(old_slots_);
+        free(old_ctrl_);
+        old_slots_ = nullptr;
+        old_ctrl_ = nullptr;
+        old_mask_ = 0;
+        migrate_pos_ = 0;
+
+        if (ctrl_) {
+            memset(ctrl_, kEmpty, capacity());
+        }
+        size_ = 0;
+    }
+
+    // hint cpu to load the probe start of key, used by batch lookup
+    void prefetch(const K& key) const {
+        if (slots_) {
+            size_t pos = bucket_(key);
+            __builtin_prefetch(&ctrl_[pos]);
+            __builtin_prefetch(&slots_[pos]);
+        }
+
+        if (old_slots_) {
+            size_t pos = old_bucket_(key);
+            __builtin_prefetch(&old_ctrl_[pos]);
+            __builtin_prefetch(&old_slots_[pos]);
+        }
+    }
+
+    // call func(const K& key, V& value) for every element
+    template <typename Func>
+    void for_each(Func&& func) {
+        for (size_t i = 0; old_slots_ && i <= old_mask_; ++i) {
+            if (kFull == old_ctrl_[i]) {
+                func(old_slots_[i].key, old_slots_[i].value);
+            }
+        }
+
+        for (size_t i = 0; i < capacity(); ++i) {
+            if (kFull == ctrl_[i]) {
+                func(slots_[i].key, slots_[i].value);
+            }
+        }
+    }
+
+    // call func(const K& key, V& value) for every element in slots [begin, end) of
+    // capacity(), used to visit a big map in small steps as erase_if
+    template <typename Func>
+    void for_each(size_t begin, size_t end, Func&& func) {
+        migrate_(SIZE_MAX);
+
+        end = std::min(end, capacity());
+        for (size_t pos = begin; pos < end; ++pos) {
+            if (kFull == ctrl_[pos]) {
+                func(slots_[pos].key, slots_[pos].value);
+            }
+        }
+    }
+
+    template <typename Func>
+    void for_each(Func&& func) const {
+        for (size_t i = 0; old_slots_ && i <= old_mask_; ++i) {
+            if (kFull == old_ctrl_[i]) {
+                func(old_slots_[i].key, static_cast<const V&>(old_slots_[i].value));
+            }
+        }
+
+        for (size_t i = 0; i < capacity(); ++i) {
+            if (kFull == ctrl_[i]) {
+                func(slots_[i].key, static_cast<const V&>(slots_[i].value));
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        K key;
+        V value;
+    };
+
+    static constexpr uint8_t kEmpty = 0;
+    static constexpr uint8_t kFull = 1;
+    // only in old array, slot already moved or erased, probe must go on
+    static constexpr uint8_t kMoved = 2;
+
+    // old slots moved by every insert, old array has at most capacity * 0.75 keys
+    // when growing starts, so it is drained long before the new array fills.
+    static constexpr size_t MIGRATE_STEP = 16;
+
+    size_t hash_(const K& key) const {
+        // fibonacci hashing, keep the high bits of the product which are well
+        // mixed even if hasher is identity function as std::hash<uint64_t>
+        uint64_t h = static_cast<uint64_t>(hasher_(key)) * 0x9E3779B97F4A7C15ULL;
+        return h >> 32;
+    }
+
+    size_t bucket_(const K& key) const {
+        return hash_(key) & mask_;
+    }
+
+    size_t old_bucket_(const K& key) const {
+        return hash_(key) & old_mask_;
+    }
+
+    V* find_old_(const K& key) {
+        for (size_t pos = old_bucket_(key); kEmpty != old_ctrl_[pos]; pos = (pos + 1) & old_mask_) {
+            if (kFull == old_ctrl_[pos] && old_slots_[pos].key == key) {
+                return &old_slots_[pos].value;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // put a slot known not in the array
+    void place_(const Slot& slot) {
+        size_t pos = bucket_(slot.key);
+        while (kEmpty != ctrl_[pos]) {
+            pos = (pos + 1) & mask_;
+        }
+
+        ctrl_[pos] = kFull;
+        slots_[pos] = slot;
+    }
+
+    // move at most n slots of old array, free it when all moved
+    void migrate_(size_t n) {
+        if (nullptr == old_slots_) {
+            return;
+        }
+
+        size_t end = std::min(old_mask_ + 1, n == SIZE_MAX ? n : migrate_pos_ + n);
+
+        for (; migrate_pos_ < end; ++migrate_pos_) {
+            if (kFull == old_ctrl_[migrate_pos_]) {
+                place_(old_slots_[migrate_pos_]);
+                old_ctrl_[migrate_pos_] = kMoved;
+            }
+        }
+
+        if (migrate_pos_ > old_mask_) {
+            free(old_slots_);
+            free(old_ctrl_);
+            old_slots_ = nullptr;
+            old_ctrl_ = nullptr;
+            old_mask_ = 0;
+            migrate_pos_ = 0;
+        }
+    }
+
+    // start moving current slots into an array of double size
+    void grow_() {
+        if (nullptr == slots_) {
+            rehash_(16);
+            return;
+        }
+
+        migrate_(SIZE_MAX);
+
+        size_t capacity = this->capacity() * 2;
+
+        old_slots_ = slots_;
+        old_ctrl_ = ctrl_;
+        old_mask_ = mask_;
+        migrate_pos_ = 0;
+
+        slots_ = static_cast<Slot*>(malloc(sizeof(Slot) * capacity));
+        ctrl_ = static_cast<uint8_t*>(malloc(capacity));
+        PCHECK(nullptr != slots_ && nullptr != ctrl_) << "alloc hash map of:" << capacity;
+
+        memset(ctrl_, kEmpty, capacity);
+        mask_ = capacity - 1;
+    }
+
+    void erase_at_(size_t pos) {
+        size_t hole = pos;
+        for (size_t next = (hole + 1) & mask_; kFull == ctrl_[next]; next = (next + 1) & mask_) {
+            size_t home = bucket_(slots_[next].key);
+
+            // slot at next can be moved into hole only when its home bucket is not in
+            // the cyclic range (hole, next]
+            if (((next - home) & mask_) >= ((next - hole) & mask_)) {
+                slots_[hole] = slots_[next];
+                hole = next;
+            }
+        }
+
+        ctrl_[hole] = kEmpty;
+        --size_;
+    }
+
+    void rehash_(size_t capacity) {
+        CHECK_EQ(capacity & (capacity - 1), 0) << "capacity must be power of 2";
+        CHECK_GE(capacity * max_load_factor_, size_);
+
+        Slot* old_slots = slots_;
+        uint8_t* old_ctrl = ctrl_;
+        size_t old_capacity = this->capacity();
+
+        slots_ = static_cast<Slot*>(malloc(sizeof(Slot) * capacity));
+        ctrl_ = static_cast<uint8_t*>(malloc(capacity));
+        PCHECK(nullptr != slots_ && nullptr != ctrl_) << "alloc hash map of:" << capacity;
+
+        memset(ctrl_, kEmpty, capacity);
+        mask_ = capacity - 1;
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (kFull == old_ctrl[i]) {
+                place_(old_slots[i]);
+            }
+        }
+
+        free(old_slots);
+        free(old_ctrl);
+    }
+
+private:
+    Hasher hasher_;
+
+    Slot* slots_ = nullptr;
+    uint8_t* ctrl_ = nullptr;
+    size_t mask_ = 0;
+
+    // array being drained by incremental rehash, slots before migrate_pos_ are moved
+    Slot* old_slots_ = nullptr;
+    uint8_t* old_ctrl_ = nullptr;
+    size_t old_mask_ = 0;
+    size_t migrate_pos_ = 0;
+
+    size_t size_ = 0;
+
+    float max_load_factor_ = 0.75;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_OPEN_HASH_MAP_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
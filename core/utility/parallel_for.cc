@@ -0,0 +1,68 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/utility/parallel_for.h"
+
+#include <vector>
+
+#include <bthread/bthread.h>
+#include <butil/logging.h>
+
+namespace tensornet {
+
+namespace {
+
+struct ParallelTask {
+    const std::function<void(size_t)>* func;
+    size_t i;
+};
+
+void* RunParallelTask(void* arg) {
+    ParallelTask* task = static_cast<ParallelTask*>(arg);
+    (*task->func)(task->i);
+    return nullptr;
+}
+
+} // namespace
+
+void ParallelFor(size_t n, const std::function<void(size_t)>& func) {
+    if (n == 0) {
+        return;
+    }
+
+    std::vector<ParallelTask> tasks(n);
+    std::vector<bthread_t> tids(n);
+
+    for (size_t i = 1; i < n; ++i) {
+        tasks[i].func = &func;
+        tasks[i].i = i;
+
+        int ret = bthread_start_background(&tids[i], nullptr, RunParallelTask, &tasks[i]);
+        if (0 != ret) {
+            LOG(WARNING) << "start bthread failed:" << ret << ", run task in current thread";
+            tids[i] = 0;
+            func(i);
+        }
+    }
+
+    func(0);
+
+    for (size_t i = 1; i < n; ++i) {
+        if (0 != tids[i]) {
+            bthread_join(tids[i], nullptr);
+        }
+    }
+}
+
+} // namespace tensornet
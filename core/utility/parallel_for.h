@@ -0,0 +1,31 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_PARALLEL_FOR_H_
+#define TENSORNET_UTILITY_PARALLEL_FOR_H_
+
+#include <stddef.h>
+
+#include <functional>
+
+namespace tensornet {
+
+// call func(i) for every i in [0, n) concurrently and wait all of them done.
+// func(0) run in the calling thread, the others run in background bthreads,
+// so it is cheap enough to be used inside a brpc service handler.
+void ParallelFor(size_t n, const std::function<void(size_t)>& func);
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_PARALLEL_FOR_H_
@@ -0,0 +1,138 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/utility/thread_pool.h"
+#include "core/utility/cpu_affinity.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include <butil/logging.h>
+
+namespace tensornet {
+
+struct ThreadPool::Job {
+    const std::function<void(size_t)>* func = nullptr;
+    size_t n = 0;
+    std::atomic<size_t> next{0};
+
+    std::mutex mu;
+    std::condition_variable cv;
+    size_t done = 0;
+};
+
+static size_t io_thread_num = 16;
+static std::vector<int> io_cpus;
+
+void ThreadPool::InitIo(size_t thread_num, const std::vector<int>& cpus) {
+    CHECK_GT(thread_num, 0);
+
+    io_thread_num = thread_num;
+    io_cpus = cpus;
+}
+
+ThreadPool* ThreadPool::Io() {
+    static ThreadPool pool(io_thread_num, io_cpus);
+    return &pool;
+}
+
+ThreadPool::ThreadPool(size_t thread_num, const std::vector<int>& cpus) {
+    CHECK_GT(thread_num, 0);
+
+    for (size_t i = 0; i < thread_num; ++i) {
+        threads_.emplace_back(&ThreadPool::Loop_, this, cpus);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        const std::lock_guard<std::mutex> lock(mu_);
+        stopped_ = true;
+    }
+    cv_.notify_all();
+
+    std::for_each(threads_.begin(), threads_.end(), [](std::thread& t) {
+        t.join();
+    });
+}
+
+void ThreadPool::Run(size_t n, const std::function<void(size_t)>& func) {
+    if (n == 0) {
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->func = &func;
+    job->n = n;
+
+    size_t helpers = std::min(n - 1, threads_.size());
+    if (helpers > 0) {
+        {
+            const std::lock_guard<std::mutex> lock(mu_);
+            for (size_t i = 0; i < helpers; ++i) {
+                jobs_.push_back(job);
+            }
+        }
+        cv_.notify_all();
+    }
+
+    Work_(job.get());
+
+    // tasks not claimed yet are all run by this thread above, so the rest are in
+    // progress by pool threads
+    std::unique_lock<std::mutex> lock(job->mu);
+    job->cv.wait(lock, [&job]() { return job->done == job->n; });
+}
+
+void ThreadPool::Work_(Job* job) {
+    size_t done = 0;
+    for (size_t i = job->next++; i < job->n; i = job->next++) {
+        (*job->func)(i);
+        ++done;
+    }
+
+    if (done == 0) {
+        return;
+    }
+
+    const std::lock_guard<std::mutex> lock(job->mu);
+    job->done += done;
+    if (job->done == job->n) {
+        job->cv.notify_all();
+    }
+}
+
+void ThreadPool::Loop_(const std::vector<int>& cpus) {
+    PinCurrentThread(cpus);
+
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [this]() { return stopped_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        Work_(job.get());
+    }
+}
+
+} // namespace tensornet
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,75 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_THREAD_POOL_H_
+#define TENSORNET_UTILITY_THREAD_POOL_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tensornet {
+
+// pthreads shared by save, load and show decay of all tables, so that io of many
+// tables at once does not start more threads than the cores left to ps.
+//
+// Run claims tasks by index, the calling thread runs tasks too and only waits for
+// those claimed by pool threads. one job never waits for a task not started, so
+// tasks blocking on each other, like the stages of save pipeline, can not deadlock
+// however busy the pool is as long as every stage is run by a thread of its own.
+class ThreadPool {
+public:
+    static ThreadPool* Io();
+
+    ThreadPool(size_t thread_num, const std::vector<int>& cpus);
+
+    ~ThreadPool();
+
+    // call func(i) for every i in [0, n) with at most n threads and wait them done
+    void Run(size_t n, const std::function<void(size_t)>& func);
+
+    size_t ThreadNum() const {
+        return threads_.size();
+    }
+
+    // take effect only when called before the first Io()
+    static void InitIo(size_t thread_num, const std::vector<int>& cpus);
+
+private:
+    struct Job;
+
+    void Loop_(const std::vector<int>& cpus);
+
+    static void Work_(Job* job);
+
+private:
+    std::vector<std::thread> threads_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Job>> jobs_;
+    bool stopped_ = false;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_THREAD_POOL_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
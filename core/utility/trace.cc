@@ -0,0 +1,134 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/utility/trace.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include <butil/logging.h>
+
+namespace tensornet {
+
+// small ids of pthreads in order of their first span, rows of the timeline
+static uint32_t TraceThreadId() {
+    static std::atomic<uint32_t> next_tid(1);
+    thread_local uint32_t tid = next_tid++;
+
+    return tid;
+}
+
+Tracer* Tracer::Instance() {
+    static Tracer instance;
+    return &instance;
+}
+
+void Tracer::Start(size_t max_events) {
+    CHECK_GT(max_events, 0);
+
+    std::atomic_store(&buffer_, std::make_shared<Buffer>(max_events));
+    enabled_.store(true, std::memory_order_release);
+}
+
+void Tracer::Stop() {
+    enabled_.store(false, std::memory_order_release);
+}
+
+void Tracer::Record(const char* name, const char* cat, int64_t begin_us, int64_t end_us,
+                    uint64_t step, int peer, bool async) {
+    if (!Enabled()) {
+        return;
+    }
+
+    std::shared_ptr<Buffer> buffer = std::atomic_load(&buffer_);
+    if (!buffer) {
+        return;
+    }
+
+    size_t i = buffer->next.fetch_add(1, std::memory_order_relaxed);
+    if (i >= buffer->size) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event& event = buffer->events[i];
+    event.name = name;
+    event.cat = cat;
+    event.begin_us = begin_us;
+    event.end_us = std::max(begin_us, end_us);
+    event.step = step;
+    event.peer = peer;
+    event.tid = TraceThreadId();
+    event.async = async;
+    event.ready.store(true, std::memory_order_release);
+}
+
+size_t Tracer::Dump(const std::string& file, int rank) const {
+    std::shared_ptr<Buffer> buffer = std::atomic_load(&buffer_);
+
+    FILE* fp = fopen(file.c_str(), "w");
+    CHECK(nullptr != fp) << "fail to open trace file:" << file;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}",
+            rank, rank);
+
+    size_t count = 0;
+    size_t dropped = 0;
+
+    if (buffer) {
+        size_t n = std::min(buffer->next.load(std::memory_order_relaxed), buffer->size);
+        dropped = buffer->dropped.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < n; ++i) {
+            const Event& event = buffer->events[i];
+            if (!event.ready.load(std::memory_order_acquire)) {
+                continue;
+            }
+
+            if (event.async) {
+                // pair of async events matched by id, one row for every name
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"b\",\"id\":%zu,\"ts\":%" PRId64
+                        ",\"pid\":%d,\"tid\":%u,\"args\":{\"step\":%" PRIu64 ",\"peer\":%d}}",
+                        event.name, event.cat, i, event.begin_us, rank, event.tid, event.step, event.peer);
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\",\"id\":%zu,\"ts\":%" PRId64
+                        ",\"pid\":%d,\"tid\":%u}",
+                        event.name, event.cat, i, event.end_us, rank, event.tid);
+            } else {
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64 ",\"dur\":%" PRId64
+                        ",\"pid\":%d,\"tid\":%u,\"args\":{\"step\":%" PRIu64 ",\"peer\":%d}}",
+                        event.name, event.cat, event.begin_us, event.end_us - event.begin_us,
+                        rank, event.tid, event.step, event.peer);
+            }
+
+            ++count;
+        }
+    }
+
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"rank\":%d,\"dropped\":%zu}}\n",
+            rank, dropped);
+    fclose(fp);
+
+    if (dropped > 0) {
+        LOG(WARNING) << dropped << " trace spans dropped, start tracing with more max_events";
+    }
+
+    return count;
+}
+
+} // namespace tensornet
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
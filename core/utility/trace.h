@@ -0,0 +1,152 @@
+// Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TENSORNET_UTILITY_TRACE_H_
+#define TENSORNET_UTILITY_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <butil/time.h>
+
+namespace tensornet {
+
+// opt-in timeline of the process in chrome trace event format, dumped files are
+// opened by chrome://tracing or ui.perfetto.dev, files of all ranks are merged by
+// tools/merge_trace.py. spans are kept in a buffer of fixed size from Start, later
+// ones are dropped, nothing is recorded and Record costs one load when stopped.
+//
+// time is wall clock in us, so that spans of ranks on different hosts line up as
+// well as their clocks do.
+class Tracer {
+public:
+    static Tracer* Instance();
+
+    // clear spans recorded before and keep at most max_events new ones
+    void Start(size_t max_events);
+
+    void Stop();
+
+    bool Enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // step of this worker, carried by rpc so that server spans are tagged with the
+    // step of the requester
+    void SetStep(uint64_t step) {
+        step_.store(step, std::memory_order_relaxed);
+    }
+
+    uint64_t Step() const {
+        return step_.load(std::memory_order_relaxed);
+    }
+
+    static int64_t NowUs() {
+        return butil::gettimeofday_us();
+    }
+
+    // name and cat must be string literals. peer is the shard of a client span or
+    // the requester rank of a server span, -1 if none. async spans are those begin
+    // and end in different threads, like rpc, they are drawn in rows of their own.
+    void Record(const char* name, const char* cat, int64_t begin_us, int64_t end_us,
+                uint64_t step, int peer = -1, bool async = false);
+
+    // write spans recorded since Start as json with pid of rank, return count of
+    // them. should be called after Stop.
+    size_t Dump(const std::string& file, int rank) const;
+
+private:
+    Tracer() = default;
+
+    struct Event {
+        const char* name;
+        const char* cat;
+        int64_t begin_us;
+        int64_t end_us;
+        uint64_t step;
+        int32_t peer;
+        uint32_t tid;
+        bool async;
+        // set after the other fields are written
+        std::atomic<bool> ready;
+    };
+
+    struct Buffer {
+        explicit Buffer(size_t n)
+            : events(new Event[n])
+            , size(n) {
+            for (size_t i = 0; i < n; ++i) {
+                events[i].ready.store(false, std::memory_order_relaxed);
+            }
+        }
+
+        std::unique_ptr<Event[]> events;
+        size_t size = 0;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> dropped{0};
+    };
+
+private:
+    std::atomic<bool> enabled_{false};
+    std::atomic<uint64_t> step_{0};
+
+    // replaced as a whole by Start, recorders hold a reference while writing
+    std::shared_ptr<Buffer> buffer_;
+};
+
+// span of the enclosing scope in the current thread
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* cat, int peer = -1)
+        : name_(name)
+        , cat_(cat)
+        , peer_(peer) {
+        if (Tracer::Instance()->Enabled()) {
+            begin_us_ = Tracer::NowUs();
+        }
+    }
+
+    ~TraceSpan() {
+        if (begin_us_ > 0) {
+            Tracer* tracer = Tracer::Instance();
+            tracer->Record(name_, cat_, begin_us_, Tracer::NowUs(),
+                           has_step_ ? step_ : tracer->Step(), peer_);
+        }
+    }
+
+    // step of the span if it is not of this worker, like server spans
+    void SetStep(uint64_t step) {
+        step_ = step;
+        has_step_ = true;
+    }
+
+private:
+    const char* name_;
+    const char* cat_;
+    int peer_;
+    int64_t begin_us_ = 0;
+    uint64_t step_ = 0;
+    bool has_step_ = false;
+};
+
+} // namespace tensornet
+
+#endif // TENSORNET_UTILITY_TRACE_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
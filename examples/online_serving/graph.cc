@@ -8,36 +8,39 @@
 
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 
-extern "C" int Run(const std::vector<std::vector<std::vector<float>>>& input,
-                   std::vector<float>& output) {
-    Eigen::ThreadPool tp(std::thread::hardware_concurrency());
-    Eigen::ThreadPoolDevice device(&tp, tp.NumThreads());
-    Graph graph;
+// emb_inputs is [batch_size][slot_num][emb_size], every slot is wide embedding followed by
+// deep embedding. graph and thread pool are kept across calls, not thread safe.
+extern "C" int Run(const float* emb_inputs, int batch_size, int slot_num, int emb_size,
+                   float* output) {
+    static Eigen::ThreadPool tp(std::thread::hardware_concurrency());
+    static Eigen::ThreadPoolDevice device(&tp, tp.NumThreads());
+    static Graph graph;
     graph.set_thread_pool(&device);
 
-    std::vector<int> dim = {1, 8};
-    for (size_t i = 0; i < input.size(); ++i) {
-        if (input[i].size() != Graph::kNumArgs / 2) {
-            std::cerr << "TFFeaValues size is wrong, expected " << Graph::kNumArgs / 2 << " but get" << input[i].size() << std::endl;
-            return -1;
-        }
-        if ((int)input[i][0].size() != dim[0] + dim[1]) {
-            std::cerr << "embedding size is wrong, expected " << dim[0] + dim[1] << " but get" << input[i][0].size() << std::endl;
-            return -1;
-        }
-
-        std::copy(input[i][0].data(), input[i][0].data() + dim[0], graph.arg_feed_wide_emb_0_data() + i * dim[0]);
-        std::copy(input[i][0].data() + dim[0], input[i][0].data() + dim[0] + dim[1], graph.arg_feed_deep_emb_0_data() + i * dim[1]);
+    const int wide_dim = 1;
+    const int deep_dim = 8;
 
-        std::copy(input[i][1].data(), input[i][1].data() + dim[0], graph.arg_feed_wide_emb_1_data() + i * dim[0]);
-        std::copy(input[i][1].data() + dim[0], input[i][1].data() + dim[0] + dim[1], graph.arg_feed_deep_emb_1_data() + i * dim[1]);
+    if (slot_num != Graph::kNumArgs / 2) {
+        std::cerr << "TFFeaValues size is wrong, expected " << Graph::kNumArgs / 2 << " but get" << slot_num << std::endl;
+        return -1;
+    }
+    if (emb_size != wide_dim + deep_dim) {
+        std::cerr << "embedding size is wrong, expected " << wide_dim + deep_dim << " but get" << emb_size << std::endl;
+        return -1;
+    }
 
-        std::copy(input[i][2].data(), input[i][2].data() + dim[0], graph.arg_feed_wide_emb_2_data() + i * dim[0]);
-        std::copy(input[i][2].data() + dim[0], input[i][2].data() + dim[0] + dim[1], graph.arg_feed_deep_emb_2_data() + i * dim[1]);
+    float* wide_args[] = {graph.arg_feed_wide_emb_0_data(), graph.arg_feed_wide_emb_1_data(),
+                          graph.arg_feed_wide_emb_2_data(), graph.arg_feed_wide_emb_3_data()};
+    float* deep_args[] = {graph.arg_feed_deep_emb_0_data(), graph.arg_feed_deep_emb_1_data(),
+                          graph.arg_feed_deep_emb_2_data(), graph.arg_feed_deep_emb_3_data()};
 
-        std::copy(input[i][3].data(), input[i][3].data() + dim[0], graph.arg_feed_wide_emb_3_data() + i * dim[0]);
-        std::copy(input[i][3].data() + dim[0], input[i][3].data() + dim[0] + dim[1], graph.arg_feed_deep_emb_3_data() + i * dim[1]);
+    for (int i = 0; i < batch_size; ++i) {
+        for (int s = 0; s < slot_num; ++s) {
+            const float* emb = emb_inputs + (i * slot_num + s) * emb_size;
 
+            std::copy(emb, emb + wide_dim, wide_args[s] + i * wide_dim);
+            std::copy(emb + wide_dim, emb + emb_size, deep_args[s] + i * deep_dim);
+        }
     }
 
     auto ok = graph.Run();
@@ -45,10 +48,7 @@ extern "C" int Run(const std::vector<std::vector<std::vector<float>>>& input,
         return -1;
     }
 
-    output.clear();
-    output.assign(input.size(), 0.0);
-    std::copy(graph.result0_data(), graph.result0_data() + input.size(), output.data());
+    std::copy(graph.result0_data(), graph.result0_data() + batch_size, output);
 
     return 0;
 }
-
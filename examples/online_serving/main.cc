@@ -18,80 +18,161 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <atomic>
+#include <thread>
 #include <boost/algorithm/string.hpp>
 #include <dlfcn.h>
 
-#include "core/utility/random.h"
+#include "core/serving/embedding_snapshot.h"
+#include "core/serving/update_subscriber.h"
 
 using namespace std::chrono;
 
-typedef int (*RUN_FUNC)(const std::vector<std::vector<std::vector<float>>>&,
-                        std::vector<float>&);
+// emb_inputs is [batch_size][slot_num][emb_size], outputs is [batch_size]
+typedef int (*RUN_FUNC)(const float* emb_inputs, int batch_size, int slot_num, int emb_size,
+                        float* outputs);
 
 const int k_batch_size = 32;
 
-void InitWeight(int dim, std::vector<float>& weight) {
-    weight.clear();
-    auto& reng = tensornet::local_random_engine();
-    auto distribution = std::normal_distribution<float>(0, 1 / sqrt(dim));
+const int k_wide_dim = 1;
+const int k_deep_dim = 8;
 
-    for (int i = 0; i < dim; ++i) {
-        weight.push_back(distribution(reng) * 0.001);
+// every slot is fed by mean of wide embedding and mean of deep embedding of its features
+const int k_emb_size = k_wide_dim + k_deep_dim;
+
+// mode is full or delta, files are separated by comma
+int update_store(const std::string& mode, const std::string& files,
+                 tensornet::HotSwapEmbeddingStore* store) {
+    std::vector<std::string> file_vec;
+    boost::split(file_vec, files, boost::is_any_of(","));
+
+    int ret = mode == "delta" ? store->ApplyDelta(file_vec) : store->Load(file_vec);
+    if (ret != 0) {
+        std::cerr << "update embedding store " << mode << " " << files << " error." << std::endl;
+        return -1;
     }
+
+    return 0;
 }
 
-int combine_fea(std::vector<std::vector<float>> emb_feas, std::vector<float>& merged_feas) {
-    if (emb_feas.size() % 2 != 0) {
-        std::cerr << "combine_fea error." << std::endl;
+// addrs are ps ranks separated by comma, updates streamed by them are applied till exit
+int subscribe_store(const std::string& table_handle, const std::string& addrs,
+                    tensornet::HotSwapEmbeddingStore* store,
+                    std::vector<std::unique_ptr<tensornet::SparseUpdateSubscriber> >* subscribers) {
+    std::vector<std::string> addr_vec;
+    boost::split(addr_vec, addrs, boost::is_any_of(","));
+
+    std::unique_ptr<tensornet::SparseUpdateSubscriber> subscriber(
+        new tensornet::SparseUpdateSubscriber(store, std::stoul(table_handle), addr_vec));
+    if (subscriber->Start() != 0) {
+        std::cerr << "subscribe table " << table_handle << " from " << addrs << " error." << std::endl;
         return -1;
     }
-    float wide_lr = 0.0;
-    std::vector<float> dnn_vec(8, 0.0);
-    for (size_t i = 0; i < emb_feas.size(); i++) {
-        if (i % 2 == 0) {
-            wide_lr += emb_feas[i][0];
-        } else if (i % 2 == 1) {
-            for (size_t j = 0; j < emb_feas[i].size(); ++j) {
-                dnn_vec[j] += emb_feas[i][j];
+
+    subscribers->emplace_back(std::move(subscriber));
+
+    return 0;
+}
+
+// every line appended to update_file is applied in background as
+//     <wide|deep> <full|delta> <files>
+// or
+//     <wide|deep> subscribe <table_handle> <ps_addrs>
+void update_loop(const std::string& update_file, tensornet::HotSwapEmbeddingStore* wide_store,
+                 tensornet::HotSwapEmbeddingStore* deep_store, const std::atomic<bool>* stop) {
+    size_t applied = 0;
+    std::vector<std::unique_ptr<tensornet::SparseUpdateSubscriber> > subscribers;
+
+    while (!*stop) {
+        std::ifstream update_if(update_file);
+        std::string line;
+
+        for (size_t i = 0; getline(update_if, line); ++i) {
+            if (i < applied) {
+                continue;
+            }
+            applied = i + 1;
+
+            std::vector<std::string> vec;
+            boost::split(vec, line, boost::is_any_of(" \t"), boost::token_compress_on);
+            if (vec.size() < 3 || (vec[0] != "wide" && vec[0] != "deep")
+                    || (vec[1] == "subscribe") != (vec.size() == 4)) {
+                std::cerr << "bad update line: " << line << std::endl;
+                continue;
+            }
+
+            tensornet::HotSwapEmbeddingStore* store = vec[0] == "wide" ? wide_store : deep_store;
+            if (vec[1] == "subscribe") {
+                subscribe_store(vec[2], vec[3], store, &subscribers);
+            } else {
+                update_store(vec[1], vec[2], store);
             }
         }
-    }
 
-    int count = emb_feas.size() / 2;
-    merged_feas.push_back(wide_lr / count);
-    for (auto& w : dnn_vec) {
-        merged_feas.push_back(w / count);
+        std::this_thread::sleep_for(seconds(1));
     }
-
-    return 0;
 }
 
-int emb_lookup(const std::vector<std::vector<std::vector<uint64_t> > >& inputs,
-               std::vector<std::vector<std::vector<float>>>& emb_inputs) {
+// emb_inputs must have room for inputs.size() * slot_num * k_emb_size floats, embeddings
+// of slots without store are zeros
+void emb_lookup(const tensornet::EmbeddingSnapshot* wide_store,
+                const tensornet::EmbeddingSnapshot* deep_store,
+                const std::vector<std::vector<std::vector<uint64_t> > >& inputs,
+                float* emb_inputs) {
     for (size_t b = 0; b < inputs.size(); ++b) {
-        std::vector<std::vector<float>> emb_slots;
         for (size_t s = 0; s < inputs[b].size(); ++s) {
-            int input_slot = s;
-            std::vector<std::vector<float>> emb_feas;
-            for (size_t f = 0; f < inputs[b][input_slot].size(); ++f) {
-                std::vector<float> weight;
-                // TODO : seek embedding
-                InitWeight(1, weight);
-                emb_feas.emplace_back(std::move(weight));
-                InitWeight(8, weight);
-                emb_feas.emplace_back(std::move(weight));
+            const std::vector<uint64_t>& feas = inputs[b][s];
+            float* emb = emb_inputs + (b * inputs[b].size() + s) * k_emb_size;
+
+            std::fill(emb, emb + k_emb_size, 0.0);
+            if (wide_store != nullptr) {
+                wide_store->Pool(feas.data(), feas.size(), tensornet::EPT_MEAN, emb);
+            }
+            if (deep_store != nullptr) {
+                deep_store->Pool(feas.data(), feas.size(), tensornet::EPT_MEAN, emb + k_wide_dim);
             }
-            std::vector<float> merged_feas;
-            combine_fea(emb_feas, merged_feas);
-            emb_slots.emplace_back(std::move(merged_feas));
         }
-        emb_inputs.emplace_back(std::move(emb_slots));
     }
+}
+
+// current snapshot of store is held till batch done, update swaps it out in between
+int run_batch(RUN_FUNC run_func,
+              tensornet::HotSwapEmbeddingStore* wide_store,
+              tensornet::HotSwapEmbeddingStore* deep_store,
+              const std::vector<std::vector<std::vector<uint64_t> > >& inputs,
+              int slot_num, std::vector<float>& emb_inputs, std::vector<float>& outputs) {
+    auto start = system_clock::now();
+    {
+        tensornet::HotSwapEmbeddingStore::ScopedPtr wide;
+        tensornet::HotSwapEmbeddingStore::ScopedPtr deep;
+        wide_store->Read(&wide);
+        deep_store->Read(&deep);
+
+        emb_lookup((*wide).get(), (*deep).get(), inputs, emb_inputs.data());
+    }
+    int ret = run_func(emb_inputs.data(), inputs.size(), slot_num, k_emb_size, outputs.data());
+    auto end   = system_clock::now();
+    auto duration = duration_cast<microseconds>(end - start);
+
+    if (ret != 0) {
+        std::cerr << "run error." << std::endl;
+        return -1;
+    }
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        std::cout << outputs[i] << std::endl;
+    }
+    std::cerr << "batch " << inputs.size() << " cost " << duration.count() << "us" << std::endl;
 
     return 0;
 }
 
-int main() {
+// usage: tf_serving [wide_emb_files deep_emb_files [update_file]], files of a table are
+// separated by comma, they are serving embedding files of all shards exported by
+// training. snapshots or deltas listed in update_file are swapped in while serving, so are
+// updates streamed by ps of tables subscribed there
+int main(int argc, char* argv[]) {
     std::string train_slot = "./data/slot.data";
     std::ifstream slot_if(train_slot);
     if (!slot_if.is_open()) {
@@ -106,6 +187,25 @@ int main() {
         slot2pos[std::stoi(slots_vec[i])] = i;
     }
 
+    // merged snapshots of deltas are written beside the data
+    tensornet::HotSwapEmbeddingStore wide_store("./data", k_wide_dim);
+    tensornet::HotSwapEmbeddingStore deep_store("./data", k_deep_dim);
+
+    if (argc >= 3) {
+        if (update_store("full", argv[1], &wide_store) != 0
+                || update_store("full", argv[2], &deep_store) != 0) {
+            return -1;
+        }
+    } else {
+        std::cerr << "no embedding store, embeddings are zeros." << std::endl;
+    }
+
+    std::atomic<bool> stop(false);
+    std::thread updater;
+    if (argc >= 4) {
+        updater = std::thread(update_loop, std::string(argv[3]), &wide_store, &deep_store, &stop);
+    }
+
     void* handle = dlopen("./libmodel.so", RTLD_LAZY);
     if (handle == NULL) {
         std::cerr << "dlopen error." << std::endl;
@@ -126,7 +226,12 @@ int main() {
     }
 
     std::vector<std::vector<std::vector<uint64_t> > > inputs;
-    std::vector<std::vector<std::vector<float>>> emb_inputs;
+
+    // buffers are reused by all batches
+    int slot_num = slot2pos.size();
+    std::vector<float> emb_inputs(k_batch_size * slot_num * k_emb_size);
+    std::vector<float> outputs(k_batch_size);
+
     while(getline(data_if, input)) {
         std::vector<std::vector<uint64_t> > one_input;
         one_input.assign(slot2pos.size(), {});
@@ -153,34 +258,23 @@ int main() {
         inputs.emplace_back(one_input);
 
         if (inputs.size() % k_batch_size == 0) {
-            emb_lookup(inputs, emb_inputs);
-            std::vector<float> outputs;
-            auto start = system_clock::now();
-            run_func(emb_inputs, outputs);
-            auto end   = system_clock::now();
-            auto duration = duration_cast<microseconds>(end - start);
-
-            for (size_t i = 0; i < outputs.size(); ++i) {
-                std::cout << outputs[i] << std::endl;
+            if (run_batch(run_func, &wide_store, &deep_store, inputs, slot_num, emb_inputs, outputs) != 0) {
+                return -1;
             }
             inputs.clear();
-            outputs.clear();
-            emb_inputs.clear();
         }
     }
 
     if (inputs.size() != 0) {
-        emb_lookup(inputs, emb_inputs);
-        std::vector<float> outputs;
-        auto start = system_clock::now();
-        run_func(emb_inputs, outputs);
-        auto end   = system_clock::now();
-        auto duration = duration_cast<microseconds>(end - start);
-
-        for (auto w : outputs) {
-            std::cout <<  w << std::endl;
+        if (run_batch(run_func, &wide_store, &deep_store, inputs, slot_num, emb_inputs, outputs) != 0) {
+            return -1;
         }
     }
 
+    stop = true;
+    if (updater.joinable()) {
+        updater.join();
+    }
+
     return 0;
 }
@@ -22,14 +22,25 @@ from tensorflow.python.keras.callbacks import Callback
 class PsWeightCheckpoint(Callback):
     """Save ps weight after every fit.
     """
-    def __init__(self, checkpoint_dir, need_save_model=False, dt=None):
+    def __init__(self, checkpoint_dir, need_save_model=False, dt=None, save_mode="full",
+                 evict_option=None, spill_option=None, binary=False):
         """
         :param checkpoint_dir: path of save model
         :param need_save_model: whether save model
+        :param save_mode: "full" or "delta", see tn.model.Model.save_weights
+        :param binary: save sparse tables in binary format, see tn.model.Model.save_weights
+        :param evict_option: dict of show_threshold and ttl_days, evict sparse keys after
+            show decay when given, see tn.model.Model.evict
+        :param spill_option: dict of show_threshold and idle_days, spill sparse keys to
+            cold tier after evict when given, see tn.model.Model.spill
         """
         self.checkpoint_dir = checkpoint_dir
         self.need_save_model = need_save_model
         self.dt = dt
+        self.save_mode = save_mode
+        self.evict_option = evict_option
+        self.spill_option = spill_option
+        self.binary = binary
 
         super(PsWeightCheckpoint, self).__init__()
 
@@ -55,14 +66,24 @@ class PsWeightCheckpoint(Callback):
         self.reset_balance_dataset()
 
     def on_train_end(self, logs=None):
+        # all pushes of this worker must be applied before saving
+        tn.core.flush_push()
+
         tn.core.barrier()
 
         self.model.show_decay()
 
+        if self.evict_option:
+            self.model.evict(**self.evict_option)
+
+        if self.spill_option:
+            self.model.spill(**self.spill_option)
+
         if not self.need_save_model:
             return
 
-        self.model.save_weights(self.checkpoint_dir, dt=self.dt)
+        self.model.save_weights(self.checkpoint_dir, dt=self.dt, mode=self.save_mode,
+                                binary=self.binary)
 
     def on_predict_begin(self, logs=None):
         self.load_model()
@@ -80,3 +101,54 @@ class PsWeightCheckpoint(Callback):
     def on_test_end(self, logs=None):
         tn.core.barrier()
 
+
+
+class TraceCallback(Callback):
+    """Record timeline of worker and ps spans for some steps of training.
+
+    every rank writes trace_rank_<rank>.json to log_dir, merge them with
+    tools/merge_trace.py and open the result in chrome://tracing or ui.perfetto.dev.
+    """
+    def __init__(self, log_dir, start_step=100, num_steps=20, max_events=1000000):
+        """
+        :param log_dir: local directory of trace files
+        :param start_step: first traced batch, skip warmup steps before it
+        :param num_steps: count of traced batches
+        :param max_events: spans kept by every rank, later ones are dropped
+        """
+        self.log_dir = log_dir
+        self.start_step = start_step
+        self.num_steps = num_steps
+        self.max_events = max_events
+        self.step = 0
+        self.tracing = False
+
+        super(TraceCallback, self).__init__()
+
+    def on_train_batch_begin(self, batch, logs=None):
+        tn.core.trace_step(self.step)
+
+        if self.step == self.start_step:
+            tn.core.trace_start(self.max_events)
+            self.tracing = True
+
+        if self.tracing and self.step == self.start_step + self.num_steps:
+            self.dump()
+
+        self.step += 1
+
+    def on_train_end(self, logs=None):
+        if self.tracing:
+            self.dump()
+
+    def dump(self):
+        import os
+
+        tn.core.trace_stop()
+        self.tracing = False
+
+        if not os.path.exists(self.log_dir):
+            os.makedirs(self.log_dir, exist_ok=True)
+
+        file = os.path.join(self.log_dir, "trace_rank_{}.json".format(tn.core.self_shard_id()))
+        tn.core.trace_dump(file)
@@ -22,13 +22,15 @@ from tensorflow.python.util.tf_export import tf_export
 
 @_dispatch.add_dispatch_list
 @tf_export('balance_dataset')
-def balance_dataset(input_dataset, output_types, output_shapes, name=None):
+def balance_dataset(input_dataset, output_types, output_shapes, buffer_size=100, compress="snappy", name=None):
   r"""balance input data between datasets
 
   Args:
     input_dataset: A `Tensor` of type `variant`.
     output_types: A list of `tf.DTypes` that has length `>= 1`.
     output_shapes: A list of shapes (each a `tf.TensorShape` or list of `ints`) that has length `>= 1`.
+    buffer_size: An optional `int`. Defaults to `100`.
+    compress: An optional `string` from: `"none", "snappy", "gzip"`. Defaults to `"snappy"`.
     name: A name for the operation (optional).
 
   Returns:
@@ -41,20 +43,24 @@ def balance_dataset(input_dataset, output_types, output_shapes, name=None):
       _result = pywrap_tfe.TFE_Py_FastPathExecute(
         _ctx._context_handle, tld.device_name, "BalanceDataset", name,
         tld.op_callbacks, input_dataset, "output_types", output_types,
-        "output_shapes", output_shapes)
+        "output_shapes", output_shapes, "buffer_size", buffer_size, "compress",
+        compress)
       return _result
     except _core._FallbackException:
       try:
         return balance_dataset_eager_fallback(
             input_dataset, output_types=output_types,
-            output_shapes=output_shapes, name=name, ctx=_ctx)
+            output_shapes=output_shapes, buffer_size=buffer_size,
+            compress=compress, name=name, ctx=_ctx)
       except _core._SymbolicException:
         pass  # Add nodes to the TensorFlow graph.
       except (TypeError, ValueError):
         result = _dispatch.dispatch(
               balance_dataset, input_dataset=input_dataset,
                                output_types=output_types,
-                               output_shapes=output_shapes, name=name)
+                               output_shapes=output_shapes,
+                               buffer_size=buffer_size, compress=compress,
+                               name=name)
         if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
           return result
         raise
@@ -71,23 +77,35 @@ def balance_dataset(input_dataset, output_types, output_shapes, name=None):
         "Expected list for 'output_shapes' argument to "
         "'balance_dataset' Op, not %r." % output_shapes)
   output_shapes = [_execute.make_shape(_s, "output_shapes") for _s in output_shapes]
+  if buffer_size is None:
+    buffer_size = 100
+  buffer_size = _execute.make_int(buffer_size, "buffer_size")
+  if compress is None:
+    compress = "snappy"
+  compress = _execute.make_str(compress, "compress")
   try:
     _, _, _op, _outputs = _op_def_library._apply_op_helper(
         "BalanceDataset", input_dataset=input_dataset,
                           output_types=output_types,
-                          output_shapes=output_shapes, name=name)
+                          output_shapes=output_shapes,
+                          buffer_size=buffer_size, compress=compress,
+                          name=name)
   except (TypeError, ValueError):
     result = _dispatch.dispatch(
           balance_dataset, input_dataset=input_dataset,
                            output_types=output_types,
-                           output_shapes=output_shapes, name=name)
+                           output_shapes=output_shapes,
+                           buffer_size=buffer_size, compress=compress,
+                           name=name)
     if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
       return result
     raise
   _result = _outputs[:]
   if _execute.must_record_gradient():
     _attrs = ("output_types", _op.get_attr("output_types"), "output_shapes",
-              _op.get_attr("output_shapes"))
+              _op.get_attr("output_shapes"), "buffer_size",
+              _op._get_attr_int("buffer_size"), "compress",
+              _op.get_attr("compress"))
     _inputs_flat = _op.inputs
     _execute.record_gradient(
         "BalanceDataset", _inputs_flat, _attrs, _result)
@@ -97,7 +115,7 @@ def balance_dataset(input_dataset, output_types, output_shapes, name=None):
 BalanceDataset = tf_export("raw_ops.BalanceDataset")(_ops.to_raw_op(balance_dataset))
 
 
-def balance_dataset_eager_fallback(input_dataset, output_types, output_shapes, name, ctx):
+def balance_dataset_eager_fallback(input_dataset, output_types, output_shapes, buffer_size, compress, name, ctx):
   if not isinstance(output_types, (list, tuple)):
     raise TypeError(
         "Expected list for 'output_types' argument to "
@@ -108,9 +126,16 @@ def balance_dataset_eager_fallback(input_dataset, output_types, output_shapes, n
         "Expected list for 'output_shapes' argument to "
         "'balance_dataset' Op, not %r." % output_shapes)
   output_shapes = [_execute.make_shape(_s, "output_shapes") for _s in output_shapes]
+  if buffer_size is None:
+    buffer_size = 100
+  buffer_size = _execute.make_int(buffer_size, "buffer_size")
+  if compress is None:
+    compress = "snappy"
+  compress = _execute.make_str(compress, "compress")
   input_dataset = _ops.convert_to_tensor(input_dataset, _dtypes.variant)
   _inputs_flat = [input_dataset]
-  _attrs = ("output_types", output_types, "output_shapes", output_shapes)
+  _attrs = ("output_types", output_types, "output_shapes", output_shapes,
+  "buffer_size", buffer_size, "compress", compress)
   _result = _execute.execute(b"BalanceDataset", 1, inputs=_inputs_flat,
                              attrs=_attrs, ctx=ctx, name=name)
   if _execute.must_record_gradient():
@@ -185,3 +185,97 @@ def dense_table_push_pull_eager_fallback(vars, grads, table_handle, name, ctx):
   _result = None
   return _result
 
+
+@_dispatch.add_dispatch_list
+@tf_export('dense_table_all_reduce')
+def dense_table_all_reduce(vars, grads, table_handle, name=None):
+  r"""allreduce dense gradients among ranks and apply them locally
+
+  Args:
+    vars: A list of at least 1 `Tensor` objects with type `resource`.
+    grads: A list with the same length as `vars` of `Tensor` objects with type `float32`.
+    table_handle: An `int`.
+    name: A name for the operation (optional).
+
+  Returns:
+    The created Operation.
+  """
+  _ctx = _context._context or _context.context()
+  tld = _ctx._thread_local_data
+  if tld.is_eager:
+    try:
+      _result = pywrap_tfe.TFE_Py_FastPathExecute(
+        _ctx._context_handle, tld.device_name, "DenseTableAllReduce", name,
+        tld.op_callbacks, vars, grads, "table_handle", table_handle)
+      return _result
+    except _core._FallbackException:
+      try:
+        return dense_table_all_reduce_eager_fallback(
+            vars, grads, table_handle=table_handle, name=name, ctx=_ctx)
+      except _core._SymbolicException:
+        pass  # Add nodes to the TensorFlow graph.
+      except (TypeError, ValueError):
+        result = _dispatch.dispatch(
+              dense_table_all_reduce, vars=vars, grads=grads,
+                                      table_handle=table_handle, name=name)
+        if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+          return result
+        raise
+    except _core._NotOkStatusException as e:
+      _ops.raise_from_not_ok_status(e, name)
+  # Add nodes to the TensorFlow graph.
+  if not isinstance(vars, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'vars' argument to "
+        "'dense_table_all_reduce' Op, not %r." % vars)
+  _attr_N = len(vars)
+  if not isinstance(grads, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'grads' argument to "
+        "'dense_table_all_reduce' Op, not %r." % grads)
+  if len(grads) != _attr_N:
+    raise ValueError(
+        "List argument 'grads' to 'dense_table_all_reduce' Op with length %d "
+        "must match length %d of argument 'vars'." %
+        (len(grads), _attr_N))
+  table_handle = _execute.make_int(table_handle, "table_handle")
+  try:
+    _, _, _op, _outputs = _op_def_library._apply_op_helper(
+        "DenseTableAllReduce", vars=vars, grads=grads,
+                               table_handle=table_handle, name=name)
+  except (TypeError, ValueError):
+    result = _dispatch.dispatch(
+          dense_table_all_reduce, vars=vars, grads=grads,
+                                  table_handle=table_handle, name=name)
+    if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+      return result
+    raise
+  return _op
+DenseTableAllReduce = tf_export("raw_ops.DenseTableAllReduce")(_ops.to_raw_op(dense_table_all_reduce))
+
+
+def dense_table_all_reduce_eager_fallback(vars, grads, table_handle, name, ctx):
+  if not isinstance(vars, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'vars' argument to "
+        "'dense_table_all_reduce' Op, not %r." % vars)
+  _attr_N = len(vars)
+  if not isinstance(grads, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'grads' argument to "
+        "'dense_table_all_reduce' Op, not %r." % grads)
+  if len(grads) != _attr_N:
+    raise ValueError(
+        "List argument 'grads' to 'dense_table_all_reduce' Op with length %d "
+        "must match length %d of argument 'vars'." %
+        (len(grads), _attr_N))
+  table_handle = _execute.make_int(table_handle, "table_handle")
+  vars = _ops.convert_n_to_tensor(vars, _dtypes.resource)
+  grads = _ops.convert_n_to_tensor(grads, _dtypes.float32)
+  _inputs_flat = list(vars) + list(grads)
+  _attrs = ("table_handle", table_handle, "N", _attr_N)
+  _result = _execute.execute(b"DenseTableAllReduce", 0, inputs=_inputs_flat,
+                             attrs=_attrs, ctx=ctx, name=name)
+  _result = None
+  return _result
+
@@ -126,6 +126,350 @@ def sparse_table_pull_eager_fallback(resources, values, table_handle, name, ctx)
   return _result
 
 
+@_dispatch.add_dispatch_list
+@tf_export('sparse_table_multi_pull')
+def sparse_table_multi_pull(resources, values, table_handles, name=None):
+  r"""pull variables of several tables from parameter server, one rpc
+
+      to every shard for all the tables. table_handles[i] is table of resources[i].
+
+  Args:
+    resources: A list of at least 1 `Tensor` objects with type `resource`.
+    values: A list with the same length as `resources` of `Tensor` objects with type `int64`.
+    table_handles: A list of `ints`.
+    name: A name for the operation (optional).
+
+  Returns:
+    A list with the same length as `resources` of `Tensor` objects with type `int64`.
+  """
+  _ctx = _context._context or _context.context()
+  tld = _ctx._thread_local_data
+  if tld.is_eager:
+    try:
+      _result = pywrap_tfe.TFE_Py_FastPathExecute(
+        _ctx._context_handle, tld.device_name, "SparseTableMultiPull", name,
+        tld.op_callbacks, resources, values, "table_handles", table_handles)
+      return _result
+    except _core._FallbackException:
+      try:
+        return sparse_table_multi_pull_eager_fallback(
+            resources, values, table_handles=table_handles, name=name,
+            ctx=_ctx)
+      except _core._SymbolicException:
+        pass  # Add nodes to the TensorFlow graph.
+      except (TypeError, ValueError):
+        result = _dispatch.dispatch(
+              sparse_table_multi_pull, resources=resources, values=values,
+                                       table_handles=table_handles, name=name)
+        if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+          return result
+        raise
+    except _core._NotOkStatusException as e:
+      _ops.raise_from_not_ok_status(e, name)
+  # Add nodes to the TensorFlow graph.
+  if not isinstance(resources, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'resources' argument to "
+        "'sparse_table_multi_pull' Op, not %r." % resources)
+  _attr_N = len(resources)
+  if not isinstance(values, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'values' argument to "
+        "'sparse_table_multi_pull' Op, not %r." % values)
+  if len(values) != _attr_N:
+    raise ValueError(
+        "List argument 'values' to 'sparse_table_multi_pull' Op with length %d "
+        "must match length %d of argument 'resources'." %
+        (len(values), _attr_N))
+  if not isinstance(table_handles, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'table_handles' argument to "
+        "'sparse_table_multi_pull' Op, not %r." % table_handles)
+  table_handles = [_execute.make_int(_i, "table_handles") for _i in table_handles]
+  try:
+    _, _, _op, _outputs = _op_def_library._apply_op_helper(
+        "SparseTableMultiPull", resources=resources, values=values,
+                                table_handles=table_handles, name=name)
+  except (TypeError, ValueError):
+    result = _dispatch.dispatch(
+          sparse_table_multi_pull, resources=resources, values=values,
+                                   table_handles=table_handles, name=name)
+    if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+      return result
+    raise
+  _result = _outputs[:]
+  if not _result:
+    return _op
+  if _execute.must_record_gradient():
+    _attrs = ("table_handles", _op.get_attr("table_handles"), "N",
+              _op._get_attr_int("N"))
+    _inputs_flat = _op.inputs
+    _execute.record_gradient(
+        "SparseTableMultiPull", _inputs_flat, _attrs, _result)
+  return _result
+
+SparseTableMultiPull = tf_export("raw_ops.SparseTableMultiPull")(_ops.to_raw_op(sparse_table_multi_pull))
+
+
+def sparse_table_multi_pull_eager_fallback(resources, values, table_handles, name, ctx):
+  if not isinstance(resources, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'resources' argument to "
+        "'sparse_table_multi_pull' Op, not %r." % resources)
+  _attr_N = len(resources)
+  if not isinstance(values, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'values' argument to "
+        "'sparse_table_multi_pull' Op, not %r." % values)
+  if len(values) != _attr_N:
+    raise ValueError(
+        "List argument 'values' to 'sparse_table_multi_pull' Op with length %d "
+        "must match length %d of argument 'resources'." %
+        (len(values), _attr_N))
+  if not isinstance(table_handles, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'table_handles' argument to "
+        "'sparse_table_multi_pull' Op, not %r." % table_handles)
+  table_handles = [_execute.make_int(_i, "table_handles") for _i in table_handles]
+  resources = _ops.convert_n_to_tensor(resources, _dtypes.resource)
+  values = _ops.convert_n_to_tensor(values, _dtypes.int64)
+  _inputs_flat = list(resources) + list(values)
+  _attrs = ("table_handles", table_handles, "N", _attr_N)
+  _result = _execute.execute(b"SparseTableMultiPull", _attr_N,
+                             inputs=_inputs_flat, attrs=_attrs, ctx=ctx,
+                             name=name)
+  if _execute.must_record_gradient():
+    _execute.record_gradient(
+        "SparseTableMultiPull", _inputs_flat, _attrs, _result)
+  return _result
+
+
+@_dispatch.add_dispatch_list
+@tf_export('sparse_table_gather')
+def sparse_table_gather(values, segment_ids, num_segments, table_handle, dim, combiner="none", name=None):
+  r"""pull embeddings of values into dense outputs, no variable is needed.
+
+      output i is [values_i size, dim] if combiner is 'none', otherwise embeddings of
+      values are pooled into num_segments_i rows by segment_ids_i.
+
+  Args:
+    values: A list of at least 1 `Tensor` objects with type `int64`.
+    segment_ids: A list with the same length as `values` of `Tensor` objects with type `int64`.
+    num_segments: A list with the same length as `values` of `Tensor` objects with type `int64`.
+    table_handle: An `int`.
+    dim: An `int`.
+    combiner: An optional `string` from: `"none", "sum", "mean", "sqrtn"`. Defaults to `"none"`.
+    name: A name for the operation (optional).
+
+  Returns:
+    A list with the same length as `values` of `Tensor` objects with type `float32`.
+  """
+  _ctx = _context._context or _context.context()
+  tld = _ctx._thread_local_data
+  if tld.is_eager:
+    try:
+      _result = pywrap_tfe.TFE_Py_FastPathExecute(
+        _ctx._context_handle, tld.device_name, "SparseTableGather", name,
+        tld.op_callbacks, values, segment_ids, num_segments, "table_handle",
+        table_handle, "dim", dim, "combiner", combiner)
+      return _result
+    except _core._FallbackException:
+      try:
+        return sparse_table_gather_eager_fallback(
+            values, segment_ids, num_segments, table_handle=table_handle,
+            dim=dim, combiner=combiner, name=name, ctx=_ctx)
+      except _core._SymbolicException:
+        pass  # Add nodes to the TensorFlow graph.
+      except (TypeError, ValueError):
+        result = _dispatch.dispatch(
+              sparse_table_gather, values=values, segment_ids=segment_ids,
+                                   num_segments=num_segments,
+                                   table_handle=table_handle, dim=dim,
+                                   combiner=combiner, name=name)
+        if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+          return result
+        raise
+    except _core._NotOkStatusException as e:
+      _ops.raise_from_not_ok_status(e, name)
+  # Add nodes to the TensorFlow graph.
+  if not isinstance(values, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'values' argument to "
+        "'sparse_table_gather' Op, not %r." % values)
+  _attr_N = len(values)
+  if not isinstance(segment_ids, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'segment_ids' argument to "
+        "'sparse_table_gather' Op, not %r." % segment_ids)
+  if len(segment_ids) != _attr_N:
+    raise ValueError(
+        "List argument 'segment_ids' to 'sparse_table_gather' Op with length %d "
+        "must match length %d of argument 'values'." %
+        (len(segment_ids), _attr_N))
+  if not isinstance(num_segments, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'num_segments' argument to "
+        "'sparse_table_gather' Op, not %r." % num_segments)
+  if len(num_segments) != _attr_N:
+    raise ValueError(
+        "List argument 'num_segments' to 'sparse_table_gather' Op with length %d "
+        "must match length %d of argument 'values'." %
+        (len(num_segments), _attr_N))
+  table_handle = _execute.make_int(table_handle, "table_handle")
+  dim = _execute.make_int(dim, "dim")
+  if combiner is None:
+    combiner = "none"
+  combiner = _execute.make_str(combiner, "combiner")
+  try:
+    _, _, _op, _outputs = _op_def_library._apply_op_helper(
+        "SparseTableGather", values=values, segment_ids=segment_ids,
+                             num_segments=num_segments,
+                             table_handle=table_handle, dim=dim,
+                             combiner=combiner, name=name)
+  except (TypeError, ValueError):
+    result = _dispatch.dispatch(
+          sparse_table_gather, values=values, segment_ids=segment_ids,
+                               num_segments=num_segments,
+                               table_handle=table_handle, dim=dim,
+                               combiner=combiner, name=name)
+    if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+      return result
+    raise
+  _result = _outputs[:]
+  if not _result:
+    return _op
+  if _execute.must_record_gradient():
+    _attrs = ("table_handle", _op._get_attr_int("table_handle"), "dim",
+              _op._get_attr_int("dim"), "combiner", _op.get_attr("combiner"),
+              "N", _op._get_attr_int("N"))
+    _inputs_flat = _op.inputs
+    _execute.record_gradient(
+        "SparseTableGather", _inputs_flat, _attrs, _result)
+  return _result
+
+SparseTableGather = tf_export("raw_ops.SparseTableGather")(_ops.to_raw_op(sparse_table_gather))
+
+
+def sparse_table_gather_eager_fallback(values, segment_ids, num_segments, table_handle, dim, combiner, name, ctx):
+  if not isinstance(values, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'values' argument to "
+        "'sparse_table_gather' Op, not %r." % values)
+  _attr_N = len(values)
+  if not isinstance(segment_ids, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'segment_ids' argument to "
+        "'sparse_table_gather' Op, not %r." % segment_ids)
+  if len(segment_ids) != _attr_N:
+    raise ValueError(
+        "List argument 'segment_ids' to 'sparse_table_gather' Op with length %d "
+        "must match length %d of argument 'values'." %
+        (len(segment_ids), _attr_N))
+  if not isinstance(num_segments, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'num_segments' argument to "
+        "'sparse_table_gather' Op, not %r." % num_segments)
+  if len(num_segments) != _attr_N:
+    raise ValueError(
+        "List argument 'num_segments' to 'sparse_table_gather' Op with length %d "
+        "must match length %d of argument 'values'." %
+        (len(num_segments), _attr_N))
+  table_handle = _execute.make_int(table_handle, "table_handle")
+  dim = _execute.make_int(dim, "dim")
+  if combiner is None:
+    combiner = "none"
+  combiner = _execute.make_str(combiner, "combiner")
+  values = _ops.convert_n_to_tensor(values, _dtypes.int64)
+  segment_ids = _ops.convert_n_to_tensor(segment_ids, _dtypes.int64)
+  num_segments = _ops.convert_n_to_tensor(num_segments, _dtypes.int64)
+  _inputs_flat = list(values) + list(segment_ids) + list(num_segments)
+  _attrs = ("table_handle", table_handle, "dim", dim, "combiner", combiner,
+  "N", _attr_N)
+  _result = _execute.execute(b"SparseTableGather", _attr_N,
+                             inputs=_inputs_flat, attrs=_attrs, ctx=ctx,
+                             name=name)
+  if _execute.must_record_gradient():
+    _execute.record_gradient(
+        "SparseTableGather", _inputs_flat, _attrs, _result)
+  return _result
+
+
+@_dispatch.add_dispatch_list
+@tf_export('sparse_table_prefetch')
+def sparse_table_prefetch(values, table_handle, name=None):
+  r"""pull embeddings of values into worker embedding cache in background,
+
+      the op finish without waiting for rpc. cache of the table must be enabled.
+
+  Args:
+    values: A list of at least 1 `Tensor` objects with type `int64`.
+    table_handle: An `int`.
+    name: A name for the operation (optional).
+
+  Returns:
+    The created Operation.
+  """
+  _ctx = _context._context or _context.context()
+  tld = _ctx._thread_local_data
+  if tld.is_eager:
+    try:
+      _result = pywrap_tfe.TFE_Py_FastPathExecute(
+        _ctx._context_handle, tld.device_name, "SparseTablePrefetch", name,
+        tld.op_callbacks, values, "table_handle", table_handle)
+      return _result
+    except _core._FallbackException:
+      try:
+        return sparse_table_prefetch_eager_fallback(
+            values, table_handle=table_handle, name=name, ctx=_ctx)
+      except _core._SymbolicException:
+        pass  # Add nodes to the TensorFlow graph.
+      except (TypeError, ValueError):
+        result = _dispatch.dispatch(
+              sparse_table_prefetch, values=values, table_handle=table_handle,
+                                     name=name)
+        if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+          return result
+        raise
+    except _core._NotOkStatusException as e:
+      _ops.raise_from_not_ok_status(e, name)
+  # Add nodes to the TensorFlow graph.
+  if not isinstance(values, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'values' argument to "
+        "'sparse_table_prefetch' Op, not %r." % values)
+  _attr_N = len(values)
+  table_handle = _execute.make_int(table_handle, "table_handle")
+  try:
+    _, _, _op, _outputs = _op_def_library._apply_op_helper(
+        "SparseTablePrefetch", values=values, table_handle=table_handle,
+                               name=name)
+  except (TypeError, ValueError):
+    result = _dispatch.dispatch(
+          sparse_table_prefetch, values=values, table_handle=table_handle,
+                                 name=name)
+    if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+      return result
+    raise
+  return _op
+SparseTablePrefetch = tf_export("raw_ops.SparseTablePrefetch")(_ops.to_raw_op(sparse_table_prefetch))
+
+
+def sparse_table_prefetch_eager_fallback(values, table_handle, name, ctx):
+  if not isinstance(values, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'values' argument to "
+        "'sparse_table_prefetch' Op, not %r." % values)
+  _attr_N = len(values)
+  table_handle = _execute.make_int(table_handle, "table_handle")
+  values = _ops.convert_n_to_tensor(values, _dtypes.int64)
+  _inputs_flat = list(values)
+  _attrs = ("table_handle", table_handle, "N", _attr_N)
+  _result = _execute.execute(b"SparseTablePrefetch", 0, inputs=_inputs_flat,
+                             attrs=_attrs, ctx=ctx, name=name)
+  _result = None
+  return _result
+
+
 @_dispatch.add_dispatch_list
 @tf_export('sparse_table_push')
 def sparse_table_push(values, grads, table_handle, name=None):
@@ -219,3 +563,131 @@ def sparse_table_push_eager_fallback(values, grads, table_handle, name, ctx):
   _result = None
   return _result
 
+@_dispatch.add_dispatch_list
+@tf_export('sparse_table_gather_push')
+def sparse_table_gather_push(values, segment_ids, grads, table_handle, combiner="none", name=None):
+  r"""push gradients of SparseTableGather outputs, values, segment_ids and
+
+      combiner must be the same as the gather.
+
+  Args:
+    values: A list of at least 1 `Tensor` objects with type `int64`.
+    segment_ids: A list with the same length as `values` of `Tensor` objects with type `int64`.
+    grads: A list with the same length as `values` of `Tensor` objects with type `float32`.
+    table_handle: An `int`.
+    combiner: An optional `string` from: `"none", "sum", "mean", "sqrtn"`. Defaults to `"none"`.
+    name: A name for the operation (optional).
+
+  Returns:
+    The created Operation.
+  """
+  _ctx = _context._context or _context.context()
+  tld = _ctx._thread_local_data
+  if tld.is_eager:
+    try:
+      _result = pywrap_tfe.TFE_Py_FastPathExecute(
+        _ctx._context_handle, tld.device_name, "SparseTableGatherPush", name,
+        tld.op_callbacks, values, segment_ids, grads, "table_handle",
+        table_handle, "combiner", combiner)
+      return _result
+    except _core._FallbackException:
+      try:
+        return sparse_table_gather_push_eager_fallback(
+            values, segment_ids, grads, table_handle=table_handle,
+            combiner=combiner, name=name, ctx=_ctx)
+      except _core._SymbolicException:
+        pass  # Add nodes to the TensorFlow graph.
+      except (TypeError, ValueError):
+        result = _dispatch.dispatch(
+              sparse_table_gather_push, values=values,
+                                        segment_ids=segment_ids, grads=grads,
+                                        table_handle=table_handle,
+                                        combiner=combiner, name=name)
+        if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+          return result
+        raise
+    except _core._NotOkStatusException as e:
+      _ops.raise_from_not_ok_status(e, name)
+  # Add nodes to the TensorFlow graph.
+  if not isinstance(values, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'values' argument to "
+        "'sparse_table_gather_push' Op, not %r." % values)
+  _attr_N = len(values)
+  if not isinstance(segment_ids, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'segment_ids' argument to "
+        "'sparse_table_gather_push' Op, not %r." % segment_ids)
+  if len(segment_ids) != _attr_N:
+    raise ValueError(
+        "List argument 'segment_ids' to 'sparse_table_gather_push' Op with length %d "
+        "must match length %d of argument 'values'." %
+        (len(segment_ids), _attr_N))
+  if not isinstance(grads, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'grads' argument to "
+        "'sparse_table_gather_push' Op, not %r." % grads)
+  if len(grads) != _attr_N:
+    raise ValueError(
+        "List argument 'grads' to 'sparse_table_gather_push' Op with length %d "
+        "must match length %d of argument 'values'." %
+        (len(grads), _attr_N))
+  table_handle = _execute.make_int(table_handle, "table_handle")
+  if combiner is None:
+    combiner = "none"
+  combiner = _execute.make_str(combiner, "combiner")
+  try:
+    _, _, _op, _outputs = _op_def_library._apply_op_helper(
+        "SparseTableGatherPush", values=values, segment_ids=segment_ids,
+                                 grads=grads, table_handle=table_handle,
+                                 combiner=combiner, name=name)
+  except (TypeError, ValueError):
+    result = _dispatch.dispatch(
+          sparse_table_gather_push, values=values, segment_ids=segment_ids,
+                                    grads=grads, table_handle=table_handle,
+                                    combiner=combiner, name=name)
+    if result is not _dispatch.OpDispatcher.NOT_SUPPORTED:
+      return result
+    raise
+  return _op
+SparseTableGatherPush = tf_export("raw_ops.SparseTableGatherPush")(_ops.to_raw_op(sparse_table_gather_push))
+
+
+def sparse_table_gather_push_eager_fallback(values, segment_ids, grads, table_handle, combiner, name, ctx):
+  if not isinstance(values, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'values' argument to "
+        "'sparse_table_gather_push' Op, not %r." % values)
+  _attr_N = len(values)
+  if not isinstance(segment_ids, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'segment_ids' argument to "
+        "'sparse_table_gather_push' Op, not %r." % segment_ids)
+  if len(segment_ids) != _attr_N:
+    raise ValueError(
+        "List argument 'segment_ids' to 'sparse_table_gather_push' Op with length %d "
+        "must match length %d of argument 'values'." %
+        (len(segment_ids), _attr_N))
+  if not isinstance(grads, (list, tuple)):
+    raise TypeError(
+        "Expected list for 'grads' argument to "
+        "'sparse_table_gather_push' Op, not %r." % grads)
+  if len(grads) != _attr_N:
+    raise ValueError(
+        "List argument 'grads' to 'sparse_table_gather_push' Op with length %d "
+        "must match length %d of argument 'values'." %
+        (len(grads), _attr_N))
+  table_handle = _execute.make_int(table_handle, "table_handle")
+  if combiner is None:
+    combiner = "none"
+  combiner = _execute.make_str(combiner, "combiner")
+  values = _ops.convert_n_to_tensor(values, _dtypes.int64)
+  segment_ids = _ops.convert_n_to_tensor(segment_ids, _dtypes.int64)
+  grads = _ops.convert_n_to_tensor(grads, _dtypes.float32)
+  _inputs_flat = list(values) + list(segment_ids) + list(grads)
+  _attrs = ("table_handle", table_handle, "combiner", combiner, "N", _attr_N)
+  _result = _execute.execute(b"SparseTableGatherPush", 0, inputs=_inputs_flat,
+                             attrs=_attrs, ctx=ctx, name=name)
+  _result = None
+  return _result
+
@@ -24,6 +24,7 @@ from tensorflow.python.ops import control_flow_ops
 from tensorflow.python.ops import gen_io_ops
 from tensorflow.python.ops import math_ops
 from tensorflow.python.ops import string_ops
+from tensorflow.python.util import nest
 
 
 def list_files(datapath, days, match_pattern):
@@ -56,15 +57,45 @@ def list_files(datapath, days, match_pattern):
 
 class BalanceDataset(dataset_ops.UnaryDataset):
     """A `Dataset` that balance input data between other cocurrent ops
+
+    Args:
+        input_dataset: dataset to balance.
+        buffer_size: max elements buffered for other ranks, rounded up to power of two.
+        compress: codec of elements pulled from other ranks, one of `none`, `snappy`
+            and `gzip`.
     """
-    def __init__(self, input_dataset):
+    def __init__(self, input_dataset, buffer_size=100, compress="snappy"):
         self._input_dataset = input_dataset
         self._structure = input_dataset.element_spec
         variant_tensor = gen_balance_dataset_ops.balance_dataset(
             input_dataset._variant_tensor,
+            buffer_size=buffer_size,
+            compress=compress,
             **self._flat_structure)
         super(BalanceDataset, self).__init__(input_dataset, variant_tensor)
 
     @property
     def element_spec(self):
         return self._structure
+
+
+def prefetch_embeddings(dataset, layers):
+    """prefetch embeddings of every element for `layers` when it pass through the
+    input pipeline. follow it with `dataset.prefetch()` so that the next batch is
+    pulled into worker embedding cache while the current batch is computing. the
+    staleness of prefetched embeddings is bounded by table option `cache_staleness`.
+
+    Args:
+        dataset: elements are `features` or tuple whose first item is `features`.
+        layers: list of `tn.layers.EmbeddingFeatures`.
+    """
+    def _prefetch(*element):
+        features = element[0]
+        prefetch_ops = [layer.prefetch(features) for layer in layers]
+
+        with ops.control_dependencies(prefetch_ops):
+            element = nest.map_structure(array_ops.identity, element, expand_composites=True)
+
+        return element if len(element) > 1 else element[0]
+
+    return dataset.map(_prefetch)
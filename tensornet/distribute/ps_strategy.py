@@ -24,16 +24,42 @@ from tensorflow.python.distribute.one_device_strategy import OneDeviceStrategy,
 
 class PsStrategy(OneDeviceStrategy):
     """
+    Args:
+        rpc_options: rpc behaviour of parameter servers, all optional.
+            rpc_timeout_ms: deadline of one rpc attempt. (default 60000)
+            rpc_max_retry: retries before the job aborts. (default 3)
+            rpc_backoff_base_ms, rpc_backoff_max_ms: retry n waits a random time
+                up to min(base * 2^n, max). (default 100, 5000)
+            rpc_backup_request_ms: send a backup sparse pull if there is no
+                response in this time, disabled when not positive. (default 0)
+            rpc_connection_type: single, pooled or short. (default single)
+            rpc_channels_per_server: channels with own connections to every
+                server. (default 1)
+            rpc_transport: tcp or rdma, rdma needs tensornet built with
+                --config=rdma. (default tcp)
+            rpc_warmup_concurrency: servers connected at the same time by init
+                before the first step, disabled when not positive. (default 64)
+            server_num_threads: pthreads running bthreads of the server and rpc
+                callbacks, brpc default when not positive. (default 0)
+            server_max_concurrency: requests processed by the server at the same
+                time, unlimited when not positive. (default 0)
+            ps_cpus: cpus bthread workers and io threads are bound to, like
+                "0-7,16-23". keep tensorflow off them with taskset or
+                intra_op/inter_op threads of tf.config.threading. (default "")
+            ps_numa_node: bind ps threads to cpus of this numa node when ps_cpus
+                is empty, not bound when negative. (default -1)
+            io_threads: threads shared by save, load and show decay of all
+                tables. (default 16)
     """
-    def __init__(self):
-        super(OneDeviceStrategy, self).__init__(PsExtend(self))
+    def __init__(self, **rpc_options):
+        super(OneDeviceStrategy, self).__init__(PsExtend(self, **rpc_options))
 
 
 class PsExtend(OneDeviceExtended):
     """
     """
-    def __init__(self, container_strategy):
-        tn.core.init()
+    def __init__(self, container_strategy, **rpc_options):
+        tn.core.init(**rpc_options)
 
         super(PsExtend, self).__init__(container_strategy, "/cpu:0")
 
@@ -12,4 +12,4 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from .embedding_features import EmbeddingFeatures
\ No newline at end of file
+from .embedding_features import EmbeddingFeatures, fused_pull
\ No newline at end of file
@@ -35,10 +35,16 @@ from tensorflow.python.util import serialization
 class StateManagerImpl(fc.StateManager):
     """
     """
-    def __init__(self, layer, sparse_opt, dimension, trainable):
+    def __init__(self, layer, sparse_opt, dimension, trainable, table_options=None,
+                 extra_dims=None):
         self._trainable = trainable
         self._layer = layer
-        self.sparse_table_handle = tn.core.create_sparse_table(sparse_opt, dimension)
+        self.dimension = dimension
+        table_options = dict(table_options or {})
+        if extra_dims:
+            table_options['extra_dims'] = list(extra_dims)
+        self.sparse_table_handle = tn.core.create_sparse_table(sparse_opt, dimension,
+                                                               **table_options)
         self.pulled_mapping_values = {}
 
         if self._layer is not None and not hasattr(self._layer, '_resources'):
@@ -84,7 +90,7 @@ class StateManagerImpl(fc.StateManager):
 
         return self._cols_to_var_map[column_name]
 
-    def pull(self, features):
+    def pull_inputs(self, features):
         vars = []
         feature_values = []
 
@@ -98,11 +104,19 @@ class StateManagerImpl(fc.StateManager):
             vars.append(self._cols_to_var_map[column_name])
             feature_values.append(sparse_feature)
 
+        return vars, feature_values
+
+    def pull(self, features):
+        vars, feature_values = self.pull_inputs(features)
+
         pulled_mapping_values = gen_sparse_table_ops.sparse_table_pull(
                                                 [var.handle for var in vars],
                                                 [f.values for f in feature_values],
                                                 table_handle=self.sparse_table_handle)
 
+        return self.set_pulled_mapping_values(vars, pulled_mapping_values)
+
+    def set_pulled_mapping_values(self, vars, pulled_mapping_values):
         assert len(pulled_mapping_values) == len(vars)
 
         for var, mapping_value in zip(vars, pulled_mapping_values):
@@ -142,18 +156,66 @@ class StateManagerImpl(fc.StateManager):
         return gen_sparse_table_ops.sparse_table_push(feature_values, grads,
                                                       table_handle=self.sparse_table_handle)
 
+    def gather_inputs(self, features):
+        feature_values = []
+        segment_ids = []
+        num_segments = []
+
+        for column_name, sparse_feature in features.items():
+            if not isinstance(sparse_feature, sparse_tensor_lib.SparseTensor):
+                raise ValueError('sparse_feature input must be a SparseTensor.')
+
+            feature_values.append(sparse_feature.values)
+            segment_ids.append(sparse_feature.indices[:, 0])
+            num_segments.append(sparse_feature.dense_shape[0])
+
+        return feature_values, segment_ids, num_segments
+
+    def gather(self, features, combiner):
+        """pull embeddings of features straight into dense tensors, pooled into rows of
+        the batch by combiner or one row per value if combiner is 'none'.
+        """
+        feature_values, segment_ids, num_segments = self.gather_inputs(features)
+
+        embeddings = gen_sparse_table_ops.sparse_table_gather(
+                                            feature_values, segment_ids, num_segments,
+                                            table_handle=self.sparse_table_handle,
+                                            dim=self.dimension, combiner=combiner)
+
+        return collections.OrderedDict(zip(features.keys(), embeddings))
+
+    def push_gathered(self, grads, features, combiner):
+        feature_values, segment_ids, _ = self.gather_inputs(features)
+
+        assert len(grads) == len(feature_values)
+
+        return gen_sparse_table_ops.sparse_table_gather_push(
+                                            feature_values, segment_ids, grads,
+                                            table_handle=self.sparse_table_handle,
+                                            combiner=combiner)
+
     def get_feature_mapping_values(self, column_name):
         return self.pulled_mapping_values[column_name]
 
-    def save_sparse_table(self, filepath):
-        return tn.core.save_sparse_table(self.sparse_table_handle, filepath)
+    def save_sparse_table(self, filepath, binary=False, delta=False):
+        return tn.core.save_sparse_table(self.sparse_table_handle, filepath, binary, delta)
 
-    def load_sparse_table(self, filepath):
-        return tn.core.load_sparse_table(self.sparse_table_handle, filepath)
+    def load_sparse_table(self, filepath, lazy=False):
+        return tn.core.load_sparse_table(self.sparse_table_handle, filepath, lazy)
 
     def show_decay(self):
         return tn.core.show_decay(self.sparse_table_handle)
 
+    def evict(self, **kwargs):
+        return tn.core.evict(self.sparse_table_handle, **kwargs)
+
+    def spill(self, **kwargs):
+        return tn.core.spill(self.sparse_table_handle, **kwargs)
+
+    def export_sparse_table(self, filepath, weight_type="float", show_threshold=0, delta=False):
+        return tn.core.export_sparse_table(self.sparse_table_handle, filepath,
+                                           weight_type, show_threshold, delta)
+
 
 class EmbeddingFeatures(Layer):
     """
@@ -164,6 +226,8 @@ class EmbeddingFeatures(Layer):
                  trainable=True,
                  name=None,
                  is_concat=False,
+                 table_options=None,
+                 fused_gather=False,
                  **kwargs):
         """create a embedding feature layer.
         when this layer is been called, all the embedding data of `feature_columns` will be
@@ -179,6 +243,49 @@ class EmbeddingFeatures(Layer):
             name: Name to give to the EmbeddingFeatures.
             is_concat: when this parameter is True, all the tensor of pulled will be concat
                 with axis=-1 and returned.
+            table_options: dict of options pass to the sparse table when create, e.g.
+                `{'block_num': 16}` set the lock block number of each table shard, more
+                blocks means less lock contention between pull and push threads.
+                `{'weight_type': 'bf16'}` store weights in 16 bit floats, optimizer state
+                stays float. one of 'float', 'fp16' and 'bf16', default is 'float'.
+                `{'capacity': 100000000}` expected key count of the whole table, hash maps
+                of table shards are sized for it at creation. tables start small and grow
+                incrementally without it. loading a model sizes them from the model.
+                `{'io_threads': 32}` threads of every table shard to save and load model
+                files, default is 16.
+                `{'cold_dir': '/ssd/tensornet'}` local directory of the cold tier, keys
+                moved there by `spill` stay out of memory until pulled again.
+                `{'weight_rows': True}` keep a float copy of weights in rows apart from
+                optimizer state, pull reads less memory at the cost of dim floats per key.
+                `{'admit_shows': 3}` a key is only created when it has been pushed in 3
+                batches, counted approximately in `admit_sketch_width` counters per row
+                of every block. keys not created yet are pulled as zeros and their
+                gradients are dropped. counts decay with `show_decay`. disabled by default.
+                `{'pull_encoding': 'fp16', 'push_encoding': 'bf16'}` encoding of pulled
+                embeddings and pushed gradients between workers and ps, same choices as
+                `weight_type`.
+                `{'delta_signs': True}` send sorted and delta coded signs, which are smaller.
+                `{'grad_threshold': 1e-6}` do not push gradient rows whose elements are all
+                less than threshold in absolute value, shows of them are dropped too.
+                `{'cache_staleness': 2, 'cache_capacity': 1000000}` cache pulled embeddings
+                on worker, a cached embedding is used until it missed `cache_staleness`
+                pushes, at most `cache_capacity` embeddings are cached. disabled by default.
+                `{'hot_key_num': 1000, 'hot_push_interval': 4}` every ps shard detect its
+                `hot_key_num` most pulled signs, workers sum gradients of them locally and
+                push once every `hot_push_interval` steps. disabled by default.
+                `{'stream_interval_ms': 1000}` every ps shard collect weights of updated
+                keys every `stream_interval_ms` and keep them for serving subscribers,
+                at most `stream_max_keys_per_second` keys per second and the latest
+                `stream_max_batches` batches. disabled by default.
+            fused_gather: when this parameter is True, pulled embeddings are written
+                straight into the pooled outputs of columns, no embedding variable is
+                created. all columns must have the same combiner and dimension.
+                gradients of outputs are pushed by `backwards`, `fused_pull` can not be
+                used.
+
+        columns may have different dimensions, they share one sparse table whose every
+        dimension is kept apart on ps, pull and push of all of them send one rpc to
+        every ps shard. `prefetch` only covers columns of the first dimension.
 
         """
         super(EmbeddingFeatures, self).__init__(
@@ -187,13 +294,18 @@ class EmbeddingFeatures(Layer):
         assert len(feature_columns) != 0, "feature_columns must not empty"
 
         dim = feature_columns[0].dimension
+        extra_dims = []
         for feature_column in feature_columns:
-            assert feature_column.dimension == dim, "currently we only support feature_columns with same dimension in EmbeddingFeatures"
+            if feature_column.dimension != dim and feature_column.dimension not in extra_dims:
+                extra_dims.append(feature_column.dimension)
 
         self._feature_columns = feature_columns
-        self._state_manager = StateManagerImpl(self, sparse_opt, dim, self.trainable)  # pylint: disable=protected-access
+        self._state_manager = StateManagerImpl(self, sparse_opt, dim, self.trainable,
+                                               table_options, extra_dims)  # pylint: disable=protected-access
         self.sparse_pulling_features = None
         self.is_concat = is_concat
+        self.fused_gather = fused_gather
+        self.gathered_outputs = None
 
         for column in self._feature_columns:
             if not isinstance(column, fc.EmbeddingColumn):
@@ -201,14 +313,24 @@ class EmbeddingFeatures(Layer):
                     'Items of feature_columns must be a {}. '
                     'Given: {}'.format(fc.EmbeddingColumn, column))
 
+        self.combiner = self._feature_columns[0].combiner
+        if self.fused_gather:
+            for column in self._feature_columns:
+                assert column.combiner == self.combiner, "fused_gather need all feature_columns with same combiner"
+            assert not extra_dims, "fused_gather need all feature_columns with same dimension"
+
     def build(self, input_shapes):
-        for column in self._feature_columns:
-            with ops.name_scope(column.name):
-                column.create_state(self._state_manager)
+        if not self.fused_gather:
+            for column in self._feature_columns:
+                with ops.name_scope(column.name):
+                    column.create_state(self._state_manager)
 
         super(EmbeddingFeatures, self).build(None)
 
-    def call(self, features, cols_to_output_tensors=None):
+    def call(self, features, cols_to_output_tensors=None, pulled_mapping_values=None):
+        """pulled_mapping_values: pulled by `fused_pull()` if not None, pulling of this
+        layer is skipped.
+        """
         if not isinstance(features, dict):
             raise ValueError('We expected a dictionary here. Instead we got: ',
                              features)
@@ -218,7 +340,11 @@ class EmbeddingFeatures(Layer):
 
         self.sparse_pulling_features = self.get_sparse_pulling_feature(using_features)
 
-        pulled_mapping_values = self._state_manager.pull(self.sparse_pulling_features)
+        if self.fused_gather:
+            return self.call_gathered(cols_to_output_tensors)
+
+        if pulled_mapping_values is None:
+            pulled_mapping_values = self._state_manager.pull(self.sparse_pulling_features)
 
         output_tensors = []
         for column in self._feature_columns:
@@ -242,11 +368,79 @@ class EmbeddingFeatures(Layer):
         else:
             return output_tensors
 
+    def call_gathered(self, cols_to_output_tensors=None):
+        gathered = self._state_manager.gather(self.sparse_pulling_features, self.combiner)
+        self.gathered_outputs = list(gathered.values())
+
+        output_tensors = []
+        for column in self._feature_columns:
+            if column.categorical_column.name not in gathered:
+                raise ValueError("column not found in sparse features")
+
+            tensor = gathered[column.categorical_column.name]
+            processed_tensors = self._process_dense_tensor(column, tensor)
+
+            if cols_to_output_tensors is not None:
+                cols_to_output_tensors[column] = processed_tensors
+
+            output_tensors.append(processed_tensors)
+
+        if self.is_concat:
+            return self._verify_and_concat_tensors(output_tensors)
+        else:
+            return output_tensors
+
     def backwards(self, grads_and_vars):
         assert self.sparse_pulling_features
 
+        if self.fused_gather:
+            return self.backwards_gathered(grads_and_vars)
+
         return self._state_manager.push(grads_and_vars, self.sparse_pulling_features)
 
+    def backwards_gathered(self, grads_and_outputs):
+        """grads_and_outputs must have gradients of `gathered_outputs`, an output
+        without gradient is pushed with zeros.
+        """
+        assert self.gathered_outputs
+
+        output_grads = {output.ref(): grad for grad, output in grads_and_outputs}
+
+        grads = []
+        for output in self.gathered_outputs:
+            grad = output_grads.get(output.ref())
+            if grad is None:
+                grad = array_ops.zeros_like(output)
+
+            grads.append(ops.convert_to_tensor(grad))
+
+        return self._state_manager.push_gathered(grads, self.sparse_pulling_features,
+                                                 self.combiner)
+
+    def pull_inputs(self, features):
+        using_features = self.filter_not_used_features(features)
+        return self._state_manager.pull_inputs(self.get_sparse_pulling_feature(using_features))
+
+    def set_pulled_mapping_values(self, vars, pulled_mapping_values):
+        return self._state_manager.set_pulled_mapping_values(vars, pulled_mapping_values)
+
+    def prefetch(self, features):
+        """pull embeddings of features into worker embedding cache in background so
+        that the pulling of next batch overlap with computing of current batch, the
+        `cache_staleness` table option must be set. return the prefetch op.
+        """
+        using_features = self.filter_not_used_features(features)
+        sparse_features = self.get_sparse_pulling_feature(using_features)
+
+        dim = self._state_manager.dimension
+        for column in self._feature_columns:
+            if column.dimension != dim:
+                sparse_features.pop(column.categorical_column.name, None)
+
+        return gen_sparse_table_ops.sparse_table_prefetch(
+                    [f.values for f in sparse_features.values()],
+                    table_handle=self._state_manager.sparse_table_handle)
+
     def filter_not_used_features(self, features):
         new_features = {}
         for column in self._feature_columns:
@@ -264,15 +458,60 @@ class EmbeddingFeatures(Layer):
 
         return new_features
 
-    def save_sparse_table(self, filepath):
-        return self._state_manager.save_sparse_table(filepath)
+    def save_sparse_table(self, filepath, binary=False, delta=False):
+        """save sparse table to filepath.
+
+        Args:
+            binary: save in packed binary format when True, which is much faster than the
+                default gzip'd text format. loading detect the format automatically.
+            delta: only save keys updated since last save, must be binary format.
+                load the base checkpoint then all the deltas in order to restore.
+        """
+        return self._state_manager.save_sparse_table(filepath, binary, delta)
 
-    def load_sparse_table(self, filepath):
-        return self._state_manager.load_sparse_table(filepath)
+    def load_sparse_table(self, filepath, lazy=False):
+        """
+        Args:
+            lazy: return at once and read the checkpoint in background, pull and push
+                of keys not read yet wait for them. only binary checkpoints saved
+                with same sparse block number are loaded lazily, others are loaded
+                before return.
+        """
+        return self._state_manager.load_sparse_table(filepath, lazy)
 
     def show_decay(self):
         return self._state_manager.show_decay()
 
+    def evict(self, show_threshold=0, ttl_days=0):
+        """remove sparse keys whose decayed show less than show_threshold or not
+        updated in ttl_days from the local shard, a condition is disabled if not
+        positive. return count of evicted keys.
+        """
+        return self._state_manager.evict(show_threshold=float(show_threshold),
+                                         ttl_days=int(ttl_days))
+
+    def spill(self, show_threshold=0, idle_days=0):
+        """move sparse keys whose decayed show less than show_threshold or not updated
+        in idle_days from memory to the cold tier on local disk, they are read back
+        when pulled again. only works for tables created with `cold_dir`, return count
+        of spilled keys.
+        """
+        return self._state_manager.spill(show_threshold=float(show_threshold),
+                                         idle_days=int(idle_days))
+
+    def export_sparse_table(self, filepath, weight_type="float", show_threshold=0, delta=False):
+        """export weights of sparse table to filepath/serving/<table_handle>/shard_<rank>
+        for the serving embedding store, optimizer state is not written.
+
+        Args:
+            weight_type: "float", "fp16" or "int8". int8 keeps one float scale per key.
+            show_threshold: keys whose decayed show less than it are not exported.
+            delta: only export keys updated since last export of this process, serving
+                merges it into the snapshot it is serving.
+        """
+        return self._state_manager.export_sparse_table(filepath, weight_type,
+                                                       float(show_threshold), bool(delta))
+
     def _target_shape(self, input_shape, total_elements):
         return (input_shape[0], total_elements)
 
@@ -330,3 +569,43 @@ class EmbeddingFeatures(Layer):
         metadata['_is_feature_layer'] = True
         return json.dumps(metadata, default=serialization.get_json_type)
 
+
+def fused_pull(layers, features):
+    """pull embeddings of several EmbeddingFeatures layers in one op, which send one rpc
+    to every ps shard for all the sparse tables instead of one rpc per table.
+
+    layers must have been built. returns pulled mapping values of every layer, call
+    the layers with them to skip their own pulling, e.g.
+
+        values = fused_pull([layer_a, layer_b], features)
+        emb_a = layer_a(features, pulled_mapping_values=values[0])
+        emb_b = layer_b(features, pulled_mapping_values=values[1])
+    """
+    all_vars = []
+    all_values = []
+    table_handles = []
+    var_counts = []
+
+    for layer in layers:
+        assert layer.built, "layer must be built before fused_pull"
+        assert not layer.fused_gather, "fused_gather layer can not be pulled by fused_pull"
+
+        vars, feature_values = layer.pull_inputs(features)
+        all_vars.extend(vars)
+        all_values.extend(feature_values)
+        table_handles.extend([layer._state_manager.sparse_table_handle] * len(vars))
+        var_counts.append(len(vars))
+
+    pulled = gen_sparse_table_ops.sparse_table_multi_pull(
+                                    [var.handle for var in all_vars],
+                                    [f.values for f in all_values],
+                                    table_handles=table_handles)
+
+    results = []
+    begin = 0
+    for layer, count in zip(layers, var_counts):
+        end = begin + count
+        results.append(layer.set_pulled_mapping_values(all_vars[begin:end], pulled[begin:end]))
+        begin = end
+
+    return results
@@ -35,12 +35,18 @@ def load_done_info(cp_dir):
         return
 
 
-def save_done_info(cp_dir, dt):
+def save_done_info(cp_dir, dt, base_dt=None, delta_dts=None):
     done_file = os.path.join(cp_dir, '_checkpoint')
     done_info = {
         "dt": dt,
     }
 
+    # sparse table of dt is a delta checkpoint, base_dt hold the full sparse table
+    # and delta_dts must be replayed by order after it.
+    if delta_dts:
+        done_info["base_dt"] = base_dt
+        done_info["delta_dts"] = delta_dts
+
     if tf.io.gfile.exists(done_file):
         tf.io.gfile.remove(done_file)
 
@@ -56,6 +62,21 @@ def read_last_train_dt(filepath):
     return done_info['dt']
 
 
+def read_sparse_dts(filepath):
+    """return the dt list of sparse checkpoint need to be loaded by order,
+    the first one is a full checkpoint and others are deltas.
+    """
+    done_info = load_done_info(filepath)
+
+    if not done_info or 'dt' not in done_info:
+        return []
+
+    if 'base_dt' not in done_info:
+        return [done_info['dt']]
+
+    return [done_info['base_dt']] + done_info['delta_dts']
+
+
 class Model(tf.keras.Model):
     def __init__(self, *args, **kwargs):
         super(Model, self).__init__(*args, **kwargs)
@@ -64,6 +85,9 @@ class Model(tf.keras.Model):
         # when model.fit() is called multiple times through multi days training
         self.is_loaded_from_checkpoint = False
 
+        # a delta checkpoint does not record evicted keys, next save must be full
+        self._evicted_since_save = False
+
         self._backward_count = self.add_weight(
             "backward_count",
             shape=[],
@@ -94,10 +118,19 @@ class Model(tf.keras.Model):
             loss = self.compiled_loss(
                 y, y_pred, sample_weight, regularization_losses=self.losses)
 
-        gradients = tape.gradient(loss, self.trainable_variables)
-        self.optimizer.apply_gradients(zip(gradients, self.trainable_variables))
+        # outputs of fused_gather layers have no variable, their gradients are pushed
+        # by backwards
+        trainable_variables = self.trainable_variables
+        gathered_outputs = self.gathered_outputs()
 
-        self.backwards(list(zip(gradients, self.trainable_variables)))
+        gradients = tape.gradient(loss, trainable_variables + gathered_outputs)
+        gathered_grads = gradients[len(trainable_variables):]
+        gradients = gradients[:len(trainable_variables)]
+
+        self.optimizer.apply_gradients(zip(gradients, trainable_variables))
+
+        self.backwards(list(zip(gradients, trainable_variables))
+                       + list(zip(gathered_grads, gathered_outputs)))
 
         self.compiled_metrics.update_state(y, y_pred, sample_weight)
         return {m.name: m.result() for m in self.metrics}
@@ -112,6 +145,14 @@ class Model(tf.keras.Model):
 
         return y, y_pred, sample_weight
 
+    def gathered_outputs(self):
+        outputs = []
+
+        for layer in self.layers:
+            outputs.extend(getattr(layer, 'gathered_outputs', None) or [])
+
+        return outputs
+
     def backwards(self, grads_and_vars):
         backward_ops = []
 
@@ -129,16 +170,38 @@ class Model(tf.keras.Model):
 
         return
 
-    def save_weights(self, filepath, overwrite=True, save_format=None, dt="", root=True):
+    def save_weights(self, filepath, overwrite=True, save_format=None, dt="", root=True, mode="full",
+                     binary=False, max_deltas=7):
+        """save model weights to filepath/dt.
+
+        Args:
+            mode: "full" or "delta". when "delta" only the sparse keys updated since last
+                save are written, dense weights are always saved fully. a full save is done
+                instead if there is no full checkpoint saved before in filepath, if keys
+                are evicted since last save, or if max_deltas deltas follow the last full
+                checkpoint already.
+            binary: save sparse tables in packed binary format instead of gzip'd text,
+                much faster to save and load. delta saves are always binary.
+        """
+        assert mode in ("full", "delta"), "save mode must be full or delta"
+
+        sparse_dts = read_sparse_dts(filepath)
+        # a delta can not overwrite any checkpoint it based on, nor remove keys of them.
+        # the chain is bounded so that loading does not replay too many deltas
+        if mode == "delta" and (not sparse_dts or dt in sparse_dts or self._evicted_since_save
+                                or len(sparse_dts) > max_deltas):
+            mode = "full"
+
         cp_dir = os.path.join(filepath, dt)
         # sparse weight
         for layer in self.layers:
             assert type(layer) != tf.keras.Model, "not support direct use keras.Model, use tn.model.Model instead"
 
             if isinstance(layer, type(self)):
-                layer.save_weights(filepath, overwrite, save_format, dt, False)
+                layer.save_weights(filepath, overwrite, save_format, dt, False, mode, binary, max_deltas)
             elif isinstance(layer, tn.layers.EmbeddingFeatures):
-                layer.save_sparse_table(cp_dir)
+                layer.save_sparse_table(cp_dir, binary=(binary or mode == "delta"),
+                                        delta=(mode == "delta"))
 
         if self.optimizer:
             self.optimizer.save_dense_table(cp_dir)
@@ -153,11 +216,21 @@ class Model(tf.keras.Model):
             tf_cp_file = os.path.join(cp_dir, "tf_checkpoint")
             super(Model, self).save_weights(tf_cp_file, overwrite, save_format='tf')
 
-            save_done_info(filepath, dt)
+            if mode == "delta":
+                save_done_info(filepath, dt, sparse_dts[0], sparse_dts[1:] + [dt])
+            else:
+                save_done_info(filepath, dt)
 
         self.is_loaded_from_checkpoint = True
+        self._evicted_since_save = False
 
-    def load_weights(self, filepath, by_name=False, skip_mismatch=False, root=True):
+    def load_weights(self, filepath, by_name=False, skip_mismatch=False, root=True, lazy_sparse=False):
+        """
+        Args:
+            lazy_sparse: start training before sparse tables are loaded, keys are read
+                in background or when they are first pulled. see
+                EmbeddingFeatures.load_sparse_table.
+        """
         last_train_dt = read_last_train_dt(filepath)
 
         # not saved model info found
@@ -165,6 +238,7 @@ class Model(tf.keras.Model):
             return
 
         cp_dir = os.path.join(filepath, last_train_dt)
+        sparse_dts = read_sparse_dts(filepath)
 
         if not self.is_loaded_from_checkpoint:
             # sparse weight
@@ -172,9 +246,11 @@ class Model(tf.keras.Model):
                 assert type(layer) != tf.keras.Model, "not support direct use keras.Model, use tn.model.Model instead"
 
                 if isinstance(layer, type(self)):
-                    layer.load_weights(filepath, by_name, skip_mismatch, False)
+                    layer.load_weights(filepath, by_name, skip_mismatch, False, lazy_sparse)
                 elif isinstance(layer, tn.layers.EmbeddingFeatures):
-                    layer.load_sparse_table(cp_dir)
+                    # full checkpoint first, then replay deltas
+                    for sparse_dt in sparse_dts:
+                        layer.load_sparse_table(os.path.join(filepath, sparse_dt), lazy_sparse)
 
             # dense weight
             if self.optimizer:
@@ -186,6 +262,36 @@ class Model(tf.keras.Model):
             tf_cp_file = os.path.join(cp_dir, "tf_checkpoint")
             super(Model, self).load_weights(tf_cp_file, by_name, skip_mismatch)
 
+    def export(self, filepath, dt="", weight_type="float", show_threshold=0, delta=False, root=True):
+        """export weights for serving to filepath/dt, weights of sparse tables are under
+        serving/ in layout of the serving embedding store, optimizer state is never
+        written. dense weights are the tf variables, which hold no optimizer state
+        either, they are saved by the first node as tf checkpoint `tf_weights`.
+
+        Args:
+            weight_type: "float", "fp16" or "int8", quantization of sparse weights.
+            show_threshold: sparse keys whose decayed show less than it are pruned.
+            delta: only export sparse keys updated since last export, see
+                EmbeddingFeatures.export_sparse_table.
+        """
+        assert weight_type in ("float", "fp16", "int8"), "weight_type must be float, fp16 or int8"
+
+        export_dir = os.path.join(filepath, dt)
+        exported = 0
+        for layer in self.layers:
+            assert type(layer) != tf.keras.Model, "not support direct use keras.Model, use tn.model.Model instead"
+
+            if isinstance(layer, type(self)):
+                exported += layer.export(filepath, dt, weight_type, show_threshold, delta, False)
+            elif isinstance(layer, tn.layers.EmbeddingFeatures):
+                exported += layer.export_sparse_table(export_dir, weight_type, show_threshold, delta)
+
+        if tn.core.self_shard_id() == 0 and root:
+            tf_weights_file = os.path.join(export_dir, "tf_weights")
+            super(Model, self).save_weights(tf_weights_file, save_format='tf')
+
+        return exported
+
     def show_decay(self):
         for layer in self.layers:
             assert type(layer) != tf.keras.Model, "not support direct use keras.Model, use tn.model.Model instead"
@@ -194,3 +300,34 @@ class Model(tf.keras.Model):
                 layer.show_decay()
             elif isinstance(layer, tn.layers.EmbeddingFeatures):
                 layer.show_decay()
+
+    def evict(self, show_threshold=0, ttl_days=0):
+        """evict sparse keys of all embedding layers, see EmbeddingFeatures.evict.
+        next save_weights is a full save.
+        """
+        self._evicted_since_save = True
+
+        evicted = 0
+        for layer in self.layers:
+            assert type(layer) != tf.keras.Model, "not support direct use keras.Model, use tn.model.Model instead"
+
+            if isinstance(layer, type(self)):
+                evicted += layer.evict(show_threshold, ttl_days)
+            elif isinstance(layer, tn.layers.EmbeddingFeatures):
+                evicted += layer.evict(show_threshold, ttl_days)
+
+        return evicted
+
+    def spill(self, show_threshold=0, idle_days=0):
+        """spill sparse keys of all embedding layers to cold tier, see EmbeddingFeatures.spill
+        """
+        spilled = 0
+        for layer in self.layers:
+            assert type(layer) != tf.keras.Model, "not support direct use keras.Model, use tn.model.Model instead"
+
+            if isinstance(layer, type(self)):
+                spilled += layer.spill(show_threshold, idle_days)
+            elif isinstance(layer, tn.layers.EmbeddingFeatures):
+                spilled += layer.spill(show_threshold, idle_days)
+
+        return spilled
@@ -25,12 +25,25 @@ from tensorflow.python.ops import array_ops
 
 class Optimizer(optimizer_v2.OptimizerV2):
     """
+    Args:
+        dense_opt: optimizer of dense variables.
+        dense_sync: how dense variables are synchronized among ranks.
+            'push_pull': every slice of gradients is pushed to its owner rank and
+                applied there one by one, weights are pulled back. (default)
+            'allreduce': gradients of all ranks are averaged by reduce scatter, each
+                rank applies its own slice and weights are allgathered. it is
+                synchronous and scales better with many ranks.
     """
     def __init__(self,
                  dense_opt,
                  name='TensornetOptimizer',
+                 dense_sync='push_pull',
                  **kwargs):
+        if dense_sync not in ('push_pull', 'allreduce'):
+            raise ValueError("unknown dense_sync: %s" % dense_sync)
+
         self.dense_table_handle = tn.core.create_dense_table(dense_opt)
+        self.dense_sync = dense_sync
         self.is_var_inited = False
 
         super(Optimizer, self).__init__(name, **kwargs)
@@ -61,7 +74,10 @@ class Optimizer(optimizer_v2.OptimizerV2):
 
             tn.core.barrier()
 
-        gen_dense_table_ops.dense_table_push_pull(vars, grads, table_handle=self.dense_table_handle)
+        if self.dense_sync == 'allreduce':
+            gen_dense_table_ops.dense_table_all_reduce(vars, grads, table_handle=self.dense_table_handle)
+        else:
+            gen_dense_table_ops.dense_table_push_pull(vars, grads, table_handle=self.dense_table_handle)
 
         super(Optimizer, self)._distributed_apply(distribution, grads_and_vars, name, apply_state)
 
@@ -1,12 +1,29 @@
 #include <gtest/gtest.h>
 
 #include "core/ps/optimizer/optimizer_kernel.h"
+#include "core/ps/optimizer/adam_kernel.h"
+#include "core/ps/optimizer/ada_grad_kernel.h"
+#include "core/serving/embedding_store.h"
 #include "core/utility/random.h"
 
 #include <butil/time.h>
 
+#include <stdio.h>
+
+#include <fstream>
+#include <thread>
+
 using namespace tensornet;
 
+// export into a serving store writer as SparseTable does
+static SparseExportFunc AddTo(EmbeddingStoreWriter* writer) {
+    return [writer](const std::vector<uint64_t>& signs, const std::vector<float>& weights) {
+        for (size_t i = 0; i < signs.size(); i++) {
+            writer->Add(signs[i], weights.data() + i * writer->Dim());
+        }
+    };
+}
+
 TEST(optimizer, GetWeightPerf) {
     float epsilon = 1e-8;
     float grad_decay_rate = 1.0;
@@ -16,16 +33,17 @@ TEST(optimizer, GetWeightPerf) {
     AdaGrad opt(0.01, 0.1, 0.1, epsilon, grad_decay_rate, mom_decay_rate, show_decay_rate);
 
     int dim = 8;
-    auto op_kernel = opt.CreateSparseOptKernel(dim);
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
 
     auto& reng = local_random_engine();
     std::uniform_int_distribution<uint64_t> distr;
 
     butil::Timer timer(butil::Timer::STARTED);
 
+    float w[dim];
     for (int i = 0; i < 1000; i++) {
         uint64_t sign = distr(reng);
-        float* w = op_kernel->GetWeight(sign);
+        op_kernel->GetWeight(sign, w);
     }
 
     timer.stop();
@@ -35,3 +53,1051 @@ TEST(optimizer, GetWeightPerf) {
     //EXPECT_LT(timer.u_elapsed(), 10000);
 }
 
+
+TEST(optimizer, GetWeightsAndApplyBatch) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 8;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    auto& reng = local_random_engine();
+    std::uniform_int_distribution<uint64_t> distr;
+
+    size_t n = 10000;
+    std::vector<uint64_t> signs(n);
+    for (size_t i = 0; i < n; i++) {
+        signs[i] = distr(reng);
+    }
+
+    std::vector<float> weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, weights.data());
+
+    EXPECT_EQ(op_kernel->KeyCount(), n);
+    EXPECT_GE(op_kernel->MemoryBytes(), n * dim * sizeof(float));
+
+    float w[dim];
+    for (size_t i = 0; i < n; i++) {
+        op_kernel->GetWeight(signs[i], w);
+        for (int j = 0; j < dim; j++) {
+            EXPECT_EQ(weights[i * dim + j], w[j]);
+        }
+    }
+
+    std::vector<float> grads(n * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(n);
+    for (size_t i = 0; i < n; i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), n);
+
+    std::vector<float> new_weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, new_weights.data());
+
+    for (size_t i = 0; i < n * dim; i++) {
+        EXPECT_LT(new_weights[i], weights[i]);
+    }
+}
+
+TEST(optimizer, SerializedBinary) {
+    Ftrl opt(0.05, 0.1, 1, 0.1, 1, 0.98);
+
+    int dim = 4;
+    SparseKernelOption option;
+    option.block_num = 3;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+    std::vector<uint64_t> signs(100000);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i * 7919;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    std::string filepath = "/tmp/tensornet_optimizer_kernel_test";
+    op_kernel->Serialized(filepath, SFF_BINARY, false);
+
+    // load with different block number
+    option.block_num = 5;
+    auto load_kernel = opt.CreateSparseOptKernel(dim, option);
+    load_kernel->DeSerialized(filepath);
+
+    EXPECT_EQ(load_kernel->KeyCount(), signs.size());
+
+    std::vector<float> load_weights(signs.size() * dim);
+    load_kernel->GetWeights(signs.data(), signs.size(), load_weights.data());
+
+    EXPECT_EQ(weights, load_weights);
+    EXPECT_EQ(load_kernel->KeyCount(), signs.size());
+}
+
+TEST(optimizer, SerializedParts) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    SparseKernelOption option;
+    option.block_num = 1;
+    option.io_threads = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+    // one block is cut into 3 part files
+    std::vector<uint64_t> signs(SPARSE_BLOCK_FILE_PART_KEYS * 2 + 100);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i * 7919;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    std::string filepath = "/tmp/tensornet_optimizer_kernel_test/parts";
+    op_kernel->Serialized(filepath, SFF_BINARY, false);
+
+    EXPECT_TRUE(FileExists(filepath + "/sparse_block_2.bin"));
+    EXPECT_FALSE(FileExists(filepath + "/sparse_block_3.bin"));
+
+    option.block_num = 8;
+    option.io_threads = 2;
+    auto load_kernel = opt.CreateSparseOptKernel(dim, option);
+    load_kernel->DeSerialized(filepath);
+
+    EXPECT_EQ(load_kernel->KeyCount(), signs.size());
+
+    std::vector<float> load_weights(signs.size() * dim);
+    load_kernel->GetWeights(signs.data(), signs.size(), load_weights.data());
+
+    EXPECT_EQ(weights, load_weights);
+}
+
+TEST(optimizer, DeSerializedShardFilter) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    std::vector<uint64_t> signs(1000);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    std::string filepath = "/tmp/tensornet_optimizer_kernel_test/shard";
+    op_kernel->Serialized(filepath, SFF_BINARY, false);
+
+    // keep signs % 3 == 1
+    SparseShardFilter filter;
+    filter.keep = {0, 1, 0};
+
+    auto load_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+    load_kernel->DeSerialized(filepath, filter);
+
+    EXPECT_EQ(load_kernel->KeyCount(), 333);
+
+    std::vector<float> w(dim);
+    load_kernel->GetWeight(4, w.data());
+    EXPECT_EQ(w, std::vector<float>(weights.begin() + 4 * dim, weights.begin() + 5 * dim));
+}
+
+TEST(optimizer, SerializedDelta) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    std::vector<uint64_t> signs(1000);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    op_kernel->Serialized("/tmp/tensornet_optimizer_kernel_test/base", SFF_BINARY, false);
+
+    // update first 100 signs only
+    std::vector<float> grads(100 * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(100);
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+
+    op_kernel->Serialized("/tmp/tensornet_optimizer_kernel_test/delta", SFF_BINARY, true);
+
+    auto delta_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+    delta_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/delta");
+    EXPECT_EQ(delta_kernel->KeyCount(), 100);
+
+    auto load_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+    load_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/base");
+    load_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/delta");
+
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    std::vector<float> load_weights(signs.size() * dim);
+    load_kernel->GetWeights(signs.data(), signs.size(), load_weights.data());
+
+    EXPECT_EQ(weights, load_weights);
+}
+
+TEST(optimizer, DeSerializedLazy) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    SparseKernelOption option;
+    option.block_num = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+    std::vector<uint64_t> signs(10000);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i * 7919;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+    op_kernel->Serialized("/tmp/tensornet_optimizer_kernel_test/lazy_base", SFF_BINARY, false);
+
+    std::vector<float> grads(signs.size() * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(signs.size());
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i] = {grads.data() + i * dim, 1};
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), 100);
+    op_kernel->Serialized("/tmp/tensornet_optimizer_kernel_test/lazy_delta", SFF_BINARY, true);
+
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    // base and delta are queued in order, pulls read them first
+    auto load_kernel = opt.CreateSparseOptKernel(dim, option);
+    load_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/lazy_base", SparseShardFilter(), true);
+    load_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/lazy_delta", SparseShardFilter(), true);
+
+    std::vector<float> load_weights(signs.size() * dim);
+    load_kernel->GetWeights(signs.data(), signs.size(), load_weights.data());
+    EXPECT_EQ(weights, load_weights);
+    EXPECT_EQ(load_kernel->KeyCount(), signs.size());
+
+    // other block number is loaded at once
+    option.block_num = 3;
+    auto other_kernel = opt.CreateSparseOptKernel(dim, option);
+    other_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/lazy_base", SparseShardFilter(), true);
+    EXPECT_EQ(other_kernel->KeyCount(), signs.size());
+}
+
+TEST(optimizer, DumpBinarySnapshot) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    SparseKernelOption option;
+    option.block_num = 1;
+    SparseKernelBlock<AdaGrad, SparseAdaGradValue<float>> block(&opt, dim, option);
+
+    std::vector<uint64_t> signs(SPARSE_BLOCK_FILE_PART_KEYS + 1000);
+    std::vector<uint32_t> index(signs.size());
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i * 7919;
+        index[i] = i;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    block.GetWeights(signs.data(), index.data(), index.size(), weights.data());
+
+    std::vector<float> grads(signs.size() * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(signs.size());
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i] = {grads.data() + i * dim, 1};
+    }
+
+    // block is not locked while parts are emitted. values are pushed and then all
+    // evicted after first part, but parts still hold values when dump started
+    std::vector<SparseBlockFilePart> parts;
+    block.DumpBinary(false, [&](SparseBlockFilePart&& part) {
+        if (parts.empty()) {
+            block.ApplyBatch(signs.data(), grad_infos.data(), index.data(), index.size());
+
+            SparseEvictOption evict_option;
+            evict_option.show_threshold = 1e9;
+            block.Evict(evict_option);
+        }
+
+        parts.emplace_back(std::move(part));
+    });
+
+    EXPECT_EQ(parts.size(), 2);
+
+    SparseKernelBlock<AdaGrad, SparseAdaGradValue<float>> load_block(&opt, dim, option);
+    for (const auto& part : parts) {
+        load_block.CheckHeader(part.header);
+        load_block.LoadBinary(part.signs.data(), part.values.data(), index.data(),
+                              part.signs.size(), SPARSE_BLOCK_FILE_VERSION);
+    }
+
+    EXPECT_EQ(load_block.Size(), signs.size());
+
+    std::vector<float> load_weights(signs.size() * dim);
+    load_block.GetWeights(signs.data(), index.data(), index.size(), load_weights.data());
+
+    EXPECT_EQ(weights, load_weights);
+}
+
+TEST(optimizer, Evict) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    std::vector<uint64_t> signs(1000);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    // only first 100 signs have show
+    std::vector<float> grads(100 * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(100);
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+
+    SparseEvictOption option;
+    option.show_threshold = 0.5;
+
+    EXPECT_EQ(op_kernel->Evict(option), 900);
+    EXPECT_EQ(op_kernel->KeyCount(), 100);
+
+    option.show_threshold = 0;
+    option.ttl_days = 1;
+    EXPECT_EQ(op_kernel->Evict(option), 0);
+}
+
+TEST(optimizer, PushWithoutPull) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    std::vector<uint64_t> signs(100);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    SparseEvictOption option;
+    option.show_threshold = 0.5;
+    EXPECT_EQ(op_kernel->Evict(option), signs.size());
+    EXPECT_EQ(op_kernel->KeyCount(), 0);
+
+    // evicted signs and signs never pulled are pushed as if pulled just before
+    signs.push_back(1000);
+    std::vector<float> grads(signs.size() * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(signs.size());
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+    EXPECT_EQ(op_kernel->KeyCount(), signs.size());
+}
+
+TEST(optimizer, ShowDecay) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    // blocks are bigger than one decay step
+    size_t n = 200000;
+    std::vector<uint64_t> signs(n);
+    for (size_t i = 0; i < n; i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, weights.data());
+
+    std::vector<float> grads(n * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(n);
+    for (size_t i = 0; i < n; i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), n);
+
+    // 0.98^34 is a bit more than 0.5, every key is decayed exactly once a time
+    for (int i = 0; i < 34; i++) {
+        op_kernel->ShowDecay();
+    }
+
+    SparseEvictOption option;
+    option.show_threshold = 0.5;
+    EXPECT_EQ(op_kernel->Evict(option), 0);
+
+    op_kernel->ShowDecay();
+    EXPECT_EQ(op_kernel->Evict(option), n);
+}
+
+TEST(optimizer, ShowDecayWhileGrow) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    size_t n = 200000;
+    std::vector<uint64_t> signs(n);
+    for (size_t i = 0; i < n; i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, weights.data());
+
+    std::vector<float> grads(n * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(n);
+    for (size_t i = 0; i < n; i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), n);
+
+    // new signs grow hash maps of blocks while they are decayed
+    size_t m = 2000000;
+    std::thread grow([&op_kernel, n, m, dim]() {
+        std::vector<uint64_t> new_signs(1000);
+        std::vector<float> new_weights(new_signs.size() * dim);
+
+        for (size_t begin = n; begin < n + m; begin += new_signs.size()) {
+            for (size_t i = 0; i < new_signs.size(); i++) {
+                new_signs[i] = begin + i;
+            }
+            op_kernel->GetWeights(new_signs.data(), new_signs.size(), new_weights.data());
+        }
+    });
+
+    for (int i = 0; i < 34; i++) {
+        op_kernel->ShowDecay();
+    }
+    grow.join();
+
+    // new signs have no show, old ones are decayed exactly once a time
+    SparseEvictOption option;
+    option.show_threshold = 0.5;
+    EXPECT_EQ(op_kernel->Evict(option), m);
+
+    op_kernel->ShowDecay();
+    EXPECT_EQ(op_kernel->Evict(option), n);
+}
+
+TEST(optimizer, Admission) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    SparseKernelOption option;
+    option.admit_shows = 3;
+    option.admit_sketch_width = 1 << 12;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+    std::vector<uint64_t> signs = {1, 2, 3};
+    std::vector<float> weights(signs.size() * dim, 1);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    // not admitted signs are zeros without allocation
+    EXPECT_EQ(op_kernel->KeyCount(), 0);
+    EXPECT_EQ(weights, std::vector<float>(signs.size() * dim, 0));
+
+    std::vector<float> grads(signs.size() * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(signs.size());
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = i + 1;
+    }
+
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+    EXPECT_EQ(op_kernel->KeyCount(), 1);
+
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+    EXPECT_EQ(op_kernel->KeyCount(), 2);
+
+    float w[dim];
+    op_kernel->GetWeight(1, w);
+    EXPECT_EQ(std::vector<float>(w, w + dim), std::vector<float>(dim, 0));
+
+    op_kernel->GetWeight(3, w);
+    EXPECT_NE(std::vector<float>(w, w + dim), std::vector<float>(dim, 0));
+    EXPECT_EQ(op_kernel->KeyCount(), 2);
+
+    // counts of sign 1 are halved to 1, it needs 2 more shows
+    op_kernel->ShowDecay();
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), 1);
+    EXPECT_EQ(op_kernel->KeyCount(), 2);
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), 1);
+    EXPECT_EQ(op_kernel->KeyCount(), 3);
+}
+
+TEST(optimizer, SpillColdTier) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    SparseKernelOption option;
+    option.block_num = 2;
+    option.cold_dir = "/tmp";
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+    std::vector<uint64_t> signs(1000);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    // only first 100 signs have shows
+    std::vector<float> grads(100 * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(100);
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    size_t memory_bytes = op_kernel->MemoryBytes();
+
+    SparseEvictOption spill_option;
+    spill_option.show_threshold = 0.5;
+    EXPECT_EQ(op_kernel->Spill(spill_option), 900);
+    EXPECT_EQ(op_kernel->KeyCount(), signs.size());
+    EXPECT_LT(op_kernel->MemoryBytes(), memory_bytes * 2);
+
+    // cold values are saved too
+    std::string filepath = "/tmp/tensornet_optimizer_kernel_test/cold";
+    op_kernel->Serialized(filepath, SFF_BINARY, false);
+
+    auto load_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+    load_kernel->DeSerialized(filepath);
+    EXPECT_EQ(load_kernel->KeyCount(), signs.size());
+
+    // and read back by pull
+    std::vector<float> cold_weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), cold_weights.data());
+    EXPECT_EQ(weights, cold_weights);
+
+    std::vector<float> w(dim);
+    op_kernel->GetWeight(999, w.data());
+    EXPECT_EQ(w, std::vector<float>(weights.end() - dim, weights.end()));
+
+    std::vector<float> load_weights(signs.size() * dim);
+    load_kernel->GetWeights(signs.data(), signs.size(), load_weights.data());
+    EXPECT_EQ(weights, load_weights);
+}
+
+TEST(optimizer, PushSpilled) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    SparseKernelOption option;
+    option.block_num = 2;
+    option.cold_dir = "/tmp";
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+    std::vector<uint64_t> signs(100);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    SparseEvictOption spill_option;
+    spill_option.show_threshold = 0.5;
+    EXPECT_EQ(op_kernel->Spill(spill_option), signs.size());
+
+    // spilled signs are read back by push and updated from their spilled weights
+    std::vector<float> grads(signs.size() * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(signs.size());
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+    EXPECT_EQ(op_kernel->KeyCount(), signs.size());
+
+    std::vector<float> pushed_weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), pushed_weights.data());
+
+    for (size_t i = 0; i < weights.size(); i++) {
+        EXPECT_NE(weights[i], pushed_weights[i]);
+    }
+}
+
+TEST(optimizer, ExportServing) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    SparseKernelOption option;
+    option.block_num = 2;
+    option.cold_dir = "/tmp";
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+    std::vector<uint64_t> signs(1000);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i * 7;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    // only first 100 signs have shows, the others are spilled
+    std::vector<float> grads(100 * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(100);
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    SparseEvictOption spill_option;
+    spill_option.show_threshold = 0.5;
+    EXPECT_EQ(op_kernel->Spill(spill_option), 900);
+
+    SparseExportOption export_option;
+    export_option.show_threshold = 0.5;
+
+    EmbeddingStoreWriter pruned(dim);
+    EXPECT_EQ(op_kernel->Export(export_option, AddTo(&pruned)), 100);
+
+    // nothing is updated from now on
+    export_option.show_threshold = 0;
+    export_option.updated_since = butil::gettimeofday_s() + 1;
+
+    EmbeddingStoreWriter delta(dim);
+    EXPECT_EQ(op_kernel->Export(export_option, AddTo(&delta)), 0);
+
+    export_option.updated_since = 0;
+
+    EmbeddingStoreWriter writer(dim);
+    EXPECT_EQ(op_kernel->Export(export_option, AddTo(&writer)), signs.size());
+
+    std::string file = "/tmp/tensornet_optimizer_kernel_test_export";
+    {
+        std::ofstream os(file, std::ios::binary);
+        writer.Write(os);
+    }
+
+    EmbeddingStore store;
+    ASSERT_EQ(store.Open({file}), 0);
+    EXPECT_EQ(store.KeyCount(), signs.size());
+
+    std::vector<float> exported(signs.size() * dim);
+    EXPECT_EQ(store.Lookup(signs.data(), signs.size(), exported.data()), signs.size());
+    EXPECT_EQ(weights, exported);
+
+    // cold values are not read back into memory by export
+    EXPECT_EQ(op_kernel->Spill(spill_option), 0);
+}
+
+TEST(optimizer, ExportWhilePull) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    size_t n = 200000;
+    std::vector<uint64_t> signs(n);
+    for (size_t i = 0; i < n; i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, weights.data());
+
+    std::vector<float> grads(n * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(n);
+    for (size_t i = 0; i < n; i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), n);
+
+    // new signs without shows are pulled into blocks while they are exported
+    size_t m = 1000000;
+    std::thread pull([&op_kernel, n, m, dim]() {
+        std::vector<uint64_t> new_signs(1000);
+        std::vector<float> new_weights(new_signs.size() * dim);
+
+        for (size_t begin = n; begin < n + m; begin += new_signs.size()) {
+            for (size_t i = 0; i < new_signs.size(); i++) {
+                new_signs[i] = begin + i;
+            }
+            op_kernel->GetWeights(new_signs.data(), new_signs.size(), new_weights.data());
+        }
+    });
+
+    SparseExportOption export_option;
+    export_option.show_threshold = 0.5;
+
+    EmbeddingStoreWriter writer(dim);
+    EXPECT_EQ(op_kernel->Export(export_option, AddTo(&writer)), n);
+    pull.join();
+
+    EXPECT_EQ(writer.KeyCount(), n);
+}
+
+TEST(optimizer, OverlappedSave) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+
+    std::vector<uint64_t> signs(100000);
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i;
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+    // second save waits for the first instead of aborting
+    std::thread save([&op_kernel]() {
+        op_kernel->Serialized("/tmp/tensornet_optimizer_kernel_test/overlap_0", SFF_BINARY, false);
+    });
+    op_kernel->Serialized("/tmp/tensornet_optimizer_kernel_test/overlap_1", SFF_BINARY, false);
+    save.join();
+
+    for (int i = 0; i < 2; i++) {
+        auto load_kernel = opt.CreateSparseOptKernel(dim, SparseKernelOption());
+        load_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/overlap_" + std::to_string(i));
+        EXPECT_EQ(load_kernel->KeyCount(), signs.size());
+    }
+}
+
+TEST(optimizer, HalfWeight) {
+    Adam opt(0.001, 0.9, 0.999, 1e-8, 1.0);
+
+    int dim = 8;
+    std::vector<uint64_t> signs = {1, 2, 3};
+    std::vector<float> grads(signs.size() * dim, 1);
+    std::vector<SparseGradInfo> grad_infos(signs.size());
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+
+    // update of adam is not depend on weight, so float and fp16 kernel must move
+    // weights about the same distance
+    std::vector<float> deltas[2];
+    SparseWeightType weight_types[2] = {SWT_FLOAT, SWT_FP16};
+
+    for (int k = 0; k < 2; k++) {
+        SparseKernelOption option;
+        option.weight_type = weight_types[k];
+        auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+        std::vector<float> weights(signs.size() * dim);
+        op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+        for (int i = 0; i < 100; i++) {
+            op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+        }
+
+        std::vector<float> new_weights(signs.size() * dim);
+        op_kernel->GetWeights(signs.data(), signs.size(), new_weights.data());
+
+        for (size_t i = 0; i < weights.size(); i++) {
+            deltas[k].push_back(weights[i] - new_weights[i]);
+        }
+
+        op_kernel->Serialized("/tmp/tensornet_optimizer_kernel_test/half", SFF_BINARY, false);
+
+        auto load_kernel = opt.CreateSparseOptKernel(dim, option);
+        load_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/half");
+
+        std::vector<float> load_weights(signs.size() * dim);
+        load_kernel->GetWeights(signs.data(), signs.size(), load_weights.data());
+        EXPECT_EQ(new_weights, load_weights);
+    }
+
+    for (size_t i = 0; i < deltas[0].size(); i++) {
+        EXPECT_NEAR(deltas[0][i], deltas[1][i], 0.01);
+    }
+}
+
+TEST(optimizer, HalfWeightSmallGrad) {
+    Adam opt(0.001, 0.9, 0.999, 1e-8, 1.0);
+
+    int dim = 8;
+    std::vector<uint64_t> signs = {1, 2, 3};
+
+    // g*g of these underflows in fp16, moments must be kept in float
+    std::vector<float> grads(signs.size() * dim, 1e-3);
+    std::vector<SparseGradInfo> grad_infos(signs.size());
+    for (size_t i = 0; i < grad_infos.size(); i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+
+    std::vector<float> deltas[2];
+    SparseWeightType weight_types[2] = {SWT_FLOAT, SWT_FP16};
+
+    for (int k = 0; k < 2; k++) {
+        SparseKernelOption option;
+        option.weight_type = weight_types[k];
+        auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+        std::vector<float> weights(signs.size() * dim);
+        op_kernel->GetWeights(signs.data(), signs.size(), weights.data());
+
+        for (int i = 0; i < 100; i++) {
+            op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+        }
+
+        std::vector<float> new_weights(signs.size() * dim);
+        op_kernel->GetWeights(signs.data(), signs.size(), new_weights.data());
+
+        for (size_t i = 0; i < weights.size(); i++) {
+            deltas[k].push_back(weights[i] - new_weights[i]);
+        }
+    }
+
+    for (size_t i = 0; i < deltas[0].size(); i++) {
+        EXPECT_GT(deltas[0][i], 0);
+        EXPECT_NEAR(deltas[0][i], deltas[1][i], 0.02);
+    }
+}
+
+TEST(optimizer, WeightRows) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 8;
+    SparseKernelOption option;
+    option.weight_type = SWT_FP16;
+    option.cold_dir = "/tmp";
+    option.weight_rows = true;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+
+    size_t n = 1000;
+    std::vector<uint64_t> signs(n);
+    for (size_t i = 0; i < n; i++) {
+        signs[i] = i * 3;
+    }
+
+    std::vector<float> weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, weights.data());
+
+    std::vector<float> grads(n * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(n);
+    for (size_t i = 0; i < n; i++) {
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), n);
+
+    std::vector<float> new_weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, new_weights.data());
+    for (size_t i = 0; i < n * dim; i++) {
+        EXPECT_LT(new_weights[i], weights[i]);
+    }
+
+    // rows follow values read back from cold tier
+    SparseEvictOption spill_option;
+    spill_option.show_threshold = 10;
+    EXPECT_EQ(op_kernel->Spill(spill_option), n);
+
+    std::vector<float> cold_weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, cold_weights.data());
+    EXPECT_EQ(new_weights, cold_weights);
+
+    // and values loaded, by kernels with or without rows
+    op_kernel->Serialized("/tmp/tensornet_optimizer_kernel_test/rows", SFF_BINARY, false);
+
+    for (bool weight_rows : {false, true}) {
+        option.weight_rows = weight_rows;
+        auto load_kernel = opt.CreateSparseOptKernel(dim, option);
+        load_kernel->DeSerialized("/tmp/tensornet_optimizer_kernel_test/rows");
+
+        std::vector<float> load_weights(n * dim);
+        load_kernel->GetWeights(signs.data(), n, load_weights.data());
+        EXPECT_EQ(new_weights, load_weights);
+    }
+
+    EXPECT_GE(op_kernel->MemoryBytes(), n * dim * sizeof(float));
+}
+
+TEST(optimizer, DenseAdamApply) {
+    float lr = 0.01, beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    Adam opt(lr, beta1, beta2, epsilon, 0.1);
+
+    int len = 10007;
+    auto op_kernel = opt.CreateDenseOptKernel(0, len);
+
+    std::vector<float> w(len), m(len, 0), v(len, 0);
+    for (int i = 0; i < len; i++) {
+        w[i] = 0.001 * (i % 100);
+    }
+
+    butil::IOBuf w_buf;
+    w_buf.append(w.data(), len * sizeof(float));
+    op_kernel->SetWeight(w_buf);
+
+    float beta1_power = 1, beta2_power = 1;
+    for (int step = 0; step < 3; step++) {
+        std::vector<float> g(len);
+        for (int i = 0; i < len; i++) {
+            g[i] = 0.01 * ((i + step) % 7) - 0.03;
+        }
+
+        butil::IOBuf grad;
+        grad.append(g.data(), len * sizeof(float));
+        op_kernel->Apply(grad);
+
+        beta1_power *= beta1;
+        beta2_power *= beta2;
+        float alpha = lr * std::sqrt(1.0 - beta2_power) / (1.0 - beta1_power);
+
+        for (int i = 0; i < len; i++) {
+            m[i] += (g[i] - m[i]) * (1.0 - beta1);
+            v[i] += (g[i] * g[i] - v[i]) * (1.0 - beta2);
+            w[i] -= (m[i] * alpha) / (std::sqrt(v[i]) + epsilon);
+        }
+    }
+
+    butil::IOBuf new_w_buf;
+    op_kernel->GetWeight(new_w_buf);
+    ASSERT_EQ(new_w_buf.size(), len * sizeof(float));
+
+    std::vector<float> new_w(len);
+    new_w_buf.copy_to(new_w.data(), len * sizeof(float));
+
+    for (int i = 0; i < len; i++) {
+        EXPECT_NEAR(new_w[i], w[i], 1e-5);
+    }
+}
+
+TEST(optimizer, DenseCopyFrom) {
+    Adam opt(0.01, 0.9, 0.999, 1e-8, 0.1);
+
+    int len = 1000;
+    std::vector<float> w(len);
+    for (int i = 0; i < len; i++) {
+        w[i] = 0.001 * i;
+    }
+
+    // saved by two shards, loaded by three
+    std::vector<DenseOptKernelSharedPtr> saved = {
+        opt.CreateDenseOptKernel(0, 500), opt.CreateDenseOptKernel(500, 1000)};
+    for (auto& kernel : saved) {
+        butil::IOBuf w_buf;
+        w_buf.append(w.data() + kernel->OffsetBegin(), kernel->Length() * sizeof(float));
+        kernel->SetWeight(w_buf);
+    }
+
+    auto op_kernel = opt.CreateDenseOptKernel(334, 668);
+    for (auto& kernel : saved) {
+        op_kernel->CopyFrom(*kernel);
+    }
+
+    butil::IOBuf new_w_buf;
+    op_kernel->GetWeight(new_w_buf);
+
+    std::vector<float> new_w(op_kernel->Length());
+    new_w_buf.copy_to(new_w.data(), new_w.size() * sizeof(float));
+
+    EXPECT_EQ(new_w, std::vector<float>(w.begin() + 334, w.begin() + 668));
+}
+
+TEST(optimizer, FixedDimValue) {
+    static_assert(sizeof(SparseAdaGradValue<float, 8>) + sizeof(int) == sizeof(SparseAdaGradValue<float>),
+                  "fixed dim value should not store dim");
+    static_assert(sizeof(SparseAdamValue<Half, 16>) + sizeof(int) == sizeof(SparseAdamValue<Half>),
+                  "fixed dim value should not store dim");
+
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 8;
+    SparseKernelOption option;
+    option.block_num = 2;
+
+    // save with runtime dim values, and mark file as saved before version 3
+    SparseOptimizerKernel<SparseKernelBlock<AdaGrad, SparseAdaGradValue<float>>> dyn_kernel(&opt, dim, option);
+
+    std::vector<uint64_t> signs(10000);
+    std::vector<float> grads(signs.size() * dim);
+    std::vector<SparseGradInfo> grad_infos(signs.size());
+    for (size_t i = 0; i < signs.size(); i++) {
+        signs[i] = i * 7919;
+        for (int j = 0; j < dim; j++) {
+            grads[i * dim + j] = 0.001 * (i % 10 + j);
+        }
+        grad_infos[i] = {grads.data() + i * dim, 1};
+    }
+
+    std::vector<float> weights(signs.size() * dim);
+    dyn_kernel.GetWeights(signs.data(), signs.size(), weights.data());
+    dyn_kernel.ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+
+    std::string filepath = "/tmp/tensornet_optimizer_kernel_test/fixed_dim";
+    dyn_kernel.Serialized(filepath, SFF_BINARY, false);
+
+    for (size_t i = 0; i < option.block_num; i++) {
+        std::string file = filepath + "/sparse_block_" + std::to_string(i) + ".bin";
+        FILE* fp = fopen(file.c_str(), "r+b");
+        ASSERT_TRUE(fp != nullptr);
+
+        uint32_t version = 2;
+        fseek(fp, offsetof(SparseBlockFileHeader, version), SEEK_SET);
+        fwrite(&version, sizeof(version), 1, fp);
+        fclose(fp);
+    }
+
+    auto op_kernel = opt.CreateSparseOptKernel(dim, option);
+    op_kernel->DeSerialized(filepath);
+    EXPECT_EQ(op_kernel->KeyCount(), signs.size());
+
+    // both must give same result after one more apply
+    dyn_kernel.ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), grad_infos.size());
+
+    dyn_kernel.GetWeights(signs.data(), signs.size(), weights.data());
+
+    std::vector<float> load_weights(signs.size() * dim);
+    op_kernel->GetWeights(signs.data(), signs.size(), load_weights.data());
+
+    for (size_t i = 0; i < weights.size(); i++) {
+        EXPECT_NEAR(weights[i], load_weights[i], 1e-6);
+    }
+}
+
+TEST(optimizer, DenseWeightCopyOnWrite) {
+    DenseWeight weight(100);
+    weight.Mutable().setConstant(1);
+
+    const float* data = weight.Mutable().data();
+
+    {
+        butil::IOBuf buf;
+        weight.AppendTo(buf);
+
+        // referenced by buf, update must not touch the responded weights
+        auto w = weight.Mutable();
+        EXPECT_NE(w.data(), data);
+        w.setConstant(2);
+
+        EXPECT_EQ(buf.size(), 100 * sizeof(float));
+        EXPECT_EQ(data[0], 1);
+        EXPECT_EQ(weight[0], 2);
+
+        data = w.data();
+    }
+
+    EXPECT_EQ(weight.Mutable().data(), data);
+}
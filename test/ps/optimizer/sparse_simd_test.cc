@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include "core/ps/optimizer/sparse_simd.h"
+
+#include <random>
+#include <vector>
+
+using namespace tensornet;
+
+namespace {
+
+std::vector<float> RandomVector(std::mt19937& reng, int n, float low, float high) {
+    std::uniform_real_distribution<float> distr(low, high);
+
+    std::vector<float> v(n);
+    for (auto& x : v) {
+        x = distr(reng);
+    }
+
+    return v;
+}
+
+const int DIMS[] = {1, 7, 8, 16, 23, 32, 40, 64, 100};
+
+} // namespace
+
+TEST(sparse_simd, same_as_scalar) {
+    Adam adam(0.01, 0.9, 0.999, 1e-8, 1.0);
+    Ftrl ftrl(0.05, 0.1, 1, 0.1, 1, 0.98);
+
+    std::mt19937 reng(0);
+
+    for (int isa = SIMD_AVX2; isa <= SupportedSimdIsa(); isa++) {
+        for (int dim : DIMS) {
+            auto g = RandomVector(reng, dim, -1, 1);
+            auto w = RandomVector(reng, dim, -1, 1);
+            auto a = RandomVector(reng, dim, -1, 1);
+            auto b = RandomVector(reng, dim, 0, 1);
+
+            auto w_simd = w, a_simd = a, b_simd = b;
+
+            SetSimdIsa(SIMD_NONE);
+            SimdSparseAdamApply(&adam, w.data(), a.data(), b.data(), g.data(), dim);
+            SimdSparseFtrlApply(&ftrl, w.data(), a.data(), b.data(), g.data(), dim);
+            SimdScaledSub(w.data(), g.data(), 0.1, dim);
+            float sum = SimdSquareSum(g.data(), dim);
+
+            SetSimdIsa(static_cast<SimdIsa>(isa));
+            ASSERT_EQ(CurrentSimdIsa(), isa);
+            SimdSparseAdamApply(&adam, w_simd.data(), a_simd.data(), b_simd.data(), g.data(), dim);
+            SimdSparseFtrlApply(&ftrl, w_simd.data(), a_simd.data(), b_simd.data(), g.data(), dim);
+            SimdScaledSub(w_simd.data(), g.data(), 0.1, dim);
+            float sum_simd = SimdSquareSum(g.data(), dim);
+
+            EXPECT_NEAR(sum, sum_simd, 1e-4) << "isa:" << isa << " dim:" << dim;
+
+            for (int i = 0; i < dim; i++) {
+                EXPECT_NEAR(w[i], w_simd[i], 1e-5) << "isa:" << isa << " dim:" << dim;
+                EXPECT_NEAR(a[i], a_simd[i], 1e-5) << "isa:" << isa << " dim:" << dim;
+                EXPECT_NEAR(b[i], b_simd[i], 1e-5) << "isa:" << isa << " dim:" << dim;
+            }
+        }
+    }
+
+    SetSimdIsa(SupportedSimdIsa());
+}
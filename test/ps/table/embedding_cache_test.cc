@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "core/ps/table/embedding_cache.h"
+
+using namespace tensornet;
+
+TEST(embedding_cache, staleness) {
+    SparseCacheOption option;
+    option.staleness = 2;
+
+    int dim = 4;
+    EmbeddingCache cache(dim, option);
+
+    std::vector<float> w(dim, 1.0), out(dim, 0);
+
+    EXPECT_FALSE(cache.Get(1, out.data()));
+
+    cache.Put(1, w.data());
+    ASSERT_TRUE(cache.Get(1, out.data()));
+    EXPECT_EQ(out, w);
+
+    cache.NextStep();
+    EXPECT_TRUE(cache.Get(1, out.data()));
+
+    cache.NextStep();
+    EXPECT_FALSE(cache.Get(1, out.data()));
+
+    // pull again refresh the entry
+    cache.Put(1, w.data());
+    EXPECT_TRUE(cache.Get(1, out.data()));
+
+    EXPECT_EQ(cache.HitCount(), 3);
+    EXPECT_EQ(cache.MissCount(), 2);
+}
+
+TEST(embedding_cache, capacity) {
+    SparseCacheOption option;
+    option.staleness = 1;
+    option.capacity = 1600;
+
+    int dim = 4;
+    EmbeddingCache cache(dim, option);
+
+    std::vector<float> w(dim, 1.0);
+
+    for (uint64_t i = 0; i < 100000; i++) {
+        cache.Put(i << 32 | i, w.data());
+    }
+    EXPECT_LE(cache.Size(), option.capacity);
+
+    // expired entries give up space to new ones
+    cache.NextStep();
+    for (uint64_t i = 0; i < 100; i++) {
+        cache.Put(i << 32 | (i + 200000), w.data());
+    }
+
+    std::vector<float> out(dim);
+    for (uint64_t i = 0; i < 100; i++) {
+        EXPECT_TRUE(cache.Get(i << 32 | (i + 200000), out.data()));
+    }
+}
+
+TEST(embedding_cache, shard) {
+    SparseCacheOption option;
+    option.staleness = 1;
+    option.capacity = 1600;
+
+    int dim = 4;
+    EmbeddingCache cache(dim, option);
+
+    std::vector<float> w(dim, 1.0);
+
+    // signs with same high bits spread over all shards
+    for (uint64_t i = 0; i < 1000; i++) {
+        cache.Put(i, w.data());
+    }
+    EXPECT_EQ(cache.Size(), 1000);
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include "core/ps/table/hot_key.h"
+#include "core/ps/table/sparse_table.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace tensornet;
+
+TEST(hot_key, detect) {
+    HotKeyOption option;
+    option.hot_key_num = 10;
+    option.sample_rate = 3;
+    option.refresh_samples = 10000;
+
+    HotKeyDetector detector(option);
+
+    std::mt19937_64 reng(0);
+    std::uniform_int_distribution<uint64_t> distr(100, 1 << 30);
+
+    // signs 0~9 are 10% of requests
+    std::vector<uint64_t> signs(1000);
+    for (int round = 0; round < 100; ++round) {
+        for (size_t i = 0; i < signs.size(); ++i) {
+            signs[i] = i % 10 == 0 ? i / 10 % 10 : distr(reng);
+        }
+        detector.Sample(signs.data(), signs.size());
+    }
+
+    std::vector<uint64_t> hot_signs;
+    uint32_t version = detector.GetHotKeys(0, &hot_signs);
+    EXPECT_GT(version, 0);
+
+    std::vector<uint64_t> expect = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    EXPECT_EQ(hot_signs, expect);
+
+    hot_signs.clear();
+    EXPECT_EQ(detector.GetHotKeys(version, &hot_signs), version);
+    EXPECT_TRUE(hot_signs.empty());
+}
+
+TEST(hot_key, combine) {
+    HotKeyOption option;
+    option.hot_key_num = 10;
+    option.push_interval = 2;
+
+    int dim = 2;
+    HotKeyCombiner combiner(dim, 2, option);
+
+    combiner.Update(0, 1, {2, 4});
+    combiner.Update(1, 1, {3});
+    EXPECT_EQ(combiner.Version(1), 1);
+
+    auto hot_set = combiner.HotSet();
+    EXPECT_EQ(hot_set->size(), 3);
+    EXPECT_TRUE(hot_set->count(3));
+
+    float grad[] = {1.0, 2.0};
+    combiner.Add(SparsePushSignInfo(2, 1), grad);
+
+    std::vector<SparsePushSignInfo> sign_infos;
+    std::vector<float> grads;
+    EXPECT_FALSE(combiner.NextPush(&sign_infos, &grads));
+
+    combiner.Add(SparsePushSignInfo(2, 3), grad);
+    combiner.Add(SparsePushSignInfo(3, 1), grad);
+    ASSERT_TRUE(combiner.NextPush(&sign_infos, &grads));
+
+    ASSERT_EQ(sign_infos.size(), 2);
+    EXPECT_EQ(sign_infos[0].sign, 2);
+    EXPECT_EQ(sign_infos[0].batch_show, 4);
+    EXPECT_EQ(grads, std::vector<float>({2.0, 4.0, 1.0, 2.0}));
+
+    EXPECT_FALSE(combiner.NextPush(&sign_infos, &grads));
+}
+
+TEST(hot_key, flush) {
+    HotKeyOption option;
+    option.hot_key_num = 10;
+    option.push_interval = 4;
+
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 2;
+    SparseTable* table = CreateSparseTable(&opt, dim, 1, 0, SparseKernelOption(),
+                                           SparseWireOption(), SparseCacheOption(), option);
+    HotKeyCombiner* combiner = table->HotKeys();
+    ASSERT_TRUE(nullptr != combiner);
+
+    combiner->Update(0, 1, {2});
+
+    uint64_t sign = 2;
+    std::vector<float> weights(dim);
+    std::vector<uint64_t> hot_signs;
+    table->PullLocal(&sign, 1, weights.data(), 0, &hot_signs);
+
+    // combined gradients are not due yet
+    float grad[] = {1.0, 2.0};
+    std::vector<SparsePushSignInfo> sign_infos;
+    std::vector<float> grads;
+    for (int i = 0; i < option.push_interval - 1; ++i) {
+        combiner->Add(SparsePushSignInfo(sign, 1), grad);
+        EXPECT_FALSE(combiner->NextPush(&sign_infos, &grads));
+    }
+
+    ASSERT_TRUE(combiner->Flush(&sign_infos, &grads));
+    ASSERT_EQ(sign_infos.size(), 1);
+    EXPECT_EQ(sign_infos[0].batch_show, option.push_interval - 1);
+
+    // as push of the flushed gradients to self shard
+    SparseGradInfo grad_info;
+    grad_info.grad = grads.data();
+    grad_info.batch_show = sign_infos[0].batch_show;
+    table->PushLocal(&sign, &grad_info, 1);
+
+    std::vector<float> pushed_weights(dim);
+    table->PullLocal(&sign, 1, pushed_weights.data(), 0, &hot_signs);
+
+    for (int i = 0; i < dim; ++i) {
+        EXPECT_LT(pushed_weights[i], weights[i]);
+    }
+
+    EXPECT_FALSE(combiner->Flush(&sign_infos, &grads));
+}
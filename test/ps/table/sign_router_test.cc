@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include "core/ps/table/sign_router.h"
+
+using namespace tensornet;
+
+TEST(sign_router, default_routing) {
+    SignRouter router(3);
+
+    EXPECT_EQ(router.VirtualShardNum() % 3, 0);
+    EXPECT_GE(router.VirtualShardNum(), SIGN_ROUTER_MIN_VIRTUAL_SHARD_NUM);
+    EXPECT_TRUE(router.IsDefault());
+
+    // same as sign % rank_num before routing table
+    for (uint64_t sign = 0; sign < 100000; sign += 7) {
+        EXPECT_EQ(router.Rank(sign), sign % 3);
+    }
+
+    uint64_t sign = 0xfedcba9876543210;
+    EXPECT_EQ(router.Rank(sign), sign % 3);
+}
+
+TEST(sign_router, assign) {
+    SignRouter router(2, 8);
+    ASSERT_EQ(router.VirtualShardNum(), 8);
+
+    router.Assign(3, 0);
+    EXPECT_FALSE(router.IsDefault());
+
+    EXPECT_EQ(router.Rank(11), 0);
+    EXPECT_EQ(router.Rank(13), 1);
+    EXPECT_EQ(router.VirtualShardsOf(1), std::vector<int>({1, 5, 7}));
+
+    SparseShardFilter filter = router.FilterOf(1);
+    EXPECT_FALSE(filter.Match(11));
+    EXPECT_TRUE(filter.Match(13));
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include "core/ps/optimizer/optimizer.h"
+#include "core/ps/table/sparse_stream.h"
+#include "core/ps_interface/sparse_codec.h"
+
+#include <set>
+
+using namespace tensornet;
+
+TEST(sparse_stream, subscribe) {
+    AdaGrad opt(0.01, 0.1, 0.1, 1e-8, 1.0, 1.0, 0.98);
+
+    int dim = 4;
+    SparseKernelOption kernel_option;
+    kernel_option.track_updates = true;
+    auto op_kernel = opt.CreateSparseOptKernel(dim, kernel_option);
+
+    // collected by hand
+    SparseStreamOption option;
+    option.max_keys_per_second = 300;
+    option.max_batches = 2;
+    SparseUpdateStream stream(op_kernel.get(), dim, option);
+
+    size_t n = 1000;
+    std::vector<uint64_t> signs(n);
+    std::vector<float> grads(n * dim, 0.1);
+    std::vector<SparseGradInfo> grad_infos(n);
+    for (size_t i = 0; i < n; i++) {
+        signs[i] = i * 7 + 1;
+        grad_infos[i].grad = grads.data() + i * dim;
+        grad_infos[i].batch_show = 1;
+    }
+
+    std::vector<float> weights(n * dim);
+    op_kernel->GetWeights(signs.data(), n, weights.data());
+    op_kernel->ApplyBatch(signs.data(), grad_infos.data(), n);
+
+    EXPECT_EQ(stream.Collect(), 300);
+
+    SparseSubscribeRequest req;
+    req.set_max_keys(1000);
+
+    SparseSubscribeResponse resp;
+    butil::IOBuf attachment;
+    stream.Read(&req, &resp, &attachment);
+
+    EXPECT_FALSE(resp.lost());
+    EXPECT_EQ(resp.next_seq(), 1);
+    ASSERT_EQ(resp.signs_size(), 300);
+
+    std::vector<float> streamed(resp.signs_size() * dim);
+    ASSERT_TRUE(DecodeSparseValues(&attachment, streamed.size(), SVE_FLOAT, streamed.data()));
+
+    float w[dim];
+    std::set<uint64_t> seen;
+    for (int i = 0; i < resp.signs_size(); ++i) {
+        seen.insert(resp.signs(i));
+        op_kernel->GetWeight(resp.signs(i), w);
+        for (int j = 0; j < dim; ++j) {
+            EXPECT_EQ(streamed[i * dim + j], w[j]);
+        }
+    }
+    EXPECT_EQ(seen.size(), 300);
+
+    // the rest are collected in later batches, the first batch is dropped
+    EXPECT_EQ(stream.Collect(), 300);
+    EXPECT_EQ(stream.Collect(), 300);
+    EXPECT_EQ(stream.Collect(), 100);
+    EXPECT_EQ(stream.Collect(), 0);
+
+    req.set_stream_id(resp.stream_id());
+    req.set_next_seq(resp.next_seq());
+
+    SparseSubscribeResponse next_resp;
+    butil::IOBuf next_attachment;
+    stream.Read(&req, &next_resp, &next_attachment);
+
+    EXPECT_TRUE(next_resp.lost());
+    EXPECT_EQ(next_resp.next_seq(), 4);
+    EXPECT_EQ(next_resp.signs_size(), 400);
+
+    for (int i = 0; i < next_resp.signs_size(); ++i) {
+        seen.insert(next_resp.signs(i));
+    }
+    EXPECT_EQ(seen.size(), 700);
+
+    // up to date
+    req.set_next_seq(next_resp.next_seq());
+
+    SparseSubscribeResponse empty_resp;
+    butil::IOBuf empty_attachment;
+    stream.Read(&req, &empty_resp, &empty_attachment);
+
+    EXPECT_FALSE(empty_resp.lost());
+    EXPECT_EQ(empty_resp.next_seq(), 4);
+    EXPECT_EQ(empty_resp.signs_size(), 0);
+}
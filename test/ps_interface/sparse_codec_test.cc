@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "core/ps_interface/sparse_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace tensornet;
+
+TEST(sparse_codec, values) {
+    std::mt19937 reng(0);
+    std::normal_distribution<float> distr(0, 0.1);
+
+    // more than one conversion batch
+    std::vector<float> values(3000);
+    for (auto& v : values) {
+        v = distr(reng);
+    }
+
+    for (auto encoding : {SVE_FLOAT, SVE_FP16, SVE_BF16}) {
+        butil::IOBuf buf;
+        EncodeSparseValues(values.data(), values.size(), encoding, &buf);
+        EXPECT_EQ(buf.size(), values.size() * SparseValueSize(encoding));
+
+        std::vector<float> decoded(values.size());
+        ASSERT_TRUE(DecodeSparseValues(&buf, values.size(), encoding, decoded.data()));
+        EXPECT_EQ(buf.size(), 0);
+
+        float tolerance = encoding == SVE_FLOAT ? 0 : (encoding == SVE_FP16 ? 1e-3 : 8e-3);
+        for (size_t i = 0; i < values.size(); ++i) {
+            EXPECT_LE(std::fabs(decoded[i] - values[i]), std::fabs(values[i]) * tolerance + 1e-7);
+        }
+
+        EXPECT_FALSE(DecodeSparseValues(&buf, 1, encoding, decoded.data()));
+    }
+}
+
+TEST(sparse_codec, delta_signs) {
+    std::mt19937_64 reng(0);
+
+    std::vector<uint64_t> signs(10000);
+    for (auto& sign : signs) {
+        sign = reng();
+    }
+    std::sort(signs.begin(), signs.end());
+
+    SparsePullRequest delta_req;
+    EncodeDeltaSigns(signs.data(), signs.size(), delta_req.mutable_signs());
+    delta_req.set_delta_signs(true);
+
+    SparsePullRequest raw_req;
+    raw_req.mutable_signs()->Add(signs.begin(), signs.end());
+
+    EXPECT_LT(delta_req.ByteSizeLong(), raw_req.ByteSizeLong());
+
+    std::vector<uint64_t> decoded;
+    DecodeSigns(delta_req.signs(), delta_req.delta_signs(), &decoded);
+    EXPECT_EQ(decoded, signs);
+
+    DecodeSigns(raw_req.signs(), raw_req.delta_signs(), &decoded);
+    EXPECT_EQ(decoded, signs);
+}
+
+TEST(sparse_codec, dedup_signs) {
+    std::vector<uint64_t> signs = {7, 3, 7, 0, 3, 9, 0};
+
+    std::vector<uint64_t> unique;
+    std::vector<int64_t> ids(signs.size());
+    DedupSigns(signs.data(), signs.size(), &unique, ids.data());
+
+    EXPECT_EQ(unique, std::vector<uint64_t>({7, 3, 0, 9}));
+    EXPECT_EQ(ids, std::vector<int64_t>({0, 1, 0, 2, 1, 3, 2}));
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+
+#include "core/serving/embedding_snapshot.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+using namespace tensornet;
+
+// weights of every sign are all value
+static std::vector<std::string> WriteStore(const std::string& prefix, int shard_num,
+                                           const std::vector<uint64_t>& signs, float value) {
+    std::vector<EmbeddingStoreWriter> writers(shard_num, EmbeddingStoreWriter(2));
+
+    float w[2] = {value, value};
+    for (auto sign : signs) {
+        writers[sign % shard_num].Add(sign, w);
+    }
+
+    std::vector<std::string> files;
+    for (int i = 0; i < shard_num; i++) {
+        files.push_back(prefix + std::to_string(i));
+        std::ofstream os(files.back(), std::ios::binary);
+        writers[i].Write(os, i, shard_num, EWT_HALF);
+    }
+
+    return files;
+}
+
+TEST(embedding_snapshot, apply_delta) {
+    HotSwapEmbeddingStore store("/tmp");
+
+    std::string delta_prefix = "/tmp/tensornet_snapshot_delta_";
+    EXPECT_NE(store.ApplyDelta(WriteStore(delta_prefix, 2, {0}, 1)), 0);
+
+    std::vector<uint64_t> signs;
+    for (uint64_t i = 0; i < 1000; i++) {
+        signs.push_back(i);
+    }
+    ASSERT_EQ(store.Load(WriteStore("/tmp/tensornet_snapshot_base_", 2, signs, 1)), 0);
+    EXPECT_EQ(store.Version(), 1);
+
+    std::atomic<bool> stop(false);
+    std::atomic<int> bad(0);
+
+    // sign 0 and 500 are updated by every delta together, readers never see one
+    // without the other
+    std::thread reader([&]() {
+        float w0[2], w500[2];
+        while (!stop) {
+            HotSwapEmbeddingStore::ScopedPtr ptr;
+            store.Read(&ptr);
+
+            const EmbeddingStore& s = (*ptr)->base->store;
+            if (!s.Find(0, w0) || !s.Find(500, w500) || w0[0] != w500[0]) {
+                ++bad;
+            }
+        }
+    });
+
+    std::vector<std::string> merged;
+    for (int v = 2; v <= 10; v++) {
+        ASSERT_EQ(store.ApplyDelta(WriteStore(delta_prefix, 2, {0, 500, 1000 + (uint64_t)v}, v)), 0);
+
+        HotSwapEmbeddingStore::ScopedPtr ptr;
+        store.Read(&ptr);
+        merged = (*ptr)->base->owned_files;
+    }
+
+    stop = true;
+    reader.join();
+
+    EXPECT_EQ(bad, 0);
+    EXPECT_EQ(store.Version(), 10);
+
+    {
+        HotSwapEmbeddingStore::ScopedPtr ptr;
+        store.Read(&ptr);
+
+        const EmbeddingStore& s = (*ptr)->base->store;
+        EXPECT_EQ(s.KeyCount(), 1009);
+
+        float w[2];
+        ASSERT_TRUE(s.Find(500, w));
+        EXPECT_EQ(w[1], 10);
+        ASSERT_TRUE(s.Find(999, w));
+        EXPECT_EQ(w[0], 1);
+        ASSERT_TRUE(s.Find(1003, w));
+        EXPECT_EQ(w[0], 3);
+    }
+
+    // merged files of old snapshot are removed once swapped out
+    ASSERT_EQ(store.Load(WriteStore("/tmp/tensornet_snapshot_base_", 2, signs, 1)), 0);
+    EXPECT_NE(access(merged[0].c_str(), F_OK), 0);
+}
+
+TEST(embedding_snapshot, apply_updates) {
+    // overlay is merged into files once more than 3 signs are in it
+    HotSwapEmbeddingStore store("/tmp", 2, 3);
+
+    std::vector<uint64_t> signs;
+    for (uint64_t i = 0; i < 100; i++) {
+        signs.push_back(i);
+    }
+
+    uint64_t update_signs[] = {5, 200};
+    float update_weights[] = {7, 7, 8, 8};
+    EXPECT_NE(store.ApplyUpdates(update_signs, update_weights, 2), 0);
+
+    ASSERT_EQ(store.Load(WriteStore("/tmp/tensornet_snapshot_base_", 2, signs, 1)), 0);
+    ASSERT_EQ(store.ApplyUpdates(update_signs, update_weights, 2), 0);
+    EXPECT_EQ(store.Version(), 2);
+
+    {
+        HotSwapEmbeddingStore::ScopedPtr ptr;
+        store.Read(&ptr);
+        ASSERT_TRUE((*ptr)->overlay);
+
+        float w[2];
+        ASSERT_TRUE((*ptr)->Find(200, w));
+        EXPECT_EQ(w[0], 8);
+
+        // 5 and 200 from overlay, 6 from base, 300 missing
+        uint64_t pool_signs[] = {5, 6, 200, 300};
+        EXPECT_EQ((*ptr)->Pool(pool_signs, 4, EPT_SUM, w), 3);
+        EXPECT_EQ(w[0], 16);
+    }
+
+    uint64_t more_signs[] = {5, 201, 202};
+    float more_weights[] = {9, 9, 1, 1, 2, 2};
+    ASSERT_EQ(store.ApplyUpdates(more_signs, more_weights, 3), 0);
+
+    {
+        HotSwapEmbeddingStore::ScopedPtr ptr;
+        store.Read(&ptr);
+        EXPECT_FALSE((*ptr)->overlay);
+        EXPECT_EQ((*ptr)->base->store.KeyCount(), 103);
+
+        float w[2];
+        ASSERT_TRUE((*ptr)->Find(5, w));
+        EXPECT_EQ(w[1], 9);
+        ASSERT_TRUE((*ptr)->Find(200, w));
+        EXPECT_EQ(w[1], 8);
+        ASSERT_TRUE((*ptr)->Find(6, w));
+        EXPECT_EQ(w[0], 1);
+    }
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include "core/serving/embedding_store.h"
+
+#include <fstream>
+#include <random>
+
+using namespace tensornet;
+
+static void WriteShards(const std::string& prefix, int shard_num, int dim,
+                        const std::vector<uint64_t>& signs, std::vector<std::string>* files,
+                        EmbeddingWeightType weight_type = EWT_FLOAT) {
+    std::vector<EmbeddingStoreWriter> writers(shard_num, EmbeddingStoreWriter(dim));
+
+    for (auto sign : signs) {
+        std::vector<float> w(dim);
+        for (int j = 0; j < dim; j++) {
+            w[j] = (sign % 1000) + j;
+        }
+        writers[sign % shard_num].Add(sign, w.data());
+    }
+
+    for (int i = 0; i < shard_num; i++) {
+        files->push_back(prefix + std::to_string(i));
+        std::ofstream os(files->back(), std::ios::binary);
+        writers[i].Write(os, i, shard_num, weight_type);
+    }
+}
+
+TEST(embedding_store, lookup) {
+    std::mt19937_64 reng(7);
+    std::vector<uint64_t> signs;
+    for (int i = 0; i < 10000; i++) {
+        signs.push_back(reng());
+    }
+
+    // a sign added twice keeps the last, both have the same weights here
+    signs.push_back(signs[0]);
+
+    std::vector<std::string> files;
+    WriteShards("/tmp/tensornet_embedding_store_test_", 3, 8, signs, &files);
+
+    // shards are placed by id in file header
+    std::swap(files[0], files[2]);
+
+    EmbeddingStore store;
+    ASSERT_EQ(store.Open(files), 0);
+    EXPECT_EQ(store.Dim(), 8);
+    EXPECT_EQ(store.KeyCount(), 10000);
+
+    float w[8];
+    for (int i = 0; i < 10000; i++) {
+        ASSERT_TRUE(store.Find(signs[i], w));
+        EXPECT_EQ(w[0], signs[i] % 1000);
+        EXPECT_EQ(w[7], signs[i] % 1000 + 7);
+    }
+
+    std::vector<uint64_t> batch = {signs[5], 12345, signs[9]};
+    for (int i = 0; i < 40; i++) {
+        batch.push_back(signs[100 + i]);
+    }
+
+    std::vector<float> out(batch.size() * 8, -1);
+    EXPECT_EQ(store.Lookup(batch.data(), batch.size(), out.data()), batch.size() - 1);
+    EXPECT_EQ(out[0], signs[5] % 1000);
+    EXPECT_EQ(out[8], 0);
+    EXPECT_EQ(out[15], 0);
+    EXPECT_EQ(out[2 * 8 + 3], signs[9] % 1000 + 3);
+    EXPECT_EQ(out[42 * 8], signs[139] % 1000);
+
+    float pooled[8];
+    EXPECT_EQ(store.Pool(batch.data(), 3, EPT_MEAN, pooled), 2);
+    EXPECT_FLOAT_EQ(pooled[1], (signs[5] % 1000 + signs[9] % 1000 + 2) / 3.0);
+
+    EXPECT_EQ(store.Pool(batch.data(), 3, EPT_SUM, pooled), 2);
+    EXPECT_FLOAT_EQ(pooled[1], signs[5] % 1000 + signs[9] % 1000 + 2);
+}
+
+TEST(embedding_store, bad_file) {
+    std::vector<std::string> files;
+    WriteShards("/tmp/tensornet_embedding_store_bad_", 2, 4, {1, 2, 3}, &files);
+
+    EmbeddingStore store;
+
+    // shard 1 of 2 is missing
+    EXPECT_NE(store.Open({files[0]}), 0);
+    EXPECT_NE(store.Open({files[0], files[0]}), 0);
+    EXPECT_NE(store.Open({files[0], "/tmp/tensornet_embedding_store_no_such_file"}), 0);
+
+    EXPECT_EQ(store.Open(files), 0);
+    EXPECT_EQ(store.KeyCount(), 3);
+    float w[4];
+    EXPECT_FALSE(store.Find(4, w));
+}
+
+TEST(embedding_store, quantized) {
+    std::vector<uint64_t> signs;
+    for (uint64_t i = 0; i < 1000; i++) {
+        signs.push_back(i * 7919);
+    }
+
+    for (auto weight_type : {EWT_HALF, EWT_INT8}) {
+        std::vector<std::string> files;
+        WriteShards("/tmp/tensornet_embedding_store_quantized_", 2, 5, signs, &files, weight_type);
+
+        EmbeddingStore store;
+        ASSERT_EQ(store.Open(files), 0);
+
+        // weights are in [0, 1004), int8 error is at most half of scale = max / 127
+        float tolerance = weight_type == EWT_HALF ? 0.5 : 1004 / 127.0 / 2;
+
+        std::vector<float> out(signs.size() * 5);
+        EXPECT_EQ(store.Lookup(signs.data(), signs.size(), out.data()), signs.size());
+
+        for (size_t i = 0; i < signs.size(); i++) {
+            for (int j = 0; j < 5; j++) {
+                EXPECT_NEAR(out[i * 5 + j], signs[i] % 1000 + j, tolerance);
+            }
+        }
+
+        float pooled[5];
+        EXPECT_EQ(store.Pool(signs.data(), 2, EPT_SUM, pooled), 2);
+        EXPECT_NEAR(pooled[4], signs[0] % 1000 + signs[1] % 1000 + 8, tolerance * 2);
+    }
+}
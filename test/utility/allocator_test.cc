@@ -5,6 +5,8 @@
 
 #include <butil/time.h>
 
+#include <vector>
+
 using namespace tensornet;
 
 TEST(allocator, perf) {
@@ -16,7 +18,7 @@ TEST(allocator, perf) {
     AdaGrad opt(0.01, 0.1, 0.1, epsilon, grad_decay_rate, mom_decay_rate, show_decay_rate);
 
     int dim = 8;
-    Allocator<SparseAdaGradValue> alloc(SparseAdaGradValue::DynSizeof(dim));
+    Allocator<SparseAdaGradValue<float>> alloc(SparseAdaGradValue<float>::DynSizeof(dim));
 
     butil::Timer timer(butil::Timer::STARTED);
 
@@ -31,3 +33,81 @@ TEST(allocator, perf) {
     EXPECT_LT(timer.u_elapsed(), 10000);
 }
 
+
+TEST(allocator, release_empty_slab) {
+    struct Value {
+        Value(int v) : v(v) { }
+        int v;
+        char padding[60];
+    };
+
+    Allocator<Value> alloc(sizeof(Value), 1024);
+    size_t per_slab = alloc.SlabSize() / sizeof(Value);
+
+    std::vector<Value*> values;
+    for (size_t i = 0; i < per_slab * 4; i++) {
+        values.push_back(alloc.allocate(i));
+    }
+
+    EXPECT_GE(alloc.SlabCount(), 4);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        EXPECT_EQ(values[i]->v, i);
+    }
+
+    // free all but a few values of first slab, empty slabs are released except one
+    for (size_t i = 10; i < values.size(); i++) {
+        alloc.deallocate(values[i]);
+    }
+
+    EXPECT_LE(alloc.SlabCount(), 2);
+
+    // freed objects are reused before new slab is created
+    size_t slab_count = alloc.SlabCount();
+    for (size_t i = 10; i < per_slab; i++) {
+        values[i] = alloc.allocate(i);
+    }
+
+    EXPECT_EQ(alloc.SlabCount(), slab_count);
+
+    for (size_t i = 0; i < per_slab; i++) {
+        EXPECT_EQ(values[i]->v, i);
+        alloc.deallocate(values[i]);
+    }
+
+    EXPECT_EQ(alloc.SlabCount(), 1);
+}
+
+TEST(allocator, rows) {
+    struct Value {
+        Value(int v) : v(v) { }
+        int v;
+        char padding[28];
+    };
+
+    Allocator<Value> alloc(sizeof(Value), 1024, sizeof(float) * 4);
+
+    std::vector<Value*> values;
+    for (int i = 0; i < 100000; i++) {
+        values.push_back(alloc.allocate(i));
+        std::fill_n(static_cast<float*>(alloc.Row(values.back())), 4, i);
+    }
+
+    EXPECT_GT(alloc.SlabCount(), 1);
+    EXPECT_EQ(alloc.RowMemoryBytes() % (sizeof(float) * 4), 0);
+
+    // rows of values carved one by one are next to each other
+    EXPECT_EQ(static_cast<float*>(alloc.Row(values[1])), static_cast<float*>(alloc.Row(values[0])) + 4);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        const float* row = static_cast<const float*>(alloc.Row(values[i]));
+        EXPECT_EQ(row[0], values[i]->v);
+        EXPECT_EQ(row[3], values[i]->v);
+    }
+
+    for (size_t i = 0; i < values.size(); i++) {
+        alloc.deallocate(values[i]);
+    }
+
+    EXPECT_EQ(alloc.SlabCount(), 1);
+}
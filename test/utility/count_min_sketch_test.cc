@@ -0,0 +1,36 @@
+#include <gtest/gtest.h>
+
+#include "core/utility/count_min_sketch.h"
+
+using namespace tensornet;
+
+TEST(count_min_sketch, estimate) {
+    CountMinSketch sketch(1 << 12);
+
+    // key i is added i % 8 times
+    for (uint64_t i = 0; i < 2000; i++) {
+        for (uint64_t k = 0; k < i % 8; k++) {
+            sketch.Add(i, 1);
+        }
+    }
+
+    size_t exact = 0;
+    for (uint64_t i = 0; i < 2000; i++) {
+        uint32_t estimate = sketch.Estimate(i);
+        EXPECT_GE(estimate, i % 8);
+        exact += estimate == i % 8;
+    }
+
+    // far less keys than width, nearly all are exact
+    EXPECT_GT(exact, 1950);
+
+    EXPECT_EQ(sketch.Add(7, 1000), 1007);
+    sketch.Halve();
+    EXPECT_EQ(sketch.Estimate(7), 503);
+
+    sketch.Add(7, 100000);
+    EXPECT_EQ(sketch.Estimate(7), 65535);
+
+    sketch.Clear();
+    EXPECT_EQ(sketch.Estimate(7), 0);
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "core/utility/log_store.h"
+
+#include <unistd.h>
+
+using namespace tensornet;
+
+TEST(log_store, append_read) {
+    std::string file = "/tmp/tensornet_log_store_test";
+
+    {
+        LogStore store(file, sizeof(uint64_t) * 2);
+
+        for (uint64_t i = 0; i < 1000; i++) {
+            uint64_t record[2] = {i, i * i};
+            EXPECT_EQ(store.Append(record), i);
+
+            // half is flushed, the others are still in buffer
+            if (i == 499) {
+                store.Flush();
+            }
+        }
+
+        uint64_t record[2] = {0, 0};
+        store.Read(7, record);
+        EXPECT_EQ(record[1], 49);
+
+        store.Read(777, record);
+        EXPECT_EQ(record[1], 777 * 777);
+
+        std::vector<uint64_t> ids = {900, 3, 4, 5, 498, 499, 500, 100};
+        std::vector<uint64_t> out(ids.size() * 2);
+        store.ReadBatch(ids.data(), ids.size(), reinterpret_cast<char*>(out.data()));
+
+        for (size_t i = 0; i < ids.size(); i++) {
+            EXPECT_EQ(out[i * 2], ids[i]);
+            EXPECT_EQ(out[i * 2 + 1], ids[i] * ids[i]);
+        }
+
+        // flushed records are read from file only
+        EXPECT_TRUE(store.Flushed(499));
+        EXPECT_FALSE(store.Flushed(500));
+
+        std::vector<uint64_t> flushed_ids = {499, 3, 4, 100};
+        store.ReadFlushed(flushed_ids.data(), flushed_ids.size(), reinterpret_cast<char*>(out.data()));
+
+        for (size_t i = 0; i < flushed_ids.size(); i++) {
+            EXPECT_EQ(out[i * 2 + 1], flushed_ids[i] * flushed_ids[i]);
+        }
+
+        store.Free(3);
+        EXPECT_EQ(store.LiveCount(), 999);
+        EXPECT_EQ(store.GarbageCount(), 1);
+    }
+
+    // scratch file is removed with store
+    EXPECT_NE(access(file.c_str(), F_OK), 0);
+}
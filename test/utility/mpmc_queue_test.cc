@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "core/utility/mpmc_queue.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace tensornet;
+
+TEST(mpmc_queue, bounded) {
+    MpmcQueue<int> queue(3);
+
+    ASSERT_EQ(queue.capacity(), 4);
+
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(queue.try_push(std::move(i)));
+    }
+
+    int v = 100;
+    EXPECT_TRUE(queue.full());
+    EXPECT_FALSE(queue.try_push(std::move(v)));
+
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(queue.try_pop(&v));
+        EXPECT_EQ(v, i);
+    }
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.try_pop(&v));
+}
+
+TEST(mpmc_queue, concurrent) {
+    MpmcQueue<std::vector<int>> queue(64);
+
+    const int producer_num = 4;
+    const int consumer_num = 4;
+    const int n = 20000;
+
+    std::atomic<long> sum(0);
+    std::atomic<int> popped(0);
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producer_num; ++p) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 0; i < n; ++i) {
+                std::vector<int> value(1, p * n + i);
+                while (!queue.try_push(std::move(value))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    for (int c = 0; c < consumer_num; ++c) {
+        threads.emplace_back([&]() {
+            std::vector<int> value;
+            while (popped.load() < producer_num * n) {
+                if (queue.try_pop(&value)) {
+                    ASSERT_EQ(value.size(), 1);
+                    sum += value[0];
+                    ++popped;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    long total = (long)producer_num * n;
+    EXPECT_EQ(popped.load(), total);
+    EXPECT_EQ(sum.load(), total * (total - 1) / 2);
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include "core/utility/open_hash_map.h"
+
+#include <unordered_map>
+#include <random>
+
+using namespace tensornet;
+
+TEST(open_hash_map, insert_find_erase) {
+    OpenHashMap<uint64_t, int> map;
+
+    for (uint64_t i = 0; i < 1000; i++) {
+        auto inserted = map.insert(i * 7, i);
+        EXPECT_TRUE(inserted.second);
+    }
+
+    EXPECT_EQ(map.size(), 1000);
+
+    auto inserted = map.insert(7, 100);
+    EXPECT_FALSE(inserted.second);
+    EXPECT_EQ(*inserted.first, 1);
+
+    for (uint64_t i = 0; i < 1000; i += 2) {
+        EXPECT_EQ(map.erase(i * 7), 1);
+    }
+
+    EXPECT_EQ(map.size(), 500);
+    EXPECT_EQ(map.erase(0), 0);
+
+    for (uint64_t i = 0; i < 1000; i++) {
+        int* value = map.find(i * 7);
+        if (i % 2 == 0) {
+            EXPECT_TRUE(value == nullptr);
+        } else {
+            ASSERT_TRUE(value != nullptr);
+            EXPECT_EQ(*value, i);
+        }
+    }
+}
+
+TEST(open_hash_map, same_as_unordered_map) {
+    OpenHashMap<uint64_t, uint64_t> map(16);
+    std::unordered_map<uint64_t, uint64_t> expect;
+
+    std::mt19937_64 reng(0);
+    std::uniform_int_distribution<uint64_t> distr(0, 4096);
+
+    for (int i = 0; i < 100000; i++) {
+        uint64_t key = distr(reng);
+        if (i % 3 == 0) {
+            EXPECT_EQ(map.erase(key), expect.erase(key));
+        } else {
+            EXPECT_EQ(map.insert(key, i).second, expect.insert({key, i}).second);
+        }
+    }
+
+    EXPECT_EQ(map.size(), expect.size());
+
+    size_t count = 0;
+    map.for_each([&](const uint64_t& key, uint64_t& value) {
+        ++count;
+        ASSERT_TRUE(expect.count(key));
+        EXPECT_EQ(expect[key], value);
+    });
+
+    EXPECT_EQ(count, expect.size());
+}
+
+TEST(open_hash_map, erase_if) {
+    OpenHashMap<uint64_t, uint64_t> map;
+
+    for (uint64_t i = 0; i < 10000; i++) {
+        map.insert(i, i);
+    }
+
+    size_t erased = 0;
+    for (size_t begin = 0; begin < map.capacity(); begin += 100) {
+        erased += map.erase_if(begin, begin + 100, [](const uint64_t& key, uint64_t& value) {
+            return value % 2 == 0;
+        });
+    }
+
+    // elements moved by backward shift may be skipped in one pass
+    EXPECT_LE(erased, 5000);
+    EXPECT_EQ(map.size(), 10000 - erased);
+
+    map.for_each([](const uint64_t& key, uint64_t value) {
+        EXPECT_EQ(key, value);
+    });
+
+    for (uint64_t i = 1; i < 10000; i += 2) {
+        EXPECT_TRUE(map.find(i) != nullptr);
+    }
+}
+
+TEST(open_hash_map, incremental_rehash) {
+    OpenHashMap<uint64_t, uint64_t> map;
+
+    bool seen_rehashing = false;
+    for (uint64_t i = 0; i < 100000; i++) {
+        map.insert(i, i * 2);
+        seen_rehashing |= map.rehashing();
+
+        if (map.rehashing()) {
+            // keys are found in either old or new slots while moving
+            for (uint64_t j = i > 100 ? i - 100 : 0; j <= i; j++) {
+                uint64_t* value = map.find(j);
+                ASSERT_TRUE(value != nullptr);
+                EXPECT_EQ(*value, j * 2);
+            }
+
+            EXPECT_EQ(map.erase(i), 1);
+            EXPECT_TRUE(map.find(i) == nullptr);
+            EXPECT_FALSE(map.insert(i - 1, 0).second);
+            map.insert(i, i * 2);
+        }
+    }
+
+    EXPECT_TRUE(seen_rehashing);
+    EXPECT_EQ(map.size(), 100000);
+
+    size_t count = 0;
+    map.for_each([&count](const uint64_t& key, uint64_t& value) {
+        ++count;
+        EXPECT_EQ(key * 2, value);
+    });
+    EXPECT_EQ(count, 100000);
+
+    map.reserve(1000000);
+    EXPECT_FALSE(map.rehashing());
+    EXPECT_GE(map.capacity(), 1000000);
+
+    for (uint64_t i = 0; i < 100000; i++) {
+        ASSERT_TRUE(map.find(i) != nullptr);
+    }
+}
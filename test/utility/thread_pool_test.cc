@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include "core/utility/blocking_queue.h"
+#include "core/utility/cpu_affinity.h"
+#include "core/utility/thread_pool.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace tensornet;
+
+TEST(thread_pool, run) {
+    ThreadPool pool(4, {});
+
+    std::vector<std::atomic<int>> counts(100);
+    pool.Run(counts.size(), [&counts](size_t i) {
+        ++counts[i];
+    });
+
+    for (auto& count : counts) {
+        EXPECT_EQ(count.load(), 1);
+    }
+
+    pool.Run(0, [](size_t) {
+        FAIL();
+    });
+}
+
+// two stages blocking on each other, like save, must not wait for a pool with one
+// thread only
+TEST(thread_pool, pipeline) {
+    ThreadPool pool(1, {});
+    BlockingQueue<int> queue(2);
+
+    std::atomic<int> next(0);
+    std::atomic<int> sum(0);
+
+    std::thread producer([&]() {
+        pool.Run(4, [&](size_t) {
+            for (int i = next++; i < 1000; i = next++) {
+                int value = i;
+                queue.Push(std::move(value));
+            }
+        });
+
+        queue.Close();
+    });
+
+    pool.Run(4, [&](size_t) {
+        int i = 0;
+        while (queue.Pop(&i)) {
+            sum += i;
+        }
+    });
+
+    producer.join();
+
+    EXPECT_EQ(sum.load(), 999 * 1000 / 2);
+}
+
+TEST(cpu_affinity, parse_cpu_list) {
+    std::vector<int> cpus;
+
+    EXPECT_TRUE(ParseCpuList("0-3,8,10-11", &cpus));
+    EXPECT_EQ(cpus, std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+
+    EXPECT_FALSE(ParseCpuList("", &cpus));
+    EXPECT_FALSE(ParseCpuList("3-1", &cpus));
+    EXPECT_FALSE(ParseCpuList("1,a", &cpus));
+    EXPECT_FALSE(ParseCpuList("1-", &cpus));
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include "core/utility/trace.h"
+
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace tensornet;
+
+TEST(trace, record_dump) {
+    Tracer* tracer = Tracer::Instance();
+    std::string file = "/tmp/tensornet_trace_test.json";
+
+    // nothing is kept before start
+    tracer->Record("before", "test", 1, 2, 0);
+
+    tracer->Start(100);
+    tracer->SetStep(7);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 10; i++) {
+                TraceSpan span("span", "test", t);
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    tracer->Record("rpc", "test", 10, 20, 3, 1, true);
+    tracer->Stop();
+    tracer->Record("after", "test", 1, 2, 0);
+
+    EXPECT_EQ(tracer->Dump(file, 2), 41);
+
+    std::ifstream in(file);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string content = ss.str();
+
+    EXPECT_EQ(content.find("before"), std::string::npos);
+    EXPECT_EQ(content.find("after"), std::string::npos);
+    EXPECT_NE(content.find("\"step\":7"), std::string::npos);
+    EXPECT_NE(content.find("\"ph\":\"b\""), std::string::npos);
+    EXPECT_NE(content.find("\"dropped\":0"), std::string::npos);
+
+    unlink(file.c_str());
+}
+
+TEST(trace, drop_when_full) {
+    Tracer* tracer = Tracer::Instance();
+    std::string file = "/tmp/tensornet_trace_test_full.json";
+
+    tracer->Start(5);
+    for (int i = 0; i < 8; i++) {
+        tracer->Record("span", "test", i, i + 1, 0);
+    }
+    tracer->Stop();
+
+    EXPECT_EQ(tracer->Dump(file, 0), 5);
+
+    std::ifstream in(file);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    EXPECT_NE(ss.str().find("\"dropped\":3"), std::string::npos);
+
+    unlink(file.c_str());
+}
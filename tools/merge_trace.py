@@ -0,0 +1,56 @@
+#!/usr/bin/env python
+# Copyright (c) 2020, Qihoo, Inc.  All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# -*- coding: utf-8 -*-
+"""merge trace files of all ranks written by tn.callbacks.TraceCallback into one
+
+usage: merge_trace.py -o merged.json trace_rank_0.json trace_rank_1.json ...
+"""
+import argparse
+import json
+
+
+def main():
+    parser = argparse.ArgumentParser(description="merge tensornet trace files of ranks")
+    parser.add_argument("-o", "--output", required=True, help="merged trace file")
+    parser.add_argument("files", nargs="+", help="trace files of ranks")
+    args = parser.parse_args()
+
+    events = []
+    dropped = {}
+
+    for file in args.files:
+        with open(file) as f:
+            trace = json.load(f)
+
+        other = trace.get("otherData", {})
+        rank = other.get("rank", len(dropped))
+        dropped[str(rank)] = other.get("dropped", 0)
+
+        for event in trace["traceEvents"]:
+            # ids of async spans are unique within a rank only
+            if "id" in event:
+                event["id"] = "{}:{}".format(rank, event["id"])
+            events.append(event)
+
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms",
+                   "otherData": {"dropped": dropped}}, f)
+
+    print("merged {} events of {} ranks into {}".format(len(events), len(args.files), args.output))
+
+
+if __name__ == "__main__":
+    main()